@@ -2,7 +2,7 @@
   "targets" : [
     {
       "target_name": "node-ps6000",
-      "sources": ["main.cpp", "main_wrap.cpp"],
+      "sources": ["main.cpp", "main_wrap.cpp", "bufferpool.cpp", "codec.cpp", "convert.cpp", "largebuffer.cpp", "peaks.cpp", "recorder.cpp", "recordreader.cpp", "ringbuffer.cpp", "threads.cpp", "workqueue.cpp"],
       "libraries": ["<(module_root_dir)/lib/ps6000.lib"],
       "cflags": [
         "-std=c++11",
@@ -20,6 +20,60 @@
           ]
         }
       ]
+    },
+    {
+      "target_name": "convert-test",
+      "type": "executable",
+      "sources": ["convert_test.cpp", "convert.cpp"],
+      "cflags": [
+        "-std=c++11",
+        "-stdlib=libc++"
+      ]
+    },
+    {
+      "target_name": "bufferpool-test",
+      "type": "executable",
+      "sources": ["bufferpool_test.cpp", "bufferpool.cpp", "largebuffer.cpp"],
+      "cflags": [
+        "-std=c++11",
+        "-stdlib=libc++"
+      ]
+    },
+    {
+      "target_name": "ringbuffer-test",
+      "type": "executable",
+      "sources": ["ringbuffer_test.cpp", "ringbuffer.cpp", "largebuffer.cpp"],
+      "cflags": [
+        "-std=c++11",
+        "-stdlib=libc++"
+      ]
+    },
+    {
+      "target_name": "codec-test",
+      "type": "executable",
+      "sources": ["codec_test.cpp", "codec.cpp", "convert.cpp", "threads.cpp"],
+      "cflags": [
+        "-std=c++11",
+        "-stdlib=libc++"
+      ]
+    },
+    {
+      "target_name": "peaks-test",
+      "type": "executable",
+      "sources": ["peaks_test.cpp", "peaks.cpp", "convert.cpp"],
+      "cflags": [
+        "-std=c++11",
+        "-stdlib=libc++"
+      ]
+    },
+    {
+      "target_name": "record-test",
+      "type": "executable",
+      "sources": ["record_test.cpp", "recorder.cpp", "recordreader.cpp", "codec.cpp", "convert.cpp", "threads.cpp"],
+      "cflags": [
+        "-std=c++11",
+        "-stdlib=libc++"
+      ]
     }
   ]
 }
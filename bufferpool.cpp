@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include "bufferpool.h"
+#include "largebuffer.h"
+
+#define BLOCK_FROM_PAYLOAD(ptr)     ((POOL_BLOCK *)((char *)(ptr) - POOL_BLOCK_HEADER_SIZE))
+#define PAYLOAD_FROM_BLOCK(ptr)     ((void *)((char *)(ptr) + POOL_BLOCK_HEADER_SIZE))
+
+BufferPool::BufferPool()
+{
+  uv_mutex_init(&mutex);
+  memset(apSmallList, 0, sizeof(apSmallList));
+  pLargeList = NULL;
+  nLargeCached = 0;
+  nOutstanding = 0;
+  nAllocations = 0;
+  isDestroyed = false;
+}
+
+BufferPool::~BufferPool()
+{
+  for (int32_t i = 0; i < POOL_SMALL_CLASSES; i++)
+    freeList(apSmallList[i]);
+
+  freeList(pLargeList);
+
+  uv_mutex_destroy(&mutex);
+}
+
+int32_t BufferPool::getSmallClass(size_t nLength)
+{
+  int32_t nClass = 0;
+
+  while (((size_t)64 << nClass) < nLength)
+    nClass++;
+
+  return nClass;
+}
+
+POOL_BLOCK *BufferPool::takeLarge(size_t nLength, POOL_BLOCK **ppStale)
+{
+  POOL_BLOCK **ppBest = NULL;
+  POOL_BLOCK **ppLink;
+  size_t nLimit = nLength + nLength / POOL_FIT_TOLERANCE;
+
+  // Best fit, but never hand a much larger block to a smaller request
+  for (ppLink = &pLargeList; *ppLink; ppLink = &(*ppLink)->pNext)
+  {
+    size_t nCapacity = (*ppLink)->nCapacity;
+
+    if (nCapacity >= nLength && nCapacity <= nLimit && (ppBest == NULL || nCapacity < (*ppBest)->nCapacity))
+      ppBest = ppLink;
+  }
+
+  if (ppBest)
+  {
+    POOL_BLOCK *pBlock = *ppBest;
+
+    *ppBest = pBlock->pNext;
+    nLargeCached -= pBlock->nCapacity;
+
+    return pBlock;
+  }
+
+  // Configuration grew: blocks smaller than this request will not fit it
+  // again, the larger ones still serve other requests
+  for (ppLink = &pLargeList; *ppLink; )
+  {
+    POOL_BLOCK *pBlock = *ppLink;
+
+    if (pBlock->nCapacity < nLength)
+    {
+      *ppLink = pBlock->pNext;
+      nLargeCached -= pBlock->nCapacity;
+      pBlock->pNext = *ppStale;
+      *ppStale = pBlock;
+    }
+    else
+    {
+      ppLink = &pBlock->pNext;
+    }
+  }
+
+  return NULL;
+}
+
+POOL_BLOCK *BufferPool::evictLarge()
+{
+  POOL_BLOCK *pEvicted = NULL;
+
+  // Blocks are put at the head, so the tail is the one unused the longest.
+  // The block just returned always stays, it is the likeliest to be asked for.
+  while (nLargeCached > POOL_CACHE_LIMIT && pLargeList->pNext)
+  {
+    POOL_BLOCK **ppLink = &pLargeList;
+    POOL_BLOCK *pBlock;
+
+    while ((*ppLink)->pNext)
+      ppLink = &(*ppLink)->pNext;
+
+    pBlock = *ppLink;
+    *ppLink = NULL;
+    nLargeCached -= pBlock->nCapacity;
+    pBlock->pNext = pEvicted;
+    pEvicted = pBlock;
+  }
+
+  return pEvicted;
+}
+
+void *BufferPool::acquire(size_t nLength)
+{
+  POOL_BLOCK *pBlock = NULL;
+  POOL_BLOCK *pStale = NULL;
+  int32_t nClass = -1;
+
+  // Small arrays (trigger times, segment lists, previews) have lists of their
+  // own so they never take or evict the capture sized blocks
+  if (nLength <= POOL_SMALL_BLOCK_SIZE)
+  {
+    nClass = getSmallClass(nLength);
+    nLength = (size_t)64 << nClass;
+  }
+
+  uv_mutex_lock(&mutex);
+
+  if (nClass >= 0)
+  {
+    pBlock = apSmallList[nClass];
+
+    if (pBlock)
+      apSmallList[nClass] = pBlock->pNext;
+  }
+  else
+  {
+    pBlock = takeLarge(nLength, &pStale);
+  }
+
+  if (pBlock)
+    nOutstanding++;
+
+  uv_mutex_unlock(&mutex);
+
+  freeList(pStale);
+
+  if (pBlock == NULL)
+  {
+    // Capture sized blocks come straight from the OS, on huge pages where possible
+    if (nLength >= POOL_LARGE_BLOCK_SIZE)
+      pBlock = (POOL_BLOCK *)allocateLargeBuffer(POOL_BLOCK_HEADER_SIZE + nLength);
+    else
+      pBlock = (POOL_BLOCK *)malloc(POOL_BLOCK_HEADER_SIZE + nLength);
+
+    if (pBlock == NULL)
+      return NULL;
+
+    pBlock->pPool = this;
+    pBlock->nCapacity = nLength;
+
+    uv_mutex_lock(&mutex);
+    nAllocations++;
+    nOutstanding++;
+    uv_mutex_unlock(&mutex);
+  }
+
+  pBlock->pNext = NULL;
+
+  return PAYLOAD_FROM_BLOCK(pBlock);
+}
+
+void BufferPool::release(void *pData)
+{
+  if (pData == NULL)
+    return;
+
+  POOL_BLOCK *pBlock = BLOCK_FROM_PAYLOAD(pData);
+
+  pBlock->pPool->put(pBlock);
+}
+
+void BufferPool::put(POOL_BLOCK *pBlock)
+{
+  bool bDelete;
+  POOL_BLOCK *pEvicted = NULL;
+
+  uv_mutex_lock(&mutex);
+
+  // Small blocks carry their class size as capacity
+  if (pBlock->nCapacity <= POOL_SMALL_BLOCK_SIZE)
+  {
+    POOL_BLOCK **ppList = &apSmallList[getSmallClass(pBlock->nCapacity)];
+
+    pBlock->pNext = *ppList;
+    *ppList = pBlock;
+  }
+  else
+  {
+    // Blocks held by a slow consumer come back in bursts, keep only so much
+    pBlock->pNext = pLargeList;
+    pLargeList = pBlock;
+    nLargeCached += pBlock->nCapacity;
+    pEvicted = evictLarge();
+  }
+
+  nOutstanding--;
+  bDelete = isDestroyed && nOutstanding == 0;
+
+  uv_mutex_unlock(&mutex);
+
+  freeList(pEvicted);
+
+  if (bDelete)
+    delete this;
+}
+
+void BufferPool::trim()
+{
+  POOL_BLOCK *apSmall[POOL_SMALL_CLASSES];
+  POOL_BLOCK *pLarge;
+
+  uv_mutex_lock(&mutex);
+  memcpy(apSmall, apSmallList, sizeof(apSmall));
+  memset(apSmallList, 0, sizeof(apSmallList));
+  pLarge = pLargeList;
+  pLargeList = NULL;
+  nLargeCached = 0;
+  uv_mutex_unlock(&mutex);
+
+  for (int32_t i = 0; i < POOL_SMALL_CLASSES; i++)
+    freeList(apSmall[i]);
+
+  freeList(pLarge);
+}
+
+void BufferPool::freeBlock(POOL_BLOCK *pBlock)
+{
+  if (pBlock->nCapacity >= POOL_LARGE_BLOCK_SIZE)
+    freeLargeBuffer(pBlock, POOL_BLOCK_HEADER_SIZE + pBlock->nCapacity);
+  else
+    free(pBlock);
+}
+
+void BufferPool::freeList(POOL_BLOCK *pBlock)
+{
+  while (pBlock)
+  {
+    POOL_BLOCK *pNext = pBlock->pNext;
+
+    freeBlock(pBlock);
+    pBlock = pNext;
+  }
+}
+
+void BufferPool::destroy()
+{
+  bool bDelete;
+
+  uv_mutex_lock(&mutex);
+
+  isDestroyed = true;
+  bDelete = nOutstanding == 0;
+
+  uv_mutex_unlock(&mutex);
+
+  if (bDelete)
+    delete this;
+}
+
+uint32_t BufferPool::getAllocationCount()
+{
+  uint32_t nCount;
+
+  uv_mutex_lock(&mutex);
+  nCount = nAllocations;
+  uv_mutex_unlock(&mutex);
+
+  return nCount;
+}
+
+size_t BufferPool::getCachedBytes()
+{
+  size_t nBytes;
+
+  uv_mutex_lock(&mutex);
+  nBytes = nLargeCached;
+  uv_mutex_unlock(&mutex);
+
+  return nBytes;
+}
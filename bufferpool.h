@@ -0,0 +1,90 @@
+#ifndef _PS6000_BUFFER_POOL_H_
+#define _PS6000_BUFFER_POOL_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <uv.h>
+
+// Size of the bookkeeping header in front of each payload. Kept at one cache
+// line so payloads stay aligned for the conversion kernels.
+#define POOL_BLOCK_HEADER_SIZE      64
+#define POOL_LARGE_BLOCK_SIZE       (1024 * 1024)   // Blocks from this size on are mapped from the OS
+#define POOL_SMALL_BLOCK_SIZE       (64 * 1024)     // Requests up to this size come from size classes
+#define POOL_SMALL_CLASSES          11              // Powers of two from 64 bytes to POOL_SMALL_BLOCK_SIZE
+#define POOL_FIT_TOLERANCE          8               // Larger blocks are reused if at most 1/8 too big
+#define POOL_CACHE_LIMIT            ((size_t)256 * 1024 * 1024)   // Free large bytes kept, the newest block always stays
+
+class BufferPool;
+
+typedef struct tPoolBlock
+{
+  BufferPool *pPool;
+  struct tPoolBlock *pNext;
+  size_t nCapacity;
+} POOL_BLOCK;
+
+class BufferPool
+{
+  public:
+    /**
+     * @desc Constructor
+     */
+    BufferPool();
+
+    /**
+     * @desc Get a block of at least nLength bytes. A block is never handed out
+     *       twice until it has been released.
+     * @return Pointer to payload, NULL on allocation failure
+     */
+    void *acquire(size_t nLength);
+
+    /**
+     * @desc Return a block to the pool it came from. Safe to call from any thread
+     *       (node::Buffer free callbacks run on the main thread).
+     * @param[in] pData: Payload returned by acquire()
+     */
+    static void release(void *pData);
+
+    /**
+     * @desc Free the blocks nobody holds. Blocks still out come back as usual.
+     */
+    void trim();
+
+    /**
+     * @desc Drop the owner's reference. The pool frees itself once every block
+     *       handed out has been released.
+     */
+    void destroy();
+
+    /**
+     * @desc Number of heap allocations made by this pool so far
+     */
+    uint32_t getAllocationCount();
+
+    /**
+     * @desc Bytes held by free large blocks, at most POOL_CACHE_LIMIT unless
+     *       the newest block alone is larger
+     */
+    size_t getCachedBytes();
+
+  private:
+    ~BufferPool();
+
+    void put(POOL_BLOCK *pBlock);
+    POOL_BLOCK *takeLarge(size_t nLength, POOL_BLOCK **ppStale);
+    POOL_BLOCK *evictLarge();
+    static int32_t getSmallClass(size_t nLength);
+    static void freeBlock(POOL_BLOCK *pBlock);
+    static void freeList(POOL_BLOCK *pBlock);
+
+    uv_mutex_t mutex;
+    POOL_BLOCK *apSmallList[POOL_SMALL_CLASSES];
+    POOL_BLOCK *pLargeList;
+    size_t nLargeCached;
+    int32_t nOutstanding;
+    uint32_t nAllocations;
+    bool isDestroyed;
+};
+
+#endif
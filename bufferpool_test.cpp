@@ -0,0 +1,129 @@
+/*
+ * Checks that BufferPool hands blocks back out instead of allocating again:
+ * small requests by power of two class, large ones by best fit within
+ * POOL_FIT_TOLERANCE. Also checks that blocks outgrown by a request are
+ * freed and that no more than POOL_CACHE_LIMIT free bytes stay cached.
+ *
+ *   npm run test:pool
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "bufferpool.h"
+
+#define MIB                         ((size_t)1024 * 1024)
+
+static int32_t nFailures = 0;
+
+static void check(bool bPassed, const char *pszWhat)
+{
+  if (bPassed)
+    return;
+
+  printf("FAIL %s\n", pszWhat);
+  nFailures++;
+}
+
+static void testSmallClasses()
+{
+  BufferPool *pPool = new BufferPool();
+  void *pFirst, *pSecond;
+
+  // 33 and 64 bytes share the 64 byte class, 65 bytes needs the next one
+  pFirst = pPool->acquire(33);
+  BufferPool::release(pFirst);
+  pSecond = pPool->acquire(64);
+  check(pSecond == pFirst && pPool->getAllocationCount() == 1, "small request reuses its class");
+
+  pFirst = pPool->acquire(65);
+  check(pFirst != pSecond && pPool->getAllocationCount() == 2, "small request takes the next class");
+  BufferPool::release(pFirst);
+  BufferPool::release(pSecond);
+
+  // The largest class still comes from the small lists
+  pFirst = pPool->acquire(POOL_SMALL_BLOCK_SIZE);
+  BufferPool::release(pFirst);
+  pSecond = pPool->acquire(POOL_SMALL_BLOCK_SIZE - 1);
+  check(pSecond == pFirst && pPool->getAllocationCount() == 3, "largest small class is reused");
+  BufferPool::release(pSecond);
+
+  // Small blocks are not counted as cached large bytes
+  check(pPool->getCachedBytes() == 0, "small blocks stay out of the large cache");
+
+  pPool->destroy();
+}
+
+static void testBestFit()
+{
+  BufferPool *pPool = new BufferPool();
+  void *pSmaller, *pLarger, *pBlock;
+
+  pLarger = pPool->acquire(12 * MIB);
+  pSmaller = pPool->acquire(11 * MIB);
+  BufferPool::release(pSmaller);
+  BufferPool::release(pLarger);
+  check(pPool->getCachedBytes() == 23 * MIB, "released blocks are cached");
+
+  // Both fit within the tolerance, the tighter one is taken
+  pBlock = pPool->acquire(10 * MIB + MIB / 2);
+  check(pBlock == pSmaller && pPool->getAllocationCount() == 2, "best fit takes the tighter block");
+  BufferPool::release(pBlock);
+
+  // Neither is handed to a request far smaller than it
+  pBlock = pPool->acquire(2 * MIB);
+  check(pBlock != pSmaller && pBlock != pLarger && pPool->getAllocationCount() == 3, "much larger block is not handed out");
+  BufferPool::release(pBlock);
+
+  // A request that outgrew every block frees them, they will never fit again
+  pBlock = pPool->acquire(13 * MIB);
+  check(pPool->getAllocationCount() == 4 && pPool->getCachedBytes() == 0, "outgrown blocks are freed");
+  BufferPool::release(pBlock);
+
+  pPool->destroy();
+}
+
+static void testCacheLimit()
+{
+  BufferPool *pPool = new BufferPool();
+  std::vector<void *> apBlock(POOL_CACHE_LIMIT / (4 * MIB) + 8);
+  void *pNewest, *pBlock;
+
+  for (size_t i = 0; i < apBlock.size(); i++)
+    apBlock[i] = pPool->acquire(4 * MIB);
+
+  for (size_t i = 0; i < apBlock.size(); i++)
+    BufferPool::release(apBlock[i]);
+
+  check(pPool->getCachedBytes() <= POOL_CACHE_LIMIT, "cached bytes stay within the limit");
+  check(pPool->getCachedBytes() > POOL_CACHE_LIMIT - 4 * MIB, "blocks under the limit are kept");
+
+  // The block returned last is the one kept and handed out again
+  pNewest = pPool->acquire(4 * MIB);
+  check(pNewest == apBlock[apBlock.size() - 1], "newest block survives eviction");
+  BufferPool::release(pNewest);
+
+  pPool->trim();
+  check(pPool->getCachedBytes() == 0, "trim empties the cache");
+
+  // A single block over the limit is still kept for reuse
+  pNewest = pPool->acquire(POOL_CACHE_LIMIT + MIB);
+  BufferPool::release(pNewest);
+  check(pPool->getCachedBytes() == POOL_CACHE_LIMIT + MIB, "oversized newest block is kept");
+  pBlock = pPool->acquire(POOL_CACHE_LIMIT + MIB);
+  check(pBlock == pNewest, "oversized block is reused");
+  BufferPool::release(pBlock);
+
+  pPool->destroy();
+}
+
+int main()
+{
+  testSmallClasses();
+  testBestFit();
+  testCacheLimit();
+
+  printf(nFailures ? "%d failures\n" : "All buffer pool checks passed\n", nFailures);
+
+  return nFailures ? 1 : 0;
+}
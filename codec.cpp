@@ -0,0 +1,454 @@
+#include <string.h>
+
+#include "convert.h"
+#include "codec.h"
+
+typedef struct tCodecJob
+{
+  const uint8_t *pbSrc;             // Samples when encoding, the stream when decoding
+  int32_t nSampleSize;
+  int32_t nStride;
+  uint64_t nRunValues;
+  uint32_t nFirstRun;
+  uint32_t nRuns;
+  uint8_t *pbDst;                   // Stream when encoding, samples when decoding
+  uint64_t nBase;                   // Offset of pbDst in the stream when encoding
+  uint64_t *pnOffset;               // Run table entries of the job when encoding
+  size_t nWritten;
+  bool bResult;
+} CODEC_JOB;
+
+static size_t getRunBound(int32_t nSampleSize, uint64_t nRunValues)
+{
+  uint64_t nFrames = (nRunValues + CODEC_FRAME_VALUES - 1) / CODEC_FRAME_VALUES;
+
+  return (size_t)(nFrames * (1 + CODEC_FRAME_VALUES * nSampleSize));
+}
+
+/* Zigzag differences of one frame, values past the end of the run are 0 */
+
+static uint16_t deltaFrame(const uint8_t *pbSrc, int32_t nSampleSize, int32_t nStride, uint64_t nStart, uint64_t nCount, uint16_t *pnFrame)
+{
+  uint16_t nBits = 0;
+
+  if (nSampleSize == 2)
+  {
+    const int16_t *pnSrc = (const int16_t *)pbSrc;
+
+    // Whole frame with its references inside the run
+    if (nCount == CODEC_FRAME_VALUES && nStart >= (uint64_t)nStride)
+      return deltaInt16(pnSrc + nStart, pnSrc + nStart - nStride, pnFrame, CODEC_FRAME_VALUES);
+
+    for (uint64_t j = 0; j < nCount; j++)
+    {
+      uint64_t i = nStart + j;
+      int16_t nDelta = (int16_t)(uint16_t)(pnSrc[i] - (i >= (uint64_t)nStride ? pnSrc[i - nStride] : 0));
+
+      pnFrame[j] = (uint16_t)(((uint16_t)nDelta << 1) ^ (uint16_t)(nDelta >> 15));
+      nBits |= pnFrame[j];
+    }
+  }
+  else
+  {
+    const int8_t *pcSrc = (const int8_t *)pbSrc;
+
+    for (uint64_t j = 0; j < nCount; j++)
+    {
+      uint64_t i = nStart + j;
+      int8_t nDelta = (int8_t)(uint8_t)(pcSrc[i] - (i >= (uint64_t)nStride ? pcSrc[i - nStride] : 0));
+
+      pnFrame[j] = (uint8_t)(((uint8_t)nDelta << 1) ^ (uint8_t)(nDelta >> 7));
+      nBits |= pnFrame[j];
+    }
+  }
+
+  for (uint64_t j = nCount; j < CODEC_FRAME_VALUES; j++)
+    pnFrame[j] = 0;
+
+  return nBits;
+}
+
+/* 64 values of nWidth bits fill exactly nWidth words */
+
+static uint8_t *packFrame(const uint16_t *pnFrame, int32_t nWidth, uint8_t *pbDst)
+{
+  uint64_t nBits = 0;
+  int32_t nFill = 0;
+
+  for (int32_t j = 0; j < CODEC_FRAME_VALUES; j++)
+  {
+    nBits |= (uint64_t)pnFrame[j] << nFill;
+    nFill += nWidth;
+
+    if (nFill >= 64)
+    {
+      memcpy(pbDst, &nBits, sizeof(uint64_t));
+      pbDst += sizeof(uint64_t);
+      nFill -= 64;
+      nBits = nFill ? (uint64_t)pnFrame[j] >> (nWidth - nFill) : 0;
+    }
+  }
+
+  return pbDst;
+}
+
+static const uint8_t *unpackFrame(const uint8_t *pbSrc, int32_t nWidth, size_t nAvailable, uint16_t *pnFrame)
+{
+  uint32_t nMask = ((uint32_t)1 << nWidth) - 1;
+  uint64_t nBits = 0;
+  uint64_t nWord;
+  int32_t nAvail = 0;
+
+  // Each value sits in the 4 bytes from its first bit, the last load may run 3 bytes past the frame
+  if (nAvailable >= (size_t)nWidth * sizeof(uint64_t) + sizeof(uint32_t))
+  {
+    for (int32_t j = 0; j < CODEC_FRAME_VALUES; j++)
+    {
+      uint32_t nBit = (uint32_t)(j * nWidth);
+      uint32_t nValue;
+
+      memcpy(&nValue, pbSrc + (nBit >> 3), sizeof(uint32_t));
+      pnFrame[j] = (uint16_t)((nValue >> (nBit & 7)) & nMask);
+    }
+
+    return pbSrc + nWidth * sizeof(uint64_t);
+  }
+
+  for (int32_t j = 0; j < CODEC_FRAME_VALUES; j++)
+  {
+    if (nAvail >= nWidth)
+    {
+      pnFrame[j] = (uint16_t)(nBits & nMask);
+      nBits >>= nWidth;
+      nAvail -= nWidth;
+      continue;
+    }
+
+    // Value straddles into the next word
+    memcpy(&nWord, pbSrc, sizeof(uint64_t));
+    pbSrc += sizeof(uint64_t);
+    pnFrame[j] = (uint16_t)((nBits | (nWord << nAvail)) & nMask);
+    nBits = nWord >> (nWidth - nAvail);
+    nAvail += 64 - nWidth;
+  }
+
+  return pbSrc;
+}
+
+static size_t encodeRun(const uint8_t *pbSrc, int32_t nSampleSize, int32_t nStride, uint64_t nValues, uint8_t *pbDst)
+{
+  uint16_t anFrame[CODEC_FRAME_VALUES];
+  uint8_t *pbOut = pbDst;
+  uint8_t *pbZeroRun = NULL;
+
+  for (uint64_t i = 0; i < nValues; i += CODEC_FRAME_VALUES)
+  {
+    uint64_t nCount = nValues - i < CODEC_FRAME_VALUES ? nValues - i : CODEC_FRAME_VALUES;
+    uint16_t nBits = deltaFrame(pbSrc, nSampleSize, nStride, i, nCount, anFrame);
+    int32_t nWidth = 0;
+
+    // Flat baseline costs one byte per CODEC_MAX_ZERO_RUN frames
+    if (nBits == 0)
+    {
+      if (pbZeroRun && *pbZeroRun < CODEC_ZERO_RUN + CODEC_MAX_ZERO_RUN - 1)
+      {
+        (*pbZeroRun)++;
+      }
+      else
+      {
+        pbZeroRun = pbOut;
+        *pbOut++ = CODEC_ZERO_RUN;
+      }
+
+      continue;
+    }
+
+    pbZeroRun = NULL;
+
+    while (nBits >> nWidth)
+      nWidth++;
+
+    *pbOut++ = (uint8_t)nWidth;
+    pbOut = packFrame(anFrame, nWidth, pbOut);
+  }
+
+  return (size_t)(pbOut - pbDst);
+}
+
+static bool decodeRun(const uint8_t *pbSrc, size_t nLength, int32_t nSampleSize, int32_t nStride, uint64_t nValues, uint8_t *pbDst)
+{
+  uint16_t anFrame[CODEC_FRAME_VALUES];
+  const uint8_t *pbEnd = pbSrc + nLength;
+  int16_t *pnDst = (int16_t *)pbDst;
+  int8_t *pcDst = (int8_t *)pbDst;
+  int32_t nMaxWidth = 8 * nSampleSize;
+  uint64_t i = 0;
+
+  while (i < nValues)
+  {
+    uint64_t nCount;
+    uint8_t nCode;
+
+    if (pbSrc >= pbEnd)
+      return false;
+
+    nCode = *pbSrc++;
+
+    // Frames without change repeat the reference values
+    if (nCode >= CODEC_ZERO_RUN)
+    {
+      nCount = (uint64_t)(nCode - CODEC_ZERO_RUN + 1) * CODEC_FRAME_VALUES;
+      if (nCount > nValues - i)
+        nCount = nValues - i;
+
+      if (nSampleSize == 2)
+      {
+        for (uint64_t j = i; j < i + nCount; j++)
+          pnDst[j] = j >= (uint64_t)nStride ? pnDst[j - nStride] : 0;
+      }
+      else
+      {
+        for (uint64_t j = i; j < i + nCount; j++)
+          pcDst[j] = j >= (uint64_t)nStride ? pcDst[j - nStride] : 0;
+      }
+
+      i += nCount;
+      continue;
+    }
+
+    if (nCode == 0 || nCode > nMaxWidth || (size_t)(pbEnd - pbSrc) < (size_t)nCode * sizeof(uint64_t))
+      return false;
+
+    pbSrc = unpackFrame(pbSrc, nCode, (size_t)(pbEnd - pbSrc), anFrame);
+
+    nCount = nValues - i < CODEC_FRAME_VALUES ? nValues - i : CODEC_FRAME_VALUES;
+
+    if (nSampleSize == 2)
+    {
+      uint64_t j = 0;
+
+      // References before the run are 0
+      for (; j < nCount && i < (uint64_t)nStride; j++, i++)
+        pnDst[i] = (int16_t)(uint16_t)((anFrame[j] >> 1) ^ (uint16_t)-(anFrame[j] & 1));
+
+      // Planar data keeps the running value in a register instead of reloading it
+      if (nStride == 1)
+      {
+        uint16_t nValue = i > 0 ? (uint16_t)pnDst[i - 1] : 0;
+
+        for (; j < nCount; j++, i++)
+        {
+          nValue = (uint16_t)(nValue + ((anFrame[j] >> 1) ^ (uint16_t)-(anFrame[j] & 1)));
+          pnDst[i] = (int16_t)nValue;
+        }
+      }
+
+      for (; j < nCount; j++, i++)
+        pnDst[i] = (int16_t)(uint16_t)((uint16_t)pnDst[i - nStride] + ((anFrame[j] >> 1) ^ (uint16_t)-(anFrame[j] & 1)));
+    }
+    else
+    {
+      uint64_t j = 0;
+
+      for (; j < nCount && i < (uint64_t)nStride; j++, i++)
+        pcDst[i] = (int8_t)(uint8_t)((anFrame[j] >> 1) ^ (uint8_t)-(anFrame[j] & 1));
+
+      for (; j < nCount; j++, i++)
+        pcDst[i] = (int8_t)(uint8_t)((uint8_t)pcDst[i - nStride] + ((anFrame[j] >> 1) ^ (uint8_t)-(anFrame[j] & 1)));
+    }
+  }
+
+  return true;
+}
+
+static void encodeJob(CODEC_JOB *pJob)
+{
+  size_t nRunBytes = (size_t)pJob->nRunValues * pJob->nSampleSize;
+  uint64_t nOffset = pJob->nBase;
+  uint8_t *pbOut = pJob->pbDst;
+
+  for (uint32_t r = 0; r < pJob->nRuns; r++)
+  {
+    size_t nWritten = encodeRun(pJob->pbSrc + r * nRunBytes, pJob->nSampleSize, pJob->nStride, pJob->nRunValues, pbOut);
+
+    pJob->pnOffset[r] = nOffset;
+    nOffset += nWritten;
+    pbOut += nWritten;
+  }
+
+  pJob->nWritten = (size_t)(pbOut - pJob->pbDst);
+}
+
+static void decodeJob(CODEC_JOB *pJob)
+{
+  const uint64_t *pnOffset = (const uint64_t *)(pJob->pbSrc + sizeof(CODEC_HEADER));
+  size_t nRunBytes = (size_t)pJob->nRunValues * pJob->nSampleSize;
+
+  pJob->bResult = true;
+
+  for (uint32_t r = 0; r < pJob->nRuns && pJob->bResult; r++)
+  {
+    uint64_t nStart = pnOffset[pJob->nFirstRun + r];
+    uint64_t nEnd = pnOffset[pJob->nFirstRun + r + 1];
+
+    pJob->bResult = decodeRun(pJob->pbSrc + nStart, (size_t)(nEnd - nStart), pJob->nSampleSize, pJob->nStride, pJob->nRunValues, pJob->pbDst + r * nRunBytes);
+  }
+}
+
+static void encodeThreadMain(void *pParameter)
+{
+  encodeJob((CODEC_JOB *)pParameter);
+}
+
+static void decodeThreadMain(void *pParameter)
+{
+  decodeJob((CODEC_JOB *)pParameter);
+}
+
+/* Runs are split in contiguous slices, the first one on the calling thread */
+
+static int32_t splitRuns(uint32_t nRuns, int32_t nThreads, uint32_t *pnSlice)
+{
+  uint64_t nSlice;
+
+  nThreads = splitJobs(nRuns, 1, nThreads, &nSlice);
+  *pnSlice = (uint32_t)nSlice;
+
+  return nThreads;
+}
+
+size_t getCodecBound(int32_t nSampleSize, uint64_t nRunValues, uint32_t nRuns)
+{
+  return sizeof(CODEC_HEADER) + ((size_t)nRuns + 1) * sizeof(uint64_t) + nRuns * getRunBound(nSampleSize, nRunValues);
+}
+
+size_t encodeRuns(const void *pSrc, int32_t nSampleSize, int32_t nStride, uint64_t nRunValues, uint32_t nRuns, uint8_t *pbDst, int32_t nThreads)
+{
+  CODEC_JOB acjJob[CODEC_MAX_THREADS];
+  CODEC_HEADER *pchHeader = (CODEC_HEADER *)pbDst;
+  uint64_t *pnOffset = (uint64_t *)(pchHeader + 1);
+  size_t nRunBound = getRunBound(nSampleSize, nRunValues);
+  size_t nTableEnd = sizeof(CODEC_HEADER) + ((size_t)nRuns + 1) * sizeof(uint64_t);
+  size_t nEnd = nTableEnd;
+  uint32_t nSlice;
+
+  if ((nSampleSize != 1 && nSampleSize != 2) || nStride < 1 || nStride > 0xFFFF || nRunValues == 0 || nRuns == 0)
+    return 0;
+
+  nThreads = splitRuns(nRuns, nThreads, &nSlice);
+
+  // Every slice starts where its runs would be at the bound
+  for (int32_t t = 0; t < nThreads; t++)
+  {
+    uint32_t nFirst = t * nSlice;
+
+    acjJob[t].pbSrc = (const uint8_t *)pSrc + (size_t)nFirst * nRunValues * nSampleSize;
+    acjJob[t].nSampleSize = nSampleSize;
+    acjJob[t].nStride = nStride;
+    acjJob[t].nRunValues = nRunValues;
+    acjJob[t].nFirstRun = nFirst;
+    acjJob[t].nRuns = nRuns - nFirst < nSlice ? nRuns - nFirst : nSlice;
+    acjJob[t].nBase = nTableEnd + (uint64_t)nFirst * nRunBound;
+    acjJob[t].pbDst = pbDst + acjJob[t].nBase;
+    acjJob[t].pnOffset = pnOffset + nFirst;
+  }
+
+  runJobs(acjJob, sizeof(CODEC_JOB), nThreads, encodeThreadMain);
+
+  // Close the gaps the slices left behind them
+  for (int32_t t = 0; t < nThreads; t++)
+  {
+    uint64_t nShift = acjJob[t].nBase - nEnd;
+
+    if (nShift)
+    {
+      memmove(pbDst + nEnd, acjJob[t].pbDst, acjJob[t].nWritten);
+
+      for (uint32_t r = 0; r < acjJob[t].nRuns; r++)
+        acjJob[t].pnOffset[r] -= nShift;
+    }
+
+    nEnd += acjJob[t].nWritten;
+  }
+
+  pnOffset[nRuns] = nEnd;
+
+  pchHeader->nMagic = CODEC_MAGIC;
+  pchHeader->nSampleSize = (uint16_t)nSampleSize;
+  pchHeader->nStride = (uint16_t)nStride;
+  pchHeader->nRuns = nRuns;
+  pchHeader->nReserved = 0;
+  pchHeader->nRunValues = nRunValues;
+  pchHeader->nLength = nEnd;
+
+  return nEnd;
+}
+
+uint64_t getDecodedLength(const uint8_t *pbSrc, size_t nLength)
+{
+  const CODEC_HEADER *pchHeader = (const CODEC_HEADER *)pbSrc;
+  const uint64_t *pnOffset = (const uint64_t *)(pchHeader + 1);
+  uint64_t nTableEnd;
+
+  if (nLength < sizeof(CODEC_HEADER) || pchHeader->nMagic != CODEC_MAGIC || pchHeader->nLength > nLength ||
+    (pchHeader->nSampleSize != 1 && pchHeader->nSampleSize != 2) || pchHeader->nStride < 1 || pchHeader->nRuns == 0 || pchHeader->nRunValues == 0)
+    return 0;
+
+  nTableEnd = sizeof(CODEC_HEADER) + ((uint64_t)pchHeader->nRuns + 1) * sizeof(uint64_t);
+  if (nTableEnd > pchHeader->nLength)
+    return 0;
+
+  // Runs follow each other inside the stream
+  if (pnOffset[0] < nTableEnd || pnOffset[pchHeader->nRuns] > pchHeader->nLength)
+    return 0;
+
+  for (uint32_t r = 0; r < pchHeader->nRuns; r++)
+  {
+    if (pnOffset[r + 1] < pnOffset[r])
+      return 0;
+  }
+
+  if (pchHeader->nRunValues > UINT64_MAX / pchHeader->nSampleSize / pchHeader->nRuns)
+    return 0;
+
+  return pchHeader->nRunValues * pchHeader->nSampleSize * pchHeader->nRuns;
+}
+
+bool decodeRuns(const uint8_t *pbSrc, size_t nLength, uint32_t nFirstRun, uint32_t nCount, void *pDst, int32_t nThreads)
+{
+  const CODEC_HEADER *pchHeader = (const CODEC_HEADER *)pbSrc;
+  CODEC_JOB acjJob[CODEC_MAX_THREADS];
+  size_t nRunBytes;
+  uint32_t nSlice;
+  bool bResult = true;
+
+  if (getDecodedLength(pbSrc, nLength) == 0 || nFirstRun > pchHeader->nRuns || nCount > pchHeader->nRuns - nFirstRun)
+    return false;
+
+  if (nCount == 0)
+    return true;
+
+  nRunBytes = (size_t)pchHeader->nRunValues * pchHeader->nSampleSize;
+  nThreads = splitRuns(nCount, nThreads, &nSlice);
+
+  for (int32_t t = 0; t < nThreads; t++)
+  {
+    uint32_t nFirst = t * nSlice;
+
+    acjJob[t].pbSrc = pbSrc;
+    acjJob[t].nSampleSize = pchHeader->nSampleSize;
+    acjJob[t].nStride = pchHeader->nStride;
+    acjJob[t].nRunValues = pchHeader->nRunValues;
+    acjJob[t].nFirstRun = nFirstRun + nFirst;
+    acjJob[t].nRuns = nCount - nFirst < nSlice ? nCount - nFirst : nSlice;
+    acjJob[t].pbDst = (uint8_t *)pDst + (size_t)nFirst * nRunBytes;
+    acjJob[t].bResult = false;
+  }
+
+  runJobs(acjJob, sizeof(CODEC_JOB), nThreads, decodeThreadMain);
+
+  for (int32_t t = 0; t < nThreads; t++)
+    bResult = bResult && acjJob[t].bResult;
+
+  return bResult;
+}
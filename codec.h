@@ -0,0 +1,71 @@
+#ifndef _PS6000_CODEC_H_
+#define _PS6000_CODEC_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "threads.h"
+
+#define CODEC_MAGIC                 0x315A4B50  // "PKZ1"
+#define CODEC_FRAME_VALUES          64          // Values sharing one bit width
+#define CODEC_ZERO_RUN              0x80        // Frame byte of (n - 0x80 + 1) frames without change
+#define CODEC_MAX_ZERO_RUN          128
+#define CODEC_MAX_THREADS           JOB_MAX_THREADS
+
+/*
+ * Lossless packing of int8 / int16 waveforms, mostly flat baseline with
+ * sparse peaks. Data is cut into runs, usually one per segment, that are
+ * coded independently so they can be spread over threads and decoded one
+ * by one. Within a run every value is replaced by its difference to the
+ * value nStride before it (channels of an interleaved run), zigzag mapped
+ * to unsigned and bit packed in frames of CODEC_FRAME_VALUES:
+ *
+ *   CODEC_HEADER
+ *   uint64 anRunOffset[nRuns + 1]   from the start of the header
+ *   run, repeated: frames of
+ *     uint8 width, 1 to 8 * nSampleSize, then width * 8 bytes,
+ *       value j at bits [j * width, (j + 1) * width), little endian
+ *     or uint8 CODEC_ZERO_RUN + n - 1 for n frames of zero differences
+ *
+ * Differences wrap around like the sample type does, so every input
+ * decodes back bit for bit. The last frame of a run is padded with zeros.
+ */
+typedef struct tCodecHeader
+{
+  uint32_t nMagic;                  // CODEC_MAGIC
+  uint16_t nSampleSize;             // Bytes, 1 or 2
+  uint16_t nStride;                 // Values between a sample and the one it is coded against
+  uint32_t nRuns;
+  uint32_t nReserved;
+  uint64_t nRunValues;              // Values per run
+  uint64_t nLength;                 // Whole stream including this header
+} CODEC_HEADER;
+
+/**
+ * @desc Largest stream encodeRuns can produce for this shape
+ */
+size_t getCodecBound(int32_t nSampleSize, uint64_t nRunValues, uint32_t nRuns);
+
+/**
+ * @desc Pack nRuns consecutive runs of nRunValues samples each
+ * @param[in] nSampleSize: 1 for int8, 2 for int16
+ * @param[in] nStride: 1 for planar data, the channel count for interleaved data
+ * @param[in] pbDst: getCodecBound bytes
+ * @param[in] nThreads: Runs are split between up to CODEC_MAX_THREADS threads
+ * @return Bytes written, 0 for a shape that cannot be coded
+ */
+size_t encodeRuns(const void *pSrc, int32_t nSampleSize, int32_t nStride, uint64_t nRunValues, uint32_t nRuns, uint8_t *pbDst, int32_t nThreads);
+
+/**
+ * @desc Check the header and run table of a stream
+ * @return Bytes of all runs once decoded, 0 if it is not a valid stream
+ */
+uint64_t getDecodedLength(const uint8_t *pbSrc, size_t nLength);
+
+/**
+ * @desc Unpack runs [nFirstRun, nFirstRun + nCount) to pDst, back to back
+ * @return false if the stream is damaged, pDst is then partly written
+ */
+bool decodeRuns(const uint8_t *pbSrc, size_t nLength, uint32_t nFirstRun, uint32_t nCount, void *pDst, int32_t nThreads);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Round trips the waveform codec: every frame width of both sample sizes,
+ * flat data packed as zero run bytes, interleaved strides, partial run
+ * decodes and more threads than runs. Truncated and bit flipped streams
+ * must be refused or decode to something, never read past the buffer.
+ *
+ *   npm run test:codec
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "codec.h"
+
+static const uint64_t anRunValues[] = {1, 63, 64, 65, 1000, 4096};
+static const int32_t anStride[] = {1, 2, 3, 4};
+static const int32_t anThreads[] = {1, 3, CODEC_MAX_THREADS};
+
+static uint32_t nRandom = 0x12345678;
+static int32_t nFailures = 0;
+
+static uint32_t nextRandom()
+{
+  nRandom ^= nRandom << 13;
+  nRandom ^= nRandom >> 17;
+  nRandom ^= nRandom << 5;
+
+  return nRandom;
+}
+
+static void check(bool bPassed, const char *pszWhat, int32_t nSampleSize, int32_t nDetail)
+{
+  if (bPassed)
+    return;
+
+  printf("FAIL %s, %d byte samples, %d\n", pszWhat, nSampleSize, nDetail);
+  nFailures++;
+}
+
+/* Samples whose differences to the value nStride before need at most nWidth bits zigzag coded */
+
+static void fillWidth(std::vector<uint8_t> &abSamples, int32_t nSampleSize, uint64_t nRunValues, int32_t nWidth)
+{
+  size_t nCount = abSamples.size() / nSampleSize;
+  uint32_t nMask = nWidth > 1 ? ((uint32_t)1 << (nWidth - 1)) - 1 : 0;
+
+  for (size_t i = 0; i < nCount; i++)
+  {
+    uint32_t nValue;
+
+    // Full width is anything, width 1 only steps down by 0 or 1 from 0 at the run start
+    if (nWidth == 8 * nSampleSize)
+      nValue = nextRandom();
+    else if (nWidth == 1)
+      nValue = (uint32_t)-(int32_t)(i % nRunValues / 2);
+    else
+      nValue = nextRandom() & nMask;
+
+    if (nSampleSize == 2)
+      ((int16_t *)abSamples.data())[i] = (int16_t)nValue;
+    else
+      ((int8_t *)abSamples.data())[i] = (int8_t)nValue;
+  }
+}
+
+/* Encode, check the stream describes the input, decode and compare */
+
+static size_t roundTrip(const std::vector<uint8_t> &abSamples, int32_t nSampleSize, int32_t nStride, uint64_t nRunValues, uint32_t nRuns, int32_t nThreads, std::vector<uint8_t> &abStream)
+{
+  std::vector<uint8_t> abDecoded(abSamples.size(), 0xAA);
+  size_t nLength;
+
+  abStream.assign(getCodecBound(nSampleSize, nRunValues, nRuns), 0);
+  nLength = encodeRuns(abSamples.data(), nSampleSize, nStride, nRunValues, nRuns, abStream.data(), nThreads);
+
+  check(nLength > 0 && nLength <= abStream.size(), "encode within bound", nSampleSize, (int32_t)nRunValues);
+  if (nLength == 0 || nLength > abStream.size())
+    return 0;
+
+  check(getDecodedLength(abStream.data(), nLength) == abSamples.size(), "decoded length", nSampleSize, (int32_t)nRunValues);
+  check(decodeRuns(abStream.data(), nLength, 0, nRuns, abDecoded.data(), nThreads) && abDecoded == abSamples, "round trip", nSampleSize, (int32_t)nRunValues);
+
+  // Runs decode on their own, from the middle of the stream
+  if (nRuns > 2)
+  {
+    size_t nRunBytes = (size_t)nRunValues * nSampleSize;
+    std::vector<uint8_t> abPart(2 * nRunBytes);
+
+    check(decodeRuns(abStream.data(), nLength, 1, 2, abPart.data(), nThreads) && memcmp(abPart.data(), abSamples.data() + nRunBytes, abPart.size()) == 0,
+      "partial decode", nSampleSize, (int32_t)nRunValues);
+  }
+
+  return nLength;
+}
+
+static void testWidths(int32_t nSampleSize)
+{
+  const uint64_t nRunValues = 4096;
+  const uint32_t nRuns = 3;
+  const size_t nFrames = nRuns * nRunValues / CODEC_FRAME_VALUES;
+  const size_t nOverhead = sizeof(CODEC_HEADER) + (nRuns + 1) * sizeof(uint64_t);
+  std::vector<uint8_t> abSamples(nRuns * nRunValues * nSampleSize);
+  std::vector<uint8_t> abStream;
+
+  for (int32_t nWidth = 1; nWidth <= 8 * nSampleSize; nWidth++)
+  {
+    size_t nLength;
+
+    fillWidth(abSamples, nSampleSize, nRunValues, nWidth);
+    nLength = roundTrip(abSamples, nSampleSize, 1, nRunValues, nRuns, 2, abStream);
+
+    // No frame is coded wider than its differences need
+    check(nLength <= nOverhead + nFrames * (1 + nWidth * sizeof(uint64_t)), "frame width", nSampleSize, nWidth);
+  }
+}
+
+static void testZeroRuns(int32_t nSampleSize)
+{
+  const uint32_t nRuns = 2;
+  const size_t nOverhead = sizeof(CODEC_HEADER) + (nRuns + 1) * sizeof(uint64_t);
+  std::vector<uint8_t> abStream;
+
+  // 200 flat frames take one byte per CODEC_MAX_ZERO_RUN frames: 2 per run
+  {
+    std::vector<uint8_t> abSamples(nRuns * 200 * CODEC_FRAME_VALUES * nSampleSize, 0);
+
+    check(roundTrip(abSamples, nSampleSize, 1, 200 * CODEC_FRAME_VALUES, nRuns, 1, abStream) == nOverhead + nRuns * 2, "zero run bytes", nSampleSize, 200);
+  }
+
+  // A constant baseline costs one frame, a short run tail is cut off on decode
+  {
+    const uint64_t nRunValues = 10 * CODEC_FRAME_VALUES + 5;
+    std::vector<uint8_t> abSamples(nRuns * nRunValues * nSampleSize, 0x11);
+    size_t nLength = roundTrip(abSamples, nSampleSize, 1, nRunValues, nRuns, 1, abStream);
+
+    check(nLength > nOverhead && nLength <= nOverhead + nRuns * (1 + 8 * nSampleSize * sizeof(uint64_t) + 1), "constant baseline", nSampleSize, (int32_t)nRunValues);
+  }
+}
+
+static void testShapes(int32_t nSampleSize)
+{
+  std::vector<uint8_t> abStream;
+
+  for (size_t s = 0; s < sizeof(anStride) / sizeof(anStride[0]); s++)
+  {
+    for (size_t v = 0; v < sizeof(anRunValues) / sizeof(anRunValues[0]); v++)
+    {
+      uint32_t nRuns = 1 + nextRandom() % 33;
+      std::vector<uint8_t> abSamples(nRuns * anRunValues[v] * nSampleSize);
+
+      // Baseline noise with sparse peaks, like a mass spectrum
+      for (size_t i = 0; i < abSamples.size() / nSampleSize; i++)
+      {
+        int32_t nValue = (int32_t)(nextRandom() % 7) - 3 + (i % 500 < 5 ? 20000 : 0);
+
+        if (nSampleSize == 2)
+          ((int16_t *)abSamples.data())[i] = (int16_t)nValue;
+        else
+          ((int8_t *)abSamples.data())[i] = (int8_t)nValue;
+      }
+
+      for (size_t t = 0; t < sizeof(anThreads) / sizeof(anThreads[0]); t++)
+        roundTrip(abSamples, nSampleSize, anStride[s], anRunValues[v], nRuns, anThreads[t], abStream);
+    }
+  }
+
+  check(encodeRuns(NULL, 3, 1, 1, 1, abStream.data(), 1) == 0, "bad sample size refused", nSampleSize, 3);
+  check(encodeRuns(NULL, nSampleSize, 0, 1, 1, abStream.data(), 1) == 0, "bad stride refused", nSampleSize, 0);
+}
+
+static void testDamage(int32_t nSampleSize)
+{
+  const uint64_t nRunValues = 1000;
+  const uint32_t nRuns = 20;
+  std::vector<uint8_t> abSamples(nRuns * nRunValues * nSampleSize);
+  std::vector<uint8_t> abDecoded(abSamples.size());
+  std::vector<uint8_t> abStream;
+  size_t nLength;
+
+  fillWidth(abSamples, nSampleSize, nRunValues, 5);
+  nLength = roundTrip(abSamples, nSampleSize, 1, nRunValues, nRuns, 2, abStream);
+  if (nLength == 0)
+    return;
+
+  // A stream cut short is refused as a whole
+  for (size_t nCut = 1; nCut < nLength; nCut += 1 + nCut / 4)
+  {
+    std::vector<uint8_t> abShort(abStream.begin(), abStream.begin() + (nLength - nCut));
+
+    check(getDecodedLength(abShort.data(), abShort.size()) == 0, "truncated length refused", nSampleSize, (int32_t)nCut);
+    check(!decodeRuns(abShort.data(), abShort.size(), 0, nRuns, abDecoded.data(), 2), "truncated stream refused", nSampleSize, (int32_t)nCut);
+  }
+
+  check(!decodeRuns(abStream.data(), nLength, nRuns - 1, 2, abDecoded.data(), 1), "runs past the end refused", nSampleSize, nRuns);
+
+  // Flipped bits decode to anything or fail, inside the buffers either way.
+  // Callers check the shape first, as the reader and decompress do.
+  for (int32_t k = 0; k < 2000; k++)
+  {
+    std::vector<uint8_t> abCorrupt(abStream.begin(), abStream.begin() + nLength);
+
+    abCorrupt[nextRandom() % nLength] ^= (uint8_t)(1 << (nextRandom() % 8));
+
+    if (getDecodedLength(abCorrupt.data(), abCorrupt.size()) == abDecoded.size())
+      decodeRuns(abCorrupt.data(), abCorrupt.size(), 0, ((const CODEC_HEADER *)abCorrupt.data())->nRuns, abDecoded.data(), 2);
+  }
+}
+
+int main()
+{
+  for (int32_t nSampleSize = 1; nSampleSize <= 2; nSampleSize++)
+  {
+    testWidths(nSampleSize);
+    testZeroRuns(nSampleSize);
+    testShapes(nSampleSize);
+    testDamage(nSampleSize);
+
+    printf("%d byte samples: checked\n", nSampleSize);
+  }
+
+  printf(nFailures ? "%d failures\n" : "All streams decode to their input\n", nFailures);
+
+  return nFailures ? 1 : 0;
+}
@@ -0,0 +1,1095 @@
+#include <string.h>
+#include <float.h>
+
+#include "convert.h"
+
+#ifdef CONVERT_X86
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define TARGET_AVX2
+    #define TARGET_AVX512BW
+  #else
+    #include <cpuid.h>
+    #define TARGET_AVX2       __attribute__((target("avx2")))
+    #define TARGET_AVX512BW   __attribute__((target("avx512f,avx512bw")))
+  #endif
+  #include <immintrin.h>
+#endif
+
+// Kernels inlined into AVX-512 code may otherwise be fused into FMA and round
+// differently from the scalar reference
+#if defined(__clang__)
+  #pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+  #pragma GCC optimize("fp-contract=off")
+#endif
+
+/* Scalar reference */
+
+static void narrowScalar(const int16_t *pnSrc, int8_t *pcDst, size_t nCount)
+{
+  for (size_t i = 0; i < nCount; i++)
+  {
+    pcDst[i] = (int8_t)(pnSrc[i] >> 8);
+  }
+}
+
+static void scaleScalar(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset)
+{
+  for (size_t i = 0; i < nCount; i++)
+  {
+    pfDst[i] = (float)pnSrc[i] * fGain + fOffset;
+  }
+}
+
+static void interleaveScalar(const int16_t *const *ppnSrc, int32_t nChannels, int16_t *pnDst, size_t nCount)
+{
+  for (size_t i = 0; i < nCount; i++)
+  {
+    for (int32_t c = 0; c < nChannels; c++)
+      pnDst[i * nChannels + c] = ppnSrc[c][i];
+  }
+}
+
+static void scaleChannelsScalar(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels)
+{
+  for (size_t i = 0; i < nCount; i += nChannels)
+  {
+    for (int32_t c = 0; c < nChannels; c++)
+      pfDst[i + c] = (float)pnSrc[i + c] * pfGain[c] + pfOffset[c];
+  }
+}
+
+static void accumulateScalar(const int16_t *pnSrc, int32_t *pnSum, size_t nCount)
+{
+  for (size_t i = 0; i < nCount; i++)
+  {
+    pnSum[i] += pnSrc[i];
+  }
+}
+
+static uint16_t deltaScalar(const int16_t *pnSrc, const int16_t *pnPrev, uint16_t *pnDst, size_t nCount)
+{
+  uint16_t nBits = 0;
+
+  for (size_t i = 0; i < nCount; i++)
+  {
+    int16_t nDelta = (int16_t)(uint16_t)(pnSrc[i] - pnPrev[i]);
+
+    pnDst[i] = (uint16_t)(((uint16_t)nDelta << 1) ^ (uint16_t)(nDelta >> 15));
+    nBits |= pnDst[i];
+  }
+
+  return nBits;
+}
+
+static void momentsScalar(const float *pfSrc, size_t nCount, double *plfSum, double *plfSumSquares)
+{
+  double lfSum = 0.0, lfSumSquares = 0.0;
+
+  for (size_t i = 0; i < nCount; i++)
+  {
+    double lfValue = pfSrc[i];
+
+    lfSum += lfValue;
+    lfSumSquares += lfValue * lfValue;
+  }
+
+  *plfSum = lfSum;
+  *plfSumSquares = lfSumSquares;
+}
+
+static size_t findAboveScalar(const float *pfSrc, size_t nCount, float fLevel)
+{
+  for (size_t i = 0; i < nCount; i++)
+  {
+    if (pfSrc[i] > fLevel)
+      return i;
+  }
+
+  return nCount;
+}
+
+static void rangeScalar(const int16_t *pnSrc, size_t nCount, int16_t *pnMin, int16_t *pnMax)
+{
+  int16_t nMin = INT16_MAX, nMax = INT16_MIN;
+
+  for (size_t i = 0; i < nCount; i++)
+  {
+    if (pnSrc[i] < nMin)
+      nMin = pnSrc[i];
+    if (pnSrc[i] > nMax)
+      nMax = pnSrc[i];
+  }
+
+  *pnMin = nMin;
+  *pnMax = nMax;
+}
+
+static void rangeFloatScalar(const float *pfSrc, size_t nCount, float *pfMin, float *pfMax)
+{
+  float fMin = FLT_MAX, fMax = -FLT_MAX;
+
+  for (size_t i = 0; i < nCount; i++)
+  {
+    if (pfSrc[i] < fMin)
+      fMin = pfSrc[i];
+    if (pfSrc[i] > fMax)
+      fMax = pfSrc[i];
+  }
+
+  *pfMin = fMin;
+  *pfMax = fMax;
+}
+
+/* Gain and offset of 16 consecutive interleaved samples. Every kernel steps
+ * by a multiple of 8 samples, so the pattern lines up for 1, 2, 4 and 8 channels. */
+
+static bool fillChannelPattern(const float *pfGain, const float *pfOffset, int32_t nChannels, float *pfGainPattern, float *pfOffsetPattern)
+{
+  if (8 % nChannels)
+    return false;
+
+  for (int32_t i = 0; i < 16; i++)
+  {
+    pfGainPattern[i] = pfGain[i % nChannels];
+    pfOffsetPattern[i] = pfOffset[i % nChannels];
+  }
+
+  return true;
+}
+
+#ifdef CONVERT_X86
+
+/* x86 kernels. After an arithmetic shift by 8 every lane fits in int8, so the
+ * saturating packs below never clip and results match the scalar path. */
+
+static void narrowSSE2(const int16_t *pnSrc, int8_t *pcDst, size_t nCount)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m128i a = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)(pnSrc + i)), 8);
+    __m128i b = _mm_srai_epi16(_mm_loadu_si128((const __m128i *)(pnSrc + i + 8)), 8);
+
+    _mm_storeu_si128((__m128i *)(pcDst + i), _mm_packs_epi16(a, b));
+  }
+
+  narrowScalar(pnSrc + i, pcDst + i, nCount - i);
+}
+
+TARGET_AVX2
+static void narrowAVX2(const int16_t *pnSrc, int8_t *pcDst, size_t nCount)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= nCount; i += 32)
+  {
+    __m256i a = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i *)(pnSrc + i)), 8);
+    __m256i b = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i *)(pnSrc + i + 16)), 8);
+
+    // packs works per 128-bit lane, put quadwords back in order
+    __m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+
+    _mm256_storeu_si256((__m256i *)(pcDst + i), r);
+  }
+
+  narrowSSE2(pnSrc + i, pcDst + i, nCount - i);
+}
+
+TARGET_AVX512BW
+static void narrowAVX512BW(const int16_t *pnSrc, int8_t *pcDst, size_t nCount)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= nCount; i += 32)
+  {
+    __m512i a = _mm512_srai_epi16(_mm512_loadu_si512((const void *)(pnSrc + i)), 8);
+
+    _mm256_storeu_si256((__m256i *)(pcDst + i), _mm512_cvtepi16_epi8(a));
+  }
+
+  narrowSSE2(pnSrc + i, pcDst + i, nCount - i);
+}
+
+/* Scaling kernels multiply then add (no FMA) to round like the scalar path */
+
+static void scaleSSE2(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset)
+{
+  __m128 vGain = _mm_set1_ps(fGain);
+  __m128 vOffset = _mm_set1_ps(fOffset);
+  size_t i = 0;
+
+  for (; i + 8 <= nCount; i += 8)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(pnSrc + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+    _mm_storeu_ps(pfDst + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), vGain), vOffset));
+    _mm_storeu_ps(pfDst + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), vGain), vOffset));
+  }
+
+  scaleScalar(pnSrc + i, pfDst + i, nCount - i, fGain, fOffset);
+}
+
+TARGET_AVX2
+static void scaleAVX2(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset)
+{
+  __m256 vGain = _mm256_set1_ps(fGain);
+  __m256 vOffset = _mm256_set1_ps(fOffset);
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pnSrc + i)));
+    __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pnSrc + i + 8)));
+
+    _mm256_storeu_ps(pfDst + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), vGain), vOffset));
+    _mm256_storeu_ps(pfDst + i + 8, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), vGain), vOffset));
+  }
+
+  scaleSSE2(pnSrc + i, pfDst + i, nCount - i, fGain, fOffset);
+}
+
+TARGET_AVX512BW
+static void scaleAVX512BW(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset)
+{
+  __m512 vGain = _mm512_set1_ps(fGain);
+  __m512 vOffset = _mm512_set1_ps(fOffset);
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(pnSrc + i)));
+
+    _mm512_storeu_ps(pfDst + i, _mm512_add_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(x), vGain), vOffset));
+  }
+
+  scaleSSE2(pnSrc + i, pfDst + i, nCount - i, fGain, fOffset);
+}
+
+/* Interleaving is pure data movement, SSE2 unpacks saturate memory already */
+
+static void interleaveSSE2(const int16_t *const *ppnSrc, int32_t nChannels, int16_t *pnDst, size_t nCount)
+{
+  size_t i = 0;
+
+  if (nChannels == 1)
+  {
+    memcpy(pnDst, ppnSrc[0], nCount * sizeof(int16_t));
+    return;
+  }
+
+  if (nChannels == 2)
+  {
+    for (; i + 8 <= nCount; i += 8)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *)(ppnSrc[0] + i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(ppnSrc[1] + i));
+
+      _mm_storeu_si128((__m128i *)(pnDst + i * 2), _mm_unpacklo_epi16(a, b));
+      _mm_storeu_si128((__m128i *)(pnDst + i * 2 + 8), _mm_unpackhi_epi16(a, b));
+    }
+  }
+
+  else if (nChannels == 4)
+  {
+    for (; i + 8 <= nCount; i += 8)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *)(ppnSrc[0] + i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(ppnSrc[1] + i));
+      __m128i c = _mm_loadu_si128((const __m128i *)(ppnSrc[2] + i));
+      __m128i d = _mm_loadu_si128((const __m128i *)(ppnSrc[3] + i));
+      __m128i abLo = _mm_unpacklo_epi16(a, b);
+      __m128i abHi = _mm_unpackhi_epi16(a, b);
+      __m128i cdLo = _mm_unpacklo_epi16(c, d);
+      __m128i cdHi = _mm_unpackhi_epi16(c, d);
+
+      // abcd quadruples are 32-bit pairs of ab and cd
+      _mm_storeu_si128((__m128i *)(pnDst + i * 4), _mm_unpacklo_epi32(abLo, cdLo));
+      _mm_storeu_si128((__m128i *)(pnDst + i * 4 + 8), _mm_unpackhi_epi32(abLo, cdLo));
+      _mm_storeu_si128((__m128i *)(pnDst + i * 4 + 16), _mm_unpacklo_epi32(abHi, cdHi));
+      _mm_storeu_si128((__m128i *)(pnDst + i * 4 + 24), _mm_unpackhi_epi32(abHi, cdHi));
+    }
+  }
+
+  const int16_t *apnTail[CONVERT_MAX_CHANNELS];
+
+  for (int32_t c = 0; c < nChannels; c++)
+    apnTail[c] = ppnSrc[c] + i;
+
+  interleaveScalar(apnTail, nChannels, pnDst + i * nChannels, nCount - i);
+}
+
+static void scaleChannelsSSE2(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels)
+{
+  float afGain[16], afOffset[16];
+  size_t i = 0;
+
+  if (!fillChannelPattern(pfGain, pfOffset, nChannels, afGain, afOffset))
+  {
+    scaleChannelsScalar(pnSrc, pfDst, nCount, pfGain, pfOffset, nChannels);
+    return;
+  }
+
+  __m128 vGainLo = _mm_loadu_ps(afGain);
+  __m128 vGainHi = _mm_loadu_ps(afGain + 4);
+  __m128 vOffsetLo = _mm_loadu_ps(afOffset);
+  __m128 vOffsetHi = _mm_loadu_ps(afOffset + 4);
+
+  for (; i + 8 <= nCount; i += 8)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(pnSrc + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+    _mm_storeu_ps(pfDst + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), vGainLo), vOffsetLo));
+    _mm_storeu_ps(pfDst + i + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), vGainHi), vOffsetHi));
+  }
+
+  // i is a multiple of 8, the tail starts on channel 0
+  scaleChannelsScalar(pnSrc + i, pfDst + i, nCount - i, pfGain, pfOffset, nChannels);
+}
+
+TARGET_AVX2
+static void scaleChannelsAVX2(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels)
+{
+  float afGain[16], afOffset[16];
+  size_t i = 0;
+
+  if (!fillChannelPattern(pfGain, pfOffset, nChannels, afGain, afOffset))
+  {
+    scaleChannelsScalar(pnSrc, pfDst, nCount, pfGain, pfOffset, nChannels);
+    return;
+  }
+
+  __m256 vGainLo = _mm256_loadu_ps(afGain);
+  __m256 vGainHi = _mm256_loadu_ps(afGain + 8);
+  __m256 vOffsetLo = _mm256_loadu_ps(afOffset);
+  __m256 vOffsetHi = _mm256_loadu_ps(afOffset + 8);
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pnSrc + i)));
+    __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pnSrc + i + 8)));
+
+    _mm256_storeu_ps(pfDst + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), vGainLo), vOffsetLo));
+    _mm256_storeu_ps(pfDst + i + 8, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), vGainHi), vOffsetHi));
+  }
+
+  scaleChannelsSSE2(pnSrc + i, pfDst + i, nCount - i, pfGain, pfOffset, nChannels);
+}
+
+TARGET_AVX512BW
+static void scaleChannelsAVX512BW(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels)
+{
+  float afGain[16], afOffset[16];
+  size_t i = 0;
+
+  if (!fillChannelPattern(pfGain, pfOffset, nChannels, afGain, afOffset))
+  {
+    scaleChannelsScalar(pnSrc, pfDst, nCount, pfGain, pfOffset, nChannels);
+    return;
+  }
+
+  __m512 vGain = _mm512_loadu_ps(afGain);
+  __m512 vOffset = _mm512_loadu_ps(afOffset);
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(pnSrc + i)));
+
+    _mm512_storeu_ps(pfDst + i, _mm512_add_ps(_mm512_mul_ps(_mm512_cvtepi32_ps(x), vGain), vOffset));
+  }
+
+  scaleChannelsSSE2(pnSrc + i, pfDst + i, nCount - i, pfGain, pfOffset, nChannels);
+}
+
+/* Accumulation widens to int32 and adds, bounded by load/store bandwidth */
+
+static void accumulateSSE2(const int16_t *pnSrc, int32_t *pnSum, size_t nCount)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= nCount; i += 8)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(pnSrc + i));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+    _mm_storeu_si128((__m128i *)(pnSum + i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(pnSum + i)), lo));
+    _mm_storeu_si128((__m128i *)(pnSum + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(pnSum + i + 4)), hi));
+  }
+
+  accumulateScalar(pnSrc + i, pnSum + i, nCount - i);
+}
+
+TARGET_AVX2
+static void accumulateAVX2(const int16_t *pnSrc, int32_t *pnSum, size_t nCount)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pnSrc + i)));
+    __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(pnSrc + i + 8)));
+
+    _mm256_storeu_si256((__m256i *)(pnSum + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(pnSum + i)), lo));
+    _mm256_storeu_si256((__m256i *)(pnSum + i + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(pnSum + i + 8)), hi));
+  }
+
+  accumulateSSE2(pnSrc + i, pnSum + i, nCount - i);
+}
+
+TARGET_AVX512BW
+static void accumulateAVX512BW(const int16_t *pnSrc, int32_t *pnSum, size_t nCount)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m512i x = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(pnSrc + i)));
+
+    _mm512_storeu_si512((void *)(pnSum + i), _mm512_add_epi32(_mm512_loadu_si512((const void *)(pnSum + i)), x));
+  }
+
+  accumulateSSE2(pnSrc + i, pnSum + i, nCount - i);
+}
+
+/* Differences wrap like the scalar int16 subtraction, the zigzag keeps the
+ * sign in bit 0 so small steps of either sign need few bits */
+
+static uint16_t deltaSSE2(const int16_t *pnSrc, const int16_t *pnPrev, uint16_t *pnDst, size_t nCount)
+{
+  __m128i vBits = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 8 <= nCount; i += 8)
+  {
+    __m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(pnSrc + i)), _mm_loadu_si128((const __m128i *)(pnPrev + i)));
+    __m128i z = _mm_xor_si128(_mm_slli_epi16(d, 1), _mm_srai_epi16(d, 15));
+
+    _mm_storeu_si128((__m128i *)(pnDst + i), z);
+    vBits = _mm_or_si128(vBits, z);
+  }
+
+  vBits = _mm_or_si128(vBits, _mm_srli_si128(vBits, 8));
+  vBits = _mm_or_si128(vBits, _mm_srli_si128(vBits, 4));
+  vBits = _mm_or_si128(vBits, _mm_srli_si128(vBits, 2));
+
+  return (uint16_t)_mm_cvtsi128_si32(vBits) | deltaScalar(pnSrc + i, pnPrev + i, pnDst + i, nCount - i);
+}
+
+TARGET_AVX2
+static uint16_t deltaAVX2(const int16_t *pnSrc, const int16_t *pnPrev, uint16_t *pnDst, size_t nCount)
+{
+  __m256i vBits = _mm256_setzero_si256();
+  __m128i vFold;
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m256i d = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(pnSrc + i)), _mm256_loadu_si256((const __m256i *)(pnPrev + i)));
+    __m256i z = _mm256_xor_si256(_mm256_slli_epi16(d, 1), _mm256_srai_epi16(d, 15));
+
+    _mm256_storeu_si256((__m256i *)(pnDst + i), z);
+    vBits = _mm256_or_si256(vBits, z);
+  }
+
+  vFold = _mm_or_si128(_mm256_castsi256_si128(vBits), _mm256_extracti128_si256(vBits, 1));
+  vFold = _mm_or_si128(vFold, _mm_srli_si128(vFold, 8));
+  vFold = _mm_or_si128(vFold, _mm_srli_si128(vFold, 4));
+  vFold = _mm_or_si128(vFold, _mm_srli_si128(vFold, 2));
+
+  return (uint16_t)_mm_cvtsi128_si32(vFold) | deltaSSE2(pnSrc + i, pnPrev + i, pnDst + i, nCount - i);
+}
+
+/* Moments widen to double before squaring, int16 scale samples stay exact */
+
+static void momentsSSE2(const float *pfSrc, size_t nCount, double *plfSum, double *plfSumSquares)
+{
+  __m128d vSum0 = _mm_setzero_pd(), vSum1 = _mm_setzero_pd();
+  __m128d vSquares0 = _mm_setzero_pd(), vSquares1 = _mm_setzero_pd();
+  double alfSum[2], alfSquares[2], lfSum, lfSquares;
+  size_t i = 0;
+
+  for (; i + 4 <= nCount; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(pfSrc + i);
+    __m128d lo = _mm_cvtps_pd(x);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+
+    vSum0 = _mm_add_pd(vSum0, lo);
+    vSum1 = _mm_add_pd(vSum1, hi);
+    vSquares0 = _mm_add_pd(vSquares0, _mm_mul_pd(lo, lo));
+    vSquares1 = _mm_add_pd(vSquares1, _mm_mul_pd(hi, hi));
+  }
+
+  _mm_storeu_pd(alfSum, _mm_add_pd(vSum0, vSum1));
+  _mm_storeu_pd(alfSquares, _mm_add_pd(vSquares0, vSquares1));
+  momentsScalar(pfSrc + i, nCount - i, &lfSum, &lfSquares);
+
+  *plfSum = alfSum[0] + alfSum[1] + lfSum;
+  *plfSumSquares = alfSquares[0] + alfSquares[1] + lfSquares;
+}
+
+TARGET_AVX2
+static void momentsAVX2(const float *pfSrc, size_t nCount, double *plfSum, double *plfSumSquares)
+{
+  __m256d vSum0 = _mm256_setzero_pd(), vSum1 = _mm256_setzero_pd();
+  __m256d vSquares0 = _mm256_setzero_pd(), vSquares1 = _mm256_setzero_pd();
+  double alfSum[4], alfSquares[4], lfSum, lfSquares;
+  size_t i = 0;
+
+  for (; i + 8 <= nCount; i += 8)
+  {
+    __m256d lo = _mm256_cvtps_pd(_mm_loadu_ps(pfSrc + i));
+    __m256d hi = _mm256_cvtps_pd(_mm_loadu_ps(pfSrc + i + 4));
+
+    vSum0 = _mm256_add_pd(vSum0, lo);
+    vSum1 = _mm256_add_pd(vSum1, hi);
+    vSquares0 = _mm256_add_pd(vSquares0, _mm256_mul_pd(lo, lo));
+    vSquares1 = _mm256_add_pd(vSquares1, _mm256_mul_pd(hi, hi));
+  }
+
+  _mm256_storeu_pd(alfSum, _mm256_add_pd(vSum0, vSum1));
+  _mm256_storeu_pd(alfSquares, _mm256_add_pd(vSquares0, vSquares1));
+  momentsScalar(pfSrc + i, nCount - i, &lfSum, &lfSquares);
+
+  *plfSum = (alfSum[0] + alfSum[1]) + (alfSum[2] + alfSum[3]) + lfSum;
+  *plfSumSquares = (alfSquares[0] + alfSquares[1]) + (alfSquares[2] + alfSquares[3]) + lfSquares;
+}
+
+/* Baseline is skipped a register at a time, only the block holding the
+ * crossing is searched sample by sample */
+
+static size_t findAboveSSE2(const float *pfSrc, size_t nCount, float fLevel)
+{
+  __m128 vLevel = _mm_set1_ps(fLevel);
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m128 a = _mm_cmpgt_ps(_mm_loadu_ps(pfSrc + i), vLevel);
+    __m128 b = _mm_cmpgt_ps(_mm_loadu_ps(pfSrc + i + 4), vLevel);
+    __m128 c = _mm_cmpgt_ps(_mm_loadu_ps(pfSrc + i + 8), vLevel);
+    __m128 d = _mm_cmpgt_ps(_mm_loadu_ps(pfSrc + i + 12), vLevel);
+
+    if (_mm_movemask_ps(_mm_or_ps(_mm_or_ps(a, b), _mm_or_ps(c, d))))
+      break;
+  }
+
+  return i + findAboveScalar(pfSrc + i, nCount - i, fLevel);
+}
+
+TARGET_AVX2
+static size_t findAboveAVX2(const float *pfSrc, size_t nCount, float fLevel)
+{
+  __m256 vLevel = _mm256_set1_ps(fLevel);
+  size_t i = 0;
+
+  for (; i + 32 <= nCount; i += 32)
+  {
+    __m256 a = _mm256_cmp_ps(_mm256_loadu_ps(pfSrc + i), vLevel, _CMP_GT_OQ);
+    __m256 b = _mm256_cmp_ps(_mm256_loadu_ps(pfSrc + i + 8), vLevel, _CMP_GT_OQ);
+    __m256 c = _mm256_cmp_ps(_mm256_loadu_ps(pfSrc + i + 16), vLevel, _CMP_GT_OQ);
+    __m256 d = _mm256_cmp_ps(_mm256_loadu_ps(pfSrc + i + 24), vLevel, _CMP_GT_OQ);
+
+    if (_mm256_movemask_ps(_mm256_or_ps(_mm256_or_ps(a, b), _mm256_or_ps(c, d))))
+      break;
+  }
+
+  return i + findAboveSSE2(pfSrc + i, nCount - i, fLevel);
+}
+
+/* Min and max fold across lanes once at the end */
+
+static void rangeSSE2(const int16_t *pnSrc, size_t nCount, int16_t *pnMin, int16_t *pnMax)
+{
+  __m128i vMin = _mm_set1_epi16(INT16_MAX), vMax = _mm_set1_epi16(INT16_MIN);
+  int16_t nMin, nMax;
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)(pnSrc + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(pnSrc + i + 8));
+
+    vMin = _mm_min_epi16(vMin, _mm_min_epi16(a, b));
+    vMax = _mm_max_epi16(vMax, _mm_max_epi16(a, b));
+  }
+
+  vMin = _mm_min_epi16(vMin, _mm_srli_si128(vMin, 8));
+  vMin = _mm_min_epi16(vMin, _mm_srli_si128(vMin, 4));
+  vMin = _mm_min_epi16(vMin, _mm_srli_si128(vMin, 2));
+  vMax = _mm_max_epi16(vMax, _mm_srli_si128(vMax, 8));
+  vMax = _mm_max_epi16(vMax, _mm_srli_si128(vMax, 4));
+  vMax = _mm_max_epi16(vMax, _mm_srli_si128(vMax, 2));
+
+  rangeScalar(pnSrc + i, nCount - i, &nMin, &nMax);
+
+  *pnMin = (int16_t)_mm_cvtsi128_si32(vMin) < nMin ? (int16_t)_mm_cvtsi128_si32(vMin) : nMin;
+  *pnMax = (int16_t)_mm_cvtsi128_si32(vMax) > nMax ? (int16_t)_mm_cvtsi128_si32(vMax) : nMax;
+}
+
+TARGET_AVX2
+static void rangeAVX2(const int16_t *pnSrc, size_t nCount, int16_t *pnMin, int16_t *pnMax)
+{
+  __m256i vMin = _mm256_set1_epi16(INT16_MAX), vMax = _mm256_set1_epi16(INT16_MIN);
+  __m128i vMinFold, vMaxFold;
+  int16_t nMin, nMax;
+  size_t i = 0;
+
+  for (; i + 32 <= nCount; i += 32)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(pnSrc + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(pnSrc + i + 16));
+
+    vMin = _mm256_min_epi16(vMin, _mm256_min_epi16(a, b));
+    vMax = _mm256_max_epi16(vMax, _mm256_max_epi16(a, b));
+  }
+
+  vMinFold = _mm_min_epi16(_mm256_castsi256_si128(vMin), _mm256_extracti128_si256(vMin, 1));
+  vMaxFold = _mm_max_epi16(_mm256_castsi256_si128(vMax), _mm256_extracti128_si256(vMax, 1));
+  vMinFold = _mm_min_epi16(vMinFold, _mm_srli_si128(vMinFold, 8));
+  vMinFold = _mm_min_epi16(vMinFold, _mm_srli_si128(vMinFold, 4));
+  vMinFold = _mm_min_epi16(vMinFold, _mm_srli_si128(vMinFold, 2));
+  vMaxFold = _mm_max_epi16(vMaxFold, _mm_srli_si128(vMaxFold, 8));
+  vMaxFold = _mm_max_epi16(vMaxFold, _mm_srli_si128(vMaxFold, 4));
+  vMaxFold = _mm_max_epi16(vMaxFold, _mm_srli_si128(vMaxFold, 2));
+
+  rangeSSE2(pnSrc + i, nCount - i, &nMin, &nMax);
+
+  *pnMin = (int16_t)_mm_cvtsi128_si32(vMinFold) < nMin ? (int16_t)_mm_cvtsi128_si32(vMinFold) : nMin;
+  *pnMax = (int16_t)_mm_cvtsi128_si32(vMaxFold) > nMax ? (int16_t)_mm_cvtsi128_si32(vMaxFold) : nMax;
+}
+
+static void rangeFloatSSE2(const float *pfSrc, size_t nCount, float *pfMin, float *pfMax)
+{
+  __m128 vMin = _mm_set1_ps(FLT_MAX), vMax = _mm_set1_ps(-FLT_MAX);
+  float fMin, fMax;
+  size_t i = 0;
+
+  for (; i + 8 <= nCount; i += 8)
+  {
+    __m128 a = _mm_loadu_ps(pfSrc + i);
+    __m128 b = _mm_loadu_ps(pfSrc + i + 4);
+
+    vMin = _mm_min_ps(vMin, _mm_min_ps(a, b));
+    vMax = _mm_max_ps(vMax, _mm_max_ps(a, b));
+  }
+
+  vMin = _mm_min_ps(vMin, _mm_movehl_ps(vMin, vMin));
+  vMin = _mm_min_ss(vMin, _mm_shuffle_ps(vMin, vMin, 1));
+  vMax = _mm_max_ps(vMax, _mm_movehl_ps(vMax, vMax));
+  vMax = _mm_max_ss(vMax, _mm_shuffle_ps(vMax, vMax, 1));
+
+  rangeFloatScalar(pfSrc + i, nCount - i, &fMin, &fMax);
+
+  *pfMin = _mm_cvtss_f32(vMin) < fMin ? _mm_cvtss_f32(vMin) : fMin;
+  *pfMax = _mm_cvtss_f32(vMax) > fMax ? _mm_cvtss_f32(vMax) : fMax;
+}
+
+TARGET_AVX2
+static void rangeFloatAVX2(const float *pfSrc, size_t nCount, float *pfMin, float *pfMax)
+{
+  __m256 vMin = _mm256_set1_ps(FLT_MAX), vMax = _mm256_set1_ps(-FLT_MAX);
+  __m128 vMinFold, vMaxFold;
+  float fMin, fMax;
+  size_t i = 0;
+
+  for (; i + 16 <= nCount; i += 16)
+  {
+    __m256 a = _mm256_loadu_ps(pfSrc + i);
+    __m256 b = _mm256_loadu_ps(pfSrc + i + 8);
+
+    vMin = _mm256_min_ps(vMin, _mm256_min_ps(a, b));
+    vMax = _mm256_max_ps(vMax, _mm256_max_ps(a, b));
+  }
+
+  vMinFold = _mm_min_ps(_mm256_castps256_ps128(vMin), _mm256_extractf128_ps(vMin, 1));
+  vMaxFold = _mm_max_ps(_mm256_castps256_ps128(vMax), _mm256_extractf128_ps(vMax, 1));
+  vMinFold = _mm_min_ps(vMinFold, _mm_movehl_ps(vMinFold, vMinFold));
+  vMinFold = _mm_min_ss(vMinFold, _mm_shuffle_ps(vMinFold, vMinFold, 1));
+  vMaxFold = _mm_max_ps(vMaxFold, _mm_movehl_ps(vMaxFold, vMaxFold));
+  vMaxFold = _mm_max_ss(vMaxFold, _mm_shuffle_ps(vMaxFold, vMaxFold, 1));
+
+  rangeFloatSSE2(pfSrc + i, nCount - i, &fMin, &fMax);
+
+  *pfMin = _mm_cvtss_f32(vMinFold) < fMin ? _mm_cvtss_f32(vMinFold) : fMin;
+  *pfMax = _mm_cvtss_f32(vMaxFold) > fMax ? _mm_cvtss_f32(vMaxFold) : fMax;
+}
+
+static void cpuid(uint32_t nLeaf, uint32_t nSubLeaf, uint32_t *pnRegs)
+{
+#ifdef _MSC_VER
+  int anRegs[4];
+
+  __cpuidex(anRegs, (int)nLeaf, (int)nSubLeaf);
+  for (int i = 0; i < 4; i++)
+    pnRegs[i] = (uint32_t)anRegs[i];
+#else
+  if (!__get_cpuid_count(nLeaf, nSubLeaf, &pnRegs[0], &pnRegs[1], &pnRegs[2], &pnRegs[3]))
+    pnRegs[0] = pnRegs[1] = pnRegs[2] = pnRegs[3] = 0;
+#endif
+}
+
+static uint64_t xgetbv()
+{
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t nLow, nHigh;
+
+  __asm__ __volatile__("xgetbv" : "=a"(nLow), "=d"(nHigh) : "c"(0));
+
+  return ((uint64_t)nHigh << 32) | nLow;
+#endif
+}
+
+static SIMD_LEVEL detectSimdLevel()
+{
+  uint32_t anRegs[4];
+  uint64_t nXCR0 = 0;
+  uint32_t nMaxLeaf;
+
+  cpuid(0, 0, anRegs);
+  nMaxLeaf = anRegs[0];
+
+  cpuid(1, 0, anRegs);
+  if (!(anRegs[3] & (1u << 26)))              // SSE2
+    return SIMD_SCALAR;
+
+  // AVX state must be enabled by the OS (OSXSAVE + AVX, XCR0 XMM|YMM)
+  if (!(anRegs[2] & (1u << 27)) || !(anRegs[2] & (1u << 28)) || nMaxLeaf < 7)
+    return SIMD_SSE2;
+
+  nXCR0 = xgetbv();
+  if ((nXCR0 & 0x06) != 0x06)
+    return SIMD_SSE2;
+
+  cpuid(7, 0, anRegs);
+  if (!(anRegs[1] & (1u << 5)))               // AVX2
+    return SIMD_SSE2;
+
+  // AVX-512F + AVX-512BW, XCR0 opmask|ZMM_Hi256|Hi16_ZMM
+  if ((anRegs[1] & (1u << 16)) && (anRegs[1] & (1u << 30)) && (nXCR0 & 0xE0) == 0xE0)
+    return SIMD_AVX512BW;
+
+  return SIMD_AVX2;
+}
+
+#else
+
+static SIMD_LEVEL detectSimdLevel()
+{
+  return SIMD_SCALAR;
+}
+
+#endif
+
+static const SIMD_LEVEL nSimdLevel = detectSimdLevel();
+static const NARROW_KERNEL pfnNarrow = getNarrowKernel(nSimdLevel);
+static const SCALE_KERNEL pfnScale = getScaleKernel(nSimdLevel);
+static const INTERLEAVE_KERNEL pfnInterleave = getInterleaveKernel(nSimdLevel);
+static const SCALE_CHANNELS_KERNEL pfnScaleChannels = getScaleChannelsKernel(nSimdLevel);
+static const ACCUMULATE_KERNEL pfnAccumulate = getAccumulateKernel(nSimdLevel);
+static const DELTA_KERNEL pfnDelta = getDeltaKernel(nSimdLevel);
+static const MOMENTS_KERNEL pfnMoments = getMomentsKernel(nSimdLevel);
+static const FIND_ABOVE_KERNEL pfnFindAbove = getFindAboveKernel(nSimdLevel);
+static const RANGE_KERNEL pfnRange = getRangeKernel(nSimdLevel);
+static const RANGE_FLOAT_KERNEL pfnRangeFloat = getRangeFloatKernel(nSimdLevel);
+
+SIMD_LEVEL getSimdLevel()
+{
+  return nSimdLevel;
+}
+
+NARROW_KERNEL getNarrowKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return narrowSSE2;
+    case SIMD_AVX2:
+      return narrowAVX2;
+    case SIMD_AVX512BW:
+      return narrowAVX512BW;
+#endif
+    case SIMD_SCALAR:
+      return narrowScalar;
+    default:
+      return NULL;
+  }
+}
+
+void narrowInt16ToInt8(const int16_t *pnSrc, int8_t *pcDst, size_t nCount)
+{
+  pfnNarrow(pnSrc, pcDst, nCount);
+}
+
+SCALE_KERNEL getScaleKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return scaleSSE2;
+    case SIMD_AVX2:
+      return scaleAVX2;
+    case SIMD_AVX512BW:
+      return scaleAVX512BW;
+#endif
+    case SIMD_SCALAR:
+      return scaleScalar;
+    default:
+      return NULL;
+  }
+}
+
+void scaleInt16ToFloat(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset)
+{
+  pfnScale(pnSrc, pfDst, nCount, fGain, fOffset);
+}
+
+INTERLEAVE_KERNEL getInterleaveKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+    case SIMD_AVX2:
+    case SIMD_AVX512BW:
+      return interleaveSSE2;
+#endif
+    case SIMD_SCALAR:
+      return interleaveScalar;
+    default:
+      return NULL;
+  }
+}
+
+void interleaveInt16(const int16_t *const *ppnSrc, int32_t nChannels, int16_t *pnDst, size_t nCount)
+{
+  pfnInterleave(ppnSrc, nChannels, pnDst, nCount);
+}
+
+SCALE_CHANNELS_KERNEL getScaleChannelsKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return scaleChannelsSSE2;
+    case SIMD_AVX2:
+      return scaleChannelsAVX2;
+    case SIMD_AVX512BW:
+      return scaleChannelsAVX512BW;
+#endif
+    case SIMD_SCALAR:
+      return scaleChannelsScalar;
+    default:
+      return NULL;
+  }
+}
+
+void scaleInt16ToFloatChannels(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels)
+{
+  pfnScaleChannels(pnSrc, pfDst, nCount, pfGain, pfOffset, nChannels);
+}
+
+ACCUMULATE_KERNEL getAccumulateKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return accumulateSSE2;
+    case SIMD_AVX2:
+      return accumulateAVX2;
+    case SIMD_AVX512BW:
+      return accumulateAVX512BW;
+#endif
+    case SIMD_SCALAR:
+      return accumulateScalar;
+    default:
+      return NULL;
+  }
+}
+
+void accumulateInt16(const int16_t *pnSrc, int32_t *pnSum, size_t nCount)
+{
+  pfnAccumulate(pnSrc, pnSum, nCount);
+}
+
+DELTA_KERNEL getDeltaKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return deltaSSE2;
+    case SIMD_AVX2:
+    case SIMD_AVX512BW:
+      return deltaAVX2;
+#endif
+    case SIMD_SCALAR:
+      return deltaScalar;
+    default:
+      return NULL;
+  }
+}
+
+uint16_t deltaInt16(const int16_t *pnSrc, const int16_t *pnPrev, uint16_t *pnDst, size_t nCount)
+{
+  return pfnDelta(pnSrc, pnPrev, pnDst, nCount);
+}
+
+MOMENTS_KERNEL getMomentsKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return momentsSSE2;
+    case SIMD_AVX2:
+    case SIMD_AVX512BW:
+      return momentsAVX2;
+#endif
+    case SIMD_SCALAR:
+      return momentsScalar;
+    default:
+      return NULL;
+  }
+}
+
+void momentsFloat(const float *pfSrc, size_t nCount, double *plfSum, double *plfSumSquares)
+{
+  pfnMoments(pfSrc, nCount, plfSum, plfSumSquares);
+}
+
+FIND_ABOVE_KERNEL getFindAboveKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return findAboveSSE2;
+    case SIMD_AVX2:
+    case SIMD_AVX512BW:
+      return findAboveAVX2;
+#endif
+    case SIMD_SCALAR:
+      return findAboveScalar;
+    default:
+      return NULL;
+  }
+}
+
+size_t findAboveFloat(const float *pfSrc, size_t nCount, float fLevel)
+{
+  return pfnFindAbove(pfSrc, nCount, fLevel);
+}
+
+RANGE_KERNEL getRangeKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return rangeSSE2;
+    case SIMD_AVX2:
+    case SIMD_AVX512BW:
+      return rangeAVX2;
+#endif
+    case SIMD_SCALAR:
+      return rangeScalar;
+    default:
+      return NULL;
+  }
+}
+
+void rangeInt16(const int16_t *pnSrc, size_t nCount, int16_t *pnMin, int16_t *pnMax)
+{
+  pfnRange(pnSrc, nCount, pnMin, pnMax);
+}
+
+RANGE_FLOAT_KERNEL getRangeFloatKernel(SIMD_LEVEL nLevel)
+{
+  if (nLevel > getSimdLevel())
+    return NULL;
+
+  switch (nLevel)
+  {
+#ifdef CONVERT_X86
+    case SIMD_SSE2:
+      return rangeFloatSSE2;
+    case SIMD_AVX2:
+    case SIMD_AVX512BW:
+      return rangeFloatAVX2;
+#endif
+    case SIMD_SCALAR:
+      return rangeFloatScalar;
+    default:
+      return NULL;
+  }
+}
+
+void rangeFloat(const float *pfSrc, size_t nCount, float *pfMin, float *pfMax)
+{
+  pfnRangeFloat(pfSrc, nCount, pfMin, pfMax);
+}
+
+/* Column bounds are worked out in 64 bit, nSamples * nWidth overflows size_t on 32 bit builds */
+
+void envelopeInt16(const int16_t *pnSrc, size_t nSamples, int32_t nWidth, int16_t *pnDst)
+{
+  for (int32_t x = 0; x < nWidth; x++)
+  {
+    size_t nBegin = (size_t)((uint64_t)x * nSamples / nWidth);
+    size_t nEnd = (size_t)((uint64_t)(x + 1) * nSamples / nWidth);
+
+    pfnRange(pnSrc + nBegin, nEnd - nBegin, &pnDst[2 * x], &pnDst[2 * x + 1]);
+  }
+}
+
+void envelopeFloat(const float *pfSrc, size_t nSamples, int32_t nWidth, float *pfDst)
+{
+  for (int32_t x = 0; x < nWidth; x++)
+  {
+    size_t nBegin = (size_t)((uint64_t)x * nSamples / nWidth);
+    size_t nEnd = (size_t)((uint64_t)(x + 1) * nSamples / nWidth);
+
+    pfnRangeFloat(pfSrc + nBegin, nEnd - nBegin, &pfDst[2 * x], &pfDst[2 * x + 1]);
+  }
+}
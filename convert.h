@@ -0,0 +1,172 @@
+#ifndef _PS6000_CONVERT_H_
+#define _PS6000_CONVERT_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86
+#endif
+
+typedef enum {
+  SIMD_SCALAR = 0,
+  SIMD_SSE2,
+  SIMD_AVX2,
+  SIMD_AVX512BW,
+  SIMD_MAX_LEVELS
+} SIMD_LEVEL;
+
+typedef void (*NARROW_KERNEL)(const int16_t *pnSrc, int8_t *pcDst, size_t nCount);
+typedef void (*SCALE_KERNEL)(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset);
+typedef void (*INTERLEAVE_KERNEL)(const int16_t *const *ppnSrc, int32_t nChannels, int16_t *pnDst, size_t nCount);
+typedef void (*SCALE_CHANNELS_KERNEL)(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels);
+typedef void (*ACCUMULATE_KERNEL)(const int16_t *pnSrc, int32_t *pnSum, size_t nCount);
+typedef uint16_t (*DELTA_KERNEL)(const int16_t *pnSrc, const int16_t *pnPrev, uint16_t *pnDst, size_t nCount);
+typedef void (*MOMENTS_KERNEL)(const float *pfSrc, size_t nCount, double *plfSum, double *plfSumSquares);
+typedef size_t (*FIND_ABOVE_KERNEL)(const float *pfSrc, size_t nCount, float fLevel);
+typedef void (*RANGE_KERNEL)(const int16_t *pnSrc, size_t nCount, int16_t *pnMin, int16_t *pnMax);
+typedef void (*RANGE_FLOAT_KERNEL)(const float *pfSrc, size_t nCount, float *pfMin, float *pfMax);
+
+#define CONVERT_MAX_CHANNELS        8           // Four channels, or their max/min planes when aggregating
+
+/**
+ * @desc Best instruction set supported by this CPU and OS (detected once at load time)
+ */
+SIMD_LEVEL getSimdLevel();
+
+/**
+ * @desc Get int16 -> int8 narrowing kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+NARROW_KERNEL getNarrowKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Keep upper byte of each driver sample (pcDst[i] = pnSrc[i] >> 8), using the
+ *       fastest kernel available
+ */
+void narrowInt16ToInt8(const int16_t *pnSrc, int8_t *pcDst, size_t nCount);
+
+/**
+ * @desc Get int16 -> float32 scaling kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+SCALE_KERNEL getScaleKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Convert driver samples to calibrated values (pfDst[i] = pnSrc[i] * fGain + fOffset)
+ *       in one pass, using the fastest kernel available
+ */
+void scaleInt16ToFloat(const int16_t *pnSrc, float *pfDst, size_t nCount, float fGain, float fOffset);
+
+/**
+ * @desc Get planar -> channel-minor int16 interleaving kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+INTERLEAVE_KERNEL getInterleaveKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Interleave nChannels planar inputs of nCount samples each
+ *       (pnDst[i * nChannels + c] = ppnSrc[c][i]), 1 to CONVERT_MAX_CHANNELS channels
+ */
+void interleaveInt16(const int16_t *const *ppnSrc, int32_t nChannels, int16_t *pnDst, size_t nCount);
+
+/**
+ * @desc Get channel-minor int16 -> float32 scaling kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+SCALE_CHANNELS_KERNEL getScaleChannelsKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Scale interleaved samples with a gain and offset per channel
+ *       (pfDst[i] = pnSrc[i] * pfGain[i % nChannels] + pfOffset[i % nChannels]).
+ *       nCount is the total number of samples, a multiple of nChannels.
+ */
+void scaleInt16ToFloatChannels(const int16_t *pnSrc, float *pfDst, size_t nCount, const float *pfGain, const float *pfOffset, int32_t nChannels);
+
+/**
+ * @desc Get int16 -> int32 accumulation kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+ACCUMULATE_KERNEL getAccumulateKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Add driver samples to running sums (pnSum[i] += pnSrc[i]), using the fastest
+ *       kernel available. Up to 65536 additions per sum cannot overflow.
+ */
+void accumulateInt16(const int16_t *pnSrc, int32_t *pnSum, size_t nCount);
+
+/**
+ * @desc Get int16 difference kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+DELTA_KERNEL getDeltaKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Zigzag mapped differences (d = pnSrc[i] - pnPrev[i] wrapped to int16,
+ *       pnDst[i] = (d << 1) ^ (d >> 15)), using the fastest kernel available
+ * @return OR of all pnDst values, the bits a packer has to keep
+ */
+uint16_t deltaInt16(const int16_t *pnSrc, const int16_t *pnPrev, uint16_t *pnDst, size_t nCount);
+
+/**
+ * @desc Get float32 sum and sum of squares kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+MOMENTS_KERNEL getMomentsKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Sum and sum of squares of nCount samples, accumulated in double, using the
+ *       fastest kernel available. Exact for integer samples, otherwise the order of
+ *       the additions differs between kernels.
+ */
+void momentsFloat(const float *pfSrc, size_t nCount, double *plfSum, double *plfSumSquares);
+
+/**
+ * @desc Get float32 threshold search kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+FIND_ABOVE_KERNEL getFindAboveKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Index of the first sample greater than fLevel, using the fastest kernel available
+ * @return nCount if there is none
+ */
+size_t findAboveFloat(const float *pfSrc, size_t nCount, float fLevel);
+
+/**
+ * @desc Get int16 min / max kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+RANGE_KERNEL getRangeKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Smallest and largest of nCount driver samples, using the fastest kernel
+ *       available. INT16_MAX and INT16_MIN for no samples.
+ */
+void rangeInt16(const int16_t *pnSrc, size_t nCount, int16_t *pnMin, int16_t *pnMax);
+
+/**
+ * @desc Get float32 min / max kernel of given level
+ * @return Kernel, NULL if level is not supported on this machine
+ */
+RANGE_FLOAT_KERNEL getRangeFloatKernel(SIMD_LEVEL nLevel);
+
+/**
+ * @desc Smallest and largest of nCount float32 samples, using the fastest kernel
+ *       available. FLT_MAX and -FLT_MAX for no samples.
+ */
+void rangeFloat(const float *pfSrc, size_t nCount, float *pfMin, float *pfMax);
+
+/**
+ * @desc Min / max envelope of a waveform nWidth columns wide. Column x covers samples
+ *       [x * nSamples / nWidth, (x + 1) * nSamples / nWidth), pnDst gets min and max
+ *       of every column in turn. nWidth must not exceed nSamples.
+ */
+void envelopeInt16(const int16_t *pnSrc, size_t nSamples, int32_t nWidth, int16_t *pnDst);
+
+/**
+ * @desc Float32 counterpart of envelopeInt16
+ */
+void envelopeFloat(const float *pfSrc, size_t nSamples, int32_t nWidth, float *pfDst);
+
+#endif
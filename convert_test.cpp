@@ -0,0 +1,240 @@
+/*
+ * Checks every SIMD kernel this machine supports against the scalar one,
+ * bit for bit, on random samples and on the values the kernels saturate,
+ * shift or compare at. Lengths cover empty input and every tail a kernel
+ * can leave behind its vector loop.
+ *
+ *   npm run test:convert
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "convert.h"
+
+static const int16_t anEdge[] = {INT16_MIN, INT16_MIN + 1, -32512, -256, -255, -129, -128, -1, 0, 1, 127, 128, 255, 256, 32512, INT16_MAX - 1, INT16_MAX};
+static const size_t anLength[] = {0, 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 255, 257, 1000, 1031, 4099};
+static const char *aszLevel[SIMD_MAX_LEVELS] = {"scalar", "SSE2", "AVX2", "AVX-512BW"};
+
+static uint32_t nRandom = 0x12345678;
+static int32_t nFailures = 0;
+
+static uint32_t nextRandom()
+{
+  nRandom ^= nRandom << 13;
+  nRandom ^= nRandom >> 17;
+  nRandom ^= nRandom << 5;
+
+  return nRandom;
+}
+
+/* Random samples with every edge value sprinkled in, edges only when bEdges */
+
+static void fillSamples(int16_t *pnDst, size_t nCount, bool bEdges)
+{
+  const size_t nEdges = sizeof(anEdge) / sizeof(anEdge[0]);
+
+  for (size_t i = 0; i < nCount; i++)
+  {
+    if (bEdges || nextRandom() % 4 == 0)
+      pnDst[i] = anEdge[nextRandom() % nEdges];
+    else
+      pnDst[i] = (int16_t)nextRandom();
+  }
+}
+
+static void check(bool bEqual, const char *pszKernel, SIMD_LEVEL nLevel, size_t nCount, int32_t nChannels)
+{
+  if (bEqual)
+    return;
+
+  printf("FAIL %s %s, %u samples, %d channels\n", pszKernel, aszLevel[nLevel], (unsigned)nCount, nChannels);
+  nFailures++;
+}
+
+static void testNarrow(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<int8_t> acExpected(nCount + 1), acActual(nCount + 1);
+
+  getNarrowKernel(SIMD_SCALAR)(pnSrc, acExpected.data(), nCount);
+  getNarrowKernel(nLevel)(pnSrc, acActual.data(), nCount);
+  check(memcmp(acExpected.data(), acActual.data(), nCount) == 0, "narrow", nLevel, nCount, 1);
+}
+
+static void testScale(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<float> afExpected(nCount + 1), afActual(nCount + 1);
+
+  getScaleKernel(SIMD_SCALAR)(pnSrc, afExpected.data(), nCount, 1.5377e-4f, -0.25f);
+  getScaleKernel(nLevel)(pnSrc, afActual.data(), nCount, 1.5377e-4f, -0.25f);
+  check(memcmp(afExpected.data(), afActual.data(), nCount * sizeof(float)) == 0, "scale", nLevel, nCount, 1);
+}
+
+static void testInterleave(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  for (int32_t nChannels = 1; nChannels <= CONVERT_MAX_CHANNELS; nChannels++)
+  {
+    const int16_t *apnPlane[CONVERT_MAX_CHANNELS];
+    std::vector<int16_t> anPlanes(nCount * nChannels + 1);
+    std::vector<int16_t> anExpected(nCount * nChannels + 1), anActual(nCount * nChannels + 1);
+
+    // First channel is the shared input, the others get samples of their own
+    fillSamples(anPlanes.data(), nCount * nChannels, false);
+    apnPlane[0] = pnSrc;
+    for (int32_t c = 1; c < nChannels; c++)
+      apnPlane[c] = anPlanes.data() + c * nCount;
+
+    getInterleaveKernel(SIMD_SCALAR)(apnPlane, nChannels, anExpected.data(), nCount);
+    getInterleaveKernel(nLevel)(apnPlane, nChannels, anActual.data(), nCount);
+    check(memcmp(anExpected.data(), anActual.data(), nCount * nChannels * sizeof(int16_t)) == 0, "interleave", nLevel, nCount, nChannels);
+  }
+}
+
+static void testScaleChannels(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  const float afGain[CONVERT_MAX_CHANNELS] = {1.5377e-4f, 3.0754e-4f, 7.6885e-5f, 1.0f, -2.5e-3f, 6.1e-5f, 0.5f, 3.0e-2f};
+  const float afOffset[CONVERT_MAX_CHANNELS] = {0.0f, -0.25f, 0.125f, 1.0f, -3.0f, 0.0f, 2.5f, -0.5f};
+
+  for (int32_t nChannels = 1; nChannels <= CONVERT_MAX_CHANNELS; nChannels++)
+  {
+    size_t nValues = nCount / nChannels * nChannels;
+    std::vector<float> afExpected(nValues + 1), afActual(nValues + 1);
+
+    getScaleChannelsKernel(SIMD_SCALAR)(pnSrc, afExpected.data(), nValues, afGain, afOffset, nChannels);
+    getScaleChannelsKernel(nLevel)(pnSrc, afActual.data(), nValues, afGain, afOffset, nChannels);
+    check(memcmp(afExpected.data(), afActual.data(), nValues * sizeof(float)) == 0, "scaleChannels", nLevel, nValues, nChannels);
+  }
+}
+
+static void testAccumulate(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<int32_t> anExpected(nCount + 1), anActual(nCount + 1);
+
+  // Start from sums that are already large, as after many segments
+  for (size_t i = 0; i < nCount; i++)
+    anExpected[i] = anActual[i] = (int32_t)(nextRandom() % 0x40000000) - 0x20000000;
+
+  getAccumulateKernel(SIMD_SCALAR)(pnSrc, anExpected.data(), nCount);
+  getAccumulateKernel(nLevel)(pnSrc, anActual.data(), nCount);
+  check(memcmp(anExpected.data(), anActual.data(), nCount * sizeof(int32_t)) == 0, "accumulate", nLevel, nCount, 1);
+}
+
+static void testDelta(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<int16_t> anPrev(nCount + 1);
+  std::vector<uint16_t> anExpected(nCount + 1), anActual(nCount + 1);
+  uint16_t nExpectedBits, nActualBits;
+
+  fillSamples(anPrev.data(), nCount, false);
+
+  nExpectedBits = getDeltaKernel(SIMD_SCALAR)(pnSrc, anPrev.data(), anExpected.data(), nCount);
+  nActualBits = getDeltaKernel(nLevel)(pnSrc, anPrev.data(), anActual.data(), nCount);
+  check(nExpectedBits == nActualBits && memcmp(anExpected.data(), anActual.data(), nCount * sizeof(uint16_t)) == 0, "delta", nLevel, nCount, 1);
+}
+
+static void testMoments(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<float> afSrc(nCount + 1);
+  double lfExpectedSum, lfExpectedSquares, lfActualSum, lfActualSquares;
+
+  // Integer samples, where the sums do not depend on the order of the additions
+  for (size_t i = 0; i < nCount; i++)
+    afSrc[i] = pnSrc[i];
+
+  getMomentsKernel(SIMD_SCALAR)(afSrc.data(), nCount, &lfExpectedSum, &lfExpectedSquares);
+  getMomentsKernel(nLevel)(afSrc.data(), nCount, &lfActualSum, &lfActualSquares);
+  check(lfExpectedSum == lfActualSum && lfExpectedSquares == lfActualSquares, "moments", nLevel, nCount, 1);
+}
+
+static void testFindAbove(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<float> afSrc(nCount + 1);
+
+  for (size_t i = 0; i < nCount; i++)
+    afSrc[i] = pnSrc[i];
+
+  // Levels above everything, at an edge value and below everything
+  for (int32_t e = -1; e <= (int32_t)(sizeof(anEdge) / sizeof(anEdge[0])); e++)
+  {
+    float fLevel = e < 0 ? -40000.0f : e == (int32_t)(sizeof(anEdge) / sizeof(anEdge[0])) ? 40000.0f : anEdge[e];
+
+    check(getFindAboveKernel(SIMD_SCALAR)(afSrc.data(), nCount, fLevel) == getFindAboveKernel(nLevel)(afSrc.data(), nCount, fLevel), "findAbove", nLevel, nCount, 1);
+  }
+}
+
+static void testRange(SIMD_LEVEL nLevel, const int16_t *pnSrc, size_t nCount)
+{
+  std::vector<float> afSrc(nCount + 1);
+  int16_t nExpectedMin, nExpectedMax, nActualMin, nActualMax;
+  float fExpectedMin, fExpectedMax, fActualMin, fActualMax;
+
+  getRangeKernel(SIMD_SCALAR)(pnSrc, nCount, &nExpectedMin, &nExpectedMax);
+  getRangeKernel(nLevel)(pnSrc, nCount, &nActualMin, &nActualMax);
+  check(nExpectedMin == nActualMin && nExpectedMax == nActualMax, "range", nLevel, nCount, 1);
+
+  for (size_t i = 0; i < nCount; i++)
+    afSrc[i] = pnSrc[i] * 0.37f;
+
+  getRangeFloatKernel(SIMD_SCALAR)(afSrc.data(), nCount, &fExpectedMin, &fExpectedMax);
+  getRangeFloatKernel(nLevel)(afSrc.data(), nCount, &fActualMin, &fActualMax);
+  check(fExpectedMin == fActualMin && fExpectedMax == fActualMax, "rangeFloat", nLevel, nCount, 1);
+}
+
+static bool hasAllKernels(SIMD_LEVEL nLevel)
+{
+  return getNarrowKernel(nLevel) && getScaleKernel(nLevel) && getInterleaveKernel(nLevel) &&
+    getScaleChannelsKernel(nLevel) && getAccumulateKernel(nLevel) && getDeltaKernel(nLevel) &&
+    getMomentsKernel(nLevel) && getFindAboveKernel(nLevel) && getRangeKernel(nLevel) && getRangeFloatKernel(nLevel);
+}
+
+int main()
+{
+  SIMD_LEVEL nBest = getSimdLevel();
+
+  printf("Best level: %s\n", aszLevel[nBest]);
+
+  for (int32_t l = SIMD_SCALAR; l < SIMD_MAX_LEVELS; l++)
+  {
+    SIMD_LEVEL nLevel = (SIMD_LEVEL)l;
+
+    // Supported levels have every kernel, the others none
+    if (hasAllKernels(nLevel) != (nLevel <= nBest) || (nLevel > nBest && getNarrowKernel(nLevel)))
+    {
+      printf("FAIL %s kernels %s\n", aszLevel[nLevel], nLevel <= nBest ? "missing" : "returned");
+      nFailures++;
+    }
+  }
+
+  for (int32_t l = SIMD_SSE2; l <= nBest; l++)
+  {
+    SIMD_LEVEL nLevel = (SIMD_LEVEL)l;
+
+    for (size_t n = 0; n < sizeof(anLength) / sizeof(anLength[0]); n++)
+    {
+      for (int32_t nPass = 0; nPass < 2; nPass++)
+      {
+        size_t nCount = anLength[n];
+        std::vector<int16_t> anSrc(nCount + 1);
+
+        fillSamples(anSrc.data(), nCount, nPass == 1);
+
+        testNarrow(nLevel, anSrc.data(), nCount);
+        testScale(nLevel, anSrc.data(), nCount);
+        testInterleave(nLevel, anSrc.data(), nCount);
+        testScaleChannels(nLevel, anSrc.data(), nCount);
+        testAccumulate(nLevel, anSrc.data(), nCount);
+        testDelta(nLevel, anSrc.data(), nCount);
+        testMoments(nLevel, anSrc.data(), nCount);
+        testFindAbove(nLevel, anSrc.data(), nCount);
+        testRange(nLevel, anSrc.data(), nCount);
+      }
+    }
+
+    printf("%s: checked\n", aszLevel[nLevel]);
+  }
+
+  printf(nFailures ? "%d failures\n" : "All kernels match the scalar reference\n", nFailures);
+
+  return nFailures ? 1 : 0;
+}
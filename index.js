@@ -1,72 +1,380 @@
 'use strict'
 
+const { Readable } = require('stream')
 const picoscope = require('./build/release/node-ps6000')
 
 const PICO_STATUS = picoscope.PICO_STATUS
 const PS6000_COUPLING = picoscope.PS6000_COUPLING
 const PS6000_BANDWIDTH_LIMITER = picoscope.PS6000_BANDWIDTH_LIMITER
 const PS6000_RANGE = picoscope.PS6000_RANGE
+const OUTPUT_FORMAT = picoscope.OUTPUT_FORMAT
+const DATA_LAYOUT = picoscope.DATA_LAYOUT
+const PS6000_RATIO_MODE = picoscope.PS6000_RATIO_MODE
 
-function open() {
+/**
+ * List serial numbers of the connected units that are not opened yet
+ */
+function enumerate() {
   return new Promise((resolve, reject) => {
-    picoscope.open((result) => {
-      resolve(result)
+    picoscope.enumerateUnits((result, serials) => {
+      if (result !== PICO_STATUS.PICO_OK && result !== PICO_STATUS.PICO_NOT_FOUND) {
+        reject(new Error(PICO_STATUS.toString(result)))
+        return
+      }
+      resolve(serials)
     })
   })
 }
 
-function close() {
-  return new Promise((resolve, reject) => {
-    picoscope.close((result) => {
-      resolve(result)
+/**
+ * One PicoScope unit. Every instance owns its own driver handle, configuration,
+ * capture buffers and completion queues, so several units can run side by side.
+ */
+class Device {
+  /**
+   * @param serial Serial number as returned by enumerate(), first unit found if omitted
+   */
+  constructor(serial) {
+    this.native = serial ? new picoscope.Device(serial) : new picoscope.Device()
+    this.serial = serial || null
+  }
+
+  /**
+   * Open the unit without blocking the event loop. Firmware loads one unit at
+   * a time, while another unit is starting this open waits for up to 20 s.
+   * @param onProgress Optional, called with the percentage while firmware loads
+   */
+  open(onProgress) {
+    return new Promise((resolve, reject) => {
+      this.native.open((result) => {
+        resolve(result)
+      }, onProgress)
+    })
+  }
+
+  close() {
+    return new Promise((resolve, reject) => {
+      this.native.close((result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  setOption(option) {
+    return new Promise((resolve, reject) => {
+      this.native.setOption(option, (result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  setDigitizer(bRepeatedSetting) {
+    return new Promise((resolve, reject) => {
+      this.native.setDigitizer(bRepeatedSetting, (result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  doAcquisition(bIsISR) {
+    return new Promise((resolve, reject) => {
+      this.native.doAcquisition(bIsISR, (result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  waitAcquisition() {
+    return new Promise((resolve, reject) => {
+      this.native.waitAcquisition((result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  fetchData(bIsISR, layout) {
+    return new Promise((resolve, reject) => {
+      this.native.fetchData(bIsISR, layout || DATA_LAYOUT.DATA_LAYOUT_PLANAR, (result, data, triggerTimes, segments, preview) => {
+        resolve({result: result, data: data, triggerTimes: triggerTimes, segments: segments, preview: preview})
+      })
+    })
+  }
+
+  startPipeline(onBatch, layout) {
+    return new Promise((resolve, reject) => {
+      this.native.startPipeline((result, data, sequence, firstSegment, segmentCount, last, segments, preview) => {
+        onBatch({result: result, data: data, sequence: sequence, firstSegment: firstSegment, segmentCount: segmentCount, last: last, segments: segments, preview: preview})
+      }, layout || DATA_LAYOUT.DATA_LAYOUT_PLANAR, (result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  /**
+   * Arm one rapid block run and hand over segments while later ones are still
+   * capturing. Resolves with the final status once every segment was delivered
+   * (or the run failed).
+   */
+  fetchProgressive(onSegments, layout) {
+    return new Promise((resolve, reject) => {
+      this.native.startProgressive((result, data, sequence, firstSegment, segmentCount, last, segments, preview) => {
+        if (data.length > 0 || preview) {
+          onSegments({result: result, data: data, sequence: sequence, firstSegment: firstSegment, segmentCount: segmentCount, segments: segments, preview: preview})
+        }
+        if (last) {
+          this.native.stopPipeline(() => {
+            resolve(result)
+          })
+        }
+      }, layout || DATA_LAYOUT.DATA_LAYOUT_PLANAR, (result) => {
+        if (result !== PICO_STATUS.PICO_OK) {
+          resolve(result)
+        }
+      })
+    })
+  }
+
+  stopPipeline() {
+    return new Promise((resolve, reject) => {
+      this.native.stopPipeline((result) => {
+        resolve(result)
+      })
     })
+  }
+
+  createStream(options) {
+    return new ScopeStream(this.native, options)
+  }
+
+  /**
+   * Write every following readout natively to a file, int16 planes behind
+   * a fixed header. Call after setDigitizer(false).
+   * @param path File to create
+   * @param recordOnly Skip the conversion, readouts deliver empty data
+   * @param compress Pack the planes losslessly, openRecording unpacks them
+   */
+  startRecording(path, recordOnly, compress) {
+    return new Promise((resolve, reject) => {
+      this.native.startRecording(path, !!recordOnly, !!compress, (result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  stopRecording() {
+    return new Promise((resolve, reject) => {
+      this.native.stopRecording((result) => {
+        resolve(result)
+      })
+    })
+  }
+
+  getScopeDataList() {
+    return new Promise((resolve, reject) => {
+      this.native.getScopeDataList((result, list) => {
+        resolve(list)
+      })
+    })
+  }
+}
+
+/**
+ * Continuous streaming of channel A as a Readable of raw sample Buffers in the
+ * configured output format. Samples wait in the native ring while the consumer
+ * is slow; once the ring is full new samples are dropped and counted in
+ * getScopeDataList().nStreamDropped.
+ */
+class ScopeStream extends Readable {
+  constructor(scope, options) {
+    options = options || {}
+    super({highWaterMark: options.highWaterMark || 4 * 1024 * 1024})
+    this.scope = scope
+    this.maxSamples = options.maxSamples || 65536
+    this.started = false
+    this.waiting = false
+  }
+
+  _read() {
+    if (!this.started) {
+      this.started = true
+      this.scope.startStreaming(() => {
+        if (this.waiting) {
+          this.waiting = false
+          this._drainRing()
+        }
+      }, (result) => {
+        if (result !== PICO_STATUS.PICO_OK) {
+          this.destroy(new Error(PICO_STATUS.toString(result)))
+          return
+        }
+        this._drainRing()
+      })
+      return
+    }
+    this._drainRing()
+  }
+
+  _drainRing() {
+    for (;;) {
+      let chunk = this.scope.readStreaming(this.maxSamples)
+      if (chunk.result !== PICO_STATUS.PICO_OK && chunk.data.length === 0) {
+        this.destroy(new Error(PICO_STATUS.toString(chunk.result)))
+        return
+      }
+      if (chunk.data.length === 0) {
+        if (chunk.active) {
+          // Resumed by the native notification
+          this.waiting = true
+        } else {
+          this.push(null)
+        }
+        return
+      }
+      // Stop pulling when the consumer is behind, the ring keeps buffering
+      if (!this.push(chunk.data)) {
+        return
+      }
+    }
+  }
+
+  _destroy(err, callback) {
+    if (!this.started) {
+      callback(err)
+      return
+    }
+    this.scope.stopStreaming(() => {
+      callback(err)
+    })
+  }
+
+  stop() {
+    return new Promise((resolve, reject) => {
+      this.scope.stopStreaming((result) => {
+        resolve(result)
+      })
+    })
+  }
+}
+
+// Module level calls drive the first unit found, as before Device existed
+let defaultDevice = null
+
+function getDefaultDevice() {
+  if (!defaultDevice) {
+    defaultDevice = new Device()
+  }
+  return defaultDevice
+}
+
+function open(onProgress) {
+  return getDefaultDevice().open(onProgress)
+}
+
+/**
+ * Open several units one after another. The driver loads firmware into one
+ * unit at a time, so each open waits for the one before it instead of
+ * spending its own timeout on it.
+ * @param serials Serial numbers, every unit enumerate() finds if omitted
+ * @param onProgress Optional, called with (serial, percentage) while firmware loads
+ * @return [{serial, device, result}] in the order of serials
+ */
+function openAll(serials, onProgress) {
+  let listed = serials ? Promise.resolve(serials) : enumerate()
+
+  return listed.then((list) => {
+    let opened = []
+
+    return list.reduce((previous, serial) => {
+      return previous.then(() => {
+        let device = new Device(serial)
+
+        return device.open(onProgress ? (percent) => onProgress(serial, percent) : undefined).then((result) => {
+          opened.push({serial: serial, device: device, result: result})
+        })
+      })
+    }, Promise.resolve()).then(() => opened)
   })
 }
 
+function close() {
+  return getDefaultDevice().close()
+}
+
 function setOption(option) {
-  return new Promise((resolve, reject) => {
-    picoscope.setOption(option)
-    resolve()
-  })
+  return getDefaultDevice().setOption(option)
 }
 
 function setDigitizer(bRepeatedSetting) {
-  return new Promise((resolve, reject) => {
-    picoscope.setDigitizer(bRepeatedSetting, (result) => {
-      resolve(result)
-    })
-  })
+  return getDefaultDevice().setDigitizer(bRepeatedSetting)
 }
 
 function doAcquisition(bIsISR) {
-  return new Promise((resolve, reject) => {
-    picoscope.doAcquisition(bIsISR, (result) => {
-      resolve(result)
-    })
-  })
+  return getDefaultDevice().doAcquisition(bIsISR)
 }
 
 function waitAcquisition() {
-  return new Promise((resolve, reject) => {
-    picoscope.waitAcquisition((result) => {
-      resolve(result)
-    })
-  })
+  return getDefaultDevice().waitAcquisition()
 }
 
-function fetchData(bIsISR) {
-  return new Promise((resolve, reject) => {
-    picoscope.fetchData(bIsISR, (result, data) => {
-      resolve({result: result, data: data})
-    })
-  })
+function fetchData(bIsISR, layout) {
+  return getDefaultDevice().fetchData(bIsISR, layout)
+}
+
+function startPipeline(onBatch, layout) {
+  return getDefaultDevice().startPipeline(onBatch, layout)
+}
+
+function fetchProgressive(onSegments, layout) {
+  return getDefaultDevice().fetchProgressive(onSegments, layout)
+}
+
+function stopPipeline() {
+  return getDefaultDevice().stopPipeline()
+}
+
+function createStream(options) {
+  return getDefaultDevice().createStream(options)
 }
 
 function getScopeDataList() {
-  return new Promise((resolve, reject) => {
-    let data = picoscope.getScopeDataList()
-    resolve(data)
-  })
+  return getDefaultDevice().getScopeDataList()
+}
+
+function startRecording(path, recordOnly, compress) {
+  return getDefaultDevice().startRecording(path, recordOnly, compress)
+}
+
+function stopRecording() {
+  return getDefaultDevice().stopRecording()
+}
+
+/**
+ * Open a file written by startRecording for random access
+ * @param path Recording file
+ * @return Reader with getHeader(), read(firstSegment, segmentCount) and close()
+ */
+function openRecording(path) {
+  return new picoscope.Reader(path)
+}
+
+/**
+ * Unpack data delivered with the compress option
+ * @param data Buffer from fetchData or a pipeline batch
+ * @param threads Optional, threads unpacking, 1 by default
+ * @return Buffer as delivered without compress
+ */
+function decompress(data, threads) {
+  return threads ? picoscope.decompress(data, threads) : picoscope.decompress(data)
+}
+
+/**
+ * View data delivered with the peaks option as typed arrays, without copying
+ * @param data Buffer from fetchData or a pipeline batch
+ * @return {count, position, height, area, segment, plane}, positions in samples
+ *         from the start of the segment
+ */
+function getPeaks(data) {
+  return picoscope.getPeaks(data)
 }
 
 module.exports = {
@@ -74,12 +382,27 @@ module.exports = {
   PS6000_COUPLING,
   PS6000_BANDWIDTH_LIMITER,
   PS6000_RANGE,
+  OUTPUT_FORMAT,
+  DATA_LAYOUT,
+  PS6000_RATIO_MODE,
+  Device,
+  enumerate,
   open,
+  openAll,
   close,
   setOption,
   setDigitizer,
   doAcquisition,
   waitAcquisition,
   fetchData,
-  getScopeDataList
+  getScopeDataList,
+  startPipeline,
+  stopPipeline,
+  fetchProgressive,
+  createStream,
+  startRecording,
+  stopRecording,
+  openRecording,
+  decompress,
+  getPeaks
 }
@@ -0,0 +1,64 @@
+#include "largebuffer.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <unistd.h>
+  #include <sys/mman.h>
+#endif
+
+#ifndef _WIN32
+static size_t getMappedLength(size_t nLength)
+{
+  size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+
+  return (nLength + nPage - 1) / nPage * nPage;
+}
+#endif
+
+void *allocateLargeBuffer(size_t nLength)
+{
+  if (nLength == 0)
+    return NULL;
+
+#ifdef _WIN32
+  // Large pages need SeLockMemoryPrivilege, plain pages are committed zeroed
+  return VirtualAlloc(NULL, nLength, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  size_t nMapped = getMappedLength(nLength);
+  size_t nReserved = nMapped + LARGE_BUFFER_ALIGNMENT;
+  char *pReserved;
+  char *pBuffer;
+
+  // Over-reserve, then trim both ends so the buffer starts on a huge page boundary
+  pReserved = (char *)mmap(NULL, nReserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pReserved == MAP_FAILED)
+    return NULL;
+
+  pBuffer = (char *)(((uintptr_t)pReserved + LARGE_BUFFER_ALIGNMENT - 1) & ~(uintptr_t)(LARGE_BUFFER_ALIGNMENT - 1));
+
+  if (pBuffer > pReserved)
+    munmap(pReserved, pBuffer - pReserved);
+  if (pReserved + nReserved > pBuffer + nMapped)
+    munmap(pBuffer + nMapped, pReserved + nReserved - (pBuffer + nMapped));
+
+#ifdef MADV_HUGEPAGE
+  // Fewer TLB misses while the driver and the converters stream through it
+  madvise(pBuffer, nMapped, MADV_HUGEPAGE);
+#endif
+
+  return pBuffer;
+#endif
+}
+
+void freeLargeBuffer(void *pBuffer, size_t nLength)
+{
+  if (pBuffer == NULL)
+    return;
+
+#ifdef _WIN32
+  VirtualFree(pBuffer, 0, MEM_RELEASE);
+#else
+  munmap(pBuffer, getMappedLength(nLength));
+#endif
+}
@@ -0,0 +1,23 @@
+#ifndef _PS6000_LARGE_BUFFER_H_
+#define _PS6000_LARGE_BUFFER_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define LARGE_BUFFER_ALIGNMENT      (2 * 1024 * 1024)   // Huge page size on x86-64
+
+/**
+ * @desc Map zeroed memory straight from the OS for capture sized buffers. On Linux
+ *       it is aligned to LARGE_BUFFER_ALIGNMENT and advised for transparent huge
+ *       pages, elsewhere it is plain committed pages.
+ * @return Pointer, NULL on failure
+ */
+void *allocateLargeBuffer(size_t nLength);
+
+/**
+ * @desc Give memory from allocateLargeBuffer back to the OS
+ * @param[in] nLength: Length it was allocated with
+ */
+void freeLargeBuffer(void *pBuffer, size_t nLength);
+
+#endif
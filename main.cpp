@@ -1,4 +1,11 @@
 ﻿#include "main.h"
+#include "largebuffer.h"
+
+// Full scale of each PS6000_RANGE in millivolts
+static const uint16_t anInputRanges[PS6000_MAX_RANGES] = { 10,  20, 50,  100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+
+// Seconds per PS6000_TIME_UNITS step
+static const double alfTimeUnits[PS6000_MAX_TIME_UNITS] = { 1e-15, 1e-12, 1e-9, 1e-6, 1e-3, 1.0 };
 
 PicoScope::PicoScope()
 {
@@ -9,6 +16,8 @@ PicoScope::PicoScope()
   lfAcquisitionRate = DEFAULT_SAMPLE_RATE;
   lfSampleInterval = DEFAULT_SAMPLE_INTERVAL;
   nSegmentOffset = DEFAULT_NUM_SAMPLE;
+  nOutputFormat = DEFAULT_OUTPUT_FORMAT;
+  nDataFormat = DEFAULT_OUTPUT_FORMAT;
   lfDelayTime = DEFAULT_DELAYTIME;
   nFullScale = DEFAULT_VERTICAL_FULLSCALE;
   lfOffset = DEFAULT_VERTICAL_OFFSET;
@@ -16,26 +25,196 @@ PicoScope::PicoScope()
   nBandwidth = DEFAULT_VERTICAL_BANDWIDTH;
   nTbNextSegmentPad = 0;
   nTimeOut = DEFAULT_TIMEOUT;
+  uv_mutex_init(&readyMutex);
+  uv_cond_init(&readyCond);
+  isAcquisitionArmed = false;
+  isAcquisitionReady = false;
+  psReadyStatus = PICO_OK;
+  pReadyNotifier = NULL;
+  nOpenProgress = 0;
+  pOpenNotifier = NULL;
   nBufferLength = 0;
-  // zero initialize pcData
-  for (int32_t i = 0; i < MAXIMUM_BUFFER_LENGTH; i ++)
-  {
-    pcData[i] = 0;
-  }
+  nDataLength = 0;
+  pcData = NULL;
+  plfTriggerTimes = NULL;
+  nTriggerTimes = 0;
+  pnKeptSegments = NULL;
+  nKeptSegments = 0;
+  pfPreview = NULL;
+  nPreviewLength = 0;
+  pBufferPool = new BufferPool();
+  pRecorder = NULL;
+  bRecordOnly = false;
+  anRecordTicket[0] = 0;
+  anRecordTicket[1] = 0;
+  nRecordSequence = 0;
+  memset(&rfHeader, 0, sizeof(RECORD_FILE_HEADER));
+  aprsRecordEntries[0] = NULL;
+  aprsRecordEntries[1] = NULL;
+  plfRecordTimes = NULL;
+  prdRecordDirectory = NULL;
+  nRecordDirectorySize = 0;
+  nRecordOffset = 0;
+  apbRecordPacked[0] = NULL;
+  apbRecordPacked[1] = NULL;
+  nRecordPackedSlot = 0;
+  nRecordPackedSize = 0;
+  nChannelMask = DEFAULT_CHANNEL_MASK;
+  nDataChannelMask = DEFAULT_CHANNEL_MASK;
+  nDataChannels = 1;
+  anDataChannel[0] = PS6000_CHANNEL_A;
+  nDataLayout = DATA_LAYOUT_PLANAR;
+  nDownSampleRatio = 1;
+  nDownSampleMode = PS6000_RATIO_MODE_NONE;
+  nDataRatio = 1;
+  nDataRatioMode = PS6000_RATIO_MODE_NONE;
+  nDataSamples = DEFAULT_NUM_SAMPLE;
+  nDataPlanes = 1;
+  anPlaneChannel[0] = PS6000_CHANNEL_A;
+  pnRapidBuffer = NULL;
+  nRapidBytes = 0;
+  pnOverflow = NULL;
+  nRapidSamples = 0;
+  nRapidSegments = 0;
+  nRapidBanks = 0;
+  nRapidChannelMask = 0;
+  nRapidRatio = 1;
+  nRapidRatioMode = PS6000_RATIO_MODE_NONE;
+  nRapidRegistered = 0;
+  nRapidAllocations = 0;
+  memset(&hsApplied, 0, sizeof(HARDWARE_STATE));
+  nConfigCalls = 0;
+  nTimeBaseCached = 0;
+  nTimeBaseNext = 0;
+  nDataTimeBase = 2;
+  lfDataInterval = DEFAULT_SAMPLE_INTERVAL;
+  bAverage = false;
+  nAverageThreads = 1;
+  bDataAverage = false;
+  nDataAverageThreads = 1;
+  bCompress = false;
+  nCompressThreads = 1;
+  bDataCompress = false;
+  nDataCompressThreads = 1;
+  bPeaks = false;
+  pcPeaks.fThreshold = (float)DEFAULT_PEAK_THRESHOLD;
+  pcPeaks.nMinWidth = DEFAULT_PEAK_MIN_WIDTH;
+  pcPeaks.nNoiseWindow = DEFAULT_PEAK_NOISE_WINDOW;
+  nPeakThreads = 1;
+  bDataPeaks = false;
+  pcDataPeaks = pcPeaks;
+  nDataPeakThreads = 1;
+  bFilter = false;
+  memset(&sfFilter, 0, sizeof(SEGMENT_FILTER));
+  bDataFilter = false;
+  sfDataFilter = sfFilter;
+  nPreviewWidth = 0;
+  bPreviewOnly = false;
+  nDataPreviewWidth = 0;
+  bDataPreviewOnly = false;
+  bPipeline = false;
+  isProgressive = false;
+  bOverlapped = false;
+  isOverlappedSet = false;
+  lfBulkReadoutTime = 0.0;
+  nBulkSamples = 0;
+  nBulkSegments = 0;
+  isPipelineRunning = false;
+  isPipelineStopping = false;
+  nPipelineDelivered = -1;
+  pfnBatchCallback = NULL;
+  pBatchParameter = NULL;
+  pnStreamBuffer = NULL;
+  isStreaming = false;
+  isStreamStopping = false;
+  psStreamStatus = PICO_OK;
+  uv_mutex_init(&streamMutex);
+  uv_cond_init(&streamCond);
+  pStreamNotifier = NULL;
+  nStreamDropped = 0;
+  nStreamChunk = 0;
   nModelNumber = MODEL_PS6402C;
+  memset(&uAllUnit, 0, sizeof(UNIT));
   sdDataList.clear();
 }
 
 PicoScope::~PicoScope()
 {
+  stopPipeline();
+  stopStreaming();
+  stopRecording();
+  SAFE_FREE(pnStreamBuffer);
+
+  // Buffers already handed to JS keep the pool alive until they are collected
+  BufferPool::release(pcData);
+  pcData = NULL;
+  BufferPool::release(plfTriggerTimes);
+  plfTriggerTimes = NULL;
+  BufferPool::release(pnKeptSegments);
+  pnKeptSegments = NULL;
+  BufferPool::release(pfPreview);
+  pfPreview = NULL;
+  pBufferPool->destroy();
+  freeRapidBuffers();
+  uv_cond_destroy(&readyCond);
+  uv_mutex_destroy(&readyMutex);
+  uv_cond_destroy(&streamCond);
+  uv_mutex_destroy(&streamMutex);
 }
 
-PICO_STATUS PicoScope::open()
+PICO_STATUS PicoScope::open(const char *pszSerial)
 {
   PICO_STATUS psStatus;
+  int16_t nStarted = 0;
+  int16_t nProgress = 0;
+  int16_t nComplete = 0;
+  uint64_t nDeadline = uv_hrtime() + (uint64_t)DEFAULT_TIMEOUT * 1000000;
 
   memset(&uAllUnit, 0, sizeof(UNIT));
-  psStatus = ps6000OpenUnit(&uAllUnit.handle, NULL);
+  memset(&hsApplied, 0, sizeof(HARDWARE_STATE));
+  nTimeBaseCached = 0;
+  nOpenProgress = 0;
+
+  // The driver refuses to start while another unit is still starting, retry until it lets us in
+  for (;;)
+  {
+    psStatus = ps6000OpenUnitAsync(&nStarted, (int8_t *)pszSerial);
+    if (psStatus != PICO_OK || nStarted != 0)
+      break;
+
+    if (uv_hrtime() > nDeadline)
+    {
+      psStatus = PICO_OPEN_OPERATION_IN_PROGRESS;
+      break;
+    }
+
+    waitOpenPoll();
+  }
+
+  // Firmware loads in the background, report how far it got
+  while (psStatus == PICO_OK && nStarted != 0)
+  {
+    psStatus = ps6000OpenUnitProgress(&uAllUnit.handle, &nProgress, &nComplete);
+    if (psStatus != PICO_OK)
+      break;
+
+    if (nProgress != nOpenProgress || nComplete)
+    {
+      nOpenProgress = nComplete ? 100 : nProgress;
+
+      if (pOpenNotifier)
+        uv_async_send(pOpenNotifier);
+    }
+
+    if (nComplete)
+      break;
+
+    waitOpenPoll();
+  }
+
+  // A unit that failed to open reports a non-positive handle
+  if (psStatus == PICO_OK && uAllUnit.handle <= 0)
+    psStatus = uAllUnit.handle == 0 ? PICO_NOT_FOUND : PICO_OPERATION_FAILED;
 
   uAllUnit.openStatus = psStatus;
   uAllUnit.complete = true;
@@ -46,13 +225,44 @@ PICO_STATUS PicoScope::open()
   return psStatus;
 }
 
+PICO_STATUS PicoScope::enumerateUnits(char *pszSerials, int16_t *pnLength, int16_t *pnCount)
+{
+  return ps6000EnumerateUnits(pnCount, (int8_t *)pszSerials, pnLength);
+}
+
 PICO_STATUS PicoScope::close()
 {
   PICO_STATUS psStatus;
 
+  stopPipeline();
+  stopStreaming();
+  stopRecording();
+
   psStatus = ps6000CloseUnit(uAllUnit.handle);
 
   isOpened = false;
+  memset(&hsApplied, 0, sizeof(HARDWARE_STATE));
+  nTimeBaseCached = 0;
+
+  // Registrations went with the unit
+  freeRapidBuffers();
+
+  // Nothing will complete anymore
+  cancelAcquisition();
+
+  // Give capture sized memory back until the next configuration asks for it
+  BufferPool::release(pcData);
+  pcData = NULL;
+  BufferPool::release(plfTriggerTimes);
+  plfTriggerTimes = NULL;
+  nTriggerTimes = 0;
+  BufferPool::release(pnKeptSegments);
+  pnKeptSegments = NULL;
+  nKeptSegments = 0;
+  BufferPool::release(pfPreview);
+  pfPreview = NULL;
+  nPreviewLength = 0;
+  pBufferPool->trim();
 
   return psStatus;
 }
@@ -63,6 +273,24 @@ PICO_STATUS PicoScope::resetDevice()
   return PICO_OK;
 }
 
+void PicoScope::setOpenNotifier(uv_async_t *pAsync)
+{
+  pOpenNotifier = pAsync;
+}
+
+int16_t PicoScope::getOpenProgress()
+{
+  return nOpenProgress;
+}
+
+void PicoScope::waitOpenPoll()
+{
+  // Nothing signals readyCond before the unit is open, this only sleeps
+  uv_mutex_lock(&readyMutex);
+  uv_cond_timedwait(&readyCond, &readyMutex, (uint64_t)OPEN_POLL_INTERVAL * 1000000);
+  uv_mutex_unlock(&readyMutex);
+}
+
 bool PicoScope::isOpen()
 {
   return isOpened;
@@ -70,6 +298,9 @@ bool PicoScope::isOpen()
 
 PICO_STATUS PicoScope::setConfigVertical(PS6000_RANGE nFullScale, double lfOffset, PS6000_COUPLING nCoupling, PS6000_BANDWIDTH_LIMITER nBandwidth)
 {
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
   if (nBandwidth != PS6000_BW_FULL)
   {
     // If model is 6402C bandwidth should be PS6000_BW_20MHZ, others should be PS6000_BW_25MHZ.
@@ -81,6 +312,11 @@ PICO_STATUS PicoScope::setConfigVertical(PS6000_RANGE nFullScale, double lfOffse
 
   nCoupling = PS6000_DC_50R;
 
+  if (nFullScale < PS6000_10MV || nFullScale >= PS6000_MAX_RANGES)
+  {
+    return 1;
+  }
+
   this->nFullScale = nFullScale;
   this->lfOffset = lfOffset;
   //this->lfOffset = nFullScale * 7.0 / 16.0;
@@ -92,17 +328,21 @@ PICO_STATUS PicoScope::setConfigVertical(PS6000_RANGE nFullScale, double lfOffse
 
 PICO_STATUS PicoScope::setConfigHorizontal(double lfSamplerate, int32_t nSamples, int32_t nSegments)
 {
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
   if (lfSamplerate < 0.05 - 1e-6 || lfSamplerate > 5.0 + 1e-6)
   {
     return 1;
   }
 
-  if (nSamples < 1 || nSamples > 256 * 1024)
+  // Upper limits depend on the model, setDigitizer checks them against the device
+  if (nSamples < 1)
   {
     return 1;
   }
 
-  if (nSegments < 1 || nSegments > 2000)
+  if (nSegments < 1)
   {
     return 1;
   }
@@ -118,6 +358,9 @@ PICO_STATUS PicoScope::setConfigHorizontal(double lfSamplerate, int32_t nSamples
 
 PICO_STATUS PicoScope::setConfigTrigger(double lfDelayTime)
 {
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
   if (lfDelayTime < -2e-8 * 256 * 1024 || lfDelayTime > 10.0)
   {
     return 1;
@@ -128,163 +371,2008 @@ PICO_STATUS PicoScope::setConfigTrigger(double lfDelayTime)
   return 0;
 }
 
+PICO_STATUS PicoScope::setConfigOutput(OUTPUT_FORMAT nOutputFormat)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nOutputFormat < OUTPUT_FORMAT_INT8 || nOutputFormat >= OUTPUT_FORMAT_MAX)
+  {
+    return 1;
+  }
+
+  this->nOutputFormat = nOutputFormat;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigPipeline(bool bPipeline)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  this->bPipeline = bPipeline;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigChannels(uint32_t nChannelMask)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nChannelMask == 0 || nChannelMask >= (1u << PS6000_MAX_CHANNELS))
+  {
+    return 1;
+  }
+
+  this->nChannelMask = nChannelMask;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigDownsampling(uint32_t nRatio, PS6000_RATIO_MODE nMode)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nMode != PS6000_RATIO_MODE_NONE && nMode != PS6000_RATIO_MODE_AGGREGATE &&
+    nMode != PS6000_RATIO_MODE_AVERAGE && nMode != PS6000_RATIO_MODE_DECIMATE)
+  {
+    return 1;
+  }
+
+  if (nRatio < 1 || (nMode == PS6000_RATIO_MODE_NONE && nRatio != 1))
+  {
+    return 1;
+  }
+
+  this->nDownSampleRatio = nRatio;
+  this->nDownSampleMode = nMode;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigOverlapped(bool bOverlapped)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  this->bOverlapped = bOverlapped;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigAveraging(bool bAverage, int32_t nThreads)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nThreads < 1 || nThreads > AVERAGE_MAX_THREADS)
+  {
+    return 1;
+  }
+
+  this->bAverage = bAverage;
+  this->nAverageThreads = nThreads;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigCompression(bool bCompress, int32_t nThreads)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nThreads < 1 || nThreads > CODEC_MAX_THREADS)
+  {
+    return 1;
+  }
+
+  this->bCompress = bCompress;
+  this->nCompressThreads = nThreads;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigPeaks(bool bPeaks, const PEAK_CONFIG *pcConfig, int32_t nThreads)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nThreads < 1 || nThreads > PEAK_MAX_THREADS)
+  {
+    return 1;
+  }
+
+  if (pcConfig->nMinWidth < 1 || pcConfig->nNoiseWindow < 0 || !(pcConfig->fThreshold == pcConfig->fThreshold))
+  {
+    return 1;
+  }
+
+  this->bPeaks = bPeaks;
+  this->pcPeaks = *pcConfig;
+  this->nPeakThreads = nThreads;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigFilter(bool bFilter, const SEGMENT_FILTER *psfFilter)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (psfFilter->nStart < 0 || psfFilter->nLength < 0)
+  {
+    return 1;
+  }
+
+  this->bFilter = bFilter;
+  this->sfFilter = *psfFilter;
+
+  return 0;
+}
+
+PICO_STATUS PicoScope::setConfigPreview(int32_t nWidth, bool bPreviewOnly)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  if (nWidth < 0 || (bPreviewOnly && nWidth == 0))
+  {
+    return 1;
+  }
+
+  this->nPreviewWidth = nWidth;
+  this->bPreviewOnly = bPreviewOnly;
+
+  return 0;
+}
+
 PICO_STATUS PicoScope::setDigitizer(bool bRepeat)
 {
-  PICO_STATUS psStatus;
+  PICO_STATUS psStatus = PICO_OK;
   uint32_t nMaxSamples;
+  size_t nOutputLength;
+  TIMEBASE_ENTRY tbTimeBase;
   int32_t nCaptures = nSegments;
+  int32_t nBanks = bPipeline ? 2 : 1;
+
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  // A recording keeps the shape it was started with
+  if (pRecorder && !bRepeat)
+    return PICO_BUSY;
+
+  // The codec is lossless for integer samples only, refused before anything
+  // goes to the driver
+  if (bCompress && (bAverage || bPeaks || nOutputFormat == OUTPUT_FORMAT_FLOAT32))
+    return PICO_INVALID_PARAMETER;
 
   // Cleanup
   sdDataList.clear();
+  nConfigCalls = 0;
 
   // Check parameters
 
   if (!bRepeat)
   {
+    // Channels to capture, in A..D order
+    nDataChannelMask = nChannelMask;
+    nDataChannels = 0;
+    for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
+    {
+      if (nDataChannelMask & (1u << i))
+        anDataChannel[nDataChannels++] = PS6000_CHANNEL(PS6000_CHANNEL_A + i);
+    }
+
+    // Aggregation returns a max and a min plane per channel, in that order
+    nDataRatio = nDownSampleRatio;
+    nDataRatioMode = nDownSampleMode;
+    nDataSamples = nSamples / nDataRatio;
+    nDataPlanes = 0;
+    for (int32_t c = 0; c < nDataChannels; c++)
+    {
+      anPlaneChannel[nDataPlanes++] = anDataChannel[c];
+      if (nDataRatioMode == PS6000_RATIO_MODE_AGGREGATE)
+        anPlaneChannel[nDataPlanes++] = anDataChannel[c];
+    }
+
+    if (nDataSamples < 1)
+      return PICO_INVALID_SAMPLERATIO;
+
     setInfo(&uAllUnit);
-    doTriggerSet(&uAllUnit);
 
-    psStatus = ps6000SetEts(uAllUnit.handle, PS6000_ETS_OFF, 0, 0, NULL); // Turn off ETS
+    // Only what differs from the last applied state goes over USB
+    if (!hsApplied.isEtsOff)
+    {
+      psStatus = ps6000SetEts(uAllUnit.handle, PS6000_ETS_OFF, 0, 0, NULL); // Turn off ETS
+      nConfigCalls++;
 
-    if (psStatus != PICO_OK)
-      return psStatus;
+      if (psStatus != PICO_OK)
+        return psStatus;
+
+      hsApplied.isEtsOff = true;
+    }
 
-    // setting signal chennel
-    for (int32_t i = 0; i<4; i++)
+    // Signal channels get the analogue offset, the trigger channel none
+    for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
     {
-      if (i == 0 || i == 1)  //A Chaannel �� �׻� Signal channel�̾��� �Ѵ�.
-      {
-        psStatus = ps6000SetChannel(uAllUnit.handle, PS6000_CHANNEL(PS6000_CHANNEL_A + i), uAllUnit.channelSettings[i].enabled,
-          PS6000_COUPLING(uAllUnit.channelSettings[i].DCcoupled), PS6000_RANGE(uAllUnit.channelSettings[i].range), (float)lfOffset, PS6000_BANDWIDTH_LIMITER(nBandwidth));
-      }
-      else
-      {
-        psStatus = ps6000SetChannel(uAllUnit.handle, PS6000_CHANNEL(PS6000_CHANNEL_A + i), uAllUnit.channelSettings[i].enabled,
-          PS6000_COUPLING(uAllUnit.channelSettings[i].DCcoupled), PS6000_RANGE(uAllUnit.channelSettings[i].range), 0.f, PS6000_BANDWIDTH_LIMITER(nBandwidth));
-      }
+      psStatus = setChannel(i, (float)getChannelOffset(PS6000_CHANNEL(PS6000_CHANNEL_A + i)));
+      if (psStatus != PICO_OK)
+        return psStatus;
+    }
+
+    // Segment the memory (one bank of nSegments per block in flight)
+    if (hsApplied.nMemorySegments != (uint32_t)(nSegments * nBanks))
+    {
+      // Captures are checked against the segments, set them again afterwards
+      hsApplied.nMemorySegments = 0;
+      hsApplied.nCaptures = 0;
+
+      psStatus = ps6000MemorySegments(uAllUnit.handle, nSegments * nBanks, &nMaxSamples);
+      nConfigCalls++;
+      if (psStatus != PICO_OK)
+        return psStatus;
+
+      hsApplied.nMemorySegments = nSegments * nBanks;
+      hsApplied.nSegmentSamples = nMaxSamples;
+    }
+
+    // Memory of this model divided by the segments
+    if ((uint32_t)nSamples > hsApplied.nSegmentSamples)
+      return PICO_TOO_MANY_SAMPLES;
+
+    // Set the number of captures
+    if (hsApplied.nCaptures != (uint32_t)nCaptures)
+    {
+      hsApplied.nCaptures = 0;
+
+      psStatus = ps6000SetNoOfCaptures(uAllUnit.handle, nCaptures);
+      nConfigCalls++;
       if (psStatus != PICO_OK)
         return psStatus;
+
+      hsApplied.nCaptures = nCaptures;
     }
 
-    // Segment the memory
-    psStatus = ps6000MemorySegments(uAllUnit.handle, nSegments, &nMaxSamples);
+    // Closest rate the device runs with these channels and segments
+    psStatus = solveTimeBase(lfSampleInterval, nSegments * nBanks, &tbTimeBase);
     if (psStatus != PICO_OK)
       return psStatus;
 
-    // Set the number of captures
-    psStatus = ps6000SetNoOfCaptures(uAllUnit.handle, nCaptures);
+    if ((uint32_t)nSamples > tbTimeBase.nMaxSamples)
+      return PICO_TOO_MANY_SAMPLES;
+
+    nDataTimeBase = tbTimeBase.nTimeBase;
+    lfDataInterval = tbTimeBase.lfInterval;
+
+    // Delay is counted in samples of the solved interval
+    doTriggerSet(&uAllUnit);
+
+    if (nDataRatioMode != PS6000_RATIO_MODE_NONE)
+    {
+      if (hsApplied.nRatioSamples != (uint32_t)nSamples || hsApplied.nRatioMode != nDataRatioMode ||
+        hsApplied.nRatioSegments != hsApplied.nMemorySegments)
+      {
+        uint32_t nMaxRatio = 0;
+
+        hsApplied.nRatioSamples = 0;
+
+        psStatus = ps6000GetMaxDownSampleRatio(uAllUnit.handle, nSamples, &nMaxRatio, nDataRatioMode, 0);
+        nConfigCalls++;
+        if (psStatus != PICO_OK)
+          return psStatus;
+
+        hsApplied.nRatioSamples = nSamples;
+        hsApplied.nRatioMode = nDataRatioMode;
+        hsApplied.nRatioSegments = hsApplied.nMemorySegments;
+        hsApplied.nMaxRatio = nMaxRatio;
+      }
+
+      if (nDataRatio > hsApplied.nMaxRatio)
+        return PICO_INVALID_SAMPLERATIO;
+    }
+
+    // Register capture buffers (only rebuilt when the horizontal config changed)
+    uint32_t nAllocations = nRapidAllocations;
+
+    psStatus = setupRapidBuffers(nBanks);
+
+    // Overlapped readout only targets the single bank used by doAcquisition,
+    // the deferred request stays with the buffers it was made for
+    if (psStatus != PICO_OK || !bOverlapped || nBanks != 1)
+      isOverlappedSet = false;
+    else if (!isOverlappedSet || nRapidAllocations != nAllocations)
+      psStatus = setupOverlapped();
+  }
+
+  // why + 1 ?
+//  nBufferLength = nSamples * (nSegments + 1);
+  nDataFormat = nOutputFormat;
+  bDataAverage = bAverage;
+  nDataAverageThreads = nAverageThreads;
+  bDataCompress = bCompress;
+  nDataCompressThreads = nCompressThreads;
+  bDataPeaks = bPeaks;
+  pcDataPeaks = pcPeaks;
+  nDataPeakThreads = nPeakThreads;
+  bDataFilter = bFilter;
+  sfDataFilter = sfFilter;
+  nDataPreviewWidth = nPreviewWidth < nDataSamples ? nPreviewWidth : nDataSamples;
+  bDataPreviewOnly = bPreviewOnly;
+
+  // Everything fetched at once is delivered as one block, and so is its preview
+  nOutputLength = getOutputLength(nSegments);
+  if (nOutputLength > MAXIMUM_BUFFER_LENGTH || getPreviewOutputLength(nSegments) > MAXIMUM_BUFFER_LENGTH)
+  {
+    nBufferLength = 0;
+    return PICO_TOO_MANY_SAMPLES;
+  }
+
+  nBufferLength = (int32_t)nOutputLength;
+  sdDataList.nConfigCalls = nConfigCalls;
+
+  if (!bRepeat)
+    return psStatus;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::doAcquisition(bool bIsSAR)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  // Captures go into the registered buffers, setDigitizer has to run first
+  if (pnRapidBuffer == NULL)
+    return PICO_BUFFERS_NOT_SET;
+
+  return armBlock(0);
+}
+
+PICO_STATUS PicoScope::armBlock(uint32_t nSegmentIndex)
+{
+  PICO_STATUS psStatus;
+  uint32_t nTimeBase = nDataTimeBase;
+
+  // The bank is overwritten from here on, its last block must be in the file
+  waitRecording(nSegmentIndex / nRapidSegments);
+
+  uv_mutex_lock(&readyMutex);
+  isAcquisitionReady = false;
+  isAcquisitionArmed = true;
+  uv_mutex_unlock(&readyMutex);
+
+  // Driver calls onBlockReady from its own thread when all captures are done
+  psStatus = ps6000RunBlock(uAllUnit.handle, 0, nRapidSamples, nTimeBase, 1, NULL, nSegmentIndex, onBlockReady, this);
+
+  if (psStatus != PICO_OK)
+  {
+    uv_mutex_lock(&readyMutex);
+    isAcquisitionArmed = false;
+    uv_mutex_unlock(&readyMutex);
+  }
+
+  return psStatus;
+}
+
+PICO_STATUS PicoScope::waitForAcquisition()
+{
+  PICO_STATUS psStatus;
+
+  uv_mutex_lock(&readyMutex);
+
+  if (!isAcquisitionArmed && !isAcquisitionReady)
+  {
+    uv_mutex_unlock(&readyMutex);
+    return PICO_INVALID_STATE;
+  }
+
+  while (!isAcquisitionReady && !isPipelineStopping)
+  {
+    uv_cond_wait(&readyCond, &readyMutex);
+  }
+
+  psStatus = isAcquisitionReady ? psReadyStatus : PICO_CANCELLED;
+
+  uv_mutex_unlock(&readyMutex);
+
+  return psStatus;
+}
+
+bool PicoScope::isAcquisitionDone(PICO_STATUS *pStatus)
+{
+  bool bDone;
+
+  uv_mutex_lock(&readyMutex);
+
+  if (!isAcquisitionArmed && !isAcquisitionReady)
+  {
+    // Nothing armed, report it instead of waiting forever
+    *pStatus = PICO_INVALID_STATE;
+    bDone = true;
+  }
+  else
+  {
+    *pStatus = psReadyStatus;
+    bDone = isAcquisitionReady;
+  }
+
+  uv_mutex_unlock(&readyMutex);
+
+  return bDone;
+}
+
+void PicoScope::cancelAcquisition()
+{
+  uv_mutex_lock(&readyMutex);
+
+  if (isAcquisitionArmed && !isAcquisitionReady)
+  {
+    psReadyStatus = PICO_CANCELLED;
+    isAcquisitionReady = true;
+    isAcquisitionArmed = false;
+    uv_cond_broadcast(&readyCond);
+  }
+
+  uv_mutex_unlock(&readyMutex);
+
+  if (pReadyNotifier)
+    uv_async_send(pReadyNotifier);
+}
+
+void PicoScope::setReadyNotifier(uv_async_t *pAsync)
+{
+  pReadyNotifier = pAsync;
+}
+
+void PREF4 PicoScope::onBlockReady(int16_t handle, PICO_STATUS status, void *pParameter)
+{
+  PicoScope *pThis = (PicoScope *)pParameter;
+
+  // The handle is the one armed, pParameter already says which scope
+  (void)handle;
+
+  uv_mutex_lock(&pThis->readyMutex);
+
+  // Late callback of a cancelled block
+  if (pThis->isAcquisitionArmed)
+  {
+    pThis->psReadyStatus = status;
+    pThis->isAcquisitionReady = true;
+    pThis->isAcquisitionArmed = false;
+    uv_cond_broadcast(&pThis->readyCond);
+  }
+
+  uv_mutex_unlock(&pThis->readyMutex);
+
+  if (pThis->pReadyNotifier)
+    uv_async_send(pThis->pReadyNotifier);
+}
+
+PICO_STATUS PicoScope::fetchData(bool bIsSAR, DATA_LAYOUT nLayout)
+{
+  PICO_STATUS psStatus;
+  uint32_t nCompletedCaptures;
+
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  // 1. Wait for Event
+  PICO_STATUS psReady;
+
+  if (!isAcquisitionDone(&psReady) || psReady != PICO_OK)
+    return -1;
+
+  // 2. Get NoOfCaptures
+  psStatus = ps6000GetNoOfCaptures(uAllUnit.handle, &nCompletedCaptures);
+  if (psStatus != PICO_OK || nCompletedCaptures == 0)
+  {
+    ps6000Stop(uAllUnit.handle);
+    return psStatus;
+  }
+
+  // Buffers were registered by setDigitizer(false) for the current shape
+  if (!isRapidBufferSet(1))
+  {
+    ps6000Stop(uAllUnit.handle);
+    return PICO_BUFFERS_NOT_SET;
+  }
+
+  // 3. Insert to pcData (a block no one else holds), sized once the filter has run
+  BufferPool::release(pcData);
+  pcData = NULL;
+  BufferPool::release(pnKeptSegments);
+  pnKeptSegments = NULL;
+  nKeptSegments = 0;
+  BufferPool::release(pfPreview);
+  pfPreview = NULL;
+  nPreviewLength = 0;
+
+  // Get data, already transferred by the driver when overlapped
+  uint32_t lGetSamples = nRapidSamples;
+  uint64_t nReadoutStart = uv_hrtime();
+
+  if (!isOverlappedSet)
+    psStatus = ps6000GetValuesBulk(uAllUnit.handle, &lGetSamples, 0, nRapidSegments - 1, nDataRatio, nDataRatioMode, pnOverflow);
+
+  double lfReadoutTime = (uv_hrtime() - nReadoutStart) * 1e-9;
+
+  // Remember what a conventional readout costs for this shape
+  if (!isOverlappedSet)
+  {
+    lfBulkReadoutTime = lfReadoutTime;
+    nBulkSamples = nRapidSamples;
+    nBulkSegments = nRapidSegments;
+  }
+
+  nDataLayout = nLayout;
+  nDataLength = 0;
+  if (!bRecordOnly)
+  {
+    CAPTURE_BATCH cbData;
+
+    psStatus = deliverSegments(0, 0, nRapidSegments, &cbData);
+    pcData = cbData.pData;
+    nDataLength = cbData.nLength;
+    pnKeptSegments = cbData.pnSegments;
+    nKeptSegments = cbData.nKeptSegments;
+    pfPreview = cbData.pfPreview;
+    nPreviewLength = cbData.nPreviewLength;
+    if (psStatus != PICO_OK)
+    {
+      ps6000Stop(uAllUnit.handle);
+      return psStatus;
+    }
+  }
+
+  // Trigger time of every segment goes out next to the waveforms
+  BufferPool::release(plfTriggerTimes);
+  plfTriggerTimes = (double *)pBufferPool->acquire(nRapidSegments * sizeof(double));
+  nTriggerTimes = nRapidSegments;
+  if (plfTriggerTimes == NULL || readTriggerTimes(0, nRapidSegments, plfTriggerTimes) != PICO_OK)
+  {
+    BufferPool::release(plfTriggerTimes);
+    plfTriggerTimes = NULL;
+    nTriggerTimes = 0;
+  }
+
+  // The index takes the trigger times already read
+  if (pRecorder)
+  {
+    psStatus = recordSegments(0, 0, nRapidSegments, plfTriggerTimes);
+    if (psStatus != PICO_OK)
+    {
+      ps6000Stop(uAllUnit.handle);
+      return psStatus;
+    }
+  }
+
+  // Only the delivered segments keep their times, in place as kept numbers only grow
+  if (pnKeptSegments && plfTriggerTimes)
+  {
+    for (int32_t k = 0; k < nKeptSegments; k++)
+      plfTriggerTimes[k] = plfTriggerTimes[pnKeptSegments[k]];
+    nTriggerTimes = nKeptSegments;
+  }
+
+  psStatus = ps6000Stop(uAllUnit.handle);
+
+  updateScopeData();
+  sdDataList.lfReadoutTime = lfReadoutTime;
+  sdDataList.nKeptShots = nKeptSegments;
+  if (plfTriggerTimes && nTriggerTimes > 0)
+    sdDataList.relativeInitialX = plfTriggerTimes[0];
+
+  // Reference time is only known once a conventional readout of the same shape ran
+  if (isOverlappedSet && nBulkSamples == nRapidSamples && nBulkSegments == nRapidSegments)
+    sdDataList.lfReadoutSaved = lfBulkReadoutTime - lfReadoutTime;
+  else
+    sdDataList.lfReadoutSaved = 0.0;
+
+  return psStatus;
+}
+
+void PicoScope::convertCaptures(const int16_t *pnSrc, int8_t *pcDst, size_t nCount)
+{
+  double lfGain, lfOffset;
+
+  switch (nDataFormat)
+  {
+    case OUTPUT_FORMAT_INT16:
+      memcpy(pcDst, pnSrc, nCount * sizeof(int16_t));
+      break;
+
+    case OUTPUT_FORMAT_FLOAT32:
+      getScale(PS6000_CHANNEL_A, OUTPUT_FORMAT_INT16, &lfGain, &lfOffset);
+      scaleInt16ToFloat(pnSrc, (float *)pcDst, nCount, (float)lfGain, (float)lfOffset);
+      break;
+
+    default:
+      narrowInt16ToInt8(pnSrc, pcDst, nCount);
+      break;
+  }
+}
+
+void PicoScope::convertSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, DATA_LAYOUT nLayout, int8_t *pcDst)
+{
+  int32_t nSampleSize = getSampleSize(nDataFormat);
+  size_t nSegmentBytes = (size_t)nDataSamples * nSampleSize * (nLayout == DATA_LAYOUT_INTERLEAVED ? nDataPlanes : 1);
+  int32_t nRun;
+
+  if (bDataAverage)
+  {
+    averageSegments(nBank, nFirstSegment, nCount, pnSegments, nLayout, (float *)pcDst);
+    return;
+  }
+
+  if (pnSegments == NULL)
+  {
+    convertRun(nBank, nFirstSegment, nCount, nCount, nLayout, pcDst);
+    return;
+  }
+
+  // Kept segments come in runs of consecutive numbers, each converted in one go
+  for (int32_t k = 0; k < nCount; k += nRun)
+  {
+    for (nRun = 1; k + nRun < nCount && pnSegments[k + nRun] == pnSegments[k] + nRun; nRun++)
+      ;
+
+    convertRun(nBank, pnSegments[k], nRun, nCount, nLayout, pcDst + k * nSegmentBytes);
+  }
+}
+
+void PicoScope::convertRun(int32_t nBank, int32_t nFirstSegment, int32_t nCount, int32_t nDstSegments, DATA_LAYOUT nLayout, int8_t *pcDst)
+{
+  const int16_t *apnPlane[DATA_MAX_PLANES];
+  float afGain[DATA_MAX_PLANES], afOffset[DATA_MAX_PLANES];
+  size_t nPlaneSamples = (size_t)nDataSamples * nCount;
+  int32_t nSampleSize = getSampleSize(nDataFormat);
+  double lfGain, lfOffset;
+
+  // Raw bank is planar: every plane holds nRapidSegments contiguous captures
+  for (int32_t c = 0; c < nDataPlanes; c++)
+  {
+    apnPlane[c] = pnRapidBuffer + (((size_t)nBank * nDataPlanes + c) * nRapidSegments + nFirstSegment) * nDataSamples;
+
+    getScale(anPlaneChannel[c], OUTPUT_FORMAT_INT16, &lfGain, &lfOffset);
+    afGain[c] = (float)lfGain;
+    afOffset[c] = (float)lfOffset;
+  }
+
+  if (nLayout != DATA_LAYOUT_INTERLEAVED || nDataPlanes == 1)
+  {
+    // Whole bank is one contiguous run when no scaling differs per channel
+    if (nCount == nRapidSegments && nDataFormat != OUTPUT_FORMAT_FLOAT32)
+    {
+      convertCaptures(apnPlane[0], pcDst, nPlaneSamples * nDataPlanes);
+      return;
+    }
+
+    // Planes of the destination are nDstSegments apart
+    for (int32_t c = 0; c < nDataPlanes; c++)
+    {
+      int8_t *pcPlane = pcDst + c * (size_t)nDstSegments * nDataSamples * nSampleSize;
+
+      if (nDataFormat == OUTPUT_FORMAT_FLOAT32)
+        scaleInt16ToFloat(apnPlane[c], (float *)pcPlane, nPlaneSamples, afGain[c], afOffset[c]);
+      else
+        convertCaptures(apnPlane[c], pcPlane, nPlaneSamples);
+    }
+
+    return;
+  }
+
+  // Interleave a tile of every channel into scratch, then convert it while it is still in cache
+  int16_t anScratch[CONVERT_TILE_SAMPLES * DATA_MAX_PLANES];
+  const int16_t *apnTile[DATA_MAX_PLANES];
+
+  for (size_t i = 0; i < nPlaneSamples; i += CONVERT_TILE_SAMPLES)
+  {
+    size_t nTile = nPlaneSamples - i < CONVERT_TILE_SAMPLES ? nPlaneSamples - i : CONVERT_TILE_SAMPLES;
+    size_t nTileValues = nTile * nDataPlanes;
+    int8_t *pcTile = pcDst + i * nDataPlanes * nSampleSize;
+
+    for (int32_t c = 0; c < nDataPlanes; c++)
+      apnTile[c] = apnPlane[c] + i;
+
+    switch (nDataFormat)
+    {
+      case OUTPUT_FORMAT_INT16:
+        interleaveInt16(apnTile, nDataPlanes, (int16_t *)pcTile, nTile);
+        break;
+
+      case OUTPUT_FORMAT_FLOAT32:
+        interleaveInt16(apnTile, nDataPlanes, anScratch, nTile);
+        scaleInt16ToFloatChannels(anScratch, (float *)pcTile, nTileValues, afGain, afOffset, nDataPlanes);
+        break;
+
+      default:
+        interleaveInt16(apnTile, nDataPlanes, anScratch, nTile);
+        narrowInt16ToInt8(anScratch, pcTile, nTileValues);
+        break;
+    }
+  }
+}
+
+void PicoScope::averageSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, DATA_LAYOUT nLayout, float *pfDst)
+{
+  AVERAGE_JOB ajJob[AVERAGE_MAX_THREADS];
+  double alfGain[DATA_MAX_PLANES], alfOffset[DATA_MAX_PLANES];
+  int32_t nThreads;
+  uint64_t nSlice;
+
+  // Volts when asked for float, driver counts otherwise
+  for (int32_t c = 0; c < nDataPlanes; c++)
+  {
+    if (nDataFormat == OUTPUT_FORMAT_FLOAT32)
+    {
+      getScale(anPlaneChannel[c], OUTPUT_FORMAT_INT16, &alfGain[c], &alfOffset[c]);
+    }
+    else
+    {
+      alfGain[c] = 1.0;
+      alfOffset[c] = 0.0;
+    }
+  }
+
+  // Split the samples, not the segments, so no partial sums have to be merged
+  nThreads = splitJobs(nDataSamples, AVERAGE_TILE_SAMPLES, nDataAverageThreads, &nSlice);
+
+  for (int32_t t = 0; t < nThreads; t++)
+  {
+    ajJob[t].pScope = this;
+    ajJob[t].nBank = nBank;
+    ajJob[t].nFirstSegment = nFirstSegment;
+    ajJob[t].nCount = nCount;
+    ajJob[t].pnSegments = pnSegments;
+    ajJob[t].nLayout = nLayout;
+    ajJob[t].nBegin = (int32_t)(t * nSlice);
+    ajJob[t].nEnd = t == nThreads - 1 ? nDataSamples : (int32_t)((t + 1) * nSlice);
+    ajJob[t].plfGain = alfGain;
+    ajJob[t].plfOffset = alfOffset;
+    ajJob[t].pfDst = pfDst;
+  }
+
+  runJobs(ajJob, sizeof(AVERAGE_JOB), nThreads, averageThreadMain);
+}
+
+void PicoScope::averageRange(AVERAGE_JOB *pJob)
+{
+  int32_t anSum[AVERAGE_TILE_SAMPLES];
+  int64_t anTotal[AVERAGE_TILE_SAMPLES];
+
+  for (int32_t c = 0; c < nDataPlanes; c++)
+  {
+    const int16_t *pnPlane = pnRapidBuffer + ((size_t)pJob->nBank * nDataPlanes + c) * nRapidSegments * nDataSamples;
+    double lfScale = pJob->plfGain[c] / pJob->nCount;
+
+    for (int32_t i = pJob->nBegin; i < pJob->nEnd; i += AVERAGE_TILE_SAMPLES)
+    {
+      int32_t nTile = pJob->nEnd - i < AVERAGE_TILE_SAMPLES ? pJob->nEnd - i : AVERAGE_TILE_SAMPLES;
+
+      memset(anTotal, 0, nTile * sizeof(int64_t));
+
+      // Sum in int32 while it cannot overflow, then fold into the wide total
+      for (int32_t g = 0; g < pJob->nCount; g += AVERAGE_SUM_SEGMENTS)
+      {
+        int32_t nEndSegment = pJob->nCount - g < AVERAGE_SUM_SEGMENTS ? pJob->nCount : g + AVERAGE_SUM_SEGMENTS;
+
+        memset(anSum, 0, nTile * sizeof(int32_t));
+        for (int32_t k = g; k < nEndSegment; k++)
+        {
+          int32_t nSegment = pJob->pnSegments ? pJob->pnSegments[k] : pJob->nFirstSegment + k;
+
+          accumulateInt16(pnPlane + (size_t)nSegment * nDataSamples + i, anSum, nTile);
+        }
+
+        for (int32_t j = 0; j < nTile; j++)
+          anTotal[j] += anSum[j];
+      }
+
+      if (pJob->nLayout == DATA_LAYOUT_INTERLEAVED)
+      {
+        for (int32_t j = 0; j < nTile; j++)
+          pJob->pfDst[(size_t)(i + j) * nDataPlanes + c] = (float)(anTotal[j] * lfScale + pJob->plfOffset[c]);
+      }
+      else
+      {
+        for (int32_t j = 0; j < nTile; j++)
+          pJob->pfDst[(size_t)c * nDataSamples + i + j] = (float)(anTotal[j] * lfScale + pJob->plfOffset[c]);
+      }
+    }
+  }
+}
+
+void PicoScope::averageThreadMain(void *pParameter)
+{
+  AVERAGE_JOB *pJob = (AVERAGE_JOB *)pParameter;
+
+  pJob->pScope->averageRange(pJob);
+}
+
+PICO_STATUS PicoScope::readTriggerTimes(int32_t nFirstSegment, int32_t nCount, double *plfTimes)
+{
+  PICO_STATUS psStatus;
+  PS6000_TIME_UNITS *pnUnits;
+
+  pnUnits = (PS6000_TIME_UNITS *)pBufferPool->acquire(nCount * sizeof(PS6000_TIME_UNITS));
+  if (pnUnits == NULL)
+    return PICO_MEMORY_FAIL;
+
+  // Driver writes int64 counts of a unit per segment, converted in place to seconds
+  psStatus = ps6000GetValuesTriggerTimeOffsetBulk64(uAllUnit.handle, (int64_t *)plfTimes, pnUnits, nFirstSegment, nFirstSegment + nCount - 1);
+
+  if (psStatus == PICO_OK)
+  {
+    for (int32_t i = 0; i < nCount; i++)
+    {
+      int64_t nTime;
+
+      memcpy(&nTime, &plfTimes[i], sizeof(int64_t));
+      plfTimes[i] = pnUnits[i] < PS6000_MAX_TIME_UNITS ? (double)nTime * alfTimeUnits[pnUnits[i]] : 0.0;
+    }
+  }
+
+  BufferPool::release(pnUnits);
+
+  return psStatus;
+}
+
+size_t PicoScope::getOutputLength(int32_t nCount)
+{
+  // Averaging leaves one float waveform per plane, however many segments went in
+  if (bDataAverage)
+    return (size_t)nDataSamples * nDataPlanes * sizeof(float);
+
+  return (size_t)nDataSamples * nCount * nDataPlanes * getSampleSize(nDataFormat);
+}
+
+void PicoScope::updateScopeData()
+{
+  double lfGain, lfOffset;
+  // Averages of int8 data keep the full int16 scale
+  OUTPUT_FORMAT nScaleFormat = bDataAverage && nDataFormat == OUTPUT_FORMAT_INT8 ? OUTPUT_FORMAT_INT16 : nDataFormat;
+
+  // How to turn delivered samples into volts
+  getScale(anDataChannel[0], nScaleFormat, &lfGain, &lfOffset);
+
+  // Add to Buffer
+  sdDataList.nLength = nDataSamples;
+  sdDataList.absoluteInitialX = 0.0;
+  sdDataList.actualSamples = nDataSamples;
+  sdDataList.gain = lfGain;
+  sdDataList.offset = lfOffset;
+  sdDataList.nOutputFormat = nDataFormat;
+  sdDataList.relativeInitialX = 0.0;
+  sdDataList.xIncrement = lfDataInterval * nDataRatio;
+  sdDataList.samplingRate = 1.0 / sdDataList.xIncrement;
+  sdDataList.nShots = nRapidSegments;
+  sdDataList.nBufferAllocations = nRapidAllocations + pBufferPool->getAllocationCount();
+  sdDataList.bOverlapped = isOverlappedSet;
+  sdDataList.nChannelMask = nDataChannelMask;
+  sdDataList.nChannels = nDataChannels;
+  sdDataList.nLayout = nDataLayout;
+  sdDataList.nDownSampleRatio = nDataRatio;
+  sdDataList.nDownSampleMode = nDataRatioMode;
+  sdDataList.nPlanes = nDataPlanes;
+  sdDataList.bAverage = bDataAverage;
+  sdDataList.bCompressed = bDataCompress;
+  sdDataList.bPeaks = bDataPeaks;
+  sdDataList.bFiltered = bDataFilter;
+  sdDataList.nPreviewWidth = nDataPreviewWidth;
+  sdDataList.nTimeBase = nDataTimeBase;
+  sdDataList.nConfigCalls = nConfigCalls;
+
+  for (int32_t c = 0; c < nDataChannels; c++)
+  {
+    getScale(anDataChannel[c], nScaleFormat, &lfGain, &lfOffset);
+    sdDataList.channelGain[c] = lfGain;
+    sdDataList.channelOffset[c] = lfOffset;
+  }
+}
+
+PICO_STATUS PicoScope::startPipeline(BATCH_CALLBACK pfnCallback, void *pParameter, DATA_LAYOUT nLayout)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  // Needs both banks registered by setDigitizer(false)
+  if (!isRapidBufferSet(2))
+    return PICO_NOT_ENOUGH_SEGMENTS;
+
+  pfnBatchCallback = pfnCallback;
+  pBatchParameter = pParameter;
+  nDataLayout = nLayout;
+  isProgressive = false;
+  nPipelineDelivered = -1;
+
+  uv_mutex_lock(&readyMutex);
+  isPipelineStopping = false;
+  uv_mutex_unlock(&readyMutex);
+
+  updateScopeData();
+
+  if (uv_thread_create(&pipelineThread, pipelineThreadMain, this) != 0)
+    return PICO_OPERATION_FAILED;
+
+  isPipelineRunning = true;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::startProgressive(BATCH_CALLBACK pfnCallback, void *pParameter, DATA_LAYOUT nLayout)
+{
+  if (isPipelineRunning || isStreaming)
+    return PICO_BUSY;
+
+  // Reads into the first bank registered by setDigitizer(false)
+  if (!isRapidBufferSet(1))
+    return PICO_BUFFERS_NOT_SET;
+
+  pfnBatchCallback = pfnCallback;
+  pBatchParameter = pParameter;
+  nDataLayout = nLayout;
+  isProgressive = true;
+  nPipelineDelivered = -1;
+
+  uv_mutex_lock(&readyMutex);
+  isPipelineStopping = false;
+  uv_mutex_unlock(&readyMutex);
+
+  updateScopeData();
+
+  if (uv_thread_create(&pipelineThread, pipelineThreadMain, this) != 0)
+    return PICO_OPERATION_FAILED;
+
+  isPipelineRunning = true;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::stopPipeline()
+{
+  if (!isPipelineRunning)
+    return PICO_OK;
+
+  // Wakes the thread if it waits on a block that will never trigger
+  uv_mutex_lock(&readyMutex);
+  isPipelineStopping = true;
+  uv_cond_broadcast(&readyCond);
+  uv_mutex_unlock(&readyMutex);
+
+  uv_thread_join(&pipelineThread);
+  isPipelineRunning = false;
+
+  // Scope data is only written here, never while the thread runs
+  updateScopeData();
+  if (nPipelineDelivered >= 0)
+    sdDataList.nRealShots = nPipelineDelivered;
+
+  return PICO_OK;
+}
+
+void PicoScope::pipelineThreadMain(void *pParameter)
+{
+  PicoScope *pThis = (PicoScope *)pParameter;
+
+  if (pThis->isProgressive)
+    pThis->runProgressive();
+  else
+    pThis->runPipeline();
+}
+
+void PicoScope::runPipeline()
+{
+  PICO_STATUS psStatus;
+  CAPTURE_BATCH cbBatch;
+  int32_t nBank = 0;
+  uint32_t nSequence = 0;
+
+  psStatus = armBlock(0);
+
+  while (psStatus == PICO_OK)
+  {
+    psStatus = waitForAcquisition();
+    if (psStatus != PICO_OK)
+      break;
+
+    // Next block captures into the other bank while this one is read out
+    int32_t nNextBank = nBank ^ 1;
+    PICO_STATUS psArmStatus = armBlock(nNextBank * nRapidSegments);
+
+    cbBatch.psStatus = readBank(nBank, &cbBatch);
+    cbBatch.nSequence = nSequence++;
+    cbBatch.isLast = false;
+    pfnBatchCallback(&cbBatch, pBatchParameter);
+
+    psStatus = psArmStatus;
+    nBank = nNextBank;
+  }
+
+  ps6000Stop(uAllUnit.handle);
+
+  // Report why the pipeline ended unless it was asked to stop
+  if (psStatus != PICO_CANCELLED)
+  {
+    cbBatch.psStatus = psStatus;
+    cbBatch.pData = NULL;
+    cbBatch.nLength = 0;
+    cbBatch.nSequence = nSequence;
+    cbBatch.nFirstSegment = 0;
+    cbBatch.nSegmentCount = 0;
+    cbBatch.pnSegments = NULL;
+    cbBatch.nKeptSegments = 0;
+    cbBatch.pfPreview = NULL;
+    cbBatch.nPreviewLength = 0;
+    cbBatch.isLast = true;
+    pfnBatchCallback(&cbBatch, pBatchParameter);
+  }
+}
+
+void PicoScope::runProgressive()
+{
+  PICO_STATUS psStatus;
+  PICO_STATUS psReady = PICO_OK;
+  CAPTURE_BATCH cbBatch;
+  uint32_t nProcessed;
+  int32_t nDelivered = 0;
+  uint32_t nSequence = 0;
+  bool bDone = false;
+  bool bStopping = false;
+
+  psStatus = armBlock(0);
+
+  while (psStatus == PICO_OK && nDelivered < nRapidSegments && !bStopping)
+  {
+    // Sample completion before the count so no segment is missed at the end
+    bDone = isAcquisitionDone(&psReady);
+    if (bDone && psReady != PICO_OK)
+    {
+      psStatus = psReady;
+      break;
+    }
+
+    nProcessed = 0;
+    psStatus = ps6000GetNoOfProcessedCaptures(uAllUnit.handle, &nProcessed);
+    if (psStatus != PICO_OK)
+      break;
+
+    if (bDone || nProcessed > (uint32_t)nRapidSegments)
+      nProcessed = nRapidSegments;
+
+    if ((int32_t)nProcessed > nDelivered)
+    {
+      psStatus = readSegments(nDelivered, nProcessed - nDelivered, &cbBatch);
+      if (psStatus != PICO_OK)
+      {
+        BufferPool::release(cbBatch.pData);
+        BufferPool::release(cbBatch.pnSegments);
+        BufferPool::release(cbBatch.pfPreview);
+        break;
+      }
+
+      cbBatch.psStatus = PICO_OK;
+      cbBatch.nSequence = nSequence++;
+      cbBatch.isLast = (int32_t)nProcessed == nRapidSegments;
+      pfnBatchCallback(&cbBatch, pBatchParameter);
+
+      nDelivered = nProcessed;
+      continue;
+    }
+
+    // Nothing new, sleep until the block completes, stop is requested or 1ms passes
+    uv_mutex_lock(&readyMutex);
+    if (!isAcquisitionReady && !isPipelineStopping)
+      uv_cond_timedwait(&readyCond, &readyMutex, 1000000);
+    bStopping = isPipelineStopping;
+    uv_mutex_unlock(&readyMutex);
+  }
+
+  ps6000Stop(uAllUnit.handle);
+  cancelAcquisition();
+
+  // Reported by stopPipeline once this thread is joined
+  nPipelineDelivered = nDelivered;
+
+  if (nDelivered < nRapidSegments)
+  {
+    cbBatch.psStatus = bStopping ? PICO_CANCELLED : psStatus;
+    cbBatch.pData = NULL;
+    cbBatch.nLength = 0;
+    cbBatch.nSequence = nSequence;
+    cbBatch.nFirstSegment = nDelivered;
+    cbBatch.nSegmentCount = 0;
+    cbBatch.pnSegments = NULL;
+    cbBatch.nKeptSegments = 0;
+    cbBatch.pfPreview = NULL;
+    cbBatch.nPreviewLength = 0;
+    cbBatch.isLast = true;
+    pfnBatchCallback(&cbBatch, pBatchParameter);
+  }
+}
+
+PICO_STATUS PicoScope::startStreaming(uv_async_t *pNotifier)
+{
+  PICO_STATUS psStatus;
+  uint32_t nSampleInterval;
+
+  if (isPipelineRunning || isStreaming || pRecorder)
+    return PICO_BUSY;
+
+  // Driver and ring storage are kept between runs
+  if (pnStreamBuffer == NULL)
+  {
+    pnStreamBuffer = (int16_t *)calloc(STREAM_DRIVER_SAMPLES, sizeof(int16_t));
+    if (pnStreamBuffer == NULL)
+      return PICO_MEMORY_FAIL;
+  }
+
+  if (!rbStream.available() && !rbStream.allocate(STREAM_RING_SAMPLES))
+    return PICO_MEMORY_FAIL;
+
+  rbStream.reset();
+
+  // Streaming takes over segment 0 of channel A, block buffers must be registered again
+  freeRapidBuffers();
+
+  // Memory layout is the driver's during streaming, segment it again for blocks
+  hsApplied.nMemorySegments = 0;
+  hsApplied.nCaptures = 0;
+
+  psStatus = ps6000SetDataBuffer(uAllUnit.handle, PS6000_CHANNEL_A, pnStreamBuffer, STREAM_DRIVER_SAMPLES, PS6000_RATIO_MODE_NONE);
+  if (psStatus != PICO_OK)
+    return psStatus;
+
+  // Driver rounds the interval to what the hardware can do
+  nSampleInterval = (uint32_t)(lfSampleInterval * 1e12 + 0.5);
+  psStatus = ps6000RunStreaming(uAllUnit.handle, &nSampleInterval, PS6000_PS, 0, STREAM_DRIVER_SAMPLES, 0, 1, PS6000_RATIO_MODE_NONE, STREAM_DRIVER_SAMPLES);
+  if (psStatus != PICO_OK)
+    return psStatus;
+
+  updateScopeData();
+  sdDataList.samplingRate = 1e12 / nSampleInterval;
+  sdDataList.xIncrement = nSampleInterval * 1e-12;
+  sdDataList.nShots = 0;
+
+  // Streaming always carries channel A only
+  getScale(PS6000_CHANNEL_A, nDataFormat, &sdDataList.gain, &sdDataList.offset);
+  sdDataList.nChannelMask = 1u << PS6000_CHANNEL_A;
+  sdDataList.nChannels = 1;
+  sdDataList.nLayout = DATA_LAYOUT_PLANAR;
+  sdDataList.channelGain[0] = sdDataList.gain;
+  sdDataList.channelOffset[0] = sdDataList.offset;
+  sdDataList.nDownSampleRatio = 1;
+  sdDataList.nDownSampleMode = PS6000_RATIO_MODE_NONE;
+  sdDataList.nPlanes = 1;
+  sdDataList.bAverage = false;
+  sdDataList.bCompressed = false;
+
+  pStreamNotifier = pNotifier;
+  nStreamDropped = 0;
+  psStreamStatus = PICO_OK;
+  isStreamStopping = false;
+
+  if (uv_thread_create(&streamThread, streamThreadMain, this) != 0)
+  {
+    ps6000Stop(uAllUnit.handle);
+    return PICO_OPERATION_FAILED;
+  }
+
+  // readStreaming asks isStreamingActive from the JS thread
+  uv_mutex_lock(&streamMutex);
+  isStreaming = true;
+  uv_mutex_unlock(&streamMutex);
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::readStreaming(size_t nMaxSamples, int8_t **ppData, int32_t *pnLength)
+{
+  const int16_t *pnFirst, *pnSecond;
+  size_t nFirst, nSecond;
+  size_t nCount;
+  int32_t nSampleSize = getSampleSize(nDataFormat);
+  PICO_STATUS psStatus;
+
+  uv_mutex_lock(&streamMutex);
+  psStatus = psStreamStatus;
+  uv_mutex_unlock(&streamMutex);
+
+  *ppData = NULL;
+  *pnLength = 0;
+
+  nCount = rbStream.peek(&pnFirst, &nFirst, &pnSecond, &nSecond);
+  if (nCount == 0)
+    return psStatus;
+
+  if (nCount > nMaxSamples)
+  {
+    nCount = nMaxSamples;
+    if (nFirst > nCount)
+      nFirst = nCount;
+    nSecond = nCount - nFirst;
+  }
+
+  *ppData = (int8_t *)pBufferPool->acquire(nCount * nSampleSize);
+  if (*ppData == NULL)
+    return PICO_MEMORY_FAIL;
+
+  // Convert straight out of the ring, the wrapped part follows the first span
+  convertCaptures(pnFirst, *ppData, nFirst);
+  convertCaptures(pnSecond, *ppData + nFirst * nSampleSize, nSecond);
+  rbStream.consume(nCount);
+
+  *pnLength = (int32_t)(nCount * nSampleSize);
+
+  return psStatus;
+}
+
+PICO_STATUS PicoScope::stopStreaming()
+{
+  if (!isStreaming)
+    return PICO_OK;
+
+  uv_mutex_lock(&streamMutex);
+  isStreamStopping = true;
+  uv_cond_broadcast(&streamCond);
+  uv_mutex_unlock(&streamMutex);
+
+  uv_thread_join(&streamThread);
+
+  uv_mutex_lock(&streamMutex);
+  isStreaming = false;
+  uv_mutex_unlock(&streamMutex);
+
+  return PICO_OK;
+}
+
+bool PicoScope::isStreamingActive()
+{
+  bool bActive;
+
+  uv_mutex_lock(&streamMutex);
+  bActive = isStreaming && !isStreamStopping && psStreamStatus == PICO_OK;
+  uv_mutex_unlock(&streamMutex);
+
+  return bActive;
+}
+
+void PicoScope::streamThreadMain(void *pParameter)
+{
+  ((PicoScope *)pParameter)->runStreaming();
+}
+
+void PicoScope::runStreaming()
+{
+  PICO_STATUS psStatus;
+
+  uv_mutex_lock(&streamMutex);
+
+  while (!isStreamStopping)
+  {
+    uv_mutex_unlock(&streamMutex);
+
+    // onStreamingReady runs on this thread, inside the call
+    nStreamChunk = 0;
+    psStatus = ps6000GetStreamingLatestValues(uAllUnit.handle, onStreamingReady, this);
+
+    if (psStatus != PICO_OK && psStatus != PICO_BUSY)
+    {
+      uv_mutex_lock(&streamMutex);
+      psStreamStatus = psStatus;
+      uv_mutex_unlock(&streamMutex);
+
+      uv_async_send(pStreamNotifier);
+
+      uv_mutex_lock(&streamMutex);
+      break;
+    }
+
+    if (nStreamChunk)
+      uv_async_send(pStreamNotifier);
+
+    uv_mutex_lock(&streamMutex);
+
+    // Nothing new yet, give the driver a moment (returns at once on stop)
+    if (nStreamChunk == 0 && !isStreamStopping)
+      uv_cond_timedwait(&streamCond, &streamMutex, 1000000);
+  }
+
+  uv_mutex_unlock(&streamMutex);
+
+  ps6000Stop(uAllUnit.handle);
+
+  // Let the consumer see the end of the stream
+  uv_async_send(pStreamNotifier);
+}
+
+void PREF4 PicoScope::onStreamingReady(int16_t handle, uint32_t noOfSamples, uint32_t startIndex, int16_t overflow,
+  uint32_t triggerAt, int16_t triggered, int16_t autoStop, void *pParameter)
+{
+  PicoScope *pThis = (PicoScope *)pParameter;
+  size_t nWritten;
+
+  // Samples are passed on as they come, trigger, auto stop and overflow are not reported
+  (void)handle;
+  (void)overflow;
+  (void)triggerAt;
+  (void)triggered;
+  (void)autoStop;
+
+  nWritten = pThis->rbStream.write(pThis->pnStreamBuffer + startIndex, noOfSamples);
+
+  // Consumer fell behind, the ring cannot hold more
+  if (nWritten < noOfSamples)
+    pThis->nStreamDropped += noOfSamples - nWritten;
+
+  pThis->nStreamChunk += noOfSamples;
+}
+
+PICO_STATUS PicoScope::readSegments(int32_t nFirstSegment, int32_t nCount, CAPTURE_BATCH *pBatch)
+{
+  PICO_STATUS psStatus;
+  uint32_t lGetSamples = nRapidSamples;
+
+  pBatch->pData = NULL;
+  pBatch->nLength = 0;
+  pBatch->nFirstSegment = nFirstSegment;
+  pBatch->nSegmentCount = nCount;
+  pBatch->pnSegments = NULL;
+  pBatch->nKeptSegments = nCount;
+  pBatch->pfPreview = NULL;
+  pBatch->nPreviewLength = 0;
+
+  psStatus = ps6000GetValuesBulk(uAllUnit.handle, &lGetSamples, nFirstSegment, nFirstSegment + nCount - 1, nDataRatio, nDataRatioMode, pnOverflow + nFirstSegment);
+  if (psStatus != PICO_OK)
+    return psStatus;
+
+  if (pRecorder)
+  {
+    psStatus = recordSegments(0, nFirstSegment, nCount, NULL);
+    if (psStatus != PICO_OK || bRecordOnly)
+      return psStatus;
+  }
+
+  return deliverSegments(0, nFirstSegment, nCount, pBatch);
+}
+
+PICO_STATUS PicoScope::readBank(int32_t nBank, CAPTURE_BATCH *pBatch)
+{
+  PICO_STATUS psStatus;
+  uint32_t nFirstSegment = nBank * nRapidSegments;
+  uint32_t lGetSamples = nRapidSamples;
+
+  pBatch->pData = NULL;
+  pBatch->nLength = 0;
+  pBatch->nFirstSegment = 0;
+  pBatch->nSegmentCount = nRapidSegments;
+  pBatch->pnSegments = NULL;
+  pBatch->nKeptSegments = nRapidSegments;
+  pBatch->pfPreview = NULL;
+  pBatch->nPreviewLength = 0;
+
+  psStatus = ps6000GetValuesBulk(uAllUnit.handle, &lGetSamples, nFirstSegment, nFirstSegment + nRapidSegments - 1, nDataRatio, nDataRatioMode, pnOverflow + nFirstSegment);
+  if (psStatus != PICO_OK)
+    return psStatus;
+
+  if (pRecorder)
+  {
+    psStatus = recordSegments(nBank, 0, nRapidSegments, NULL);
+    if (psStatus != PICO_OK || bRecordOnly)
+      return psStatus;
+  }
+
+  return deliverSegments(nBank, 0, nRapidSegments, pBatch);
+}
+
+PICO_STATUS PicoScope::deliverSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, CAPTURE_BATCH *pBatch)
+{
+  PICO_STATUS psStatus;
+  int32_t nKept = nCount;
+
+  pBatch->pData = NULL;
+  pBatch->nLength = 0;
+  pBatch->pnSegments = NULL;
+  pBatch->nKeptSegments = nCount;
+  pBatch->pfPreview = NULL;
+  pBatch->nPreviewLength = 0;
+
+  if (bDataFilter)
+  {
+    psStatus = filterSegments(nBank, nFirstSegment, nCount, &pBatch->pnSegments, &nKept);
+    pBatch->nKeptSegments = nKept;
+    if (psStatus != PICO_OK || nKept == 0)
+      return psStatus;
+  }
+
+  if (bDataPreviewOnly)
+    return makePreview(nBank, nFirstSegment, nKept, pBatch->pnSegments, NULL, &pBatch->pfPreview, &pBatch->nPreviewLength);
+
+  if (bDataPeaks)
+  {
+    psStatus = pickPeaks(nBank, nFirstSegment, nKept, pBatch->pnSegments, &pBatch->pData, &pBatch->nLength);
+  }
+  else
+  {
+    pBatch->pData = (int8_t *)pBufferPool->acquire(getOutputLength(nKept));
+    if (pBatch->pData == NULL)
+      return PICO_MEMORY_FAIL;
+
+    convertSegments(nBank, nFirstSegment, nKept, pBatch->pnSegments, nDataLayout, pBatch->pData);
+    pBatch->nLength = (int32_t)getOutputLength(nKept);
+    psStatus = PICO_OK;
+
+    if (bDataCompress)
+      psStatus = compressData(&pBatch->pData, nKept, &pBatch->nLength);
+  }
+
+  if (psStatus != PICO_OK || nDataPreviewWidth == 0)
+    return psStatus;
+
+  // A planar average is the waveform the preview is taken from, no need to average twice
+  if (bDataAverage && !bDataPeaks && nDataLayout == DATA_LAYOUT_PLANAR)
+    return makePreview(nBank, nFirstSegment, nKept, pBatch->pnSegments, (const float *)pBatch->pData, &pBatch->pfPreview, &pBatch->nPreviewLength);
+
+  return makePreview(nBank, nFirstSegment, nKept, pBatch->pnSegments, NULL, &pBatch->pfPreview, &pBatch->nPreviewLength);
+}
+
+PICO_STATUS PicoScope::makePreview(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, const float *pfAverage, float **ppfPreview, int32_t *pnLength)
+{
+  size_t nLength = getPreviewOutputLength(nCount);
+  size_t nColumnValues = (size_t)nDataPreviewWidth * 2;
+  float *pfPreview = (float *)pBufferPool->acquire(nLength);
+
+  *ppfPreview = NULL;
+  *pnLength = 0;
+  if (pfPreview == NULL)
+    return PICO_MEMORY_FAIL;
+
+  if (bDataAverage)
+  {
+    // Averaged waveforms are already in delivered units
+    float *pfScratch = NULL;
+
+    if (pfAverage == NULL)
+    {
+      pfScratch = (float *)pBufferPool->acquire((size_t)nDataSamples * nDataPlanes * sizeof(float));
+      if (pfScratch == NULL)
+      {
+        BufferPool::release(pfPreview);
+        return PICO_MEMORY_FAIL;
+      }
+
+      averageSegments(nBank, nFirstSegment, nCount, pnSegments, DATA_LAYOUT_PLANAR, pfScratch);
+      pfAverage = pfScratch;
+    }
+
+    for (int32_t c = 0; c < nDataPlanes; c++)
+      envelopeFloat(pfAverage + (size_t)c * nDataSamples, nDataSamples, nDataPreviewWidth, pfPreview + c * nColumnValues);
+
+    BufferPool::release(pfScratch);
+  }
+  else
+  {
+    // Columns are taken from the raw counts, only their ends are scaled
+    int16_t *pnColumns = (int16_t *)pBufferPool->acquire(nColumnValues * sizeof(int16_t));
+    float afGain[DATA_MAX_PLANES], afOffset[DATA_MAX_PLANES];
+
+    if (pnColumns == NULL)
+    {
+      BufferPool::release(pfPreview);
+      return PICO_MEMORY_FAIL;
+    }
+
+    // Volts when asked for float, counts of the delivered format otherwise
+    for (int32_t c = 0; c < nDataPlanes; c++)
+    {
+      double lfGain = 1.0, lfOffset = 0.0;
+
+      if (nDataFormat == OUTPUT_FORMAT_FLOAT32)
+        getScale(anPlaneChannel[c], OUTPUT_FORMAT_INT16, &lfGain, &lfOffset);
+      afGain[c] = (float)lfGain;
+      afOffset[c] = (float)lfOffset;
+    }
+
+    for (int32_t k = 0; k < nCount; k++)
+    {
+      int32_t nSegment = pnSegments ? pnSegments[k] : nFirstSegment + k;
+
+      for (int32_t c = 0; c < nDataPlanes; c++)
+      {
+        const int16_t *pnPlane = pnRapidBuffer + (((size_t)nBank * nDataPlanes + c) * nRapidSegments + nSegment) * nDataSamples;
+
+        envelopeInt16(pnPlane, nDataSamples, nDataPreviewWidth, pnColumns);
+
+        // Narrowing keeps the order, so the ends narrow to the int8 data's ends
+        if (nDataFormat == OUTPUT_FORMAT_INT8)
+        {
+          for (size_t i = 0; i < nColumnValues; i++)
+            pnColumns[i] >>= 8;
+        }
+
+        scaleInt16ToFloat(pnColumns, pfPreview + ((size_t)k * nDataPlanes + c) * nColumnValues, nColumnValues, afGain[c], afOffset[c]);
+      }
+    }
+
+    BufferPool::release(pnColumns);
+  }
+
+  *ppfPreview = pfPreview;
+  *pnLength = (int32_t)nLength;
+
+  return PICO_OK;
+}
+
+size_t PicoScope::getPreviewOutputLength(int32_t nCount)
+{
+  // Averaging leaves one envelope per plane
+  if (bDataAverage)
+    nCount = 1;
+
+  return (size_t)nDataPreviewWidth * 2 * nCount * nDataPlanes * sizeof(float);
+}
+
+PICO_STATUS PicoScope::filterSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, int32_t **ppnKept, int32_t *pnKept)
+{
+  int32_t nStart = sfDataFilter.nStart < nDataSamples ? sfDataFilter.nStart : nDataSamples;
+  int32_t nEnd = sfDataFilter.nLength > 0 && sfDataFilter.nLength < nDataSamples - nStart ? nStart + sfDataFilter.nLength : nDataSamples;
+  int32_t *pnKeptSegments = (int32_t *)pBufferPool->acquire(nCount * sizeof(int32_t));
+  int32_t nKept = 0;
+
+  *ppnKept = pnKeptSegments;
+  *pnKept = 0;
+  if (pnKeptSegments == NULL)
+    return PICO_MEMORY_FAIL;
+
+  // One pass over the window of every plane, the raw data is left as it is
+  for (int32_t g = nFirstSegment; g < nFirstSegment + nCount; g++)
+  {
+    bool bPass = false;
+
+    for (int32_t c = 0; c < nDataPlanes && !bPass; c++)
+    {
+      const int16_t *pnPlane = pnRapidBuffer + (((size_t)nBank * nDataPlanes + c) * nRapidSegments + g) * nDataSamples;
+      int16_t nMin, nMax;
+
+      rangeInt16(pnPlane + nStart, nEnd - nStart, &nMin, &nMax);
+      bPass = sfDataFilter.bBelow ? nMin < sfDataFilter.nLevel : nMax > sfDataFilter.nLevel;
+    }
+
+    if (bPass)
+      pnKeptSegments[nKept++] = g;
+  }
+
+  *pnKept = nKept;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::startRecording(const char *pszPath, bool bRecordOnly, bool bCompress)
+{
+  double lfGain, lfOffset;
+
+  if (isPipelineRunning || isStreaming || pRecorder)
+    return PICO_BUSY;
+
+  // Blocks are written from the registered capture buffers
+  if (!isRapidBufferSet(1))
+    return PICO_BUFFERS_NOT_SET;
+
+  updateScopeData();
+
+  memset(&rfHeader, 0, sizeof(RECORD_FILE_HEADER));
+  memcpy(rfHeader.acMagic, RECORD_FILE_MAGIC, sizeof(RECORD_FILE_MAGIC));
+  rfHeader.nVersion = RECORD_FILE_VERSION;
+  rfHeader.nHeaderSize = sizeof(RECORD_FILE_HEADER);
+  rfHeader.nScopeDataSize = sizeof(SCOPE_DATA);
+  rfHeader.nDataOffset = (sizeof(RECORD_FILE_HEADER) + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+  rfHeader.nCodec = bCompress ? RECORD_CODEC_DELTA : RECORD_CODEC_NONE;
+  rfHeader.lfSampleInterval = lfDataInterval * nDataRatio;
+  rfHeader.lfDelayTime = lfDelayTime;
+  rfHeader.nTimeBase = nDataTimeBase;
+  rfHeader.nDownSampleRatio = nDataRatio;
+  rfHeader.nDownSampleMode = nDataRatioMode;
+  rfHeader.nSamples = nDataSamples;
+  rfHeader.nSegments = nRapidSegments;
+  rfHeader.nPlanes = nDataPlanes;
+  for (int32_t c = 0; c < nDataPlanes; c++)
+  {
+    getScale(anPlaneChannel[c], OUTPUT_FORMAT_INT16, &lfGain, &lfOffset);
+    rfHeader.anPlaneChannel[c] = anPlaneChannel[c];
+    rfHeader.alfPlaneGain[c] = lfGain;
+    rfHeader.alfPlaneOffset[c] = lfOffset;
+  }
+  for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
+  {
+    rfHeader.arcChannel[i].nEnabled = hsApplied.acsChannel[i].enabled;
+    rfHeader.arcChannel[i].nRange = hsApplied.acsChannel[i].nRange;
+    rfHeader.arcChannel[i].nCoupling = hsApplied.acsChannel[i].nCoupling;
+    rfHeader.arcChannel[i].nBandwidth = hsApplied.acsChannel[i].nBandwidth;
+    rfHeader.arcChannel[i].lfOffset = hsApplied.acsChannel[i].fOffset;
+  }
+  rfHeader.sdScopeData = sdDataList;
+
+  // Index entries of a bank stay put until the bank is armed again, like its samples
+  for (int32_t nBank = 0; nBank < nRapidBanks; nBank++)
+    aprsRecordEntries[nBank] = (RECORD_SEGMENT_ENTRY *)calloc(nRapidSegments, sizeof(RECORD_SEGMENT_ENTRY));
+  plfRecordTimes = (double *)calloc(nRapidSegments, sizeof(double));
+
+  if (aprsRecordEntries[0] == NULL || (nRapidBanks > 1 && aprsRecordEntries[1] == NULL) || plfRecordTimes == NULL)
+  {
+    freeRecordIndex();
+    return PICO_MEMORY_FAIL;
+  }
+
+  // Packed planes too, every segment gets a slot that holds any stream starting there
+  if (bCompress)
+  {
+    nRecordPackedSlot = getCodecBound(sizeof(int16_t), nDataSamples, 1) + sizeof(uint64_t);
+    nRecordPackedSize = nRecordPackedSlot * nRapidSegments * nDataPlanes;
+
+    for (int32_t nBank = 0; nBank < nRapidBanks; nBank++)
+    {
+      apbRecordPacked[nBank] = (uint8_t *)allocateLargeBuffer(nRecordPackedSize);
+      if (apbRecordPacked[nBank] == NULL)
+      {
+        freeRecordIndex();
+        return PICO_MEMORY_FAIL;
+      }
+    }
+  }
+
+  pRecorder = new Recorder();
+  if (pRecorder->open(pszPath, &rfHeader, sizeof(RECORD_FILE_HEADER)) != 0)
+  {
+    delete pRecorder;
+    pRecorder = NULL;
+    freeRecordIndex();
+
+    return PICO_OPERATION_FAILED;
+  }
+
+  this->bRecordOnly = bRecordOnly;
+  anRecordTicket[0] = 0;
+  anRecordTicket[1] = 0;
+  nRecordSequence = 0;
+  nRecordOffset = rfHeader.nDataOffset;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::stopRecording()
+{
+  RECORD_CHUNK rcDirectory;
+  int nResult;
+
+  if (pRecorder == NULL)
+    return PICO_OK;
+
+  if (isPipelineRunning)
+    return PICO_BUSY;
+
+  // Final counters, an unfinished file keeps zeros
+  rfHeader.nBlocks = nRecordSequence;
+  rfHeader.nDataBytes = nRecordOffset - rfHeader.nDataOffset;
+
+  // Directory goes behind the last block
+  if (nRecordSequence > 0)
+  {
+    rcDirectory.pData = prdRecordDirectory;
+    rcDirectory.nLength = nRecordSequence * sizeof(RECORD_DIRECTORY_ENTRY);
+
+    if (pRecorder->write(&rcDirectory, 1) != 0)
+    {
+      rfHeader.nDirectoryOffset = nRecordOffset;
+      rfHeader.nDirectoryEntries = nRecordSequence;
+    }
+  }
+
+  sdDataList.nRecordedBlocks = rfHeader.nBlocks;
+  sdDataList.nRecordedBytes = rfHeader.nDataBytes;
+
+  nResult = pRecorder->close(&rfHeader, sizeof(RECORD_FILE_HEADER));
+  sdDataList.nRecordError = nResult;
+
+  delete pRecorder;
+  pRecorder = NULL;
+  bRecordOnly = false;
+  anRecordTicket[0] = 0;
+  anRecordTicket[1] = 0;
+  freeRecordIndex();
+
+  return nResult == 0 ? PICO_OK : PICO_OPERATION_FAILED;
+}
+
+PICO_STATUS PicoScope::recordSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const double *plfTimes)
+{
+  static const uint8_t abPadding[8] = { 0 };
+  RECORD_BLOCK_HEADER rbHeader;
+  RECORD_CHUNK arcChunk[DATA_MAX_PLANES + 3];
+  RECORD_SEGMENT_ENTRY *prsEntries = aprsRecordEntries[nBank] + nFirstSegment;
+  size_t nSegmentBytes = (size_t)nDataSamples * sizeof(int16_t);
+  size_t nPlaneBytes = nSegmentBytes * nCount;
+  uint64_t nSamplesStart = nRecordOffset + sizeof(RECORD_BLOCK_HEADER) + nCount * sizeof(RECORD_SEGMENT_ENTRY);
+  uint64_t nLength = nCount * sizeof(RECORD_SEGMENT_ENTRY);
+  size_t nPadding;
+  int32_t nChunks = 2;
+  uint64_t nTicket;
+
+  // Make room in the directory, one entry per block
+  if (nRecordSequence >= nRecordDirectorySize)
+  {
+    uint64_t nSize = nRecordDirectorySize ? nRecordDirectorySize * 2 : 1024;
+    RECORD_DIRECTORY_ENTRY *prdDirectory = (RECORD_DIRECTORY_ENTRY *)realloc(prdRecordDirectory, nSize * sizeof(RECORD_DIRECTORY_ENTRY));
+
+    if (prdDirectory == NULL)
+      return PICO_MEMORY_FAIL;
+
+    prdRecordDirectory = prdDirectory;
+    nRecordDirectorySize = nSize;
+  }
+
+  // Every plane of a bank is one run, the writer reads them (or their packed form) in place
+  for (int32_t c = 0; c < nDataPlanes; c++)
+  {
+    const int16_t *pnPlane = pnRapidBuffer + (((size_t)nBank * nDataPlanes + c) * nRapidSegments + nFirstSegment) * nDataSamples;
+
+    if (rfHeader.nCodec == RECORD_CODEC_DELTA)
+    {
+      uint8_t *pbPacked = apbRecordPacked[nBank] + ((size_t)c * nRapidSegments + nFirstSegment) * nRecordPackedSlot;
+      size_t nPacked = encodeRuns(pnPlane, sizeof(int16_t), 1, nDataSamples, nCount, pbPacked, nDataCompressThreads);
+      size_t nPadded = (nPacked + 7) / 8 * 8;
+
+      if (nPacked == 0)
+        return PICO_INVALID_PARAMETER;
+
+      // Streams stay 8 byte aligned in the file, the slots leave room for the padding
+      memset(pbPacked + nPacked, 0, nPadded - nPacked);
+
+      arcChunk[nChunks].pData = pbPacked;
+      arcChunk[nChunks++].nLength = nPadded;
+      nLength += nPadded;
+    }
+    else
+    {
+      arcChunk[nChunks].pData = pnPlane;
+      arcChunk[nChunks++].nLength = nPlaneBytes;
+      nLength += nPlaneBytes;
+    }
+  }
+
+  // Trigger times of the segments unless the caller read them already
+  if (plfTimes == NULL)
+  {
+    if (readTriggerTimes(nBank * nRapidSegments + nFirstSegment, nCount, plfRecordTimes + nFirstSegment) != PICO_OK)
+      memset(plfRecordTimes + nFirstSegment, 0, nCount * sizeof(double));
+
+    plfTimes = plfRecordTimes + nFirstSegment;
+  }
+
+  for (int32_t g = 0; g < nCount; g++)
+  {
+    prsEntries[g].nOffset = rfHeader.nCodec == RECORD_CODEC_NONE ? nSamplesStart + g * nSegmentBytes : 0;
+    prsEntries[g].lfTriggerTime = plfTimes[g];
+    prsEntries[g].nOverflow = pnOverflow[nBank * nRapidSegments + nFirstSegment + g];
+  }
+
+  nPadding = (size_t)((8 - (sizeof(RECORD_BLOCK_HEADER) + nLength) % 8) % 8);
+
+  rbHeader.nMagic = RECORD_BLOCK_MAGIC;
+  rbHeader.nSequence = (uint32_t)nRecordSequence;
+  rbHeader.nFirstSegment = nFirstSegment;
+  rbHeader.nSegmentCount = nCount;
+  rbHeader.nTimestamp = uv_hrtime();
+  rbHeader.nLength = nLength + nPadding;
+  rbHeader.nRecordSegment = rfHeader.nRecordSegments;
+
+  arcChunk[0].pData = &rbHeader;
+  arcChunk[0].nLength = sizeof(RECORD_BLOCK_HEADER);
+  arcChunk[1].pData = prsEntries;
+  arcChunk[1].nLength = nCount * sizeof(RECORD_SEGMENT_ENTRY);
+
+  if (nPadding)
+  {
+    arcChunk[nChunks].pData = abPadding;
+    arcChunk[nChunks++].nLength = nPadding;
   }
 
-  // why + 1 ?
-//  nBufferLength = nSamples * (nSegments + 1);
-  nBufferLength = nSamples * (nSegments);
+  nTicket = pRecorder->write(arcChunk, nChunks);
+  if (nTicket == 0)
+    return PICO_MEMORY_FAIL;
 
-  if (!bRepeat)
-    return psStatus;
+  anRecordTicket[nBank] = nTicket;
+
+  prdRecordDirectory[nRecordSequence].nOffset = nRecordOffset;
+  prdRecordDirectory[nRecordSequence].nRecordSegment = rfHeader.nRecordSegments;
+  nRecordSequence++;
+  nRecordOffset += sizeof(RECORD_BLOCK_HEADER) + rbHeader.nLength;
+  rfHeader.nRecordSegments += nCount;
+
+  // Counters are read from the main loop, the recorder itself may go away meanwhile
+  sdDataList.nRecordedBlocks = pRecorder->getBlockCount();
+  sdDataList.nRecordedBytes = pRecorder->getDataLength();
+  sdDataList.nRecordError = pRecorder->getError();
 
   return PICO_OK;
 }
 
-PICO_STATUS PicoScope::doAcquisition(bool bIsSAR)
+PICO_STATUS PicoScope::compressData(int8_t **ppcData, int32_t nCount, int32_t *pnLength)
 {
-  PICO_STATUS psStatus;
-  uint32_t segmentIndex = 0;
-  uint32_t nTimeBase = getTimeBase(lfAcquisitionRate);
+  int32_t nSampleSize = getSampleSize(nDataFormat);
+  bool bInterleaved = nDataLayout == DATA_LAYOUT_INTERLEAVED && nDataPlanes > 1;
+  uint32_t nRuns = bInterleaved ? nCount : nCount * nDataPlanes;
+  uint64_t nRunValues = bInterleaved ? (uint64_t)nDataSamples * nDataPlanes : nDataSamples;
+  uint8_t *pbPacked;
+  size_t nLength;
+
+  // Interleaved channels are coded against the same channel one sample earlier
+  pbPacked = (uint8_t *)pBufferPool->acquire(getCodecBound(nSampleSize, nRunValues, nRuns));
+  if (pbPacked == NULL)
+    return PICO_MEMORY_FAIL;
+
+  nLength = encodeRuns(*ppcData, nSampleSize, bInterleaved ? nDataPlanes : 1, nRunValues, nRuns, pbPacked, nDataCompressThreads);
+  if (nLength == 0 || nLength > MAXIMUM_BUFFER_LENGTH)
+  {
+    BufferPool::release(pbPacked);
+    return PICO_TOO_MANY_SAMPLES;
+  }
 
-  isAcquisitionReady = false;
-  psStatus = ps6000RunBlock(uAllUnit.handle, 0, nSamples, nTimeBase, 1, NULL, segmentIndex, NULL, NULL);
+  BufferPool::release(*ppcData);
+  *ppcData = (int8_t *)pbPacked;
+  *pnLength = (int32_t)nLength;
 
-  return psStatus;
+  return PICO_OK;
 }
 
-PICO_STATUS PicoScope::waitForAcquisition()
+PICO_STATUS PicoScope::pickPeaks(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, int8_t **ppcData, int32_t *pnLength)
 {
+  PEAK_JOB apjJob[PEAK_MAX_THREADS];
+  PEAK_LIST aplLists[PEAK_MAX_THREADS];
+  float afGain[DATA_MAX_PLANES], afOffset[DATA_MAX_PLANES];
+  int32_t nThreads;
   PICO_STATUS psStatus;
-  int16_t ready = 0;
+  uint64_t nSlice;
+  size_t nLength;
+  uint64_t nPeaks = 0;
+  bool bResult = true;
 
-  while (true)
-  {
-    _sleep(1);
+  *ppcData = NULL;
+  *pnLength = 0;
 
-    psStatus = ps6000IsReady(uAllUnit.handle, &ready);
+  // Volts when asked for float, driver counts otherwise
+  for (int32_t c = 0; c < nDataPlanes; c++)
+  {
+    double lfGain = 1.0, lfOffset = 0.0;
 
-    if (psStatus != PICO_OK || ready)
-      break;
+    if (nDataFormat == OUTPUT_FORMAT_FLOAT32)
+      getScale(anPlaneChannel[c], OUTPUT_FORMAT_INT16, &lfGain, &lfOffset);
+    afGain[c] = (float)lfGain;
+    afOffset[c] = (float)lfOffset;
   }
 
-  if (ready)
-    isAcquisitionReady = true;
+  if (bDataAverage)
+  {
+    // Averaged waveforms are few, they are searched here
+    float *pfAverage = (float *)pBufferPool->acquire((size_t)nDataSamples * nDataPlanes * sizeof(float));
 
-  return psStatus;
-}
+    if (pfAverage == NULL)
+      return PICO_MEMORY_FAIL;
 
-PICO_STATUS PicoScope::fetchData(bool bIsSAR)
-{
-  PICO_STATUS psStatus;
-  uint32_t nCompletedCaptures;
+    averageSegments(nBank, nFirstSegment, nCount, pnSegments, DATA_LAYOUT_PLANAR, pfAverage);
 
-  // 1. Wait for Event
-  if (!isAcquisitionReady)
-    return -1;
+    memset(&aplLists[0], 0, sizeof(PEAK_LIST));
+    for (int32_t c = 0; c < nDataPlanes && bResult; c++)
+      bResult = findPeaks(pfAverage + (size_t)c * nDataSamples, nDataSamples, &pcDataPeaks, nFirstSegment, c, &aplLists[0]);
+    nThreads = 1;
 
-  // 2. Get NoOfCaptures
-  psStatus = ps6000GetNoOfCaptures(uAllUnit.handle, &nCompletedCaptures);
-  if (psStatus != PICO_OK || nCompletedCaptures == 0)
-  {
-    ps6000Stop(uAllUnit.handle);
-    return psStatus;
+    BufferPool::release(pfAverage);
   }
+  else
+  {
+    // Split the segments, every list comes out in segment order
+    nThreads = splitJobs(nCount, 1, nDataPeakThreads, &nSlice);
 
-  // 3. Insert to pcData
-  int16_t **pnRapidBuffers = (int16_t **)calloc(nSegments, sizeof(int16_t *));
-  int16_t *overflow = (int16_t *)calloc(nSegments, sizeof(int16_t));
+    for (int32_t t = 0; t < nThreads; t++)
+    {
+      int32_t nFirst = (int32_t)(t * nSlice);
+
+      apjJob[t].pScope = this;
+      apjJob[t].nBank = nBank;
+      apjJob[t].nFirstSegment = nFirstSegment + nFirst;
+      apjJob[t].nCount = t == nThreads - 1 ? nCount - nFirst : (int32_t)nSlice;
+      apjJob[t].pnSegments = pnSegments ? pnSegments + nFirst : NULL;
+      apjJob[t].pfGain = afGain;
+      apjJob[t].pfOffset = afOffset;
+      memset(&apjJob[t].plPeaks, 0, sizeof(PEAK_LIST));
+    }
 
-  for (int32_t i = 0; i < nSegments; i++)
-    pnRapidBuffers[i] = (int16_t *)calloc(nSamples + 1, sizeof(int16_t));
+    runJobs(apjJob, sizeof(PEAK_JOB), nThreads, peakThreadMain);
 
-  for (int32_t capture = 0; capture < nSegments; capture++)
-  {
-    psStatus = ps6000SetDataBufferBulk(uAllUnit.handle, PS6000_CHANNEL(PS6000_CHANNEL_A), pnRapidBuffers[capture], nSamples, capture, PS6000_RATIO_MODE_NONE);
+    for (int32_t t = 0; t < nThreads; t++)
+    {
+      aplLists[t] = apjJob[t].plPeaks;
+      bResult = bResult && apjJob[t].bResult;
+    }
   }
 
-  // Get data
-  uint32_t lGetSamples;
-  psStatus = ps6000GetValuesBulk(uAllUnit.handle, &lGetSamples, 0, nSegments - 1, 1, PS6000_RATIO_MODE_NONE, overflow);
-
-  for (int32_t capture = 0; capture < nSegments; capture++)
+  for (int32_t t = 0; t < nThreads; t++)
+    nPeaks += aplLists[t].nCount;
+
+  nLength = getPeakBlockLength(nPeaks);
+  if (!bResult)
+    psStatus = PICO_MEMORY_FAIL;
+  else if (nLength > MAXIMUM_BUFFER_LENGTH)
+    psStatus = PICO_TOO_MANY_SAMPLES;
+  else if ((*ppcData = (int8_t *)pBufferPool->acquire(nLength)) == NULL)
+    psStatus = PICO_MEMORY_FAIL;
+  else
   {
-    int32_t nIndex = capture * nSamples;
-    for (int32_t j = 0; j < nSamples; j++)
-    {
-      pcData[nIndex + j] = pnRapidBuffers[capture][j] >> 8;// / 256;
-    }
+    writePeakBlock(aplLists, nThreads, (uint8_t *)*ppcData);
+    *pnLength = (int32_t)nLength;
+    psStatus = PICO_OK;
   }
 
-  // Free buffer
-  if (pnRapidBuffers)
+  for (int32_t t = 0; t < nThreads; t++)
+    freePeakList(&aplLists[t]);
+
+  return psStatus;
+}
+
+void PicoScope::peakRange(PEAK_JOB *pJob)
+{
+  float *pfWave = (float *)pBufferPool->acquire((size_t)nDataSamples * sizeof(float));
+
+  pJob->bResult = pfWave != NULL;
+
+  // One waveform at a time through scratch, searched while it is still in cache
+  for (int32_t g = 0; g < pJob->nCount && pJob->bResult; g++)
   {
-    for (int32_t i = 0; i < nSegments; i++)
+    int32_t nSegment = pJob->pnSegments ? pJob->pnSegments[g] : pJob->nFirstSegment + g;
+
+    for (int32_t c = 0; c < nDataPlanes && pJob->bResult; c++)
     {
-      free(pnRapidBuffers[i]);
+      const int16_t *pnPlane = pnRapidBuffer + (((size_t)pJob->nBank * nDataPlanes + c) * nRapidSegments + nSegment) * nDataSamples;
+
+      scaleInt16ToFloat(pnPlane, pfWave, nDataSamples, pJob->pfGain[c], pJob->pfOffset[c]);
+      pJob->bResult = findPeaks(pfWave, nDataSamples, &pcDataPeaks, nSegment, c, &pJob->plPeaks);
     }
-    free(pnRapidBuffers);
-    free(overflow);
   }
 
-  psStatus = ps6000Stop(uAllUnit.handle);
+  BufferPool::release(pfWave);
+}
 
-  // Add to Buffer
-  sdDataList.nLength = nSamples;
-  sdDataList.absoluteInitialX = 0.0;
-  sdDataList.actualSamples = nSamples;
-  sdDataList.gain = 0.0;
-  sdDataList.offset = 0.0;
-  sdDataList.relativeInitialX = 0.0;
-  sdDataList.xIncrement = 0.0;
-  sdDataList.samplingRate = lfAcquisitionRate*1e9;
-  sdDataList.nShots = nSegments;
+void PicoScope::peakThreadMain(void *pParameter)
+{
+  PEAK_JOB *pJob = (PEAK_JOB *)pParameter;
 
-  return psStatus;
+  pJob->pScope->peakRange(pJob);
+}
+
+void PicoScope::waitRecording(int32_t nBank)
+{
+  if (pRecorder && nBank >= 0 && nBank < 2)
+    pRecorder->waitFor(anRecordTicket[nBank]);
+}
+
+void PicoScope::freeRecordIndex()
+{
+  SAFE_FREE(aprsRecordEntries[0]);
+  SAFE_FREE(aprsRecordEntries[1]);
+  SAFE_FREE(plfRecordTimes);
+  SAFE_FREE(prdRecordDirectory);
+  nRecordDirectorySize = 0;
+
+  for (int32_t nBank = 0; nBank < 2; nBank++)
+  {
+    if (apbRecordPacked[nBank])
+      freeLargeBuffer(apbRecordPacked[nBank], nRecordPackedSize);
+    apbRecordPacked[nBank] = NULL;
+  }
+  nRecordPackedSlot = 0;
+  nRecordPackedSize = 0;
 }
 
 int32_t PicoScope::getBufferLength()
@@ -292,6 +2380,11 @@ int32_t PicoScope::getBufferLength()
   return nBufferLength;
 }
 
+int32_t PicoScope::getDataLength()
+{
+  return nDataLength;
+}
+
 int32_t PicoScope::getNextSegmentPad()
 {
   return nTbNextSegmentPad;
@@ -304,6 +2397,9 @@ int32_t PicoScope::getSegmentOffset()
 
 SCOPE_DATA *PicoScope::getScopeDataList()
 {
+  // Counted by the driver's streaming callback
+  sdDataList.nStreamDropped = nStreamDropped;
+
   return &sdDataList;
 }
 
@@ -317,27 +2413,110 @@ int32_t PicoScope::getSegmentCount()
   return nSegments;
 }
 
-void PicoScope::setData(int8_t *pData)
+int8_t *PicoScope::detachData()
+{
+  int8_t *pData = pcData;
+
+  pcData = NULL;
+
+  return pData;
+}
+
+double *PicoScope::detachTriggerTimes()
+{
+  double *plfTimes = plfTriggerTimes;
+
+  plfTriggerTimes = NULL;
+
+  return plfTimes;
+}
+
+int32_t PicoScope::getTriggerTimeCount()
+{
+  return nTriggerTimes;
+}
+
+int32_t *PicoScope::detachKeptSegments()
+{
+  int32_t *pnKept = pnKeptSegments;
+
+  pnKeptSegments = NULL;
+
+  return pnKept;
+}
+
+int32_t PicoScope::getKeptSegmentCount()
+{
+  return nKeptSegments;
+}
+
+float *PicoScope::detachPreview()
+{
+  float *pfData = pfPreview;
+
+  pfPreview = NULL;
+
+  return pfData;
+}
+
+int32_t PicoScope::getPreviewLength()
 {
-  for (int32_t i = 0; i < nBufferLength; i ++)
+  return nPreviewLength;
+}
+
+int16_t PicoScope::mvToADC(int16_t mv, int16_t ch)
+{
+  return (mv * PS6000_MAX_VALUE) / anInputRanges[ch];
+}
+
+int32_t PicoScope::getSampleSize(OUTPUT_FORMAT nFormat)
+{
+  switch (nFormat)
   {
-    pcData[i] = pData == NULL ? 0 : pData[i];
+    case OUTPUT_FORMAT_INT16:
+      return sizeof(int16_t);
+    case OUTPUT_FORMAT_FLOAT32:
+      return sizeof(float);
+    default:
+      return sizeof(int8_t);
   }
 }
 
-bool PicoScope::inRange(double lfValueBase, double lfVal2)
+double PicoScope::getChannelOffset(PS6000_CHANNEL nChannel)
 {
-  if (lfVal2 > lfValueBase - 1e-6 && lfVal2 < lfValueBase + 1e-6)
-    return true;
+  // Captured channels share the signal settings, D stays the trigger whatever the mask
+  if (nChannel == PS6000_CHANNEL_D || (nDataChannelMask & (1u << (nChannel - PS6000_CHANNEL_A))) == 0)
+    return 0.0;
 
-  return false;
+  return lfOffset;
 }
 
-int16_t PicoScope::mvToADC(int16_t mv, int16_t ch)
+void PicoScope::getScale(PS6000_CHANNEL nChannel, OUTPUT_FORMAT nFormat, double *plfGain, double *plfOffset)
 {
-  static uint16_t inputRanges[PS6000_MAX_RANGES] = { 10,  20, 50,  100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+  // Signal channels follow setConfigVertical, D keeps the range set up for triggering
+  PS6000_RANGE nRange = nChannel == PS6000_CHANNEL_D ? PS6000_RANGE(uAllUnit.channelSettings[PS6000_CHANNEL_D].range) : nFullScale;
+  double lfChannelOffset = getChannelOffset(nChannel);
 
-  return (mv * PS6000_MAX_VALUE) / inputRanges[ch];
+  // The analogue offset is added to the input before digitizing:
+  // volts = sample * gain + offset
+  double lfVoltsPerCount = anInputRanges[nRange] / 1000.0 / PS6000_MAX_VALUE;
+
+  switch (nFormat)
+  {
+    case OUTPUT_FORMAT_INT16:
+      *plfGain = lfVoltsPerCount;
+      *plfOffset = -lfChannelOffset;
+      break;
+    case OUTPUT_FORMAT_FLOAT32:
+      // Already in volts
+      *plfGain = 1.0;
+      *plfOffset = 0.0;
+      break;
+    default:
+      *plfGain = lfVoltsPerCount * 256.0;
+      *plfOffset = -lfChannelOffset;
+      break;
+  }
 }
 
 void PicoScope::setInfo(UNIT *unit)
@@ -348,10 +2527,21 @@ void PicoScope::setInfo(UNIT *unit)
 
   if (unit->handle)
   {
-    // info = 3 - PICO_VARIANT_INFO
-    ps6000GetUnitInfo(unit->handle, line, sizeof(line), &r, 3);
+    // Model and serial do not change while the unit is open
+    if (!hsApplied.isInfoRead)
+    {
+      // info = 3 - PICO_VARIANT_INFO
+      ps6000GetUnitInfo(unit->handle, line, sizeof(line), &r, 3);
+      memcpy(&(unit->modelString), line, sizeof(unit->modelString) == 7 ? 7 : sizeof(unit->modelString));
+
+      // info = 4 - PICO_BATCH_AND_SERIAL
+      ps6000GetUnitInfo(unit->handle, unit->serial, sizeof(unit->serial), &r, PICO_BATCH_AND_SERIAL);
+      nConfigCalls += 2;
+      hsApplied.isInfoRead = true;
+    }
+
+    memcpy(line, unit->modelString, sizeof(line));
     variant = atoi((char *)line);
-    memcpy(&(unit->modelString), line, sizeof(unit->modelString) == 7 ? 7 : sizeof(unit->modelString));
 
     if (strlen((char *)line) == 5)            // A, B, C or D variant allUnits
     {
@@ -468,8 +2658,17 @@ void PicoScope::setInfo(UNIT *unit)
         break;
     }
 
-    // info = 4 - PICO_BATCH_AND_SERIAL
-    ps6000GetUnitInfo(unit->handle, unit->serial, sizeof(unit->serial), &r, PICO_BATCH_AND_SERIAL);
+    // B and C are captured with the signal settings when selected, D stays the trigger
+    unit->channelSettings[PS6000_CHANNEL_A].enabled = (nDataChannelMask & (1u << PS6000_CHANNEL_A)) != 0;
+    for (int32_t i = PS6000_CHANNEL_B; i <= PS6000_CHANNEL_C; i++)
+    {
+      if (nDataChannelMask & (1u << i))
+      {
+        unit->channelSettings[i].range = nFullScale;
+        unit->channelSettings[i].DCcoupled = nCoupling;
+        unit->channelSettings[i].enabled = true;
+      }
+    }
   }
 }
 
@@ -482,70 +2681,370 @@ uint32_t PicoScope::setTrigger(int16_t handle,
   int16_t auxOutputEnabled,
   int32_t nAutoTriggerMS)
 {
-  PICO_STATUS psStatus;
+  PICO_STATUS psStatus = PICO_OK;
 
-  if ((psStatus = ps6000SetTriggerChannelProperties(handle,
-    ptcpChannelProperties,        //NULL
-    nChannelProperties,        //0
-    auxOutputEnabled,        //0
-    nAutoTriggerMS)) != PICO_OK)    //0
+  // Each part is sent only when it differs from what the device already has
+  if (!hsApplied.isPropertiesSet || nChannelProperties != 1 ||
+    memcmp(&hsApplied.tcpProperties, ptcpChannelProperties, sizeof(PS6000_TRIGGER_CHANNEL_PROPERTIES)) != 0 ||
+    hsApplied.nAuxOutputEnabled != auxOutputEnabled || hsApplied.nAutoTriggerMS != nAutoTriggerMS)
   {
-    return psStatus;
+    hsApplied.isPropertiesSet = false;
+    nConfigCalls++;
+
+    if ((psStatus = ps6000SetTriggerChannelProperties(handle,
+      ptcpChannelProperties,        //NULL
+      nChannelProperties,        //0
+      auxOutputEnabled,        //0
+      nAutoTriggerMS)) != PICO_OK)    //0
+    {
+      return psStatus;
+    }
+
+    if (nChannelProperties == 1)
+    {
+      hsApplied.tcpProperties = *ptcpChannelProperties;
+      hsApplied.nAuxOutputEnabled = auxOutputEnabled;
+      hsApplied.nAutoTriggerMS = nAutoTriggerMS;
+      hsApplied.isPropertiesSet = true;
+    }
   }
 
-  if ((psStatus = ps6000SetTriggerChannelConditions(handle, ptcTriggerConditions, nTriggerConditions)) != PICO_OK)
+  if (!hsApplied.isConditionsSet || nTriggerConditions != 1 ||
+    memcmp(&hsApplied.tcConditions, ptcTriggerConditions, sizeof(PS6000_TRIGGER_CONDITIONS)) != 0)
   {
-    return psStatus;
+    hsApplied.isConditionsSet = false;
+    nConfigCalls++;
+
+    if ((psStatus = ps6000SetTriggerChannelConditions(handle, ptcTriggerConditions, nTriggerConditions)) != PICO_OK)
+    {
+      return psStatus;
+    }
+
+    if (nTriggerConditions == 1)
+    {
+      hsApplied.tcConditions = *ptcTriggerConditions;
+      hsApplied.isConditionsSet = true;
+    }
   }
 
-  if ((psStatus = ps6000SetTriggerChannelDirections(handle,
-    tdDirections->channelA,
-    tdDirections->channelB,
-    tdDirections->channelC,
-    tdDirections->channelD,
-    tdDirections->ext,
-    tdDirections->aux)) != PICO_OK)
+  if (!hsApplied.isDirectionsSet || memcmp(&hsApplied.tdDirections, tdDirections, sizeof(TRIGGER_DIRECTIONS)) != 0)
   {
-    return psStatus;
+    hsApplied.isDirectionsSet = false;
+    nConfigCalls++;
+
+    if ((psStatus = ps6000SetTriggerChannelDirections(handle,
+      tdDirections->channelA,
+      tdDirections->channelB,
+      tdDirections->channelC,
+      tdDirections->channelD,
+      tdDirections->ext,
+      tdDirections->aux)) != PICO_OK)
+    {
+      return psStatus;
+    }
+
+    hsApplied.tdDirections = *tdDirections;
+    hsApplied.isDirectionsSet = true;
   }
 
+  if (!hsApplied.isDelaySet || hsApplied.nDelay != uiDelay)
+  {
+    hsApplied.isDelaySet = false;
+    nConfigCalls++;
+
+    if ((psStatus = ps6000SetTriggerDelay(handle, uiDelay)) != PICO_OK)
+    {
+      return psStatus;
+    }
+
+    hsApplied.nDelay = uiDelay;
+    hsApplied.isDelaySet = true;
+  }
 
-  if ((psStatus = ps6000SetTriggerDelay(handle, uiDelay)) != PICO_OK)
+  if (!hsApplied.isPulseWidthSet || pwq->nConditions != 0 || hsApplied.pwq.direction != pwq->direction ||
+    hsApplied.pwq.lower != pwq->lower || hsApplied.pwq.upper != pwq->upper || hsApplied.pwq.type != pwq->type)
   {
+    hsApplied.isPulseWidthSet = false;
+    nConfigCalls++;
+
+    if ((psStatus = ps6000SetPulseWidthQualifier(handle,
+      pwq->conditions,
+      pwq->nConditions,
+      pwq->direction,
+      pwq->lower,
+      pwq->upper,
+      pwq->type)) != PICO_OK)
+    {
+      return psStatus;
+    }
+
+    if (pwq->nConditions == 0)
+    {
+      hsApplied.pwq = *pwq;
+      hsApplied.isPulseWidthSet = true;
+    }
+  }
+
+  return psStatus;
+}
+
+PICO_STATUS PicoScope::setChannel(int32_t nChannel, float fOffset)
+{
+  PICO_STATUS psStatus;
+  CHANNEL_SETTINGS *pSettings = &uAllUnit.channelSettings[nChannel];
+  CHANNEL_STATE *pState = &hsApplied.acsChannel[nChannel];
+
+  if (pState->isSet && pState->enabled == pSettings->enabled && pState->nCoupling == PS6000_COUPLING(pSettings->DCcoupled) &&
+    pState->nRange == PS6000_RANGE(pSettings->range) && pState->fOffset == fOffset && pState->nBandwidth == nBandwidth)
+    return PICO_OK;
+
+  pState->isSet = false;
+
+  psStatus = ps6000SetChannel(uAllUnit.handle, PS6000_CHANNEL(PS6000_CHANNEL_A + nChannel), pSettings->enabled,
+    PS6000_COUPLING(pSettings->DCcoupled), PS6000_RANGE(pSettings->range), fOffset, nBandwidth);
+  nConfigCalls++;
+
+  if (psStatus != PICO_OK)
     return psStatus;
+
+  pState->enabled = pSettings->enabled;
+  pState->nCoupling = PS6000_COUPLING(pSettings->DCcoupled);
+  pState->nRange = PS6000_RANGE(pSettings->range);
+  pState->fOffset = fOffset;
+  pState->nBandwidth = nBandwidth;
+  pState->isSet = true;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::solveTimeBase(double lfInterval, uint32_t nMemorySegments, TIMEBASE_ENTRY *pResult)
+{
+  PICO_STATUS psStatus;
+  TIMEBASE_ENTRY *pEntry;
+  bool bFound = false;
+  uint32_t nEstimate;
+
+  // Nominal ps6000 timebases: 2^n / 5 GHz up to 4, then (n - 4) / 156.25 MHz
+  if (lfInterval < 6.4e-9)
+  {
+    double lfStep = log2(lfInterval * 5e9);
+
+    nEstimate = lfStep <= 0.0 ? 0 : (uint32_t)(lfStep + 0.5);
+    if (nEstimate > 4)
+      nEstimate = 4;
+  }
+  else
+  {
+    nEstimate = (uint32_t)(lfInterval * 156.25e6 + 0.5) + 4;
+  }
+
+  // The driver has the last word: neighbours cover rounding, slower ones the
+  // timebases this channel set cannot run at
+  for (uint32_t n = nEstimate > 0 ? nEstimate - 1 : 0; n <= nEstimate + TIMEBASE_SEARCH_STEPS; n++)
+  {
+    if (bFound && n > nEstimate + 1)
+      break;
+
+    psStatus = queryTimeBase(n, nMemorySegments, &pEntry);
+    if (psStatus != PICO_OK)
+      return psStatus;
+
+    if (pEntry->psStatus != PICO_OK)
+      continue;
+
+    // Copied out, a later query may reuse the cache slot
+    if (!bFound || fabs(pEntry->lfInterval - lfInterval) < fabs(pResult->lfInterval - lfInterval))
+    {
+      *pResult = *pEntry;
+      bFound = true;
+    }
+  }
+
+  if (!bFound)
+    return PICO_INVALID_TIMEBASE;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::queryTimeBase(uint32_t nTimeBase, uint32_t nMemorySegments, TIMEBASE_ENTRY **ppEntry)
+{
+  PICO_STATUS psStatus;
+  TIMEBASE_ENTRY *pEntry;
+  uint32_t nEnabledMask = 0;
+  float fIntervalNs = 0.f;
+  uint32_t nMaxSamples = 0;
+
+  for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
+  {
+    if (uAllUnit.channelSettings[i].enabled)
+      nEnabledMask |= 1u << i;
   }
 
-  if ((psStatus = ps6000SetPulseWidthQualifier(handle,
-    pwq->conditions,
-    pwq->nConditions,
-    pwq->direction,
-    pwq->lower,
-    pwq->upper,
-    pwq->type)) != PICO_OK)
+  for (int32_t i = 0; i < nTimeBaseCached; i++)
   {
+    pEntry = &atbTimeBase[i];
+
+    if (pEntry->nTimeBase == nTimeBase && pEntry->nSegments == nMemorySegments && pEntry->nChannelMask == nEnabledMask)
+    {
+      *ppEntry = pEntry;
+      return PICO_OK;
+    }
+  }
+
+  // One sample: the limit is nMaxSamples, compared by the caller
+  psStatus = ps6000GetTimebase2(uAllUnit.handle, nTimeBase, 1, &fIntervalNs, 0, &nMaxSamples, 0);
+  nConfigCalls++;
+
+  // Refused timebases are an answer too, anything else is a real failure
+  if (psStatus != PICO_OK && psStatus != PICO_INVALID_TIMEBASE && psStatus != PICO_TOO_MANY_SAMPLES)
     return psStatus;
+
+  if (nTimeBaseCached < TIMEBASE_CACHE_SIZE)
+  {
+    pEntry = &atbTimeBase[nTimeBaseCached++];
+  }
+  else
+  {
+    pEntry = &atbTimeBase[nTimeBaseNext];
+    nTimeBaseNext = (nTimeBaseNext + 1) % TIMEBASE_CACHE_SIZE;
+  }
+
+  pEntry->nTimeBase = nTimeBase;
+  pEntry->nSegments = nMemorySegments;
+  pEntry->nChannelMask = nEnabledMask;
+  pEntry->psStatus = psStatus;
+  pEntry->lfInterval = fIntervalNs * 1e-9;
+  pEntry->nMaxSamples = nMaxSamples;
+
+  *ppEntry = pEntry;
+
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::setupRapidBuffers(int32_t nBanks)
+{
+  PICO_STATUS psStatus;
+  int32_t nTotalSegments = nSegments * nBanks;
+
+  // Same shape as the registered set, driver keeps using it
+  if (isRapidBufferSet(nBanks) && nRapidBanks == nBanks)
+    return PICO_OK;
+
+  freeRapidBuffers();
+
+  // Sized for the whole configuration, pages only become resident as the driver fills them
+  nRapidBytes = (size_t)nDataSamples * nTotalSegments * nDataPlanes * sizeof(int16_t);
+  pnRapidBuffer = (int16_t *)allocateLargeBuffer(nRapidBytes);
+  pnOverflow = (int16_t *)calloc(nTotalSegments, sizeof(int16_t));
+  nRapidAllocations += 2;
+
+  if (pnRapidBuffer == NULL || pnOverflow == NULL)
+  {
+    freeRapidBuffers();
+    return PICO_MEMORY_FAIL;
+  }
+
+  // Mark the set registered first so a failure below unregisters what was done
+  nRapidSamples = nSamples;
+  nRapidSegments = nSegments;
+  nRapidBanks = nBanks;
+  nRapidChannelMask = nDataChannelMask;
+  nRapidRatio = nDataRatio;
+  nRapidRatioMode = nDataRatioMode;
+
+  // Bank-major, then plane, so each plane of a bank is one contiguous run
+  for (int32_t capture = 0; capture < nTotalSegments; capture++)
+  {
+    int32_t nBank = capture / nSegments;
+    int32_t nSegment = capture % nSegments;
+
+    // Counted before the calls so a capture that fails halfway is unregistered too
+    nRapidRegistered = capture + 1;
+
+    for (int32_t c = 0; c < nDataPlanes; c++)
+    {
+      int16_t *pnCapture = pnRapidBuffer + (((size_t)nBank * nDataPlanes + c) * nSegments + nSegment) * nDataSamples;
+      int16_t *pnCaptureMin = NULL;
+
+      // Aggregation fills a max/min pair, the min plane directly follows its max plane
+      if (nDataRatioMode == PS6000_RATIO_MODE_AGGREGATE)
+      {
+        pnCaptureMin = pnCapture + (size_t)nSegments * nDataSamples;
+        c++;
+      }
+
+      psStatus = ps6000SetDataBuffersBulk(uAllUnit.handle, anPlaneChannel[c], pnCapture, pnCaptureMin, nDataSamples, capture, nDataRatioMode);
+      nConfigCalls++;
+      if (psStatus != PICO_OK)
+      {
+        freeRapidBuffers();
+        return psStatus;
+      }
+    }
   }
 
+  return PICO_OK;
+}
+
+PICO_STATUS PicoScope::setupOverlapped()
+{
+  PICO_STATUS psStatus;
+  uint32_t lGetSamples = nRapidSamples;
+
+  // Deferred request, the driver repeats it after every following ps6000RunBlock
+  psStatus = ps6000GetValuesOverlappedBulk(uAllUnit.handle, 0, &lGetSamples, nDataRatio, nDataRatioMode, 0, nRapidSegments - 1, pnOverflow);
+  nConfigCalls++;
+
+  isOverlappedSet = psStatus == PICO_OK;
+
   return psStatus;
 }
 
-uint32_t PicoScope::getTimeBase(double lfAcquisitionRate)
+void PicoScope::freeRapidBuffers()
 {
-  if (inRange(2.5, lfAcquisitionRate))
-    return 1;
-  if (inRange(1.25, lfAcquisitionRate))
-    return 2;
-  if (inRange(0.625, lfAcquisitionRate))
-    return 3;
-  if (inRange(0.3125, lfAcquisitionRate))
-    return 4;
-  if (inRange(0.15625, lfAcquisitionRate))
-    return 5;
-  if (inRange(0.078125, lfAcquisitionRate))
-    return 6;
-  if (inRange(0.0390625, lfAcquisitionRate))
-    return 8;
-  return 2;
+  // Nor the recording writer
+  waitRecording(0);
+  waitRecording(1);
+
+  // The driver must not keep pointers into memory that is about to be freed.
+  // One call per channel of every capture that was registered, as many as
+  // setupRapidBuffers made, all counted in nConfigCalls.
+  if (isOpened && pnRapidBuffer)
+  {
+    for (int32_t capture = 0; capture < nRapidRegistered; capture++)
+    {
+      for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
+      {
+        if (nRapidChannelMask & (1u << i))
+        {
+          ps6000SetDataBuffersBulk(uAllUnit.handle, PS6000_CHANNEL(PS6000_CHANNEL_A + i), NULL, NULL, 0, capture, nRapidRatioMode);
+          nConfigCalls++;
+        }
+      }
+    }
+  }
+
+  freeLargeBuffer(pnRapidBuffer, nRapidBytes);
+  pnRapidBuffer = NULL;
+  nRapidBytes = 0;
+  SAFE_FREE(pnOverflow);
+  nRapidSamples = 0;
+  nRapidSegments = 0;
+  nRapidBanks = 0;
+  nRapidChannelMask = 0;
+  nRapidRatio = 1;
+  nRapidRatioMode = PS6000_RATIO_MODE_NONE;
+  nRapidRegistered = 0;
+  isOverlappedSet = false;
+}
+
+bool PicoScope::isRapidBufferSet(int32_t nBanks)
+{
+  // Registered shape against the configured one, a setConfig* call since
+  // setDigitizer(false) means the buffers no longer match
+  return pnRapidBuffer != NULL && nRapidBanks >= nBanks && nRapidRegistered == nRapidSegments * nRapidBanks &&
+    nRapidSamples == nSamples && nRapidSegments == nSegments && nRapidChannelMask == nChannelMask &&
+    nRapidRatio == nDownSampleRatio && nRapidRatioMode == nDownSampleMode;
 }
 
 void PicoScope::doTriggerSet(UNIT *unit)
@@ -584,7 +3083,7 @@ void PicoScope::doTriggerSet(UNIT *unit)
   * Rising edge
   * Threshold = 100mV */
 
-  uint32_t nDelayCount = int(lfDelayTime * (lfAcquisitionRate * 1e9));
+  uint32_t nDelayCount = int(lfDelayTime / lfDataInterval);
 
   setTrigger(unit->handle, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, nDelayCount, 0, 0);
   //setTrigger(unit->handle, &sourceDetails, 1, &conditions, 1, &directions, &pulseWidth, nDelayCount, 0, 1000);
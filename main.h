@@ -4,14 +4,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
 
 #include <node.h>
 #include <v8.h>
 
 #include "picoStatus.h"
 #include "ps6000Api.h"
+#include "bufferpool.h"
+#include "convert.h"
+#include "ringbuffer.h"
+#include "recorder.h"
+#include "codec.h"
+#include "peaks.h"
+#include "threads.h"
 
-#define MAXIMUM_BUFFER_LENGTH       20971520
+#define MAXIMUM_BUFFER_LENGTH       0x3FFFFFFF    // Largest block handed out as one Buffer
 #define DEFAULT_NUM_SAMPLE          10000
 #define DEFAULT_NUM_SEGMENT         20
 #define DEFAULT_SAMPLE_RATE         2.0                  // Unit : GHz
@@ -22,6 +30,26 @@
 #define DEFAULT_VERTICAL_COUPLING   PS6000_DC_50R
 #define DEFAULT_VERTICAL_BANDWIDTH  PS6000_BW_FULL
 #define DEFAULT_TIMEOUT             20000    // 10000 milliseconds
+#define DEFAULT_OUTPUT_FORMAT       OUTPUT_FORMAT_INT8
+#define DEFAULT_CHANNEL_MASK        0x01        // Channel A
+#define DEFAULT_PEAK_THRESHOLD      5.0         // Noise deviations
+#define DEFAULT_PEAK_MIN_WIDTH      2           // Samples
+#define DEFAULT_PEAK_NOISE_WINDOW   256         // Samples
+#define DATA_MAX_PLANES             (PS6000_MAX_CHANNELS * 2)  // Max and min of every channel when aggregating
+#define CONVERT_TILE_SAMPLES        1024        // Per channel, interleaving scratch stays in L1
+#define STREAM_DRIVER_SAMPLES       (1 << 20)   // Driver side buffer for ps6000RunStreaming
+#define STREAM_RING_SAMPLES         (1 << 25)   // Native ring between driver and JS
+#define AVERAGE_TILE_SAMPLES        2048        // Per plane, running sums stay in L1 while segments stream past
+#define AVERAGE_SUM_SEGMENTS        65536       // int32 sums of int16 samples cannot overflow below this
+#define AVERAGE_MAX_THREADS         JOB_MAX_THREADS
+#define TIMEBASE_CACHE_SIZE         64          // Driver answers kept per device
+#define TIMEBASE_SEARCH_STEPS       16          // Slower timebases tried when the nearest is refused
+#define OPEN_POLL_INTERVAL          10          // Milliseconds between ps6000OpenUnitProgress calls
+#define RECORD_FILE_MAGIC           "PS6KREC"
+#define RECORD_FILE_VERSION         3
+#define RECORD_BLOCK_MAGIC          0x4B4C4252  // "RBLK"
+#define RECORD_CODEC_NONE           0
+#define RECORD_CODEC_DELTA          1           // Planes packed by encodeRuns, one run per segment
 
 #define SAFE_FREE(ptr)          { if (ptr) { free(ptr); ptr = NULL; } }
 
@@ -45,6 +73,19 @@ typedef enum {
   MODEL_PS6407 = 0x6407, //Bandwidth: 1GHz, Memory 2GS, AWG
 } MODEL_TYPE;
 
+typedef enum {
+  OUTPUT_FORMAT_INT8 = 0,     // Upper byte of driver samples
+  OUTPUT_FORMAT_INT16,        // Driver samples as is
+  OUTPUT_FORMAT_FLOAT32,      // Calibrated volts
+  OUTPUT_FORMAT_MAX
+} OUTPUT_FORMAT;
+
+typedef enum {
+  DATA_LAYOUT_PLANAR = 0,     // One contiguous block per channel
+  DATA_LAYOUT_INTERLEAVED,    // Channel-minor, one sample of every channel after another
+  DATA_LAYOUT_MAX
+} DATA_LAYOUT;
+
 typedef struct
 {
   int16_t DCcoupled;
@@ -90,6 +131,45 @@ typedef struct tTriggerDirections
   PS6000_THRESHOLD_DIRECTION aux;
 } TRIGGER_DIRECTIONS;
 
+// Channel as last sent with ps6000SetChannel
+typedef struct tChannelState
+{
+  bool isSet;
+  int16_t enabled;
+  PS6000_COUPLING nCoupling;
+  PS6000_RANGE nRange;
+  float fOffset;
+  PS6000_BANDWIDTH_LIMITER nBandwidth;
+} CHANNEL_STATE;
+
+// What setDigitizer(false) last wrote to the device, so unchanged settings are not
+// sent again. Zeroed whenever the device state is unknown (open, close).
+typedef struct tHardwareState
+{
+  bool isInfoRead;
+  bool isEtsOff;
+  CHANNEL_STATE acsChannel[PS6000_MAX_CHANNELS];
+  uint32_t nMemorySegments;         // 0 = not set
+  uint32_t nSegmentSamples;         // Per segment, as ps6000MemorySegments answered
+  uint32_t nCaptures;
+  bool isPropertiesSet;             // Only single source / condition triggers are tracked
+  PS6000_TRIGGER_CHANNEL_PROPERTIES tcpProperties;
+  int16_t nAuxOutputEnabled;
+  int32_t nAutoTriggerMS;
+  bool isConditionsSet;
+  PS6000_TRIGGER_CONDITIONS tcConditions;
+  bool isDirectionsSet;
+  TRIGGER_DIRECTIONS tdDirections;
+  bool isDelaySet;
+  uint32_t nDelay;
+  bool isPulseWidthSet;
+  PWQ pwq;
+  uint32_t nRatioSamples;           // ps6000GetMaxDownSampleRatio asked for these
+  PS6000_RATIO_MODE nRatioMode;
+  uint32_t nRatioSegments;
+  uint32_t nMaxRatio;
+} HARDWARE_STATE;
+
 typedef struct tScopeData
 {
   int32_t      nLength;
@@ -103,6 +183,31 @@ typedef struct tScopeData
   int32_t      nShots;
   int32_t      nRealShots;
   int32_t      nTotalShots;
+  uint32_t     nBufferAllocations;
+  int32_t      nOutputFormat;
+  uint64_t     nStreamDropped;
+  bool         bOverlapped;
+  double       lfReadoutTime;     // Seconds spent reading the last acquisition out of the device
+  double       lfReadoutSaved;    // Readout time avoided per acquisition by overlapped mode
+  uint32_t     nChannelMask;      // Captured channels, bit 0 = A
+  int32_t      nChannels;
+  int32_t      nLayout;
+  double       channelGain[PS6000_MAX_CHANNELS];     // In capture order
+  double       channelOffset[PS6000_MAX_CHANNELS];
+  uint32_t     nDownSampleRatio;  // Raw samples per delivered sample
+  int32_t      nDownSampleMode;   // PS6000_RATIO_MODE
+  int32_t      nPlanes;           // Sample planes per segment, 2 per channel (max, min) when aggregating
+  bool         bAverage;          // One float32 waveform per plane, the mean of nShots segments
+  bool         bCompressed;       // Data is a codec stream, see decodeRuns
+  bool         bPeaks;            // Data is a peak block, see getPeakArrays
+  bool         bFiltered;         // Only segments passing SEGMENT_FILTER are delivered
+  int32_t      nKeptShots;        // Segments delivered by the last fetchData
+  int32_t      nPreviewWidth;     // Columns of the min / max preview, 0 without one
+  uint32_t     nTimeBase;         // As passed to ps6000RunBlock
+  uint32_t     nConfigCalls;      // Driver calls the last setDigitizer needed
+  uint64_t     nRecordedBlocks;   // Queued to the recording file
+  uint64_t     nRecordedBytes;
+  int32_t      nRecordError;      // OS error code of the recording writer, 0 if none
 
   void clear()
   {
@@ -116,9 +221,189 @@ typedef struct tScopeData
     samplingRate = 0.0;
     nShots = 0;
     nRealShots = 0;
+    nBufferAllocations = 0;
+    nOutputFormat = DEFAULT_OUTPUT_FORMAT;
+    nStreamDropped = 0;
+    bOverlapped = false;
+    lfReadoutTime = 0.0;
+    lfReadoutSaved = 0.0;
+    nChannelMask = DEFAULT_CHANNEL_MASK;
+    nChannels = 1;
+    nLayout = DATA_LAYOUT_PLANAR;
+    for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
+    {
+      channelGain[i] = 0.0;
+      channelOffset[i] = 0.0;
+    }
+    nDownSampleRatio = 1;
+    nDownSampleMode = PS6000_RATIO_MODE_NONE;
+    nPlanes = 1;
+    bAverage = false;
+    bCompressed = false;
+    bPeaks = false;
+    bFiltered = false;
+    nKeptShots = 0;
+    nPreviewWidth = 0;
+    nTimeBase = 0;
+    nConfigCalls = 0;
+    nRecordedBlocks = 0;
+    nRecordedBytes = 0;
+    nRecordError = 0;
   };
 } SCOPE_DATA;
 
+/*
+ * Recording file, little endian, written by startRecording:
+ *
+ *   RECORD_FILE_HEADER          at 0, blocks start at nDataOffset (4096)
+ *   block, repeated             one per readout, 8 byte aligned:
+ *     RECORD_BLOCK_HEADER
+ *     RECORD_SEGMENT_ENTRY      x nSegmentCount
+ *     int16 samples             nPlanes runs of nSegmentCount * nSamples, or
+ *                               nPlanes codec streams of nSegmentCount runs,
+ *                               each padded to 8 bytes, when nCodec is set
+ *     padding to 8 bytes
+ *   RECORD_DIRECTORY_ENTRY      x nDirectoryEntries at nDirectoryOffset, one per block
+ *
+ * Segment n of the file is found by a binary search of the directory on
+ * nRecordSegment, its entry then gives the file offset of its first plane.
+ * A file that was not finished has no directory, its blocks can still be
+ * walked from nDataOffset with nLength.
+ */
+
+// Channel as applied when recording started
+typedef struct tRecordChannel
+{
+  int32_t nEnabled;
+  int32_t nRange;                   // PS6000_RANGE
+  int32_t nCoupling;                // PS6000_COUPLING
+  int32_t nBandwidth;               // PS6000_BANDWIDTH_LIMITER
+  double lfOffset;                  // Volts
+} RECORD_CHANNEL;
+
+typedef struct tRecordFileHeader
+{
+  char acMagic[8];                  // RECORD_FILE_MAGIC
+  uint32_t nVersion;
+  uint32_t nHeaderSize;             // sizeof(RECORD_FILE_HEADER)
+  uint32_t nScopeDataSize;          // sizeof(SCOPE_DATA) of the writer
+  uint32_t nDataOffset;
+  uint64_t nBlocks;                 // Written when recording stops, 0 in an unfinished file
+  uint64_t nDataBytes;              // Blocks only
+  uint64_t nRecordSegments;         // Segments in all blocks
+  uint64_t nDirectoryOffset;        // 0 in an unfinished file
+  uint64_t nDirectoryEntries;
+  uint32_t nCodec;                  // RECORD_CODEC_NONE or RECORD_CODEC_DELTA
+  uint32_t nReserved;
+  double lfSampleInterval;          // Seconds between delivered samples
+  double lfDelayTime;               // Trigger delay, seconds
+  uint32_t nTimeBase;
+  uint32_t nDownSampleRatio;
+  int32_t nDownSampleMode;          // PS6000_RATIO_MODE
+  int32_t nSamples;                 // Per segment and plane
+  int32_t nSegments;                // Per acquisition
+  int32_t nPlanes;
+  int32_t anPlaneChannel[DATA_MAX_PLANES];
+  double alfPlaneGain[DATA_MAX_PLANES];    // Volts = int16 sample * gain + offset
+  double alfPlaneOffset[DATA_MAX_PLANES];
+  RECORD_CHANNEL arcChannel[PS6000_MAX_CHANNELS];
+  SCOPE_DATA sdScopeData;           // As it was when recording started
+} RECORD_FILE_HEADER;
+
+typedef struct tRecordBlockHeader
+{
+  uint32_t nMagic;                  // RECORD_BLOCK_MAGIC
+  uint32_t nSequence;               // Counts blocks of this recording
+  int32_t nFirstSegment;            // Within its acquisition
+  int32_t nSegmentCount;
+  uint64_t nTimestamp;              // uv_hrtime() of the readout, nanoseconds
+  uint64_t nLength;                 // Bytes following this header up to the next block
+  uint64_t nRecordSegment;          // Index of its first segment in the file
+} RECORD_BLOCK_HEADER;
+
+typedef struct tRecordSegmentEntry
+{
+  uint64_t nOffset;                 // File offset of the first plane of the segment, 0 when packed
+  double lfTriggerTime;             // Seconds, ps6000GetValuesTriggerTimeOffsetBulk64
+  int16_t nOverflow;                // Bit per channel, bit 0 = A
+  int16_t anReserved[3];
+} RECORD_SEGMENT_ENTRY;
+
+typedef struct tRecordDirectoryEntry
+{
+  uint64_t nOffset;                 // Of the RECORD_BLOCK_HEADER
+  uint64_t nRecordSegment;
+} RECORD_DIRECTORY_ENTRY;
+
+typedef struct tCaptureBatch
+{
+  PICO_STATUS psStatus;
+  int8_t *pData;            // Pool-owned, give back with BufferPool::release
+  int32_t nLength;          // Bytes
+  uint32_t nSequence;
+  int32_t nFirstSegment;    // Segments carried in pData
+  int32_t nSegmentCount;
+  int32_t *pnSegments;      // Pool-owned numbers of the segments that passed the filter, NULL without one
+  int32_t nKeptSegments;    // Segments in pData, nSegmentCount without a filter
+  float *pfPreview;         // Pool-owned min / max envelope of the kept segments, NULL without a preview
+  int32_t nPreviewLength;   // Bytes
+  bool isLast;              // No batch follows for this run
+} CAPTURE_BATCH;
+
+// Segments pass when any plane crosses nLevel within the window
+typedef struct tSegmentFilter
+{
+  int32_t nStart;           // First delivered sample looked at
+  int32_t nLength;          // Samples looked at, 0 for the rest of the segment
+  int16_t nLevel;           // Driver counts (int16 scale)
+  bool bBelow;              // Pass on a sample below nLevel instead of above
+} SEGMENT_FILTER;
+
+typedef void (*BATCH_CALLBACK)(CAPTURE_BATCH *pBatch, void *pParameter);
+
+class PicoScope;
+
+// ps6000GetTimebase2 answer for one timebase and memory layout
+typedef struct tTimeBaseEntry
+{
+  uint32_t nTimeBase;
+  uint32_t nSegments;       // Memory segments it was asked with
+  uint32_t nChannelMask;    // Enabled channels, they limit the fastest timebases
+  PICO_STATUS psStatus;
+  double lfInterval;        // Seconds
+  uint32_t nMaxSamples;     // Per segment
+} TIMEBASE_ENTRY;
+
+// One sample range of an averaged readout, run inline or on a helper thread
+typedef struct tAverageJob
+{
+  PicoScope *pScope;
+  int32_t nBank;
+  int32_t nFirstSegment;
+  int32_t nCount;
+  const int32_t *pnSegments; // Averaged segments, NULL for nCount from nFirstSegment
+  DATA_LAYOUT nLayout;
+  int32_t nBegin;           // Samples [nBegin, nEnd) of every plane
+  int32_t nEnd;
+  const double *plfGain;    // Per plane, applied to the mean
+  const double *plfOffset;
+  float *pfDst;
+} AVERAGE_JOB;
+
+// Consecutive segments of a readout searched for peaks on one thread
+typedef struct tPeakJob
+{
+  PicoScope *pScope;
+  int32_t nBank;
+  int32_t nFirstSegment;
+  int32_t nCount;
+  const int32_t *pnSegments; // Searched segments, NULL for nCount from nFirstSegment
+  const float *pfGain;      // Per plane, samples are searched in delivered units
+  const float *pfOffset;
+  PEAK_LIST plPeaks;
+  bool bResult;
+} PEAK_JOB;
+
 class PicoScope
 {
   public:
@@ -133,10 +418,34 @@ class PicoScope
     ~PicoScope();
 
     /**
-     * @desc Open Picoscope oscilloscope
+     * @desc Open Picoscope oscilloscope. Firmware loading is polled, so progress
+     *       is visible through getOpenProgress while this blocks. Firmware loads
+     *       are not parallel: while another unit is starting the driver refuses
+     *       this one, which is retried for up to DEFAULT_TIMEOUT.
+     * @param[in] pszSerial: Serial number of the unit, NULL for the first unit found
+     * @return PICO_STATUS
+     */
+    PICO_STATUS open(const char *pszSerial);
+
+    /**
+     * @desc Register async handle signalled whenever the open progress changes
+     * @param[in] pAsync: Initialized uv_async_t, NULL to disable
+     */
+    void setOpenNotifier(uv_async_t *pAsync);
+
+    /**
+     * @desc Percentage of the running or last open, any thread
+     */
+    int16_t getOpenProgress();
+
+    /**
+     * @desc List serial numbers of the units that are not opened yet
+     * @param[out] pszSerials: Comma separated serial numbers
+     * @param[in,out] pnLength: Size of pszSerials, on return length of the string
+     * @param[out] pnCount: Number of units found
      * @return PICO_STATUS
      */
-    PICO_STATUS open();
+    static PICO_STATUS enumerateUnits(char *pszSerials, int16_t *pnLength, int16_t *pnCount);
 
     /**
      * @desc Check device is opened
@@ -156,26 +465,269 @@ class PicoScope
      */
     PICO_STATUS resetDevice();
 
+    // Every setConfig* returns PICO_BUSY while a pipeline or stream runs: the
+    // captures in flight keep the shape their buffers were registered with
     PICO_STATUS setConfigVertical(PS6000_RANGE nFullScale, double lfOffset, PS6000_COUPLING nCoupling, PS6000_BANDWIDTH_LIMITER nBandwidth);
     PICO_STATUS setConfigHorizontal(double lfSamplerate, int32_t nSamples, int32_t nSegments);
     PICO_STATUS setConfigTrigger(double lfDelayTime);
 
+    /**
+     * @desc Select sample format returned by fetchData. Takes effect on next setDigitizer.
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigOutput(OUTPUT_FORMAT nOutputFormat);
+
+    /**
+     * @desc Select captured channels (bit 0 = A ... bit 3 = D). B and C use the signal
+     *       settings of A, D stays the trigger input. Takes effect on next setDigitizer(false).
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigChannels(uint32_t nChannelMask);
+
+    /**
+     * @desc Let the device reduce rapid block data before it crosses USB. Aggregate
+     *       delivers a max and a min plane per channel, average and decimate one.
+     *       Checked against ps6000GetMaxDownSampleRatio on next setDigitizer(false).
+     * @param[in] nRatio: Raw samples per delivered sample, 1 with PS6000_RATIO_MODE_NONE
+     * @param[in] nMode: PS6000_RATIO_MODE_NONE, _AGGREGATE, _AVERAGE or _DECIMATE
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigDownsampling(uint32_t nRatio, PS6000_RATIO_MODE nMode);
+
     /* These functions for helping purpose of MALDI */
     PICO_STATUS setDigitizer(bool bRepeat);
     PICO_STATUS doAcquisition(bool bIsSAR);
     PICO_STATUS waitForAcquisition();
-    PICO_STATUS fetchData(bool bIsSAR);
+
+    /**
+     * @desc Check whether the block armed by doAcquisition has completed. Never blocks.
+     * @param[out] pStatus: Status reported by the driver, valid when true is returned
+     * @return true when completed (or cancelled)
+     */
+    bool isAcquisitionDone(PICO_STATUS *pStatus);
+
+    /**
+     * @desc Wake up everyone waiting on the current block with PICO_CANCELLED
+     */
+    void cancelAcquisition();
+
+    /**
+     * @desc Register async handle signalled from the driver thread when a block completes
+     * @param[in] pAsync: Initialized uv_async_t, NULL to disable
+     */
+    void setReadyNotifier(uv_async_t *pAsync);
+
+    /**
+     * @desc Read out the completed block
+     * @param[in] nLayout: Arrangement of the channels in the returned buffer
+     * @return PICO_STATUS
+     */
+    PICO_STATUS fetchData(bool bIsSAR, DATA_LAYOUT nLayout);
+
+    /**
+     * @desc Split device memory into two banks of nSegments on next setDigitizer(false),
+     *       required by startPipeline
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigPipeline(bool bPipeline);
+
+    /**
+     * @desc Let the driver transfer rapid block data as soon as a block completes
+     *       (ps6000GetValuesOverlappedBulk), set up on next setDigitizer(false).
+     *       Ignored when pipeline is enabled.
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigOverlapped(bool bOverlapped);
+
+    /**
+     * @desc Deliver the mean of the segments instead of the segments, from next
+     *       setDigitizer. Every plane becomes one float32 waveform: volts with
+     *       OUTPUT_FORMAT_FLOAT32, driver counts (int16 scale) otherwise.
+     *       Pipeline batches and progressive batches are averaged on their own.
+     * @param[in] nThreads: Threads splitting the samples of a readout, 1 to AVERAGE_MAX_THREADS
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigAveraging(bool bAverage, int32_t nThreads);
+
+    /**
+     * @desc Deliver int8 / int16 data packed by encodeRuns from next setDigitizer,
+     *       one run per segment and plane (per segment when interleaved). Fetched
+     *       data and pipeline batches shrink to getDataLength() bytes, streaming
+     *       is not packed. Float32, averaged and peak output cannot be packed,
+     *       setDigitizer refuses them with PICO_INVALID_PARAMETER up front.
+     * @param[in] nThreads: Threads packing a readout, also used for recording, 1 to CODEC_MAX_THREADS
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigCompression(bool bCompress, int32_t nThreads);
+
+    /**
+     * @desc Deliver the peaks of every segment and plane instead of the samples,
+     *       from next setDigitizer, as a block read by getPeakArrays. With averaging
+     *       the averaged waveforms are searched. Heights and areas are in volts with
+     *       OUTPUT_FORMAT_FLOAT32, driver counts (int16 scale) otherwise. Cannot be
+     *       combined with compression, streaming is not searched.
+     * @param[in] pcConfig: Threshold, minimum width and noise window, see PEAK_CONFIG
+     * @param[in] nThreads: Threads splitting the segments of a readout, 1 to PEAK_MAX_THREADS
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigPeaks(bool bPeaks, const PEAK_CONFIG *pcConfig, int32_t nThreads);
+
+    /**
+     * @desc Drop segments without signal right after readout, from next setDigitizer.
+     *       Only passing segments are converted and delivered, together with their
+     *       numbers (detachKeptSegments, CAPTURE_BATCH::pnSegments). Averaging and
+     *       peaks take the passing segments only, recording keeps all of them.
+     * @param[in] psfFilter: Window and level, see SEGMENT_FILTER
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigFilter(bool bFilter, const SEGMENT_FILTER *psfFilter);
+
+    /**
+     * @desc Deliver a min / max envelope nWidth columns wide next to the data, from
+     *       next setDigitizer: float32 [segment][plane][column][min, max] of every
+     *       delivered segment, or [plane][column][min, max] of the averaged waveforms.
+     *       Volts with OUTPUT_FORMAT_FLOAT32, counts of the delivered format otherwise.
+     *       The width is cut to the samples per segment, streaming has no preview.
+     * @param[in] nWidth: Columns, 0 for no preview
+     * @param[in] bPreviewOnly: Deliver the preview instead of the data
+     * @return PICO_STATUS
+     */
+    PICO_STATUS setConfigPreview(int32_t nWidth, bool bPreviewOnly);
+
+    /**
+     * @desc Start pipelined acquisition on a native thread. Each bank is read out
+     *       while the next block captures into the other one, every batch is
+     *       passed to pfnCallback from that thread.
+     * @param[in] pfnCallback: Receives batches, owns CAPTURE_BATCH::pData
+     * @param[in] pParameter: Passed to pfnCallback
+     * @param[in] nLayout: Arrangement of the channels in every batch
+     * @return PICO_STATUS
+     */
+    PICO_STATUS startPipeline(BATCH_CALLBACK pfnCallback, void *pParameter, DATA_LAYOUT nLayout);
+
+    /**
+     * @desc Stop pipelined acquisition and wait for its thread to finish.
+     *       No callback is made after this returns.
+     * @return PICO_STATUS
+     */
+    PICO_STATUS stopPipeline();
+
+    /**
+     * @desc Arm one rapid block run and deliver completed segments while later
+     *       ones are still capturing. A native thread polls
+     *       ps6000GetNoOfProcessedCaptures and reads each newly completed range,
+     *       the last batch has isLast set. Stop with stopPipeline.
+     * @param[in] pfnCallback: Receives batches, owns CAPTURE_BATCH::pData
+     * @param[in] pParameter: Passed to pfnCallback
+     * @param[in] nLayout: Arrangement of the channels in every batch
+     * @return PICO_STATUS
+     */
+    PICO_STATUS startProgressive(BATCH_CALLBACK pfnCallback, void *pParameter, DATA_LAYOUT nLayout);
+
+    /**
+     * @desc Start continuous streaming of channel A. A native thread drains the
+     *       driver into a lock-free ring, pNotifier is signalled whenever new
+     *       samples (or an error) are available.
+     * @param[in] pNotifier: Initialized uv_async_t
+     * @return PICO_STATUS
+     */
+    PICO_STATUS startStreaming(uv_async_t *pNotifier);
+
+    /**
+     * @desc Consumer side of the ring. Converts up to nMaxSamples queued samples
+     *       to the configured output format in a pool-owned buffer.
+     * @param[out] ppData: Buffer owned by the caller, NULL when no sample is ready
+     * @param[out] pnLength: Bytes in *ppData
+     *       Unlike the other calls it may run on a thread of its own, it only
+     *       touches the ring and the state guarded by streamMutex.
+     * @return Status of the streaming thread
+     */
+    PICO_STATUS readStreaming(size_t nMaxSamples, int8_t **ppData, int32_t *pnLength);
+
+    /**
+     * @desc Stop streaming and wait for its thread to finish. Queued samples stay
+     *       readable until the next startStreaming.
+     * @return PICO_STATUS
+     */
+    PICO_STATUS stopStreaming();
+
+    /**
+     * @desc Check streaming thread is alive
+     */
+    bool isStreamingActive();
+
+    /**
+     * @desc Append every following readout (fetchData, pipeline and progressive
+     *       batches) to a file as raw int16 planes, written by a background thread
+     *       straight from the capture buffers. Needs setDigitizer(false) first.
+     * @param[in] bRecordOnly: Skip the conversion, readouts deliver no data
+     * @param[in] bCompress: Pack the planes of every block (RECORD_CODEC_DELTA)
+     * @return PICO_STATUS
+     */
+    PICO_STATUS startRecording(const char *pszPath, bool bRecordOnly, bool bCompress);
+
+    /**
+     * @desc Finish the file: wait for the writer, cut the preallocation off and
+     *       fill in the block count
+     * @return PICO_STATUS
+     */
+    PICO_STATUS stopRecording();
 
     /* Getter */
     int32_t getBufferLength();
+
+    /**
+     * @desc Bytes of the last fetched buffer, other than getBufferLength() when packed or peaks
+     */
+    int32_t getDataLength();
     int32_t getNextSegmentPad();
     int32_t getSegmentOffset();
     SCOPE_DATA *getScopeDataList();
     int8_t *getData();
     int32_t getSegmentCount();
 
-    /* Setter */
-    void setData(int8_t *pData);
+    /**
+     * @desc Take ownership of the last fetched buffer. The next fetchData will
+     *       convert into a different block, so the caller may keep this one
+     *       until it hands it back with BufferPool::release().
+     * @return Pool-owned buffer of getDataLength() bytes, NULL if none
+     */
+    int8_t *detachData();
+
+    /**
+     * @desc Take ownership of the trigger time offsets read by the last fetchData,
+     *       one per segment in seconds (ps6000GetValuesTriggerTimeOffsetBulk64)
+     * @return Pool-owned array of getTriggerTimeCount() doubles, NULL if none
+     */
+    double *detachTriggerTimes();
+
+    /**
+     * @desc Number of entries of the buffer detachTriggerTimes() returns
+     */
+    int32_t getTriggerTimeCount();
+
+    /**
+     * @desc Take ownership of the numbers of the segments the last fetchData
+     *       delivered when filtering. Trigger times are kept for these only.
+     * @return Pool-owned array of getKeptSegmentCount() int32, NULL without a filter
+     */
+    int32_t *detachKeptSegments();
+
+    /**
+     * @desc Segments delivered by the last fetchData
+     */
+    int32_t getKeptSegmentCount();
+
+    /**
+     * @desc Take ownership of the preview of the last fetchData
+     * @return Pool-owned block of getPreviewLength() bytes, NULL without a preview
+     */
+    float *detachPreview();
+
+    /**
+     * @desc Bytes of the preview detachPreview() returns
+     */
+    int32_t getPreviewLength();
 
   private:
     int32_t nSamples;
@@ -184,7 +736,134 @@ class PicoScope
     double lfSampleInterval;
     double lfDelayTime;
     int32_t nSegmentOffset;
-    int8_t pcData[MAXIMUM_BUFFER_LENGTH];
+    OUTPUT_FORMAT nOutputFormat;      // Requested by setConfigOutput
+    OUTPUT_FORMAT nDataFormat;        // Applied by setDigitizer, format of pcData
+    int8_t *pcData;
+    double *plfTriggerTimes;          // Pool-owned, seconds per segment of pcData
+    int32_t nTriggerTimes;
+    int32_t *pnKeptSegments;          // Pool-owned, segment numbers of pcData when filtering
+    int32_t nKeptSegments;
+    float *pfPreview;                 // Pool-owned, envelope of pcData
+    int32_t nPreviewLength;
+    BufferPool *pBufferPool;
+
+    // Recording, capture banks are not re-armed before their last block is written
+    Recorder *pRecorder;
+    bool bRecordOnly;
+    uint64_t anRecordTicket[2];
+    uint64_t nRecordSequence;         // Blocks written, also the next directory entry
+    RECORD_FILE_HEADER rfHeader;
+    RECORD_SEGMENT_ENTRY *aprsRecordEntries[2];   // Per bank, written in place like the samples
+    double *plfRecordTimes;
+    RECORD_DIRECTORY_ENTRY *prdRecordDirectory;
+    uint64_t nRecordDirectorySize;
+    uint64_t nRecordOffset;           // Where the next block starts
+    uint8_t *apbRecordPacked[2];      // Per bank, planes packed for the writer
+    size_t nRecordPackedSlot;         // Bytes per segment of a plane in apbRecordPacked
+    size_t nRecordPackedSize;         // Of each apbRecordPacked block
+
+    // Captured channels, requested by setConfigChannels and applied by setDigitizer(false)
+    uint32_t nChannelMask;
+    uint32_t nDataChannelMask;
+    int32_t nDataChannels;
+    PS6000_CHANNEL anDataChannel[PS6000_MAX_CHANNELS];
+    DATA_LAYOUT nDataLayout;          // Layout of the last delivered buffer
+
+    // Hardware downsampling, requested by setConfigDownsampling and applied by setDigitizer(false)
+    uint32_t nDownSampleRatio;
+    PS6000_RATIO_MODE nDownSampleMode;
+    uint32_t nDataRatio;
+    PS6000_RATIO_MODE nDataRatioMode;
+    int32_t nDataSamples;             // Delivered samples per segment and plane
+    int32_t nDataPlanes;
+    PS6000_CHANNEL anPlaneChannel[DATA_MAX_PLANES];
+
+    // Rapid block buffers registered with the driver,
+    // nRapidBanks x nDataPlanes x nRapidSegments x nDataSamples
+    int16_t *pnRapidBuffer;
+    size_t nRapidBytes;
+    int16_t *pnOverflow;
+    int32_t nRapidSamples;
+    int32_t nRapidSegments;
+    int32_t nRapidBanks;
+    uint32_t nRapidChannelMask;
+    uint32_t nRapidRatio;
+    PS6000_RATIO_MODE nRapidRatioMode;
+    int32_t nRapidRegistered;         // Captures handed to ps6000SetDataBuffersBulk, unregistered on free
+    uint32_t nRapidAllocations;
+
+    // Overlapped readout, registered for the current rapid buffers
+    bool bOverlapped;
+    bool isOverlappedSet;
+    double lfBulkReadoutTime;         // Last measured ps6000GetValuesBulk time for nBulkSamples x nBulkSegments
+    int32_t nBulkSamples;
+    int32_t nBulkSegments;
+
+    // Last applied device settings, and driver calls made by the current setDigitizer
+    HARDWARE_STATE hsApplied;
+    uint32_t nConfigCalls;
+
+    // Timebase, solved by setDigitizer(false) against the device
+    TIMEBASE_ENTRY atbTimeBase[TIMEBASE_CACHE_SIZE];
+    int32_t nTimeBaseCached;
+    int32_t nTimeBaseNext;            // Cache slot replaced next once full
+    uint32_t nDataTimeBase;
+    double lfDataInterval;            // Seconds between raw samples
+
+    // Segment averaging, requested by setConfigAveraging and applied by setDigitizer
+    bool bAverage;
+    int32_t nAverageThreads;
+    bool bDataAverage;
+    int32_t nDataAverageThreads;
+
+    // Lossless packing, requested by setConfigCompression and applied by setDigitizer
+    bool bCompress;
+    int32_t nCompressThreads;
+    bool bDataCompress;
+    int32_t nDataCompressThreads;
+
+    // Peak picking, requested by setConfigPeaks and applied by setDigitizer
+    bool bPeaks;
+    PEAK_CONFIG pcPeaks;
+    int32_t nPeakThreads;
+    bool bDataPeaks;
+    PEAK_CONFIG pcDataPeaks;
+    int32_t nDataPeakThreads;
+
+    // Segment filter, requested by setConfigFilter and applied by setDigitizer
+    bool bFilter;
+    SEGMENT_FILTER sfFilter;
+    bool bDataFilter;
+    SEGMENT_FILTER sfDataFilter;
+
+    // Min / max preview, requested by setConfigPreview and applied by setDigitizer
+    int32_t nPreviewWidth;
+    bool bPreviewOnly;
+    int32_t nDataPreviewWidth;        // Cut to nDataSamples
+    bool bDataPreviewOnly;
+
+    // Pipelined acquisition
+    bool bPipeline;
+    bool isPipelineRunning;
+    bool isProgressive;               // Thread runs runProgressive instead of runPipeline
+    bool isPipelineStopping;          // Guarded by readyMutex
+    int32_t nPipelineDelivered;       // Set by runProgressive, -1 for runPipeline
+    uv_thread_t pipelineThread;
+    BATCH_CALLBACK pfnBatchCallback;
+    void *pBatchParameter;
+
+    // Streaming acquisition
+    int16_t *pnStreamBuffer;
+    RingBuffer rbStream;
+    bool isStreaming;                 // Written under streamMutex
+    bool isStreamStopping;            // Guarded by streamMutex
+    PICO_STATUS psStreamStatus;       // Guarded by streamMutex
+    uv_mutex_t streamMutex;
+    uv_cond_t streamCond;
+    uv_thread_t streamThread;
+    uv_async_t *pStreamNotifier;
+    std::atomic<uint64_t> nStreamDropped;
+    size_t nStreamChunk;
     SCOPE_DATA sdDataList;
 
     int32_t nModelNumber;
@@ -196,15 +875,26 @@ class PicoScope
 
     int32_t nTbNextSegmentPad;
     int32_t nBufferLength;
+    int32_t nDataLength;              // Of pcData, nBufferLength unless packed or peaks
 
     int32_t nTimeOut;
     bool isOpened;
+    volatile int16_t nOpenProgress;
+    uv_async_t *pOpenNotifier;
 
+    // Block completion, set from the driver thread by onBlockReady
+    uv_mutex_t readyMutex;
+    uv_cond_t readyCond;
+    bool isAcquisitionArmed;
     bool isAcquisitionReady;
+    PICO_STATUS psReadyStatus;
+    uv_async_t *pReadyNotifier;
 
     /* Private functions */
-    bool inRange(double lfValueBase, double lfVal2);
     int16_t mvToADC(int16_t mv, int16_t ch);
+    int32_t getSampleSize(OUTPUT_FORMAT nFormat);
+    double getChannelOffset(PS6000_CHANNEL nChannel);
+    void getScale(PS6000_CHANNEL nChannel, OUTPUT_FORMAT nFormat, double *plfGain, double *plfOffset);
     void setInfo(UNIT *unit);
     uint32_t setTrigger(int16_t handle,
       PS6000_TRIGGER_CHANNEL_PROPERTIES *ptcpChannelProperties, int16_t nChannelProperties,
@@ -214,7 +904,46 @@ class PicoScope
       uint32_t uiDelay,
       int16_t auxOutputEnabled,
       int32_t nAutoTriggerMS);
-    uint32_t getTimeBase(double lfAcquisitionRate);
+    PICO_STATUS solveTimeBase(double lfInterval, uint32_t nMemorySegments, TIMEBASE_ENTRY *pResult);
+    PICO_STATUS queryTimeBase(uint32_t nTimeBase, uint32_t nMemorySegments, TIMEBASE_ENTRY **ppEntry);
+    PICO_STATUS setChannel(int32_t nChannel, float fOffset);
+    void waitOpenPoll();
+    PICO_STATUS recordSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const double *plfTimes);
+    void freeRecordIndex();
+    void waitRecording(int32_t nBank);
+    PICO_STATUS compressData(int8_t **ppcData, int32_t nCount, int32_t *pnLength);
+    PICO_STATUS pickPeaks(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, int8_t **ppcData, int32_t *pnLength);
+    void peakRange(PEAK_JOB *pJob);
+    static void peakThreadMain(void *pParameter);
+    PICO_STATUS setupRapidBuffers(int32_t nBanks);
+    bool isRapidBufferSet(int32_t nBanks);
+    void freeRapidBuffers();
+    PICO_STATUS setupOverlapped();
+    PICO_STATUS armBlock(uint32_t nSegmentIndex);
+    void convertCaptures(const int16_t *pnSrc, int8_t *pcDst, size_t nCount);
+    PICO_STATUS filterSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, int32_t **ppnKept, int32_t *pnKept);
+    PICO_STATUS deliverSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, CAPTURE_BATCH *pBatch);
+    void convertSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, DATA_LAYOUT nLayout, int8_t *pcDst);
+    void convertRun(int32_t nBank, int32_t nFirstSegment, int32_t nCount, int32_t nDstSegments, DATA_LAYOUT nLayout, int8_t *pcDst);
+    void averageSegments(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, DATA_LAYOUT nLayout, float *pfDst);
+    void averageRange(AVERAGE_JOB *pJob);
+    static void averageThreadMain(void *pParameter);
+    size_t getOutputLength(int32_t nCount);
+    PICO_STATUS makePreview(int32_t nBank, int32_t nFirstSegment, int32_t nCount, const int32_t *pnSegments, const float *pfAverage, float **ppfPreview, int32_t *pnLength);
+    size_t getPreviewOutputLength(int32_t nCount);
+    void updateScopeData();
+    PICO_STATUS readTriggerTimes(int32_t nFirstSegment, int32_t nCount, double *plfTimes);
+    PICO_STATUS readBank(int32_t nBank, CAPTURE_BATCH *pBatch);
+    void runPipeline();
+    void runProgressive();
+    PICO_STATUS readSegments(int32_t nFirstSegment, int32_t nCount, CAPTURE_BATCH *pBatch);
+    static void pipelineThreadMain(void *pParameter);
+    void runStreaming();
+    static void streamThreadMain(void *pParameter);
+    static void PREF4 onStreamingReady(int16_t handle, uint32_t noOfSamples, uint32_t startIndex, int16_t overflow,
+      uint32_t triggerAt, int16_t triggered, int16_t autoStop, void *pParameter);
+
+    static void PREF4 onBlockReady(int16_t handle, PICO_STATUS status, void *pParameter);
 
     /* These functions for helping purpose of MALDI */
     void doTriggerSet(UNIT *unit);
@@ -3,6 +3,8 @@
 #include <nan.h>
 
 #include "main.h"
+#include "workqueue.h"
+#include "recordreader.h"
 
 typedef struct _PICOSCOPE_OPTION
 {
@@ -15,12 +17,114 @@ typedef struct _PICOSCOPE_OPTION
   int32_t nSamples;
   int32_t nSegments;
   int32_t nChannel;
+  int32_t nOutputFormat;
+  bool bPipeline;
+  bool bOverlapped;
+  uint32_t nChannelMask;
+  uint32_t nDownSampleRatio;
+  int32_t nDownSampleMode;
+  bool bAverage;
+  int32_t nAverageThreads;
+  bool bCompress;
+  int32_t nCompressThreads;
+  bool bPeaks;
+  double lfPeakThreshold;
+  int32_t nPeakMinWidth;
+  int32_t nPeakNoiseWindow;
+  int32_t nPeakThreads;
+  bool bFilter;
+  int32_t nFilterStart;
+  int32_t nFilterLength;
+  int32_t nFilterLevel;
+  bool bFilterBelow;
+  int32_t nPreviewWidth;
+  bool bPreviewOnly;
 } PICOSCOPE_OPTION;
 
+// Pipelined batches: queued by the acquisition thread, drained on the main loop
+typedef struct tBatchNode
+{
+  CAPTURE_BATCH cbBatch;
+  struct tBatchNode *pNext;
+} BATCH_NODE;
+
+#define DEFAULT_STREAM_READ_SAMPLES   (1 << 16)
+#define DEVICE_SERIAL_LENGTH          32
+#define ENUMERATE_SERIALS_LENGTH      1024
+
+/*
+ * One PicoScope unit as seen from JS. Everything that used to be module
+ * global lives here, so a process can drive several scopes at once.
+ */
+class Device : public Nan::ObjectWrap
+{
+  public:
+    static void Init(v8::Local<v8::Object> module);
+
+    // Keep the JS object alive while native work refers to it
+    void addRef() { Ref(); }
+    void releaseRef() { Unref(); }
+
+    char szSerial[DEVICE_SERIAL_LENGTH];   // Empty for the first unit found
+    PicoScope *pScope;
+    PICOSCOPE_OPTION psOption;
+
+    // Driver calls run in order on this thread, never on the libuv threadpool
+    WorkQueue wqCommand;
+
+    // Open progress: signalled by the device thread while firmware loads
+    uv_async_t *pOpenProgress;
+    Nan::Callback *pProgressCallback;
+    int16_t nReportedProgress;
+
+    // Block completion: signalled by the driver callback, drained on the main loop
+    uv_async_t *pAcquisitionReady;
+    Nan::Callback *pWaitCallback;
+    bool isWaitPending;                    // Queued or registered, until the callback ran
+
+    // Pipelined batches
+    uv_async_t *pBatchReady;
+    uv_mutex_t batchMutex;
+    BATCH_NODE *pBatchHead;
+    BATCH_NODE *pBatchTail;
+    Nan::Callback *pBatchCallback;
+
+    // Streaming: the stream thread only signals, samples are pulled by readStreaming
+    uv_async_t *pStreamReady;
+    Nan::Callback *pStreamCallback;
+
+  private:
+    explicit Device(const char *pszSerial);
+    ~Device();
+
+    static void New(const Nan::FunctionCallbackInfo<v8::Value>& args);
+    static Nan::Persistent<v8::Function> constructor;
+};
+
+/*
+ * Recording file opened for reading. Views returned by read() keep the
+ * mapping alive on their own, close() only drops this object's reference.
+ */
+class Reader : public Nan::ObjectWrap
+{
+  public:
+    static void Init(v8::Local<v8::Object> module);
+
+    RecordReader *pReader;
+
+  private:
+    explicit Reader(RecordReader *pReader);
+    ~Reader();
+
+    static void New(const Nan::FunctionCallbackInfo<v8::Value>& args);
+    static Nan::Persistent<v8::Function> constructor;
+};
+
 typedef struct _WORK
 {
   // Common
   Nan::Callback *callback;
+  Device *pDevice;
   uint32_t param1;
   uint32_t param2;
   PICO_STATUS psStatus;
@@ -28,10 +132,22 @@ typedef struct _WORK
   // fetchData only
   int8_t *data;
   int32_t length;
-} WORK;
+  double *times;
+  int32_t count;
+  int32_t *segments;
+  int32_t kept;
+  float *preview;
+  int32_t previewLength;
 
-PicoScope *ppsMainObject = NULL;
-PICOSCOPE_OPTION psOption;
+  // enumerateUnits only
+  char *text;
+
+  // setOption only
+  PICOSCOPE_OPTION option;
+
+  // getScopeDataList only
+  SCOPE_DATA scopeData;
+} WORK;
 
 #define GET_VARIABLE_NAME(value)    #value
 #define NAN_NEW_STRING(str)         Nan::New<v8::String>(str).ToLocalChecked()
@@ -52,50 +168,96 @@ void postOperation(uv_work_t* ptr)
   pWork->callback->Call(ret_count, ret);
 
   // Free Work
+  if (pWork->pDevice)
+    pWork->pDevice->releaseRef();
   delete pWork->callback;
   free(pWork);
   delete ptr;
 }
 
+/* The device thread refused the request: report it right away and free like postOperation */
+
+void failOperation(uv_work_t* ptr, int nError)
+{
+  WORK *pWork = (WORK *)ptr->data;
+
+  pWork->psStatus = nError == UV_ENOMEM ? PICO_MEMORY_FAIL : PICO_OPERATION_FAILED;
+  SAFE_FREE(pWork->text);
+  postOperation(ptr);
+}
+
 void openWork(uv_work_t* ptr)
 {
   PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
   WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  // Create PicoScope object
-  ppsMainObject = new PicoScope();
-
-  if (ppsMainObject)
+  // Capture buffers wait for the first configuration
+  if (pDevice->pScope)
   {
     // Open PicoScope
-    psStatus = ppsMainObject->open();
+    pDevice->pScope->setOpenNotifier(pDevice->pOpenProgress);
+    psStatus = pDevice->pScope->open(pDevice->szSerial[0] ? pDevice->szSerial : NULL);
+    pDevice->pScope->setOpenNotifier(NULL);
+    pDevice->pScope->setReadyNotifier(pDevice->pAcquisitionReady);
   }
 
   pWork->psStatus = psStatus;
 }
 
+void openProgressPost(uv_async_t *handle)
+{
+  Device *pDevice = (Device *)handle->data;
+  Nan::HandleScope scope;
+  const int ret_count = 1;
+  v8::Local<v8::Value> ret[ret_count];
+  int16_t nProgress;
+
+  if (pDevice->pProgressCallback == NULL || pDevice->pScope == NULL)
+    return;
+
+  // Signals coalesce, report the latest value once
+  nProgress = pDevice->pScope->getOpenProgress();
+  if (nProgress == pDevice->nReportedProgress)
+    return;
+
+  pDevice->nReportedProgress = nProgress;
+
+  ret[0] = Nan::New<v8::Int32>(nProgress);
+  pDevice->pProgressCallback->Call(ret_count, ret);
+}
+
+void openPost(uv_work_t* ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  // The last signal may still be on its way, deliver it before the result
+  openProgressPost(pDevice->pOpenProgress);
+
+  if (pDevice->pProgressCallback)
+  {
+    delete pDevice->pProgressCallback;
+    pDevice->pProgressCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pOpenProgress);
+  }
+
+  postOperation(ptr);
+}
+
 /**
- * @desc Open Picoscope
+ * @desc Open Picoscope without blocking the main loop. Devices open on their
+ *       own threads, but the driver loads firmware into one unit at a time:
+ *       while another unit is starting, this one waits up to DEFAULT_TIMEOUT.
  * @param[in] callback: Callback of this function
- * @param[in-opt] option: Option of this function
- *
- * {
- *   "verticalScale": nFullScale,
- *   "verticalOffset": lfOffset,
- *   "verticalCoupling": nCoupling,
- *   "verticalBandwidth": nBandwidth,
- *   "horizontalSamplerate": lfSamplerate,
- *   "horizontalSamples": nSamples,
- *   "horizontalSegments": nSegments,
- *   "triggerDelay": lfDelayTime,
- *   "channel": nChannel
- * }
+ * @param[in-opt] progress: Called with the percentage while firmware loads
  */
 void openPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
   bool bOption = false;
 
-  if (args.Length() != 1)
+  if (args.Length() < 1 || args.Length() > 2)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
 
@@ -110,9 +272,23 @@ void openPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
     return;
   }
 
+  if (args.Length() == 2 && !args[1]->IsFunction() && !args[1]->IsUndefined())
+  {
+    Nan::ThrowTypeError("Argument 2 should be a function");
+
+    return;
+  }
+
+  if (pDevice->pProgressCallback)
+  {
+    Nan::ThrowError("Open is already running");
+
+    return;
+  }
+
   v8::Local<v8::Function> callback = args[0].As<v8::Function>();
 
-  // Assign work to libuv queue
+  // Assign work to the device thread
   WORK *pWork;
   uv_work_t *pUVWork;
 
@@ -121,22 +297,45 @@ void openPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   pUVWork->data = pWork;
   pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  // Progress keeps the loop alive until the open completes
+  if (args.Length() == 2 && args[1]->IsFunction())
+  {
+    pDevice->pProgressCallback = new Nan::Callback(args[1].As<v8::Function>());
+    pDevice->nReportedProgress = -1;
+    uv_ref((uv_handle_t *)pDevice->pOpenProgress);
+  }
 
-  uv_queue_work(uv_default_loop(), pUVWork, openWork, (uv_after_work_cb)postOperation);
+  int nError = pDevice->wqCommand.queue(pUVWork, openWork, (uv_after_work_cb)openPost);
+  if (nError != 0)
+  {
+    // No open will report progress
+    if (pDevice->pProgressCallback)
+    {
+      delete pDevice->pProgressCallback;
+      pDevice->pProgressCallback = NULL;
+      uv_unref((uv_handle_t *)pDevice->pOpenProgress);
+    }
+    failOperation(pUVWork, nError);
+  }
 }
 
 void closeWork(uv_work_t *ptr)
 {
   PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
   WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  if (ppsMainObject)
+  if (pDevice->pScope)
   {
-    psStatus = ppsMainObject->close();
-    delete ppsMainObject;
-    ppsMainObject = NULL;
+    psStatus = pDevice->pScope->close();
   }
 
+  // Let a pending waitAcquisition see the unit is gone
+  uv_async_send(pDevice->pAcquisitionReady);
+
   pWork->psStatus = psStatus;
 }
 
@@ -146,6 +345,8 @@ void closeWork(uv_work_t *ptr)
  */
 void closePre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
   if (args.Length() != 1)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
@@ -163,7 +364,7 @@ void closePre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   v8::Local<v8::Function> callback = args[0].As<v8::Function>();
 
-  // Assign work to libuv queue
+  // Assign work to the device thread
   WORK *pWork;
   uv_work_t *pUVWork;
 
@@ -172,20 +373,126 @@ void closePre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   pUVWork->data = pWork;
   pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, closeWork, (uv_after_work_cb)postOperation);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void setOptionWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+  PICOSCOPE_OPTION *pOption = &pWork->option;
+
+  PEAK_CONFIG pcPeaks;
+
+  pcPeaks.fThreshold = (float)pOption->lfPeakThreshold;
+  pcPeaks.nMinWidth = pOption->nPeakMinWidth;
+  pcPeaks.nNoiseWindow = pOption->nPeakNoiseWindow;
+
+  SEGMENT_FILTER sfFilter;
+
+  sfFilter.nStart = pOption->nFilterStart;
+  sfFilter.nLength = pOption->nFilterLength;
+  sfFilter.nLevel = (int16_t)pOption->nFilterLevel;
+  sfFilter.bBelow = pOption->bFilterBelow;
+
+  // Apply in order and stop at the first setting refused, nothing at all
+  // while a pipeline or stream runs
+  if (pDevice->pScope)
+  {
+    PicoScope *pScope = pDevice->pScope;
+    PICO_STATUS psHorizontal = pScope->setConfigHorizontal(pOption->lfSamplerate, pOption->nSamples, pOption->nSegments);
+
+    if (psHorizontal == PICO_BUSY)
+      psStatus = PICO_BUSY;
+    else if (psHorizontal != 0)
+      psStatus = PICO_INVALID_TIMEBASE;
+    else if (pScope->setConfigVertical((PS6000_RANGE)pOption->nFullScale, pOption->lfOffset, (PS6000_COUPLING)pOption->nCoupling, (PS6000_BANDWIDTH_LIMITER)pOption->nBandwidth) != 0)
+      psStatus = PICO_INVALID_VOLTAGE_RANGE;
+    else if (pScope->setConfigTrigger(pOption->lfDelayTime) != 0)
+      psStatus = PICO_INVALID_TRIGGER_PROPERTY;
+    else if (pScope->setConfigOutput((OUTPUT_FORMAT)pOption->nOutputFormat) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigPipeline(pOption->bPipeline) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigOverlapped(pOption->bOverlapped) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigChannels(pOption->nChannelMask) != 0)
+      psStatus = PICO_INVALID_CHANNEL;
+    else if (pScope->setConfigDownsampling(pOption->nDownSampleRatio, (PS6000_RATIO_MODE)pOption->nDownSampleMode) != 0)
+      psStatus = PICO_INVALID_SAMPLERATIO;
+    else if (pScope->setConfigAveraging(pOption->bAverage, pOption->nAverageThreads) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigCompression(pOption->bCompress, pOption->nCompressThreads) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigPeaks(pOption->bPeaks, &pcPeaks, pOption->nPeakThreads) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pOption->nFilterLevel < INT16_MIN || pOption->nFilterLevel > INT16_MAX)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigFilter(pOption->bFilter, &sfFilter) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else if (pScope->setConfigPreview(pOption->nPreviewWidth, pOption->bPreviewOnly) != 0)
+      psStatus = PICO_INVALID_PARAMETER;
+    else
+      psStatus = PICO_OK;
+  }
 
-  uv_queue_work(uv_default_loop(), pUVWork, closeWork, (uv_after_work_cb)postOperation);
+  pWork->psStatus = psStatus;
 }
 
 /**
- * @desc Set options to PicoScope. No callback.
- * @param[in] options: JSON of PicoScope options.
+ * @desc Set options to PicoScope. Applied on the device thread in order with
+ *       the other commands, PICO_BUSY while a pipeline or stream runs. Stops at
+ *       the first option refused and reports it, e.g. PICO_INVALID_VOLTAGE_RANGE.
+ * @param[in] options: JSON of PicoScope options
+ * @param[in] callback:
+ *
+ * {
+ *   "verticalScale": nFullScale,
+ *   "verticalOffset": lfOffset,
+ *   "verticalCoupling": nCoupling,
+ *   "verticalBandwidth": nBandwidth,
+ *   "horizontalSamplerate": lfSamplerate,
+ *   "horizontalSamples": nSamples,
+ *   "horizontalSegments": nSegments,
+ *   "triggerDelay": lfDelayTime,
+ *   "channel": nChannel,
+ *   "outputFormat": nOutputFormat (optional, OUTPUT_FORMAT),
+ *   "pipeline": bPipeline (optional, two memory banks for startPipeline),
+ *   "overlapped": bOverlapped (optional, driver reads blocks out as they complete),
+ *   "channels": nChannelMask (optional, captured channels, bit 0 = A ... bit 3 = D),
+ *   "downSampleRatio": nDownSampleRatio (optional, raw samples per delivered sample),
+ *   "downSampleMode": nDownSampleMode (optional, PS6000_RATIO_MODE, none by default),
+ *   "average": bAverage (optional, deliver the float32 mean of the segments),
+ *   "averageThreads": nAverageThreads (optional, threads summing a readout, 1 by default),
+ *   "compress": bCompress (optional, deliver int8 / int16 data packed, see decompress),
+ *   "compressThreads": nCompressThreads (optional, threads packing a readout, 1 by default),
+ *   "peaks": bPeaks (optional, deliver the peaks of the waveforms, see getPeaks),
+ *   "peakThreshold": lfPeakThreshold (optional, noise deviations above the baseline, 5 by default),
+ *   "peakMinWidth": nPeakMinWidth (optional, samples above the threshold, 2 by default),
+ *   "peakNoiseWindow": nPeakNoiseWindow (optional, samples per noise estimate, 256 by default,
+ *                      0 makes peakThreshold the level itself),
+ *   "peakThreads": nPeakThreads (optional, threads searching a readout, 1 by default),
+ *   "filter": bFilter (optional, deliver only segments crossing filterLevel),
+ *   "filterStart": nFilterStart (optional, first delivered sample looked at, 0 by default),
+ *   "filterLength": nFilterLength (optional, samples looked at, 0 for the rest of the segment),
+ *   "filterLevel": nFilterLevel (optional, int16 counts on every channel, 0 by default),
+ *   "filterBelow": bFilterBelow (optional, pass segments going below filterLevel instead),
+ *   "preview": nPreviewWidth (optional, columns of a min / max envelope delivered next to the data, 0 by default),
+ *   "previewOnly": bPreviewOnly (optional, deliver the envelope instead of the data)
+ * }
  */
-void setOption(const Nan::FunctionCallbackInfo<v8::Value>& args)
+void setOptionPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
-  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
 
   // Options
-  if (args.Length() != 1)
+  if (args.Length() != 2)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
 
@@ -200,39 +507,124 @@ void setOption(const Nan::FunctionCallbackInfo<v8::Value>& args)
     return;
   }
 
+  // Callback
+  if (!args[1]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 2 should be a function");
+
+    return;
+  }
+
   // Parse options
   v8::Local<v8::Object> options = args[0]->ToObject();
-  psOption.lfOffset = Nan::Get(options, Nan::New<v8::String>("verticalOffset").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
-  psOption.lfSamplerate = Nan::Get(options, Nan::New<v8::String>("horizontalSamplerate").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
-  psOption.lfDelayTime = Nan::Get(options, Nan::New<v8::String>("triggerDelay").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
-  psOption.nFullScale = Nan::Get(options, Nan::New<v8::String>("verticalScale").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
-  psOption.nCoupling = Nan::Get(options, Nan::New<v8::String>("verticalCoupling").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
-  psOption.nBandwidth = Nan::Get(options, Nan::New<v8::String>("verticalBandwidth").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
-  psOption.nSamples = Nan::Get(options, Nan::New<v8::String>("horizontalSamples").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
-  psOption.nSegments = Nan::Get(options, Nan::New<v8::String>("horizontalSegments").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.lfOffset = Nan::Get(options, Nan::New<v8::String>("verticalOffset").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
+  pDevice->psOption.lfSamplerate = Nan::Get(options, Nan::New<v8::String>("horizontalSamplerate").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
+  pDevice->psOption.lfDelayTime = Nan::Get(options, Nan::New<v8::String>("triggerDelay").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
+  pDevice->psOption.nFullScale = Nan::Get(options, Nan::New<v8::String>("verticalScale").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nCoupling = Nan::Get(options, Nan::New<v8::String>("verticalCoupling").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nBandwidth = Nan::Get(options, Nan::New<v8::String>("verticalBandwidth").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nSamples = Nan::Get(options, Nan::New<v8::String>("horizontalSamples").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nSegments = Nan::Get(options, Nan::New<v8::String>("horizontalSegments").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+
+  // Optional
+  pDevice->psOption.nOutputFormat = DEFAULT_OUTPUT_FORMAT;
+  if (Nan::Has(options, Nan::New<v8::String>("outputFormat").ToLocalChecked()).FromJust())
+    pDevice->psOption.nOutputFormat = Nan::Get(options, Nan::New<v8::String>("outputFormat").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.bPipeline = false;
+  if (Nan::Has(options, Nan::New<v8::String>("pipeline").ToLocalChecked()).FromJust())
+    pDevice->psOption.bPipeline = Nan::Get(options, Nan::New<v8::String>("pipeline").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+  pDevice->psOption.bOverlapped = false;
+  if (Nan::Has(options, Nan::New<v8::String>("overlapped").ToLocalChecked()).FromJust())
+    pDevice->psOption.bOverlapped = Nan::Get(options, Nan::New<v8::String>("overlapped").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+  pDevice->psOption.nChannelMask = DEFAULT_CHANNEL_MASK;
+  if (Nan::Has(options, Nan::New<v8::String>("channels").ToLocalChecked()).FromJust())
+    pDevice->psOption.nChannelMask = Nan::Get(options, Nan::New<v8::String>("channels").ToLocalChecked()).ToLocalChecked()->ToUint32()->Uint32Value();
+  pDevice->psOption.nDownSampleRatio = 1;
+  if (Nan::Has(options, Nan::New<v8::String>("downSampleRatio").ToLocalChecked()).FromJust())
+    pDevice->psOption.nDownSampleRatio = Nan::Get(options, Nan::New<v8::String>("downSampleRatio").ToLocalChecked()).ToLocalChecked()->ToUint32()->Uint32Value();
+  pDevice->psOption.nDownSampleMode = PS6000_RATIO_MODE_NONE;
+  if (Nan::Has(options, Nan::New<v8::String>("downSampleMode").ToLocalChecked()).FromJust())
+    pDevice->psOption.nDownSampleMode = Nan::Get(options, Nan::New<v8::String>("downSampleMode").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.bAverage = false;
+  if (Nan::Has(options, Nan::New<v8::String>("average").ToLocalChecked()).FromJust())
+    pDevice->psOption.bAverage = Nan::Get(options, Nan::New<v8::String>("average").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+  pDevice->psOption.nAverageThreads = 1;
+  if (Nan::Has(options, Nan::New<v8::String>("averageThreads").ToLocalChecked()).FromJust())
+    pDevice->psOption.nAverageThreads = Nan::Get(options, Nan::New<v8::String>("averageThreads").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.bCompress = false;
+  if (Nan::Has(options, Nan::New<v8::String>("compress").ToLocalChecked()).FromJust())
+    pDevice->psOption.bCompress = Nan::Get(options, Nan::New<v8::String>("compress").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+  pDevice->psOption.nCompressThreads = 1;
+  if (Nan::Has(options, Nan::New<v8::String>("compressThreads").ToLocalChecked()).FromJust())
+    pDevice->psOption.nCompressThreads = Nan::Get(options, Nan::New<v8::String>("compressThreads").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.bPeaks = false;
+  if (Nan::Has(options, Nan::New<v8::String>("peaks").ToLocalChecked()).FromJust())
+    pDevice->psOption.bPeaks = Nan::Get(options, Nan::New<v8::String>("peaks").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+  pDevice->psOption.lfPeakThreshold = DEFAULT_PEAK_THRESHOLD;
+  if (Nan::Has(options, Nan::New<v8::String>("peakThreshold").ToLocalChecked()).FromJust())
+    pDevice->psOption.lfPeakThreshold = Nan::Get(options, Nan::New<v8::String>("peakThreshold").ToLocalChecked()).ToLocalChecked()->ToNumber()->NumberValue();
+  pDevice->psOption.nPeakMinWidth = DEFAULT_PEAK_MIN_WIDTH;
+  if (Nan::Has(options, Nan::New<v8::String>("peakMinWidth").ToLocalChecked()).FromJust())
+    pDevice->psOption.nPeakMinWidth = Nan::Get(options, Nan::New<v8::String>("peakMinWidth").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nPeakNoiseWindow = DEFAULT_PEAK_NOISE_WINDOW;
+  if (Nan::Has(options, Nan::New<v8::String>("peakNoiseWindow").ToLocalChecked()).FromJust())
+    pDevice->psOption.nPeakNoiseWindow = Nan::Get(options, Nan::New<v8::String>("peakNoiseWindow").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nPeakThreads = 1;
+  if (Nan::Has(options, Nan::New<v8::String>("peakThreads").ToLocalChecked()).FromJust())
+    pDevice->psOption.nPeakThreads = Nan::Get(options, Nan::New<v8::String>("peakThreads").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+
+  pDevice->psOption.bFilter = false;
+  if (Nan::Has(options, Nan::New<v8::String>("filter").ToLocalChecked()).FromJust())
+    pDevice->psOption.bFilter = Nan::Get(options, Nan::New<v8::String>("filter").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+  pDevice->psOption.nFilterStart = 0;
+  if (Nan::Has(options, Nan::New<v8::String>("filterStart").ToLocalChecked()).FromJust())
+    pDevice->psOption.nFilterStart = Nan::Get(options, Nan::New<v8::String>("filterStart").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nFilterLength = 0;
+  if (Nan::Has(options, Nan::New<v8::String>("filterLength").ToLocalChecked()).FromJust())
+    pDevice->psOption.nFilterLength = Nan::Get(options, Nan::New<v8::String>("filterLength").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.nFilterLevel = 0;
+  if (Nan::Has(options, Nan::New<v8::String>("filterLevel").ToLocalChecked()).FromJust())
+    pDevice->psOption.nFilterLevel = Nan::Get(options, Nan::New<v8::String>("filterLevel").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.bFilterBelow = false;
+  if (Nan::Has(options, Nan::New<v8::String>("filterBelow").ToLocalChecked()).FromJust())
+    pDevice->psOption.bFilterBelow = Nan::Get(options, Nan::New<v8::String>("filterBelow").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
+
+  pDevice->psOption.nPreviewWidth = 0;
+  if (Nan::Has(options, Nan::New<v8::String>("preview").ToLocalChecked()).FromJust())
+    pDevice->psOption.nPreviewWidth = Nan::Get(options, Nan::New<v8::String>("preview").ToLocalChecked()).ToLocalChecked()->ToInt32()->Int32Value();
+  pDevice->psOption.bPreviewOnly = false;
+  if (Nan::Has(options, Nan::New<v8::String>("previewOnly").ToLocalChecked()).FromJust())
+    pDevice->psOption.bPreviewOnly = Nan::Get(options, Nan::New<v8::String>("previewOnly").ToLocalChecked()).ToLocalChecked()->ToBoolean()->BooleanValue();
 
-  // Apply
-  if (ppsMainObject)
-  {
-    ppsMainObject->setConfigVertical((PS6000_RANGE)psOption.nFullScale, psOption.lfOffset, (PS6000_COUPLING)psOption.nCoupling, (PS6000_BANDWIDTH_LIMITER)psOption.nBandwidth);
-    ppsMainObject->setConfigHorizontal(psOption.lfSamplerate, psOption.nSamples, psOption.nSegments);
-    ppsMainObject->setConfigTrigger(psOption.lfDelayTime);
+  v8::Local<v8::Function> callback = args[1].As<v8::Function>();
 
-    psStatus = PICO_OK;
-  }
+  // Assign work to the device thread, with its own copy of the options
+  WORK *pWork;
+  uv_work_t *pUVWork;
 
-  // Return
-  args.GetReturnValue().Set(Nan::New<v8::Int32>(psStatus));
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+  pWork->option = pDevice->psOption;
+
+  int nError = pDevice->wqCommand.queue(pUVWork, setOptionWork, (uv_after_work_cb)postOperation);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
 }
 
 void setDigitizerWork(uv_work_t *ptr)
 {
   PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
   WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  if (ppsMainObject)
+  if (pDevice->pScope)
   {
-    psStatus = ppsMainObject->setDigitizer(pWork->param1);
+    psStatus = pDevice->pScope->setDigitizer(pWork->param1);
   }
 
   pWork->psStatus = psStatus;
@@ -245,6 +637,8 @@ void setDigitizerWork(uv_work_t *ptr)
  */
 void setDigitizerPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
   if (args.Length() != 2)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
@@ -270,7 +664,7 @@ void setDigitizerPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   v8::Local<v8::Function> callback = args[1].As<v8::Function>();
 
-  // Assign work to libuv queue
+  // Assign work to the device thread
   WORK *pWork;
   uv_work_t *pUVWork;
 
@@ -279,64 +673,133 @@ void setDigitizerPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   pUVWork->data = pWork;
   pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
   pWork->param1 = args[0]->ToBoolean()->BooleanValue();
 
-  uv_queue_work(uv_default_loop(), pUVWork, setDigitizerWork, (uv_after_work_cb)postOperation);
+  int nError = pDevice->wqCommand.queue(pUVWork, setDigitizerWork, (uv_after_work_cb)postOperation);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void acquisitionReadyPost(uv_async_t *handle)
+{
+  Device *pDevice = (Device *)handle->data;
+  PICO_STATUS psStatus = PICO_CANCELLED;
+
+  if (pDevice->pWaitCallback == NULL)
+    return;
+
+  // Sends coalesce, so always look at the current state
+  if (pDevice->pScope && !pDevice->pScope->isAcquisitionDone(&psStatus))
+    return;
+
+  Nan::HandleScope scope;
+  const int ret_count = 1;
+  v8::Local<v8::Value> ret[ret_count];
+  Nan::Callback *callback = pDevice->pWaitCallback;
+
+  pDevice->pWaitCallback = NULL;
+  pDevice->isWaitPending = false;
+  uv_unref((uv_handle_t *)pDevice->pAcquisitionReady);
+
+  // Insert value
+  ret[0] = Nan::New<v8::Int32>(psStatus);
+
+  // Return callback
+  callback->Call(ret_count, ret);
+
+  delete callback;
+  pDevice->releaseRef();
 }
 
 void doAcquisitionWaitWork(uv_work_t *ptr)
 {
-  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  // Nothing to run: getting here means every command issued before,
+  // doAcquisition among them, has been applied on the device thread
+  (void)ptr;
+}
+
+void doAcquisitionWaitPost(uv_work_t *ptr)
+{
   WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  if (ppsMainObject)
-  {
-    psStatus = ppsMainObject->waitForAcquisition();
-  }
+  // acquisitionReadyPost takes over the callback and the Device reference
+  pDevice->pWaitCallback = pWork->callback;
+  uv_ref((uv_handle_t *)pDevice->pAcquisitionReady);
 
-  pWork->psStatus = psStatus;
+  // Block may have completed already
+  uv_async_send(pDevice->pAcquisitionReady);
+
+  free(pWork);
+  delete ptr;
 }
 
+/**
+ * @desc Wait for the block armed by doAcquisition. Queued behind the commands
+ *       issued before it, then completes from the driver's ready callback, no
+ *       thread is held while waiting.
+ * @param[in] callback:
+ */
 void doAcquisitionWaitPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
- if (args.Length() != 1)
- {
-   Nan::ThrowTypeError("Wrong number of arguments");
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
 
-   return;
- }
+    return;
+  }
 
- // Callback
- if (!args[0]->IsFunction())
- {
-   Nan::ThrowTypeError("Argument 2 should be a function");
+  if (pDevice->isWaitPending)
+  {
+    Nan::ThrowError("waitAcquisition is already pending");
 
-   return;
- }
+    return;
+  }
 
- v8::Local<v8::Function> callback = args[0].As<v8::Function>();
+  v8::Local<v8::Function> callback = args[0].As<v8::Function>();
 
- // Assign work to libuv queue
- WORK *pWork;
- uv_work_t *pUVWork;
+  // Registered on the device thread, after the doAcquisition it waits for
+  WORK *pWork;
+  uv_work_t *pUVWork;
 
- pWork = (WORK *)calloc(1, sizeof(WORK));
- pUVWork = new uv_work_t();
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
 
- pUVWork->data = pWork;
- pWork->callback = new Nan::Callback(callback);
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+  pDevice->isWaitPending = true;
 
- uv_queue_work(uv_default_loop(), pUVWork, doAcquisitionWaitWork, (uv_after_work_cb)postOperation);
+  int nError = pDevice->wqCommand.queue(pUVWork, doAcquisitionWaitWork, (uv_after_work_cb)doAcquisitionWaitPost);
+  if (nError != 0)
+  {
+    pDevice->isWaitPending = false;
+    failOperation(pUVWork, nError);
+  }
 }
 
 void doAcquisitionWork(uv_work_t *ptr)
 {
   PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
   WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  if (ppsMainObject)
+  if (pDevice->pScope)
   {
-    psStatus = ppsMainObject->doAcquisition(pWork->param1);
+    psStatus = pDevice->pScope->doAcquisition(pWork->param1);
   }
 
   pWork->psStatus = psStatus;
@@ -349,6 +812,8 @@ void doAcquisitionWork(uv_work_t *ptr)
  */
 void doAcquisitionPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
   if (args.Length() != 2)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
@@ -374,7 +839,7 @@ void doAcquisitionPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   v8::Local<v8::Function> callback = args[1].As<v8::Function>();
 
-  // Assign work to libuv queue
+  // Assign work to the device thread
   WORK *pWork;
   uv_work_t *pUVWork;
 
@@ -383,44 +848,111 @@ void doAcquisitionPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   pUVWork->data = pWork;
   pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
   pWork->param1 = args[0]->ToBoolean()->BooleanValue();
 
-  uv_queue_work(uv_default_loop(), pUVWork, doAcquisitionWork, (uv_after_work_cb)postOperation);
+  int nError = pDevice->wqCommand.queue(pUVWork, doAcquisitionWork, (uv_after_work_cb)postOperation);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void releasePoolBuffer(char *data, void *hint)
+{
+  BufferPool::release(data);
+}
+
+/* Kept segment numbers viewed in place as Int32Array, null when nothing was filtered */
+
+v8::Local<v8::Value> newSegmentArray(int32_t *pnSegments, int32_t nCount)
+{
+  if (pnSegments == NULL)
+    return Nan::Null();
+
+  v8::Local<v8::Object> segments = Nan::NewBuffer((char *)pnSegments, nCount * sizeof(int32_t), releasePoolBuffer, NULL).ToLocalChecked();
+
+  return v8::Int32Array::New(segments.As<v8::Uint8Array>()->Buffer(), segments.As<v8::Uint8Array>()->ByteOffset(), nCount);
+}
+
+/* Min / max envelope viewed in place as Float32Array, null without a preview */
+
+v8::Local<v8::Value> newPreviewArray(float *pfPreview, int32_t nLength)
+{
+  if (pfPreview == NULL)
+    return Nan::Null();
+
+  v8::Local<v8::Object> preview = Nan::NewBuffer((char *)pfPreview, nLength, releasePoolBuffer, NULL).ToLocalChecked();
+
+  return v8::Float32Array::New(preview.As<v8::Uint8Array>()->Buffer(), preview.As<v8::Uint8Array>()->ByteOffset(), nLength / sizeof(float));
 }
 
 void fetchDataPost(uv_work_t *ptr)
 {
   WORK *pWork = (WORK *)ptr->data;
   Nan::HandleScope scope;
-  const int ret_count = 2;
+  const int ret_count = 5;
   v8::Local<v8::Value> ret[ret_count];
+  v8::Local<v8::Object> times;
 
   // Insert value
   ret[0] = Nan::New<v8::Int32>(pWork->psStatus);
-  ret[1] = Nan::CopyBuffer((char *)pWork->data, pWork->length).ToLocalChecked();
+
+  // Hand the pool block to JS as is; it goes back to the pool when collected
+  if (pWork->data)
+    ret[1] = Nan::NewBuffer((char *)pWork->data, pWork->length, releasePoolBuffer, NULL).ToLocalChecked();
+  else
+    ret[1] = Nan::NewBuffer(0).ToLocalChecked();
+
+  // Trigger times are viewed in place as Float64Array, seconds per segment
+  if (pWork->times)
+    times = Nan::NewBuffer((char *)pWork->times, pWork->count * sizeof(double), releasePoolBuffer, NULL).ToLocalChecked();
+  else
+    times = Nan::NewBuffer(0).ToLocalChecked();
+  ret[2] = v8::Float64Array::New(times.As<v8::Uint8Array>()->Buffer(), times.As<v8::Uint8Array>()->ByteOffset(), pWork->times ? pWork->count : 0);
+  ret[3] = newSegmentArray(pWork->segments, pWork->kept);
+  ret[4] = newPreviewArray(pWork->preview, pWork->previewLength);
 
   // Return callback
   pWork->callback->Call(ret_count, ret);
 
   // Free Work
+  if (pWork->pDevice)
+    pWork->pDevice->releaseRef();
   delete pWork->callback;
   free(pWork);
   delete ptr;
 }
 
+bool getLayout(v8::Local<v8::Value> value, int32_t *pnLayout)
+{
+  if (!value->IsInt32())
+    return false;
+
+  *pnLayout = value->ToInt32()->Int32Value();
+
+  return *pnLayout >= DATA_LAYOUT_PLANAR && *pnLayout < DATA_LAYOUT_MAX;
+}
+
 void fetchDataWork(uv_work_t *ptr)
 {
   PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
   WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  if (ppsMainObject)
+  if (pDevice->pScope)
   {
-    psStatus = ppsMainObject->fetchData(pWork->param1);
+    psStatus = pDevice->pScope->fetchData(pWork->param1, (DATA_LAYOUT)pWork->param2);
 
     if (psStatus == PICO_OK)
     {
-      pWork->data = ppsMainObject->getData();
-      pWork->length = ppsMainObject->getBufferLength();
+      pWork->length = pDevice->pScope->getDataLength();
+      pWork->data = pDevice->pScope->detachData();
+      pWork->count = pDevice->pScope->getTriggerTimeCount();
+      pWork->times = pDevice->pScope->detachTriggerTimes();
+      pWork->kept = pDevice->pScope->getKeptSegmentCount();
+      pWork->segments = pDevice->pScope->detachKeptSegments();
+      pWork->previewLength = pDevice->pScope->getPreviewLength();
+      pWork->preview = pDevice->pScope->detachPreview();
     }
   }
 
@@ -430,11 +962,19 @@ void fetchDataWork(uv_work_t *ptr)
 /**
  * @desc Fetch data from PicoScope
  * @param[in] bIsSAR:
- * @param[in] callback:
+ * @param[in-opt] layout: DATA_LAYOUT of the channels, planar by default
+ * @param[in] callback: (result, data, triggerTimes, segments, preview), triggerTimes a Float64Array
+ *                      of seconds per delivered segment, empty if the driver had none,
+ *                      segments an Int32Array of the numbers of the delivered segments
+ *                      with the "filter" option, null without it, preview a Float32Array
+ *                      of min / max pairs with the "preview" option, null without it
  */
 void fetchDataPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
-  if (args.Length() != 2)
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+  int32_t nLayout = DATA_LAYOUT_PLANAR;
+
+  if (args.Length() != 2 && args.Length() != 3)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
 
@@ -449,17 +989,27 @@ void fetchDataPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
     return;
   }
 
+  if (args.Length() == 3)
+  {
+    if (!getLayout(args[1], &nLayout))
+    {
+      Nan::ThrowTypeError("Argument 2 should be a DATA_LAYOUT");
+
+      return;
+    }
+  }
+
   // Callback
-  if (!args[1]->IsFunction())
+  if (!args[args.Length() - 1]->IsFunction())
   {
-    Nan::ThrowTypeError("Argument 2 should be a function");
+    Nan::ThrowTypeError("Last argument should be a function");
 
     return;
   }
 
-  v8::Local<v8::Function> callback = args[1].As<v8::Function>();
+  v8::Local<v8::Function> callback = args[args.Length() - 1].As<v8::Function>();
 
-  // Assign work to libuv queue
+  // Assign work to the device thread
   WORK *pWork;
   uv_work_t *pUVWork;
 
@@ -468,36 +1018,760 @@ void fetchDataPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
 
   pUVWork->data = pWork;
   pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
   pWork->param1 = args[0]->ToBoolean()->BooleanValue();
+  pWork->param2 = nLayout;
 
-  uv_queue_work(uv_default_loop(), pUVWork, fetchDataWork, (uv_after_work_cb)fetchDataPost);
+  int nError = pDevice->wqCommand.queue(pUVWork, fetchDataWork, (uv_after_work_cb)fetchDataPost);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
 }
 
-void retcodeToString(const Nan::FunctionCallbackInfo<v8::Value>& args)
+void queueBatch(CAPTURE_BATCH *pBatch, void *pParameter)
 {
-  if (args.Length() != 1)
-  {
-    Nan::ThrowTypeError("Wrong number of arguments");
+  Device *pDevice = (Device *)pParameter;
+  BATCH_NODE *pNode = new BATCH_NODE();
 
-    return;
-  }
+  pNode->cbBatch = *pBatch;
+  pNode->pNext = NULL;
 
-  // integer
-  if (!args[0]->IsInt32())
+  uv_mutex_lock(&pDevice->batchMutex);
+
+  if (pDevice->pBatchTail)
+    pDevice->pBatchTail->pNext = pNode;
+  else
+    pDevice->pBatchHead = pNode;
+  pDevice->pBatchTail = pNode;
+
+  uv_mutex_unlock(&pDevice->batchMutex);
+
+  uv_async_send(pDevice->pBatchReady);
+}
+
+void batchReadyPost(uv_async_t *handle)
+{
+  Device *pDevice = (Device *)handle->data;
+  BATCH_NODE *pNode;
+
+  // Take everything queued so far
+  uv_mutex_lock(&pDevice->batchMutex);
+  pNode = pDevice->pBatchHead;
+  pDevice->pBatchHead = NULL;
+  pDevice->pBatchTail = NULL;
+  uv_mutex_unlock(&pDevice->batchMutex);
+
+  Nan::HandleScope scope;
+
+  while (pNode)
   {
-    Nan::ThrowTypeError("Argument 1 should be a integer");
+    BATCH_NODE *pNext = pNode->pNext;
+    CAPTURE_BATCH *pBatch = &pNode->cbBatch;
 
-    return;
+    if (pDevice->pBatchCallback)
+    {
+      const int ret_count = 8;
+      v8::Local<v8::Value> ret[ret_count];
+
+      // Insert value
+      ret[0] = Nan::New<v8::Int32>(pBatch->psStatus);
+      if (pBatch->pData)
+        ret[1] = Nan::NewBuffer((char *)pBatch->pData, pBatch->nLength, releasePoolBuffer, NULL).ToLocalChecked();
+      else
+        ret[1] = Nan::NewBuffer(0).ToLocalChecked();
+      ret[2] = Nan::New<v8::Uint32>(pBatch->nSequence);
+      ret[3] = Nan::New<v8::Int32>(pBatch->nFirstSegment);
+      ret[4] = Nan::New<v8::Int32>(pBatch->nSegmentCount);
+      ret[5] = Nan::New<v8::Boolean>(pBatch->isLast);
+      ret[6] = newSegmentArray(pBatch->pnSegments, pBatch->nKeptSegments);
+      ret[7] = newPreviewArray(pBatch->pfPreview, pBatch->nPreviewLength);
+
+      // Return callback
+      pDevice->pBatchCallback->Call(ret_count, ret);
+    }
+    else
+    {
+      BufferPool::release(pBatch->pData);
+      BufferPool::release(pBatch->pnSegments);
+      BufferPool::release(pBatch->pfPreview);
+    }
+
+    delete pNode;
+    pNode = pNext;
   }
+}
 
-  uint32_t retcode = args[0]->ToInt32()->Int32Value();
-  v8::Local<v8::String> string;
+void startPipelineWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
 
-  switch (retcode)
+  if (pDevice->pScope)
   {
-    case PICO_UNKNOWN_ERROR                             :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_UNKNOWN_ERROR                             ));   break;
-    case PICO_OK                                        :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_OK                                        ));   break;
-    case PICO_MAX_UNITS_OPENED                          :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_MAX_UNITS_OPENED                          ));   break;
+    // param2 tells a progressive run from the two bank pipeline
+    if (pWork->param2)
+      psStatus = pDevice->pScope->startProgressive(queueBatch, pDevice, (DATA_LAYOUT)pWork->param1);
+    else
+      psStatus = pDevice->pScope->startPipeline(queueBatch, pDevice, (DATA_LAYOUT)pWork->param1);
+  }
+
+  pWork->psStatus = psStatus;
+}
+
+void startPipelinePost(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  // No thread was started, give the batch slot back
+  if (pWork->psStatus != PICO_OK && pDevice->pBatchCallback)
+  {
+    delete pDevice->pBatchCallback;
+    pDevice->pBatchCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pBatchReady);
+    pDevice->releaseRef();
+  }
+
+  postOperation(ptr);
+}
+
+/**
+ * @desc Start pipelined acquisition. Requires "pipeline": true in setOption
+ *       followed by setDigitizer(false).
+ * @param[in] onBatch: Called with (result, data, sequence, firstSegment, segmentCount, last, segments, preview)
+ *                     for every batch
+ * @param[in-opt] layout: DATA_LAYOUT of the channels, planar by default
+ * @param[in] callback: Called with the result of the start
+ */
+void startPipelinePre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+  int32_t nLayout = DATA_LAYOUT_PLANAR;
+
+  if (args.Length() != 2 && args.Length() != 3)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Batch callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  if (args.Length() == 3)
+  {
+    if (!getLayout(args[1], &nLayout))
+    {
+      Nan::ThrowTypeError("Argument 2 should be a DATA_LAYOUT");
+
+      return;
+    }
+  }
+
+  // Callback
+  if (!args[args.Length() - 1]->IsFunction())
+  {
+    Nan::ThrowTypeError(args.Length() == 3 ? "Argument 3 should be a function" : "Argument 2 should be a function");
+
+    return;
+  }
+
+  if (pDevice->pBatchCallback)
+  {
+    Nan::ThrowError("Pipeline is already running");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[args.Length() - 1].As<v8::Function>();
+
+  // Batches may arrive before the start completes, the slot is taken right away
+  pDevice->pBatchCallback = new Nan::Callback(args[0].As<v8::Function>());
+  uv_ref((uv_handle_t *)pDevice->pBatchReady);
+  pDevice->addRef();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+  pWork->param1 = nLayout;
+  pWork->param2 = false;
+
+  int nError = pDevice->wqCommand.queue(pUVWork, startPipelineWork, (uv_after_work_cb)startPipelinePost);
+  if (nError != 0)
+  {
+    // No batch will arrive, give the slot back
+    delete pDevice->pBatchCallback;
+    pDevice->pBatchCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pBatchReady);
+    pDevice->releaseRef();
+    failOperation(pUVWork, nError);
+  }
+}
+
+/**
+ * @desc Arm one rapid block run and deliver segments as soon as they are captured.
+ *       Requires setDigitizer(false). Call stopPipeline after the last batch.
+ * @param[in] onBatch: Called with (result, data, sequence, firstSegment, segmentCount, last, segments, preview)
+ *                     for every completed range of segments
+ * @param[in-opt] layout: DATA_LAYOUT of the channels, planar by default
+ * @param[in] callback: Called with the result of the start
+ */
+void startProgressivePre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+  int32_t nLayout = DATA_LAYOUT_PLANAR;
+
+  if (args.Length() != 2 && args.Length() != 3)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Batch callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  if (args.Length() == 3)
+  {
+    if (!getLayout(args[1], &nLayout))
+    {
+      Nan::ThrowTypeError("Argument 2 should be a DATA_LAYOUT");
+
+      return;
+    }
+  }
+
+  // Callback
+  if (!args[args.Length() - 1]->IsFunction())
+  {
+    Nan::ThrowTypeError(args.Length() == 3 ? "Argument 3 should be a function" : "Argument 2 should be a function");
+
+    return;
+  }
+
+  if (pDevice->pBatchCallback)
+  {
+    Nan::ThrowError("Pipeline is already running");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[args.Length() - 1].As<v8::Function>();
+
+  // Batches may arrive before the start completes, the slot is taken right away
+  pDevice->pBatchCallback = new Nan::Callback(args[0].As<v8::Function>());
+  uv_ref((uv_handle_t *)pDevice->pBatchReady);
+  pDevice->addRef();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+  pWork->param1 = nLayout;
+  pWork->param2 = true;
+
+  int nError = pDevice->wqCommand.queue(pUVWork, startPipelineWork, (uv_after_work_cb)startPipelinePost);
+  if (nError != 0)
+  {
+    // No batch will arrive, give the slot back
+    delete pDevice->pBatchCallback;
+    pDevice->pBatchCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pBatchReady);
+    pDevice->releaseRef();
+    failOperation(pUVWork, nError);
+  }
+}
+
+void stopPipelineWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  if (pDevice->pScope)
+  {
+    psStatus = pDevice->pScope->stopPipeline();
+  }
+
+  pWork->psStatus = psStatus;
+}
+
+void stopPipelinePost(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  // Deliver what the thread produced before it stopped
+  batchReadyPost(pDevice->pBatchReady);
+
+  if (pDevice->pBatchCallback)
+  {
+    delete pDevice->pBatchCallback;
+    pDevice->pBatchCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pBatchReady);
+    pDevice->releaseRef();
+  }
+
+  postOperation(ptr);
+}
+
+/**
+ * @desc Stop pipelined acquisition
+ * @param[in] callback:
+ */
+void stopPipelinePre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[0].As<v8::Function>();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, stopPipelineWork, (uv_after_work_cb)stopPipelinePost);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void startRecordingWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  if (pDevice->pScope)
+    psStatus = pDevice->pScope->startRecording(pWork->text, pWork->param1 != 0, pWork->param2 != 0);
+
+  SAFE_FREE(pWork->text);
+
+  pWork->psStatus = psStatus;
+}
+
+/**
+ * @desc Write every following readout to a file as int16 planes, natively
+ *       and on a background thread. Needs setDigitizer(false) first.
+ * @param[in] path: File to create, replaced if it exists
+ * @param[in] recordOnly: Skip the conversion, readouts deliver empty data
+ * @param[in] compress: Pack the planes losslessly, see decompress
+ * @param[in] callback:
+ */
+void startRecordingPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 4)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  if (!args[0]->IsString())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a string");
+
+    return;
+  }
+
+  // Callback
+  if (!args[3]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 4 should be a function");
+
+    return;
+  }
+
+  Nan::Utf8String path(args[0]);
+  v8::Local<v8::Function> callback = args[3].As<v8::Function>();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pWork->param1 = args[1]->ToBoolean()->BooleanValue();
+  pWork->param2 = args[2]->ToBoolean()->BooleanValue();
+  pWork->text = (char *)calloc(path.length() + 1, sizeof(char));
+  if (pWork->text)
+    memcpy(pWork->text, *path, path.length());
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, startRecordingWork, (uv_after_work_cb)postOperation);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void stopRecordingWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  if (pDevice->pScope)
+    psStatus = pDevice->pScope->stopRecording();
+
+  pWork->psStatus = psStatus;
+}
+
+/**
+ * @desc Finish the recording file
+ * @param[in] callback:
+ */
+void stopRecordingPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[0].As<v8::Function>();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, stopRecordingWork, (uv_after_work_cb)postOperation);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void streamReadyPost(uv_async_t *handle)
+{
+  Device *pDevice = (Device *)handle->data;
+  Nan::HandleScope scope;
+
+  if (pDevice->pStreamCallback)
+    pDevice->pStreamCallback->Call(0, NULL);
+}
+
+void startStreamingWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  if (pDevice->pScope)
+  {
+    psStatus = pDevice->pScope->startStreaming(pDevice->pStreamReady);
+  }
+
+  pWork->psStatus = psStatus;
+}
+
+void startStreamingPost(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  // No thread was started, give the stream slot back
+  if (pWork->psStatus != PICO_OK && pDevice->pStreamCallback)
+  {
+    delete pDevice->pStreamCallback;
+    pDevice->pStreamCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pStreamReady);
+    pDevice->releaseRef();
+  }
+
+  postOperation(ptr);
+}
+
+/**
+ * @desc Start continuous streaming of channel A at the configured sample rate.
+ * @param[in] onReady: Called without arguments whenever samples are ready to read
+ * @param[in] callback: Called with the result of the start
+ */
+void startStreamingPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 2)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Ready callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  // Callback
+  if (!args[1]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 2 should be a function");
+
+    return;
+  }
+
+  if (pDevice->pStreamCallback)
+  {
+    Nan::ThrowError("Streaming is already running");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[1].As<v8::Function>();
+
+  // The stream thread may signal before the start completes, the slot is taken right away
+  pDevice->pStreamCallback = new Nan::Callback(args[0].As<v8::Function>());
+  uv_ref((uv_handle_t *)pDevice->pStreamReady);
+  pDevice->addRef();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, startStreamingWork, (uv_after_work_cb)startStreamingPost);
+  if (nError != 0)
+  {
+    // The stream thread never starts, give the slot back
+    delete pDevice->pStreamCallback;
+    pDevice->pStreamCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pStreamReady);
+    pDevice->releaseRef();
+    failOperation(pUVWork, nError);
+  }
+}
+
+/**
+ * @desc Pull converted samples out of the stream ring. No callback.
+ * @param[in] maxSamples: Upper bound of samples returned (optional)
+ * @return { result, data, active } - data is empty when nothing is queued,
+ *         active is false once the stream thread has stopped or failed
+ */
+void readStreaming(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  uint32_t nMaxSamples = DEFAULT_STREAM_READ_SAMPLES;
+  int8_t *pData = NULL;
+  int32_t nLength = 0;
+  bool bActive = false;
+
+  if (args.Length() > 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  if (args.Length() == 1)
+  {
+    if (!args[0]->IsUint32() || args[0]->ToUint32()->Uint32Value() == 0)
+    {
+      Nan::ThrowTypeError("Argument 1 should be a positive integer");
+
+      return;
+    }
+
+    nMaxSamples = args[0]->ToUint32()->Uint32Value();
+  }
+
+  if (pDevice->pScope)
+  {
+    psStatus = pDevice->pScope->readStreaming(nMaxSamples, &pData, &nLength);
+    bActive = pDevice->pScope->isStreamingActive();
+  }
+
+  v8::Local<v8::Object> ret = Nan::New<v8::Object>();
+
+  Nan::Set(ret, NAN_NEW_STRING("result"), Nan::New<v8::Int32>(psStatus));
+  if (pData)
+    Nan::Set(ret, NAN_NEW_STRING("data"), Nan::NewBuffer((char *)pData, nLength, releasePoolBuffer, NULL).ToLocalChecked());
+  else
+    Nan::Set(ret, NAN_NEW_STRING("data"), Nan::NewBuffer(0).ToLocalChecked());
+  Nan::Set(ret, NAN_NEW_STRING("active"), Nan::New<v8::Boolean>(bActive));
+
+  args.GetReturnValue().Set(ret);
+}
+
+void stopStreamingWork(uv_work_t *ptr)
+{
+  PICO_STATUS psStatus = PICO_UNKNOWN_ERROR;
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  if (pDevice->pScope)
+  {
+    psStatus = pDevice->pScope->stopStreaming();
+  }
+
+  pWork->psStatus = psStatus;
+}
+
+void stopStreamingPost(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  // Last notification so the reader drains what is left in the ring
+  streamReadyPost(pDevice->pStreamReady);
+
+  if (pDevice->pStreamCallback)
+  {
+    delete pDevice->pStreamCallback;
+    pDevice->pStreamCallback = NULL;
+    uv_unref((uv_handle_t *)pDevice->pStreamReady);
+    pDevice->releaseRef();
+  }
+
+  postOperation(ptr);
+}
+
+/**
+ * @desc Stop streaming
+ * @param[in] callback:
+ */
+void stopStreamingPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[0].As<v8::Function>();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, stopStreamingWork, (uv_after_work_cb)stopStreamingPost);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void retcodeToString(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // integer
+  if (!args[0]->IsInt32())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a integer");
+
+    return;
+  }
+
+  uint32_t retcode = args[0]->ToInt32()->Int32Value();
+  v8::Local<v8::String> string;
+
+  switch (retcode)
+  {
+    case PICO_UNKNOWN_ERROR                             :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_UNKNOWN_ERROR                             ));   break;
+    case PICO_OK                                        :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_OK                                        ));   break;
+    case PICO_MAX_UNITS_OPENED                          :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_MAX_UNITS_OPENED                          ));   break;
     case PICO_MEMORY_FAIL                               :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_MEMORY_FAIL                               ));   break;
     case PICO_NOT_FOUND                                 :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_NOT_FOUND                                 ));   break;
     case PICO_FW_FAIL                                   :   string = NAN_NEW_STRING(GET_VARIABLE_NAME(PICO_FW_FAIL                                   ));   break;
@@ -650,260 +1924,1061 @@ void retcodeToString(const Nan::FunctionCallbackInfo<v8::Value>& args)
     default:                                                string = NAN_NEW_STRING("Invalid retcode"                                                 );    break;
   }
 
-  // Return
-  args.GetReturnValue().Set(string);
+  // Return
+  args.GetReturnValue().Set(string);
+}
+
+void defineConstants(v8::Local<v8::Object> module)
+{
+  v8::Isolate* moduleIsolate = module->GetIsolate();
+  v8::Local<v8::Context> moduleContext = moduleIsolate->GetCurrentContext();
+  v8::PropertyAttribute constant_attributes = static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontDelete);
+
+  // Add PICO_STATUS constants
+  v8::Local<v8::Object> retcodes = Nan::New<v8::Object>();
+  {
+    NODE_DEFINE_CONSTANT(retcodes, PICO_UNKNOWN_ERROR);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_OK);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_MAX_UNITS_OPENED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_MEMORY_FAIL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_FOUND);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_FW_FAIL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_OPEN_OPERATION_IN_PROGRESS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_OPERATION_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_RESPONDING);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CONFIG_FAIL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_KERNEL_DRIVER_TOO_OLD);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_EEPROM_CORRUPT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_OS_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_HANDLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_PARAMETER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_TIMEBASE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_VOLTAGE_RANGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CHANNEL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_TRIGGER_CHANNEL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CONDITION_CHANNEL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_SIGNAL_GENERATOR);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_STREAMING_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_BLOCK_MODE_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NULL_PARAMETER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_MODE_SET);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DATA_NOT_AVAILABLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_STRING_BUFFER_TO_SMALL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_AUTO_TRIGGER_TIME_TO_SHORT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_BUFFER_STALL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TOO_MANY_SAMPLES);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TOO_MANY_SEGMENTS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_PULSE_WIDTH_QUALIFIER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DELAY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SOURCE_DETAILS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CONDITIONS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_USER_CALLBACK);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DEVICE_SAMPLING);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_SAMPLES_AVAILABLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SEGMENT_OUT_OF_RANGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_BUSY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_STARTINDEX_INVALID);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_INFO);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INFO_UNAVAILABLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_SAMPLE_INTERVAL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_ERROR);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_MEMORY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_PARAM);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SHOTS_SWEEPS_WARNING);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_TRIGGER_SOURCE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_AUX_OUTPUT_CONFLICT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_AUX_OUTPUT_ETS_CONFLICT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_WARNING_EXT_THRESHOLD_CONFLICT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_WARNING_AUX_OUTPUT_CONFLICT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_OUTPUT_OVER_VOLTAGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DELAY_NULL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_BUFFER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_OFFSET_VOLTAGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_PK_TO_PK);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CANCELLED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SEGMENT_NOT_USED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CALL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_GET_VALUES_INTERRUPTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_USED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_SAMPLERATIO);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_STATE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_ENOUGH_SEGMENTS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DRIVER_FUNCTION);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_RESERVED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_COUPLING);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_BUFFERS_NOT_SET);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_RATIO_MODE_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_RAPID_NOT_SUPPORT_AGGREGATION);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_TRIGGER_PROPERTY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INTERFACE_NOT_CONNECTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_RESISTANCE_AND_PROBE_NOT_ALLOWED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_WAVEFORM_SETUP_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_FPGA_FAIL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_MANAGER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_ANALOGUE_OFFSET);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_PLL_LOCK_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ANALOG_BOARD);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CONFIG_FAIL_AWG);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INITIALISE_FPGA);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_EXTERNAL_FREQUENCY_INVALID);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CLOCK_CHANGE_ERROR);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_AND_EXTERNAL_CLOCK_CLASH);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_PWQ_AND_EXTERNAL_CLOCK_CLASH);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_UNABLE_TO_OPEN_SCALING_FILE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_MEMORY_CLOCK_FREQUENCY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_I2C_NOT_RESPONDING);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_CAPTURES_AVAILABLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_USED_IN_THIS_CAPTURE_MODE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_GET_DATA_ACTIVE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_IP_NETWORKED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_IP_ADDRESS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_IPSOCKET_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_IPSOCKET_TIMEDOUT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SETTINGS_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NETWORK_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_WS2_32_DLL_NOT_LOADED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_IP_PORT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_COUPLING_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_BANDWIDTH_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_BANDWIDTH);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_AWG_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_NOT_RUNNING);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_WHITENOISE_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_WAVETYPE_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DIGITAL_PORT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DIGITAL_CHANNEL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DIGITAL_TRIGGER_DIRECTION);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_PRBS_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_NOT_AVAILABLE_WITH_LOGIC_CHANNELS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_WARNING_REPEAT_VALUE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_CONNECTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_NOT_CONNECTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_REQUEST_INVALID);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_UNDERVOLTAGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CAPTURING_DATA);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_USB3_0_DEVICE_NON_USB3_0_PORT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_SUPPORTED_BY_THIS_DEVICE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DEVICE_RESOLUTION);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_NUMBER_CHANNELS_FOR_RESOLUTION);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_CHANNEL_DISABLED_DUE_TO_USB_POWERED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_DC_VOLTAGE_NOT_CONFIGURABLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_TRIGGER_ENABLED_FOR_TRIGGER_IN_PRE_TRIG);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_WITHIN_PRE_TRIG_NOT_ARMED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_WITHIN_PRE_NOT_ALLOWED_WITH_DELAY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_INDEX_UNAVAILABLE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_AWG_CLOCK_FREQUENCY);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_TOO_MANY_CHANNELS_IN_USE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_NULL_CONDITIONS);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DUPLICATE_CONDITION_SOURCE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CONDITION_INFO);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SETTINGS_READ_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SETTINGS_WRITE_FAILED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ARGUMENT_OUT_OF_RANGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_HARDWARE_VERSION_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DIGITAL_HARDWARE_VERSION_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_ANALOGUE_HARDWARE_VERSION_NOT_SUPPORTED);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_UNABLE_TO_CONVERT_TO_RESISTANCE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DUPLICATED_CHANNEL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_RESISTANCE_CONVERSION);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_VALUE_IN_MAX_BUFFER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_VALUE_IN_MIN_BUFFER);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_FREQUENCY_OUT_OF_RANGE);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_EEPROM2_CORRUPT);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_EEPROM2_FAIL);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_DEVICE_TIME_STAMP_RESET);
+    NODE_DEFINE_CONSTANT(retcodes, PICO_WATCHDOGTIMER);
+  }
+
+  Nan::SetMethod(retcodes, "toString", retcodeToString);
+
+  v8::Local<v8::String> retcode_name = v8::String::NewFromUtf8(moduleIsolate, "PICO_STATUS");
+  module->DefineOwnProperty(moduleContext, retcode_name, retcodes, constant_attributes).FromJust();
+
+  // Add PS6000_RANGE constants
+  v8::Local<v8::Object> ranges = Nan::New<v8::Object>();
+  {
+    NODE_DEFINE_CONSTANT(ranges, PS6000_10MV);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_20MV);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_50MV);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_100MV);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_200MV);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_500MV);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_1V);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_2V);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_5V);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_10V);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_20V);
+    NODE_DEFINE_CONSTANT(ranges, PS6000_50V);
+  }
+
+  v8::Local<v8::String> ranges_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_RANGE");
+  module->DefineOwnProperty(moduleContext, ranges_name, ranges, constant_attributes).FromJust();
+
+  // Add PS6000_COUPLING constants
+  v8::Local<v8::Object> couplings = Nan::New<v8::Object>();
+
+  NODE_DEFINE_CONSTANT(couplings, PS6000_AC);
+  NODE_DEFINE_CONSTANT(couplings, PS6000_DC_1M);
+  NODE_DEFINE_CONSTANT(couplings, PS6000_DC_50R);
+
+  v8::Local<v8::String> couplings_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_COUPLING");
+  module->DefineOwnProperty(moduleContext, couplings_name, couplings, constant_attributes).FromJust();
+
+  // Add PS6000_BANDWIDTH_LIMITER constants
+  v8::Local<v8::Object> bandwidths = Nan::New<v8::Object>();
+
+  NODE_DEFINE_CONSTANT(bandwidths, PS6000_BW_FULL);
+  NODE_DEFINE_CONSTANT(bandwidths, PS6000_BW_20MHZ);
+  NODE_DEFINE_CONSTANT(bandwidths, PS6000_BW_25MHZ);
+
+  v8::Local<v8::String> bandwidths_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_BANDWIDTH_LIMITER");
+  module->DefineOwnProperty(moduleContext, bandwidths_name, bandwidths, constant_attributes).FromJust();
+
+  // Add OUTPUT_FORMAT constants
+  v8::Local<v8::Object> formats = Nan::New<v8::Object>();
+
+  NODE_DEFINE_CONSTANT(formats, OUTPUT_FORMAT_INT8);
+  NODE_DEFINE_CONSTANT(formats, OUTPUT_FORMAT_INT16);
+  NODE_DEFINE_CONSTANT(formats, OUTPUT_FORMAT_FLOAT32);
+
+  v8::Local<v8::String> formats_name = v8::String::NewFromUtf8(moduleIsolate, "OUTPUT_FORMAT");
+  module->DefineOwnProperty(moduleContext, formats_name, formats, constant_attributes).FromJust();
+
+  // Add DATA_LAYOUT constants
+  v8::Local<v8::Object> layouts = Nan::New<v8::Object>();
+
+  NODE_DEFINE_CONSTANT(layouts, DATA_LAYOUT_PLANAR);
+  NODE_DEFINE_CONSTANT(layouts, DATA_LAYOUT_INTERLEAVED);
+
+  v8::Local<v8::String> layouts_name = v8::String::NewFromUtf8(moduleIsolate, "DATA_LAYOUT");
+  module->DefineOwnProperty(moduleContext, layouts_name, layouts, constant_attributes).FromJust();
+
+  // Add PS6000_RATIO_MODE constants
+  v8::Local<v8::Object> ratioModes = Nan::New<v8::Object>();
+
+  NODE_DEFINE_CONSTANT(ratioModes, PS6000_RATIO_MODE_NONE);
+  NODE_DEFINE_CONSTANT(ratioModes, PS6000_RATIO_MODE_AGGREGATE);
+  NODE_DEFINE_CONSTANT(ratioModes, PS6000_RATIO_MODE_AVERAGE);
+  NODE_DEFINE_CONSTANT(ratioModes, PS6000_RATIO_MODE_DECIMATE);
+
+  v8::Local<v8::String> ratioModes_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_RATIO_MODE");
+  module->DefineOwnProperty(moduleContext, ratioModes_name, ratioModes, constant_attributes).FromJust();
+}
+
+void getScopeDataListWork(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Device *pDevice = pWork->pDevice;
+
+  // Copied here, in order with the commands that write it
+  if (pDevice->pScope)
+  {
+    pWork->scopeData = *pDevice->pScope->getScopeDataList();
+    pWork->psStatus = PICO_OK;
+  }
+  else
+  {
+    pWork->psStatus = PICO_UNKNOWN_ERROR;
+  }
+}
+
+void getScopeDataListPost(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Nan::HandleScope scope;
+  const int ret_count = 2;
+  v8::Local<v8::Value> ret[ret_count];
+  v8::Local<v8::Object> list = Nan::New<v8::Object>();
+  SCOPE_DATA *data = &pWork->scopeData;
+
+  Nan::Set(list, Nan::New<v8::String>("nLength").ToLocalChecked(), Nan::New<v8::Int32>(data->nLength));
+  Nan::Set(list, Nan::New<v8::String>("absoluteInitialX").ToLocalChecked(), Nan::New<v8::Number>(data->absoluteInitialX));
+  Nan::Set(list, Nan::New<v8::String>("relativeInitialX").ToLocalChecked(), Nan::New<v8::Number>(data->relativeInitialX));
+  Nan::Set(list, Nan::New<v8::String>("actualSamples").ToLocalChecked(), Nan::New<v8::Int32>(data->actualSamples));
+  Nan::Set(list, Nan::New<v8::String>("gain").ToLocalChecked(), Nan::New<v8::Number>(data->gain));
+  Nan::Set(list, Nan::New<v8::String>("offset").ToLocalChecked(), Nan::New<v8::Number>(data->offset));
+  Nan::Set(list, Nan::New<v8::String>("xIncrement").ToLocalChecked(), Nan::New<v8::Number>(data->xIncrement));
+  Nan::Set(list, Nan::New<v8::String>("samplingRate").ToLocalChecked(), Nan::New<v8::Number>(data->samplingRate));
+  Nan::Set(list, Nan::New<v8::String>("nShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nShots));
+  Nan::Set(list, Nan::New<v8::String>("nRealShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nRealShots));
+  Nan::Set(list, Nan::New<v8::String>("nTotalShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nTotalShots));
+  Nan::Set(list, Nan::New<v8::String>("nBufferAllocations").ToLocalChecked(), Nan::New<v8::Uint32>(data->nBufferAllocations));
+  Nan::Set(list, Nan::New<v8::String>("nOutputFormat").ToLocalChecked(), Nan::New<v8::Int32>(data->nOutputFormat));
+  Nan::Set(list, Nan::New<v8::String>("nStreamDropped").ToLocalChecked(), Nan::New<v8::Number>((double)data->nStreamDropped));
+  Nan::Set(list, Nan::New<v8::String>("bOverlapped").ToLocalChecked(), Nan::New<v8::Boolean>(data->bOverlapped));
+  Nan::Set(list, Nan::New<v8::String>("lfReadoutTime").ToLocalChecked(), Nan::New<v8::Number>(data->lfReadoutTime));
+  Nan::Set(list, Nan::New<v8::String>("lfReadoutSaved").ToLocalChecked(), Nan::New<v8::Number>(data->lfReadoutSaved));
+  Nan::Set(list, Nan::New<v8::String>("nChannelMask").ToLocalChecked(), Nan::New<v8::Uint32>(data->nChannelMask));
+  Nan::Set(list, Nan::New<v8::String>("nChannels").ToLocalChecked(), Nan::New<v8::Int32>(data->nChannels));
+  Nan::Set(list, Nan::New<v8::String>("nLayout").ToLocalChecked(), Nan::New<v8::Int32>(data->nLayout));
+  Nan::Set(list, Nan::New<v8::String>("nDownSampleRatio").ToLocalChecked(), Nan::New<v8::Uint32>(data->nDownSampleRatio));
+  Nan::Set(list, Nan::New<v8::String>("nDownSampleMode").ToLocalChecked(), Nan::New<v8::Int32>(data->nDownSampleMode));
+  Nan::Set(list, Nan::New<v8::String>("nPlanes").ToLocalChecked(), Nan::New<v8::Int32>(data->nPlanes));
+  Nan::Set(list, Nan::New<v8::String>("bAverage").ToLocalChecked(), Nan::New<v8::Boolean>(data->bAverage));
+  Nan::Set(list, Nan::New<v8::String>("bCompressed").ToLocalChecked(), Nan::New<v8::Boolean>(data->bCompressed));
+  Nan::Set(list, Nan::New<v8::String>("bPeaks").ToLocalChecked(), Nan::New<v8::Boolean>(data->bPeaks));
+  Nan::Set(list, Nan::New<v8::String>("bFiltered").ToLocalChecked(), Nan::New<v8::Boolean>(data->bFiltered));
+  Nan::Set(list, Nan::New<v8::String>("nKeptShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nKeptShots));
+  Nan::Set(list, Nan::New<v8::String>("nPreviewWidth").ToLocalChecked(), Nan::New<v8::Int32>(data->nPreviewWidth));
+  Nan::Set(list, Nan::New<v8::String>("nTimeBase").ToLocalChecked(), Nan::New<v8::Uint32>(data->nTimeBase));
+  Nan::Set(list, Nan::New<v8::String>("nConfigCalls").ToLocalChecked(), Nan::New<v8::Uint32>(data->nConfigCalls));
+  Nan::Set(list, Nan::New<v8::String>("nRecordedBlocks").ToLocalChecked(), Nan::New<v8::Number>((double)data->nRecordedBlocks));
+  Nan::Set(list, Nan::New<v8::String>("nRecordedBytes").ToLocalChecked(), Nan::New<v8::Number>((double)data->nRecordedBytes));
+  Nan::Set(list, Nan::New<v8::String>("nRecordError").ToLocalChecked(), Nan::New<v8::Int32>(data->nRecordError));
+
+  v8::Local<v8::Array> channelGain = Nan::New<v8::Array>(data->nChannels);
+  v8::Local<v8::Array> channelOffset = Nan::New<v8::Array>(data->nChannels);
+
+  for (int32_t i = 0; i < data->nChannels; i++)
+  {
+    Nan::Set(channelGain, i, Nan::New<v8::Number>(data->channelGain[i]));
+    Nan::Set(channelOffset, i, Nan::New<v8::Number>(data->channelOffset[i]));
+  }
+
+  Nan::Set(list, Nan::New<v8::String>("channelGain").ToLocalChecked(), channelGain);
+  Nan::Set(list, Nan::New<v8::String>("channelOffset").ToLocalChecked(), channelOffset);
+
+  // Insert value
+  ret[0] = Nan::New<v8::Int32>(pWork->psStatus);
+  ret[1] = list;
+
+  // Return callback
+  pWork->callback->Call(ret_count, ret);
+
+  // Free Work
+  if (pWork->pDevice)
+    pWork->pDevice->releaseRef();
+  delete pWork->callback;
+  free(pWork);
+  delete ptr;
+}
+
+/**
+ * @desc Get the description of the last delivered data
+ * @param[in] callback: Called with (result, list)
+ */
+void getScopeDataListPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Device *pDevice = Nan::ObjectWrap::Unwrap<Device>(args.Holder());
+
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[0].As<v8::Function>();
+
+  // Assign work to the device thread
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+  pWork->pDevice = pDevice;
+  pDevice->addRef();
+
+  int nError = pDevice->wqCommand.queue(pUVWork, getScopeDataListWork, (uv_after_work_cb)getScopeDataListPost);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+void enumerateUnitsWork(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  int16_t nLength = ENUMERATE_SERIALS_LENGTH;
+  int16_t nCount = 0;
+
+  pWork->text = (char *)calloc(ENUMERATE_SERIALS_LENGTH, sizeof(char));
+
+  if (pWork->text)
+    pWork->psStatus = PicoScope::enumerateUnits(pWork->text, &nLength, &nCount);
+  else
+    pWork->psStatus = PICO_MEMORY_FAIL;
+}
+
+void enumerateUnitsPost(uv_work_t *ptr)
+{
+  WORK *pWork = (WORK *)ptr->data;
+  Nan::HandleScope scope;
+  const int ret_count = 2;
+  v8::Local<v8::Value> ret[ret_count];
+  v8::Local<v8::Array> serials = Nan::New<v8::Array>();
+
+  // Serials come back as one comma separated string
+  if (pWork->psStatus == PICO_OK && pWork->text)
+  {
+    uint32_t nIndex = 0;
+    char *pszToken = strtok(pWork->text, ",");
+
+    while (pszToken)
+    {
+      Nan::Set(serials, nIndex++, NAN_NEW_STRING(pszToken));
+      pszToken = strtok(NULL, ",");
+    }
+  }
+
+  // Insert value
+  ret[0] = Nan::New<v8::Int32>(pWork->psStatus);
+  ret[1] = serials;
+
+  // Return callback
+  pWork->callback->Call(ret_count, ret);
+
+  // Free Work
+  SAFE_FREE(pWork->text);
+  delete pWork->callback;
+  free(pWork);
+  delete ptr;
+}
+
+/**
+ * @desc List serial numbers of the connected units that are not opened yet
+ * @param[in] callback: Called with (result, serials)
+ */
+void enumerateUnitsPre(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  // Callback
+  if (!args[0]->IsFunction())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a function");
+
+    return;
+  }
+
+  v8::Local<v8::Function> callback = args[0].As<v8::Function>();
+
+  // Assign work to libuv queue
+  WORK *pWork;
+  uv_work_t *pUVWork;
+
+  pWork = (WORK *)calloc(1, sizeof(WORK));
+  pUVWork = new uv_work_t();
+
+  pUVWork->data = pWork;
+  pWork->callback = new Nan::Callback(callback);
+
+  int nError = uv_queue_work(uv_default_loop(), pUVWork, enumerateUnitsWork, (uv_after_work_cb)enumerateUnitsPost);
+  if (nError != 0)
+    failOperation(pUVWork, nError);
+}
+
+Nan::Persistent<v8::Function> Device::constructor;
+
+void closeAsyncHandle(uv_handle_t *handle)
+{
+  delete (uv_async_t *)handle;
+}
+
+uv_async_t *newAsyncHandle(Device *pDevice, uv_async_cb callback)
+{
+  uv_async_t *handle = new uv_async_t();
+
+  uv_async_init(uv_default_loop(), handle, callback);
+  uv_unref((uv_handle_t *)handle);
+  handle->data = pDevice;
+
+  return handle;
+}
+
+Device::Device(const char *pszSerial)
+{
+  memset(szSerial, 0, sizeof(szSerial));
+  if (pszSerial)
+    strncpy(szSerial, pszSerial, sizeof(szSerial) - 1);
+
+  // Lives as long as this object, open and close only change the unit behind it
+  pScope = new PicoScope();
+  memset(&psOption, 0, sizeof(psOption));
+  psOption.nOutputFormat = DEFAULT_OUTPUT_FORMAT;
+  psOption.nChannelMask = DEFAULT_CHANNEL_MASK;
+  psOption.nDownSampleRatio = 1;
+  psOption.nDownSampleMode = PS6000_RATIO_MODE_NONE;
+  psOption.nAverageThreads = 1;
+  psOption.nCompressThreads = 1;
+  psOption.lfPeakThreshold = DEFAULT_PEAK_THRESHOLD;
+  psOption.nPeakMinWidth = DEFAULT_PEAK_MIN_WIDTH;
+  psOption.nPeakNoiseWindow = DEFAULT_PEAK_NOISE_WINDOW;
+  psOption.nPeakThreads = 1;
+
+  pOpenProgress = newAsyncHandle(this, openProgressPost);
+  pProgressCallback = NULL;
+  nReportedProgress = -1;
+
+  pAcquisitionReady = newAsyncHandle(this, acquisitionReadyPost);
+  pWaitCallback = NULL;
+  isWaitPending = false;
+
+  pBatchReady = newAsyncHandle(this, batchReadyPost);
+  uv_mutex_init(&batchMutex);
+  pBatchHead = NULL;
+  pBatchTail = NULL;
+  pBatchCallback = NULL;
+
+  pStreamReady = newAsyncHandle(this, streamReadyPost);
+  pStreamCallback = NULL;
+}
+
+Device::~Device()
+{
+  // Collected without close: nothing native refers to us any more
+  wqCommand.stop();
+
+  if (pScope)
+  {
+    if (pScope->isOpen())
+      pScope->close();
+    delete pScope;
+    pScope = NULL;
+  }
+
+  while (pBatchHead)
+  {
+    BATCH_NODE *pNext = pBatchHead->pNext;
+
+    BufferPool::release(pBatchHead->cbBatch.pData);
+    BufferPool::release(pBatchHead->cbBatch.pnSegments);
+    BufferPool::release(pBatchHead->cbBatch.pfPreview);
+    delete pBatchHead;
+    pBatchHead = pNext;
+  }
+
+  delete pProgressCallback;
+  delete pWaitCallback;
+  delete pBatchCallback;
+  delete pStreamCallback;
+
+  uv_close((uv_handle_t *)pOpenProgress, closeAsyncHandle);
+  uv_close((uv_handle_t *)pAcquisitionReady, closeAsyncHandle);
+  uv_close((uv_handle_t *)pBatchReady, closeAsyncHandle);
+  uv_close((uv_handle_t *)pStreamReady, closeAsyncHandle);
+  uv_mutex_destroy(&batchMutex);
+}
+
+/**
+ * @desc new Device([serial])
+ * @param[in-opt] serial: Serial number of the unit, first unit found if omitted
+ */
+void Device::New(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  if (!args.IsConstructCall())
+  {
+    Nan::ThrowTypeError("Device must be called with new");
+
+    return;
+  }
+
+  if (args.Length() > 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  if (args.Length() == 1 && !args[0]->IsString() && !args[0]->IsUndefined())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a string");
+
+    return;
+  }
+
+  Device *pDevice;
+
+  if (args.Length() == 1 && args[0]->IsString())
+  {
+    Nan::Utf8String serial(args[0]);
+
+    if (serial.length() >= DEVICE_SERIAL_LENGTH)
+    {
+      Nan::ThrowRangeError("Serial number is too long");
+
+      return;
+    }
+
+    pDevice = new Device(*serial);
+  }
+  else
+  {
+    pDevice = new Device(NULL);
+  }
+
+  if (pDevice->wqCommand.start() != 0)
+  {
+    delete pDevice;
+    Nan::ThrowError("Cannot start device thread");
+
+    return;
+  }
+
+  pDevice->Wrap(args.This());
+
+  args.GetReturnValue().Set(args.This());
+}
+
+void Device::Init(v8::Local<v8::Object> module)
+{
+  v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+
+  tpl->SetClassName(NAN_NEW_STRING("Device"));
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "open", openPre);
+  Nan::SetPrototypeMethod(tpl, "close", closePre);
+  Nan::SetPrototypeMethod(tpl, "setOption", setOptionPre);
+  Nan::SetPrototypeMethod(tpl, "setDigitizer", setDigitizerPre);
+  Nan::SetPrototypeMethod(tpl, "doAcquisition", doAcquisitionPre);
+  Nan::SetPrototypeMethod(tpl, "waitAcquisition", doAcquisitionWaitPre);
+  Nan::SetPrototypeMethod(tpl, "fetchData", fetchDataPre);
+  Nan::SetPrototypeMethod(tpl, "getScopeDataList", getScopeDataListPre);
+  Nan::SetPrototypeMethod(tpl, "startPipeline", startPipelinePre);
+  Nan::SetPrototypeMethod(tpl, "stopPipeline", stopPipelinePre);
+  Nan::SetPrototypeMethod(tpl, "startProgressive", startProgressivePre);
+  Nan::SetPrototypeMethod(tpl, "startStreaming", startStreamingPre);
+  Nan::SetPrototypeMethod(tpl, "readStreaming", readStreaming);
+  Nan::SetPrototypeMethod(tpl, "stopStreaming", stopStreamingPre);
+  Nan::SetPrototypeMethod(tpl, "startRecording", startRecordingPre);
+  Nan::SetPrototypeMethod(tpl, "stopRecording", stopRecordingPre);
+
+  constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+  Nan::Set(module, NAN_NEW_STRING("Device"), Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+void releaseReaderView(char *data, void *hint)
+{
+  ((RecordReader *)hint)->release();
+}
+
+/**
+ * @desc Header of the recording
+ * @return {version, samples, segments, planes, planeChannel[], planeGain[], planeOffset[],
+ *          sampleInterval, delayTime, timeBase, downSampleRatio, downSampleMode,
+ *          channels[{enabled, range, coupling, bandwidth, offset}], segmentCount, blocks, complete, packed}
+ */
+void readerGetHeader(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Reader *pThis = Nan::ObjectWrap::Unwrap<Reader>(args.Holder());
+
+  if (pThis->pReader == NULL)
+  {
+    Nan::ThrowError("Reader is closed");
+
+    return;
+  }
+
+  const RECORD_FILE_HEADER *prfHeader = pThis->pReader->getHeader();
+  v8::Local<v8::Object> ret = Nan::New<v8::Object>();
+  v8::Local<v8::Array> planeChannel = Nan::New<v8::Array>(prfHeader->nPlanes);
+  v8::Local<v8::Array> planeGain = Nan::New<v8::Array>(prfHeader->nPlanes);
+  v8::Local<v8::Array> planeOffset = Nan::New<v8::Array>(prfHeader->nPlanes);
+  v8::Local<v8::Array> channels = Nan::New<v8::Array>(PS6000_MAX_CHANNELS);
+
+  Nan::Set(ret, NAN_NEW_STRING("version"), Nan::New<v8::Uint32>(prfHeader->nVersion));
+  Nan::Set(ret, NAN_NEW_STRING("samples"), Nan::New<v8::Int32>(prfHeader->nSamples));
+  Nan::Set(ret, NAN_NEW_STRING("segments"), Nan::New<v8::Int32>(prfHeader->nSegments));
+  Nan::Set(ret, NAN_NEW_STRING("planes"), Nan::New<v8::Int32>(prfHeader->nPlanes));
+  Nan::Set(ret, NAN_NEW_STRING("sampleInterval"), Nan::New<v8::Number>(prfHeader->lfSampleInterval));
+  Nan::Set(ret, NAN_NEW_STRING("delayTime"), Nan::New<v8::Number>(prfHeader->lfDelayTime));
+  Nan::Set(ret, NAN_NEW_STRING("timeBase"), Nan::New<v8::Uint32>(prfHeader->nTimeBase));
+  Nan::Set(ret, NAN_NEW_STRING("downSampleRatio"), Nan::New<v8::Uint32>(prfHeader->nDownSampleRatio));
+  Nan::Set(ret, NAN_NEW_STRING("downSampleMode"), Nan::New<v8::Int32>(prfHeader->nDownSampleMode));
+  Nan::Set(ret, NAN_NEW_STRING("segmentCount"), Nan::New<v8::Number>((double)pThis->pReader->getSegmentCount()));
+  Nan::Set(ret, NAN_NEW_STRING("blocks"), Nan::New<v8::Number>((double)prfHeader->nBlocks));
+  Nan::Set(ret, NAN_NEW_STRING("complete"), Nan::New<v8::Boolean>(prfHeader->nDirectoryOffset != 0));
+  Nan::Set(ret, NAN_NEW_STRING("packed"), Nan::New<v8::Boolean>(prfHeader->nCodec != RECORD_CODEC_NONE));
+
+  for (int32_t c = 0; c < prfHeader->nPlanes; c++)
+  {
+    Nan::Set(planeChannel, c, Nan::New<v8::Int32>(prfHeader->anPlaneChannel[c]));
+    Nan::Set(planeGain, c, Nan::New<v8::Number>(prfHeader->alfPlaneGain[c]));
+    Nan::Set(planeOffset, c, Nan::New<v8::Number>(prfHeader->alfPlaneOffset[c]));
+  }
+
+  for (int32_t i = 0; i < PS6000_MAX_CHANNELS; i++)
+  {
+    v8::Local<v8::Object> channel = Nan::New<v8::Object>();
+
+    Nan::Set(channel, NAN_NEW_STRING("enabled"), Nan::New<v8::Boolean>(prfHeader->arcChannel[i].nEnabled != 0));
+    Nan::Set(channel, NAN_NEW_STRING("range"), Nan::New<v8::Int32>(prfHeader->arcChannel[i].nRange));
+    Nan::Set(channel, NAN_NEW_STRING("coupling"), Nan::New<v8::Int32>(prfHeader->arcChannel[i].nCoupling));
+    Nan::Set(channel, NAN_NEW_STRING("bandwidth"), Nan::New<v8::Int32>(prfHeader->arcChannel[i].nBandwidth));
+    Nan::Set(channel, NAN_NEW_STRING("offset"), Nan::New<v8::Number>(prfHeader->arcChannel[i].lfOffset));
+    Nan::Set(channels, i, channel);
+  }
+
+  Nan::Set(ret, NAN_NEW_STRING("planeChannel"), planeChannel);
+  Nan::Set(ret, NAN_NEW_STRING("planeGain"), planeGain);
+  Nan::Set(ret, NAN_NEW_STRING("planeOffset"), planeOffset);
+  Nan::Set(ret, NAN_NEW_STRING("channels"), channels);
+
+  args.GetReturnValue().Set(ret);
+}
+
+/**
+ * @desc Segments [firstSegment, firstSegment + segmentCount) of the file. Sample
+ *       planes are Int16Arrays over the mapped file, nothing is copied, unless
+ *       the file is packed.
+ * @param[in] firstSegment: Counted over the whole file
+ * @param[in] segmentCount:
+ * @return [{firstSegment, segmentCount, planes: [Int16Array], triggerTimes: Float64Array,
+ *          overflow: Int16Array}], one entry per block the range touches
+ */
+void readerRead(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Reader *pThis = Nan::ObjectWrap::Unwrap<Reader>(args.Holder());
+  RECORD_VIEW arvViews[64];
+
+  if (args.Length() != 2)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  if (!args[0]->IsNumber() || !args[1]->IsNumber())
+  {
+    Nan::ThrowTypeError("Arguments should be numbers");
+
+    return;
+  }
+
+  if (pThis->pReader == NULL)
+  {
+    Nan::ThrowError("Reader is closed");
+
+    return;
+  }
+
+  double lfFirst = args[0]->NumberValue();
+  double lfCount = args[1]->NumberValue();
+
+  if (lfFirst < 0 || lfCount < 0 || lfFirst + lfCount > (double)pThis->pReader->getSegmentCount())
+  {
+    Nan::ThrowRangeError("Segments outside the recording");
+
+    return;
+  }
+
+  const RECORD_FILE_HEADER *prfHeader = pThis->pReader->getHeader();
+  v8::Local<v8::Array> ret = Nan::New<v8::Array>();
+  uint64_t nFirst = (uint64_t)lfFirst;
+  uint64_t nCount = (uint64_t)lfCount;
+  uint32_t nIndex = 0;
+
+  while (nCount > 0)
+  {
+    int32_t nViews = pThis->pReader->getViews(nFirst, nCount, arvViews, 64);
+
+    if (nViews <= 0)
+    {
+      Nan::ThrowError("Recording is damaged");
+
+      return;
+    }
+
+    for (int32_t v = 0; v < nViews; v++)
+    {
+      RECORD_VIEW *prvView = &arvViews[v];
+      v8::Local<v8::Object> view = Nan::New<v8::Object>();
+      v8::Local<v8::Array> planes = Nan::New<v8::Array>(prfHeader->nPlanes);
+      v8::Local<v8::Object> times = Nan::NewBuffer(prvView->nSegmentCount * sizeof(double)).ToLocalChecked();
+      v8::Local<v8::Object> overflow = Nan::NewBuffer(prvView->nSegmentCount * sizeof(int16_t)).ToLocalChecked();
+      double *plfTimes = (double *)node::Buffer::Data(times);
+      int16_t *pnOverflow = (int16_t *)node::Buffer::Data(overflow);
+      size_t nPlaneSamples = (size_t)prvView->nSegmentCount * prfHeader->nSamples;
+
+      int16_t *apnUnpacked[DATA_MAX_PLANES];
+
+      // Every plane holds its own reference on the mapping, packed planes are unpacked to new memory
+      for (int32_t c = 0; c < prfHeader->nPlanes; c++)
+      {
+        v8::Local<v8::Object> buffer;
+
+        if (prvView->apnPlane[c])
+        {
+          pThis->pReader->retain();
+          buffer = Nan::NewBuffer((char *)prvView->apnPlane[c], nPlaneSamples * sizeof(int16_t), releaseReaderView, pThis->pReader).ToLocalChecked();
+        }
+        else
+        {
+          buffer = Nan::NewBuffer(nPlaneSamples * sizeof(int16_t)).ToLocalChecked();
+          apnUnpacked[c] = (int16_t *)node::Buffer::Data(buffer);
+        }
+
+        Nan::Set(planes, c, v8::Int16Array::New(buffer.As<v8::Uint8Array>()->Buffer(), buffer.As<v8::Uint8Array>()->ByteOffset(), nPlaneSamples));
+      }
+
+      if (prfHeader->nCodec != RECORD_CODEC_NONE && !pThis->pReader->decodeView(prvView, apnUnpacked, 1))
+      {
+        Nan::ThrowError("Recording is damaged");
+
+        return;
+      }
+
+      // Index entries are small, they are copied out
+      for (int32_t g = 0; g < prvView->nSegmentCount; g++)
+      {
+        plfTimes[g] = prvView->prsEntries[g].lfTriggerTime;
+        pnOverflow[g] = prvView->prsEntries[g].nOverflow;
+      }
+
+      Nan::Set(view, NAN_NEW_STRING("firstSegment"), Nan::New<v8::Number>((double)prvView->nFirstSegment));
+      Nan::Set(view, NAN_NEW_STRING("segmentCount"), Nan::New<v8::Int32>(prvView->nSegmentCount));
+      Nan::Set(view, NAN_NEW_STRING("planes"), planes);
+      Nan::Set(view, NAN_NEW_STRING("triggerTimes"), v8::Float64Array::New(times.As<v8::Uint8Array>()->Buffer(), times.As<v8::Uint8Array>()->ByteOffset(), prvView->nSegmentCount));
+      Nan::Set(view, NAN_NEW_STRING("overflow"), v8::Int16Array::New(overflow.As<v8::Uint8Array>()->Buffer(), overflow.As<v8::Uint8Array>()->ByteOffset(), prvView->nSegmentCount));
+      Nan::Set(ret, nIndex++, view);
+
+      nFirst += prvView->nSegmentCount;
+      nCount -= prvView->nSegmentCount;
+    }
+  }
+
+  args.GetReturnValue().Set(ret);
+}
+
+/**
+ * @desc Drop the reader's reference on the file. Views already returned stay usable.
+ */
+void readerClose(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  Reader *pThis = Nan::ObjectWrap::Unwrap<Reader>(args.Holder());
+
+  if (pThis->pReader)
+  {
+    pThis->pReader->destroy();
+    pThis->pReader = NULL;
+  }
+}
+
+Nan::Persistent<v8::Function> Reader::constructor;
+
+Reader::Reader(RecordReader *pReader)
+{
+  this->pReader = pReader;
+}
+
+Reader::~Reader()
+{
+  if (pReader)
+    pReader->destroy();
+}
+
+/**
+ * @desc new Reader(path)
+ * @param[in] path: File written by startRecording
+ */
+void Reader::New(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  if (!args.IsConstructCall())
+  {
+    Nan::ThrowTypeError("Reader must be called with new");
+
+    return;
+  }
+
+  if (args.Length() != 1)
+  {
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
+  }
+
+  if (!args[0]->IsString())
+  {
+    Nan::ThrowTypeError("Argument 1 should be a string");
+
+    return;
+  }
+
+  Nan::Utf8String path(args[0]);
+  RecordReader *pReader = new RecordReader();
+  int nResult = pReader->open(*path);
+
+  if (nResult != 0)
+  {
+    char szMessage[64];
+
+    pReader->destroy();
+    snprintf(szMessage, sizeof(szMessage), nResult == EINVAL ? "Not a recording" : "Cannot open recording (%d)", nResult);
+    Nan::ThrowError(szMessage);
+
+    return;
+  }
+
+  Reader *pThis = new Reader(pReader);
+
+  pThis->Wrap(args.This());
+
+  args.GetReturnValue().Set(args.This());
 }
 
-void defineConstants(v8::Local<v8::Object> module)
+void Reader::Init(v8::Local<v8::Object> module)
 {
-  v8::Isolate* moduleIsolate = module->GetIsolate();
-  v8::Local<v8::Context> moduleContext = moduleIsolate->GetCurrentContext();
-  v8::PropertyAttribute constant_attributes = static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontDelete);
+  v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
 
-  // Add PICO_STATUS constants
-  v8::Local<v8::Object> retcodes = Nan::New<v8::Object>();
+  tpl->SetClassName(NAN_NEW_STRING("Reader"));
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  Nan::SetPrototypeMethod(tpl, "getHeader", readerGetHeader);
+  Nan::SetPrototypeMethod(tpl, "read", readerRead);
+  Nan::SetPrototypeMethod(tpl, "close", readerClose);
+
+  constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+  Nan::Set(module, NAN_NEW_STRING("Reader"), Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+/**
+ * @desc Unpack data delivered with the "compress" option
+ * @param[in] data: Buffer from fetchData or a pipeline batch
+ * @param[in-opt] threads: Threads unpacking, 1 (default) to CODEC_MAX_THREADS
+ * @return Buffer as it would have been delivered without packing
+ */
+void decompress(const Nan::FunctionCallbackInfo<v8::Value>& args)
+{
+  int32_t nThreads = 1;
+
+  if (args.Length() != 1 && args.Length() != 2)
   {
-    NODE_DEFINE_CONSTANT(retcodes, PICO_UNKNOWN_ERROR);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_OK);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_MAX_UNITS_OPENED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_MEMORY_FAIL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_FOUND);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_FW_FAIL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_OPEN_OPERATION_IN_PROGRESS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_OPERATION_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_RESPONDING);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CONFIG_FAIL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_KERNEL_DRIVER_TOO_OLD);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_EEPROM_CORRUPT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_OS_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_HANDLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_PARAMETER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_TIMEBASE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_VOLTAGE_RANGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CHANNEL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_TRIGGER_CHANNEL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CONDITION_CHANNEL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_SIGNAL_GENERATOR);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_STREAMING_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_BLOCK_MODE_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NULL_PARAMETER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_MODE_SET);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DATA_NOT_AVAILABLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_STRING_BUFFER_TO_SMALL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_AUTO_TRIGGER_TIME_TO_SHORT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_BUFFER_STALL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TOO_MANY_SAMPLES);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TOO_MANY_SEGMENTS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_PULSE_WIDTH_QUALIFIER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DELAY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SOURCE_DETAILS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CONDITIONS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_USER_CALLBACK);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DEVICE_SAMPLING);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_SAMPLES_AVAILABLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SEGMENT_OUT_OF_RANGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_BUSY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_STARTINDEX_INVALID);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_INFO);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INFO_UNAVAILABLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_SAMPLE_INTERVAL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_ERROR);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_MEMORY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_PARAM);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SHOTS_SWEEPS_WARNING);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_TRIGGER_SOURCE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_AUX_OUTPUT_CONFLICT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_AUX_OUTPUT_ETS_CONFLICT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_WARNING_EXT_THRESHOLD_CONFLICT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_WARNING_AUX_OUTPUT_CONFLICT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_OUTPUT_OVER_VOLTAGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DELAY_NULL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_BUFFER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_OFFSET_VOLTAGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_PK_TO_PK);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CANCELLED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SEGMENT_NOT_USED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CALL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_GET_VALUES_INTERRUPTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_USED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_SAMPLERATIO);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_STATE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_ENOUGH_SEGMENTS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DRIVER_FUNCTION);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_RESERVED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_COUPLING);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_BUFFERS_NOT_SET);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_RATIO_MODE_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_RAPID_NOT_SUPPORT_AGGREGATION);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_TRIGGER_PROPERTY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INTERFACE_NOT_CONNECTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_RESISTANCE_AND_PROBE_NOT_ALLOWED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_WAVEFORM_SETUP_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_FPGA_FAIL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_MANAGER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_ANALOGUE_OFFSET);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_PLL_LOCK_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ANALOG_BOARD);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CONFIG_FAIL_AWG);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INITIALISE_FPGA);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_EXTERNAL_FREQUENCY_INVALID);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CLOCK_CHANGE_ERROR);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_AND_EXTERNAL_CLOCK_CLASH);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_PWQ_AND_EXTERNAL_CLOCK_CLASH);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_UNABLE_TO_OPEN_SCALING_FILE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_MEMORY_CLOCK_FREQUENCY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_I2C_NOT_RESPONDING);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_CAPTURES_AVAILABLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_USED_IN_THIS_CAPTURE_MODE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_GET_DATA_ACTIVE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_IP_NETWORKED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_IP_ADDRESS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_IPSOCKET_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_IPSOCKET_TIMEDOUT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SETTINGS_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NETWORK_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_WS2_32_DLL_NOT_LOADED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_IP_PORT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_COUPLING_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_BANDWIDTH_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_BANDWIDTH);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_AWG_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_NOT_RUNNING);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_WHITENOISE_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_WAVETYPE_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DIGITAL_PORT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DIGITAL_CHANNEL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DIGITAL_TRIGGER_DIRECTION);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIG_GEN_PRBS_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ETS_NOT_AVAILABLE_WITH_LOGIC_CHANNELS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_WARNING_REPEAT_VALUE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_CONNECTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_NOT_CONNECTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_REQUEST_INVALID);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_POWER_SUPPLY_UNDERVOLTAGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CAPTURING_DATA);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_USB3_0_DEVICE_NON_USB3_0_PORT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NOT_SUPPORTED_BY_THIS_DEVICE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_DEVICE_RESOLUTION);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_NUMBER_CHANNELS_FOR_RESOLUTION);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_CHANNEL_DISABLED_DUE_TO_USB_POWERED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_DC_VOLTAGE_NOT_CONFIGURABLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NO_TRIGGER_ENABLED_FOR_TRIGGER_IN_PRE_TRIG);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_WITHIN_PRE_TRIG_NOT_ARMED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_WITHIN_PRE_NOT_ALLOWED_WITH_DELAY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TRIGGER_INDEX_UNAVAILABLE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_AWG_CLOCK_FREQUENCY);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_TOO_MANY_CHANNELS_IN_USE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_NULL_CONDITIONS);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DUPLICATE_CONDITION_SOURCE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_CONDITION_INFO);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SETTINGS_READ_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SETTINGS_WRITE_FAILED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ARGUMENT_OUT_OF_RANGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_HARDWARE_VERSION_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DIGITAL_HARDWARE_VERSION_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_ANALOGUE_HARDWARE_VERSION_NOT_SUPPORTED);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_UNABLE_TO_CONVERT_TO_RESISTANCE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DUPLICATED_CHANNEL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_RESISTANCE_CONVERSION);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_VALUE_IN_MAX_BUFFER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_INVALID_VALUE_IN_MIN_BUFFER);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_SIGGEN_FREQUENCY_OUT_OF_RANGE);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_EEPROM2_CORRUPT);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_EEPROM2_FAIL);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_DEVICE_TIME_STAMP_RESET);
-    NODE_DEFINE_CONSTANT(retcodes, PICO_WATCHDOGTIMER);
+    Nan::ThrowTypeError("Wrong number of arguments");
+
+    return;
   }
 
-  Nan::SetMethod(retcodes, "toString", retcodeToString);
+  if (!node::Buffer::HasInstance(args[0]))
+  {
+    Nan::ThrowTypeError("Argument 1 should be a Buffer");
 
-  v8::Local<v8::String> retcode_name = v8::String::NewFromUtf8(moduleIsolate, "PICO_STATUS");
-  module->DefineOwnProperty(moduleContext, retcode_name, retcodes, constant_attributes).FromJust();
+    return;
+  }
 
-  // Add PS6000_RANGE constants
-  v8::Local<v8::Object> ranges = Nan::New<v8::Object>();
+  if (args.Length() == 2)
   {
-    NODE_DEFINE_CONSTANT(ranges, PS6000_10MV);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_20MV);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_50MV);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_100MV);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_200MV);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_500MV);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_1V);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_2V);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_5V);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_10V);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_20V);
-    NODE_DEFINE_CONSTANT(ranges, PS6000_50V);
+    if (!args[1]->IsInt32())
+    {
+      Nan::ThrowTypeError("Argument 2 should be an integer");
+
+      return;
+    }
+
+    nThreads = args[1]->ToInt32()->Int32Value();
+    if (nThreads < 1 || nThreads > CODEC_MAX_THREADS)
+    {
+      Nan::ThrowRangeError("Argument 2 is out of range");
+
+      return;
+    }
   }
 
-  v8::Local<v8::String> ranges_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_RANGE");
-  module->DefineOwnProperty(moduleContext, ranges_name, ranges, constant_attributes).FromJust();
+  const uint8_t *pbSrc = (const uint8_t *)node::Buffer::Data(args[0]);
+  size_t nLength = node::Buffer::Length(args[0]);
+  uint64_t nDecoded = getDecodedLength(pbSrc, nLength);
 
-  // Add PS6000_COUPLING constants
-  v8::Local<v8::Object> couplings = Nan::New<v8::Object>();
+  if (nDecoded == 0 || nDecoded > MAXIMUM_BUFFER_LENGTH)
+  {
+    Nan::ThrowError("Not a packed buffer");
 
-  NODE_DEFINE_CONSTANT(couplings, PS6000_AC);
-  NODE_DEFINE_CONSTANT(couplings, PS6000_DC_1M);
-  NODE_DEFINE_CONSTANT(couplings, PS6000_DC_50R);
+    return;
+  }
 
-  v8::Local<v8::String> couplings_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_COUPLING");
-  module->DefineOwnProperty(moduleContext, couplings_name, couplings, constant_attributes).FromJust();
+  v8::Local<v8::Object> ret = Nan::NewBuffer((uint32_t)nDecoded).ToLocalChecked();
 
-  // Add PS6000_BANDWIDTH_LIMITER constants
-  v8::Local<v8::Object> bandwidths = Nan::New<v8::Object>();
+  if (!decodeRuns(pbSrc, nLength, 0, ((const CODEC_HEADER *)pbSrc)->nRuns, node::Buffer::Data(ret), nThreads))
+  {
+    Nan::ThrowError("Packed buffer is damaged");
 
-  NODE_DEFINE_CONSTANT(bandwidths, PS6000_BW_FULL);
-  NODE_DEFINE_CONSTANT(bandwidths, PS6000_BW_20MHZ);
-  NODE_DEFINE_CONSTANT(bandwidths, PS6000_BW_25MHZ);
+    return;
+  }
 
-  v8::Local<v8::String> bandwidths_name = v8::String::NewFromUtf8(moduleIsolate, "PS6000_BANDWIDTH_LIMITER");
-  module->DefineOwnProperty(moduleContext, bandwidths_name, bandwidths, constant_attributes).FromJust();
+  args.GetReturnValue().Set(ret);
 }
 
-void getScopeDataList(const Nan::FunctionCallbackInfo<v8::Value>& args)
+/**
+ * @desc View the peaks delivered with the "peaks" option, in place
+ * @param[in] data: Buffer from fetchData or a pipeline batch
+ * @return { count, position: Float64Array (samples from the segment start),
+ *           height: Float32Array, area: Float32Array (value x samples),
+ *           segment: Int32Array, plane: Uint8Array }, ordered by segment,
+ *           plane and position
+ */
+void getPeaks(const Nan::FunctionCallbackInfo<v8::Value>& args)
 {
-  if (args.Length() != 0)
+  PEAK_ARRAYS paArrays;
+
+  if (args.Length() != 1)
   {
     Nan::ThrowTypeError("Wrong number of arguments");
 
     return;
   }
 
+  if (!node::Buffer::HasInstance(args[0]))
+  {
+    Nan::ThrowTypeError("Argument 1 should be a Buffer");
+
+    return;
+  }
+
+  v8::Local<v8::Uint8Array> data = args[0].As<v8::Uint8Array>();
+  uint8_t *pbData = (uint8_t *)node::Buffer::Data(args[0]);
+
+  if (!getPeakArrays(pbData, node::Buffer::Length(args[0]), &paArrays))
+  {
+    Nan::ThrowError("Not a peak buffer");
+
+    return;
+  }
+
+  // Every array is a view of the same memory, it stays alive with any of them
+  v8::Local<v8::ArrayBuffer> buffer = data->Buffer();
+  size_t nOffset = data->ByteOffset();
   v8::Local<v8::Object> ret = Nan::New<v8::Object>();
 
-  if (ppsMainObject)
+  if (nOffset % sizeof(double))
   {
-    SCOPE_DATA* data = ppsMainObject->getScopeDataList();
+    Nan::ThrowError("Peak buffer is not aligned");
 
-    Nan::Set(ret, Nan::New<v8::String>("nLength").ToLocalChecked(), Nan::New<v8::Int32>(data->nLength));
-    Nan::Set(ret, Nan::New<v8::String>("absoluteInitialX").ToLocalChecked(), Nan::New<v8::Number>(data->absoluteInitialX));
-    Nan::Set(ret, Nan::New<v8::String>("relativeInitialX").ToLocalChecked(), Nan::New<v8::Number>(data->relativeInitialX));
-    Nan::Set(ret, Nan::New<v8::String>("actualSamples").ToLocalChecked(), Nan::New<v8::Int32>(data->actualSamples));
-    Nan::Set(ret, Nan::New<v8::String>("gain").ToLocalChecked(), Nan::New<v8::Number>(data->gain));
-    Nan::Set(ret, Nan::New<v8::String>("offset").ToLocalChecked(), Nan::New<v8::Number>(data->offset));
-    Nan::Set(ret, Nan::New<v8::String>("xIncrement").ToLocalChecked(), Nan::New<v8::Number>(data->xIncrement));
-    Nan::Set(ret, Nan::New<v8::String>("samplingRate").ToLocalChecked(), Nan::New<v8::Number>(data->samplingRate));
-    Nan::Set(ret, Nan::New<v8::String>("nShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nShots));
-    Nan::Set(ret, Nan::New<v8::String>("nRealShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nRealShots));
-    Nan::Set(ret, Nan::New<v8::String>("nTotalShots").ToLocalChecked(), Nan::New<v8::Int32>(data->nTotalShots));
+    return;
   }
 
+  Nan::Set(ret, NAN_NEW_STRING("count"), Nan::New<v8::Uint32>(paArrays.nPeaks));
+  Nan::Set(ret, NAN_NEW_STRING("position"), v8::Float64Array::New(buffer, nOffset + ((uint8_t *)paArrays.plfPosition - pbData), paArrays.nPeaks));
+  Nan::Set(ret, NAN_NEW_STRING("height"), v8::Float32Array::New(buffer, nOffset + ((uint8_t *)paArrays.pfHeight - pbData), paArrays.nPeaks));
+  Nan::Set(ret, NAN_NEW_STRING("area"), v8::Float32Array::New(buffer, nOffset + ((uint8_t *)paArrays.pfArea - pbData), paArrays.nPeaks));
+  Nan::Set(ret, NAN_NEW_STRING("segment"), v8::Int32Array::New(buffer, nOffset + ((uint8_t *)paArrays.pnSegment - pbData), paArrays.nPeaks));
+  Nan::Set(ret, NAN_NEW_STRING("plane"), v8::Uint8Array::New(buffer, nOffset + (paArrays.pnPlane - pbData), paArrays.nPeaks));
+
   args.GetReturnValue().Set(ret);
 }
 
 void Init(v8::Local<v8::Object> module)
 {
-  Nan::SetMethod(module, "open", openPre);
-  Nan::SetMethod(module, "close", closePre);
-  Nan::SetMethod(module, "setOption", setOption);
-  Nan::SetMethod(module, "setDigitizer", setDigitizerPre);
-  Nan::SetMethod(module, "doAcquisition", doAcquisitionPre);
-  Nan::SetMethod(module, "waitAcquisition", doAcquisitionWaitPre);
-  Nan::SetMethod(module, "fetchData", fetchDataPre);
-  Nan::SetMethod(module, "getScopeDataList", getScopeDataList);
+  Device::Init(module);
+  Reader::Init(module);
+
+  Nan::SetMethod(module, "enumerateUnits", enumerateUnitsPre);
+  Nan::SetMethod(module, "decompress", decompress);
+  Nan::SetMethod(module, "getPeaks", getPeaks);
 
   defineConstants(module);
 }
@@ -0,0 +1,226 @@
+#include <string.h>
+#include <math.h>
+
+#include "convert.h"
+#include "peaks.h"
+
+typedef struct tWindowStats
+{
+  double lfMean;
+  double lfDeviation;
+} WINDOW_STATS;
+
+/* The last window takes the remainder, so no short window gets to set the noise */
+
+static void getWindowStats(const float *pfWave, int32_t nSamples, int32_t nWindow, int32_t nWindows, int32_t w, WINDOW_STATS *pwsStats)
+{
+  int32_t nBegin = w * nWindow;
+  int32_t nEnd = w == nWindows - 1 ? nSamples : nBegin + nWindow;
+  double lfSum, lfSumSquares, lfVariance;
+
+  momentsFloat(pfWave + nBegin, nEnd - nBegin, &lfSum, &lfSumSquares);
+
+  pwsStats->lfMean = lfSum / (nEnd - nBegin);
+  lfVariance = lfSumSquares / (nEnd - nBegin) - pwsStats->lfMean * pwsStats->lfMean;
+  pwsStats->lfDeviation = lfVariance > 0.0 ? sqrt(lfVariance) : 0.0;
+}
+
+static bool addPeak(PEAK_LIST *pplDst, const PEAK *ppkPeak)
+{
+  if (pplDst->nCount == pplDst->nCapacity)
+  {
+    int32_t nCapacity = pplDst->nCapacity ? pplDst->nCapacity * 2 : PEAK_LIST_GROWTH;
+    PEAK *ppkPeaks = (PEAK *)realloc(pplDst->ppkPeaks, nCapacity * sizeof(PEAK));
+
+    if (ppkPeaks == NULL)
+      return false;
+
+    pplDst->ppkPeaks = ppkPeaks;
+    pplDst->nCapacity = nCapacity;
+  }
+
+  pplDst->ppkPeaks[pplDst->nCount++] = *ppkPeak;
+
+  return true;
+}
+
+bool findPeaks(const float *pfWave, int32_t nSamples, const PEAK_CONFIG *ppcConfig, int32_t nSegment, int32_t nPlane, PEAK_LIST *pplDst)
+{
+  bool bNoise = ppcConfig->nNoiseWindow > 0;
+  int32_t nWindow = bNoise && ppcConfig->nNoiseWindow < nSamples ? ppcConfig->nNoiseWindow : nSamples;
+  int32_t nWindows = nSamples > 0 ? nSamples / nWindow : 0;
+  int32_t nClaimed = 0;             // Samples before this belong to a peak already
+  int32_t nScanned = 0;             // Samples before this were compared with a threshold
+  WINDOW_STATS awsStats[3];         // Previous, current and next window
+
+  if (nWindows > 0 && bNoise)
+  {
+    getWindowStats(pfWave, nSamples, nWindow, nWindows, 0, &awsStats[1]);
+    awsStats[0] = awsStats[1];
+  }
+
+  for (int32_t w = 0; w < nWindows; w++)
+  {
+    int32_t nEnd = w == nWindows - 1 ? nSamples : (w + 1) * nWindow;
+    int32_t i = w * nWindow > nScanned ? w * nWindow : nScanned;
+    double lfBaseline = 0.0;
+    float fLevel = ppcConfig->fThreshold;
+
+    if (bNoise)
+    {
+      const WINDOW_STATS *pwsQuiet = &awsStats[1];
+
+      if (w + 1 < nWindows)
+        getWindowStats(pfWave, nSamples, nWindow, nWindows, w + 1, &awsStats[2]);
+      else
+        awsStats[2] = awsStats[1];
+
+      if (awsStats[0].lfDeviation < pwsQuiet->lfDeviation)
+        pwsQuiet = &awsStats[0];
+      if (awsStats[2].lfDeviation < pwsQuiet->lfDeviation)
+        pwsQuiet = &awsStats[2];
+
+      lfBaseline = pwsQuiet->lfMean;
+      fLevel = (float)(lfBaseline + ppcConfig->fThreshold * pwsQuiet->lfDeviation);
+    }
+
+    while (i < nEnd)
+    {
+      int32_t nRise, nFall, nBegin, nStop;
+      double lfArea = 0.0, lfWeight = 0.0, lfMoment = 0.0, lfHalf;
+      float fMax;
+      PEAK pkPeak;
+
+      i += (int32_t)findAboveFloat(pfWave + i, nEnd - i, fLevel);
+      if (i >= nEnd)
+        break;
+
+      // Above the threshold, possibly into the next windows
+      nRise = i;
+      for (nFall = nRise + 1; nFall < nSamples && pfWave[nFall] > fLevel; nFall++)
+        ;
+
+      i = nFall;
+      if (nFall - nRise < ppcConfig->nMinWidth)
+        continue;
+
+      // Down to the baseline on both sides, never into the previous peak
+      for (nBegin = nRise; nBegin > nClaimed && pfWave[nBegin - 1] > lfBaseline; nBegin--)
+        ;
+      for (nStop = nFall; nStop < nSamples && pfWave[nStop] > lfBaseline; nStop++)
+        ;
+
+      fMax = pfWave[nRise];
+      for (int32_t j = nBegin; j < nStop; j++)
+      {
+        lfArea += pfWave[j] - lfBaseline;
+        if (pfWave[j] > fMax)
+          fMax = pfWave[j];
+      }
+
+      // Centroid of the top half only, the flanks carry mostly noise
+      lfHalf = (fMax + lfBaseline) * 0.5;
+      for (int32_t j = nBegin; j < nStop; j++)
+      {
+        if (pfWave[j] > lfHalf)
+        {
+          lfWeight += pfWave[j] - lfHalf;
+          lfMoment += (pfWave[j] - lfHalf) * j;
+        }
+      }
+
+      pkPeak.lfPosition = lfWeight > 0.0 ? lfMoment / lfWeight : nRise;
+      pkPeak.fHeight = (float)(fMax - lfBaseline);
+      pkPeak.fArea = (float)lfArea;
+      pkPeak.nSegment = nSegment;
+      pkPeak.nPlane = nPlane;
+
+      if (!addPeak(pplDst, &pkPeak))
+        return false;
+
+      nClaimed = nStop;
+      i = nStop;
+    }
+
+    nScanned = i;
+
+    awsStats[0] = awsStats[1];
+    awsStats[1] = awsStats[2];
+  }
+
+  return true;
+}
+
+void freePeakList(PEAK_LIST *pplList)
+{
+  free(pplList->ppkPeaks);
+  pplList->ppkPeaks = NULL;
+  pplList->nCount = 0;
+  pplList->nCapacity = 0;
+}
+
+size_t getPeakBlockLength(uint64_t nPeaks)
+{
+  return sizeof(PEAK_BLOCK_HEADER) + (size_t)nPeaks * (sizeof(double) + 2 * sizeof(float) + sizeof(int32_t) + sizeof(uint8_t));
+}
+
+static void locateArrays(uint8_t *pbBlock, uint32_t nPeaks, PEAK_ARRAYS *ppaDst)
+{
+  uint8_t *pbArray = pbBlock + sizeof(PEAK_BLOCK_HEADER);
+
+  // Widest first, every array stays aligned to its element
+  ppaDst->nPeaks = nPeaks;
+  ppaDst->plfPosition = (double *)pbArray;
+  pbArray += nPeaks * sizeof(double);
+  ppaDst->pfHeight = (float *)pbArray;
+  pbArray += nPeaks * sizeof(float);
+  ppaDst->pfArea = (float *)pbArray;
+  pbArray += nPeaks * sizeof(float);
+  ppaDst->pnSegment = (int32_t *)pbArray;
+  pbArray += nPeaks * sizeof(int32_t);
+  ppaDst->pnPlane = pbArray;
+}
+
+void writePeakBlock(const PEAK_LIST *pplLists, int32_t nLists, uint8_t *pbDst)
+{
+  PEAK_BLOCK_HEADER *pbhHeader = (PEAK_BLOCK_HEADER *)pbDst;
+  PEAK_ARRAYS paArrays;
+  uint32_t nPeaks = 0;
+  uint32_t k = 0;
+
+  for (int32_t l = 0; l < nLists; l++)
+    nPeaks += pplLists[l].nCount;
+
+  pbhHeader->nMagic = PEAK_MAGIC;
+  pbhHeader->nPeaks = nPeaks;
+  locateArrays(pbDst, nPeaks, &paArrays);
+
+  for (int32_t l = 0; l < nLists; l++)
+  {
+    for (int32_t p = 0; p < pplLists[l].nCount; p++, k++)
+    {
+      const PEAK *ppkPeak = &pplLists[l].ppkPeaks[p];
+
+      paArrays.plfPosition[k] = ppkPeak->lfPosition;
+      paArrays.pfHeight[k] = ppkPeak->fHeight;
+      paArrays.pfArea[k] = ppkPeak->fArea;
+      paArrays.pnSegment[k] = ppkPeak->nSegment;
+      paArrays.pnPlane[k] = (uint8_t)ppkPeak->nPlane;
+    }
+  }
+}
+
+bool getPeakArrays(uint8_t *pbSrc, size_t nLength, PEAK_ARRAYS *ppaDst)
+{
+  const PEAK_BLOCK_HEADER *pbhHeader = (const PEAK_BLOCK_HEADER *)pbSrc;
+
+  if (nLength < sizeof(PEAK_BLOCK_HEADER) || pbhHeader->nMagic != PEAK_MAGIC)
+    return false;
+
+  if (getPeakBlockLength(pbhHeader->nPeaks) != nLength)
+    return false;
+
+  locateArrays(pbSrc, pbhHeader->nPeaks, ppaDst);
+
+  return true;
+}
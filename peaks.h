@@ -0,0 +1,100 @@
+#ifndef _PS6000_PEAKS_H_
+#define _PS6000_PEAKS_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "threads.h"
+
+#define PEAK_MAGIC                  0x314B4550  // "PEK1"
+#define PEAK_MAX_THREADS            JOB_MAX_THREADS
+#define PEAK_LIST_GROWTH            256         // Peaks added to a list at a time, doubled afterwards
+
+/*
+ * Peak picking on one waveform. The waveform is cut into windows of
+ * nNoiseWindow samples, each window gets the mean and standard deviation of
+ * whichever of itself and its two neighbours is the quietest, so a peak does
+ * not lift its own threshold. A peak starts where a sample rises above
+ * baseline + fThreshold * noise and needs nMinWidth samples above it. It
+ * extends both ways down to the baseline, which its height and area are
+ * taken from, its position is the centroid of the part above half height.
+ */
+typedef struct tPeakConfig
+{
+  float fThreshold;                 // Noise deviations, or the level itself when nNoiseWindow is 0
+  int32_t nMinWidth;                // Consecutive samples above the threshold
+  int32_t nNoiseWindow;             // Samples per baseline and noise estimate, 0 for a baseline of 0
+} PEAK_CONFIG;
+
+typedef struct tPeak
+{
+  double lfPosition;                // Centroid, samples from the start of the waveform
+  float fHeight;                    // Largest sample above the baseline
+  float fArea;                      // Sum of the samples above the baseline
+  int32_t nSegment;
+  int32_t nPlane;
+} PEAK;
+
+typedef struct tPeakList
+{
+  PEAK *ppkPeaks;
+  int32_t nCount;
+  int32_t nCapacity;
+} PEAK_LIST;
+
+/*
+ * Peaks handed out as one block, every field an array of its own so it can
+ * be viewed as a typed array in place:
+ *
+ *   PEAK_BLOCK_HEADER
+ *   double lfPosition[nPeaks]
+ *   float fHeight[nPeaks]
+ *   float fArea[nPeaks]
+ *   int32 nSegment[nPeaks]
+ *   uint8 nPlane[nPeaks]
+ */
+typedef struct tPeakBlockHeader
+{
+  uint32_t nMagic;                  // PEAK_MAGIC
+  uint32_t nPeaks;
+} PEAK_BLOCK_HEADER;
+
+typedef struct tPeakArrays
+{
+  uint32_t nPeaks;
+  double *plfPosition;
+  float *pfHeight;
+  float *pfArea;
+  int32_t *pnSegment;
+  uint8_t *pnPlane;
+} PEAK_ARRAYS;
+
+/**
+ * @desc Append the peaks of one waveform to pplDst, in order of position
+ * @return false if the list could not grow
+ */
+bool findPeaks(const float *pfWave, int32_t nSamples, const PEAK_CONFIG *ppcConfig, int32_t nSegment, int32_t nPlane, PEAK_LIST *pplDst);
+
+/**
+ * @desc Free the peaks of a list and empty it
+ */
+void freePeakList(PEAK_LIST *pplList);
+
+/**
+ * @desc Bytes of a block holding nPeaks peaks
+ */
+size_t getPeakBlockLength(uint64_t nPeaks);
+
+/**
+ * @desc Write the peaks of nLists lists, one after another, as a block of
+ *       getPeakBlockLength bytes
+ */
+void writePeakBlock(const PEAK_LIST *pplLists, int32_t nLists, uint8_t *pbDst);
+
+/**
+ * @desc Locate the arrays of a block written by writePeakBlock
+ * @return false if it is not a complete block
+ */
+bool getPeakArrays(uint8_t *pbSrc, size_t nLength, PEAK_ARRAYS *ppaDst);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Runs findPeaks on synthetic spectra: Gaussians of known position, height
+ * and area on a noisy sloped baseline, and hand made waveforms for the
+ * fixed level and minimum width rules. Peaks found are written to a block
+ * and read back the way the JS side views them.
+ *
+ *   npm run test:peaks
+ */
+
+#define _USE_MATH_DEFINES
+
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#include "peaks.h"
+
+#define WAVE_SAMPLES                100000
+#define PEAK_SIGMA                  4.0
+#define PEAK_SPACING                997.77
+
+static uint32_t nRandom = 0x12345678;
+static int32_t nFailures = 0;
+
+static uint32_t nextRandom()
+{
+  nRandom ^= nRandom << 13;
+  nRandom ^= nRandom >> 17;
+  nRandom ^= nRandom << 5;
+
+  return nRandom;
+}
+
+/* Roughly normal noise of deviation 1, sum of uniforms */
+
+static float nextNoise()
+{
+  float fSum = 0.f;
+
+  for (int32_t i = 0; i < 12; i++)
+    fSum += (float)(nextRandom() & 0xFFFF) / 65536.f;
+
+  return fSum - 6.f;
+}
+
+static void check(bool bPassed, const char *pszWhat, double lfDetail)
+{
+  if (bPassed)
+    return;
+
+  printf("FAIL %s, %g\n", pszWhat, lfDetail);
+  nFailures++;
+}
+
+static void testGaussians(PEAK_LIST *pplFound)
+{
+  std::vector<float> afWave(WAVE_SAMPLES);
+  std::vector<double> alfPosition, alfHeight;
+  PEAK_CONFIG pcConfig = {5.f, 2, 256};
+  PEAK_LIST plNoise = {NULL, 0, 0};
+
+  for (int32_t i = 0; i < WAVE_SAMPLES; i++)
+    afWave[i] = 1000.f + i * 0.001f + 3.f * nextNoise();
+
+  for (double lfPosition = 500.3; lfPosition < WAVE_SAMPLES - 500; lfPosition += PEAK_SPACING)
+  {
+    double lfHeight = 50 + nextRandom() % 200;
+
+    alfPosition.push_back(lfPosition);
+    alfHeight.push_back(lfHeight);
+
+    for (int32_t i = (int32_t)lfPosition - 40; i < (int32_t)lfPosition + 40; i++)
+      afWave[i] += (float)(lfHeight * exp(-0.5 * (i - lfPosition) * (i - lfPosition) / (PEAK_SIGMA * PEAK_SIGMA)));
+  }
+
+  check(findPeaks(afWave.data(), WAVE_SAMPLES, &pcConfig, 7, 1, pplFound), "findPeaks", 0);
+  check(pplFound->nCount == (int32_t)alfPosition.size(), "every Gaussian found once", pplFound->nCount);
+
+  for (int32_t k = 0; k < pplFound->nCount && k < (int32_t)alfPosition.size(); k++)
+  {
+    const PEAK *ppkPeak = &pplFound->ppkPeaks[k];
+    double lfArea = alfHeight[k] * PEAK_SIGMA * sqrt(2 * M_PI);
+
+    check(fabs(ppkPeak->lfPosition - alfPosition[k]) < 0.25, "position", ppkPeak->lfPosition - alfPosition[k]);
+    check(fabs(ppkPeak->fHeight - alfHeight[k]) < 0.15 * alfHeight[k], "height", ppkPeak->fHeight / alfHeight[k]);
+    check(fabs(ppkPeak->fArea - lfArea) < 0.15 * lfArea, "area", ppkPeak->fArea / lfArea);
+    check(ppkPeak->nSegment == 7 && ppkPeak->nPlane == 1, "segment and plane", k);
+  }
+
+  // Noise alone never reaches five deviations for two samples in a row
+  for (int32_t i = 0; i < WAVE_SAMPLES; i++)
+    afWave[i] = 1000.f + 3.f * nextNoise();
+
+  check(findPeaks(afWave.data(), WAVE_SAMPLES, &pcConfig, 0, 0, &plNoise) && plNoise.nCount == 0, "no peaks in noise", plNoise.nCount);
+  freePeakList(&plNoise);
+}
+
+static void testFixedLevel(PEAK_LIST *pplFound)
+{
+  std::vector<float> afWave(50, 0.f);
+  PEAK_CONFIG pcConfig = {1.f, 2, 0};
+  PEAK_LIST plNarrow = {NULL, 0, 0};
+
+  // A single sample spike, a symmetric three sample peak and one on the last sample
+  afWave[10] = 5.f;
+  afWave[20] = 5.f;
+  afWave[21] = 6.f;
+  afWave[22] = 5.f;
+  afWave[49] = 9.f;
+
+  check(findPeaks(afWave.data(), 50, &pcConfig, 0, 0, pplFound) && pplFound->nCount == 1, "minimum width 2", pplFound->nCount);
+  if (pplFound->nCount == 1)
+  {
+    check(pplFound->ppkPeaks[0].lfPosition == 21.0, "centroid", pplFound->ppkPeaks[0].lfPosition);
+    check(pplFound->ppkPeaks[0].fHeight == 6.f && pplFound->ppkPeaks[0].fArea == 16.f, "height and area", pplFound->ppkPeaks[0].fArea);
+  }
+
+  pcConfig.nMinWidth = 1;
+  check(findPeaks(afWave.data(), 50, &pcConfig, 0, 0, &plNarrow) && plNarrow.nCount == 3, "minimum width 1", plNarrow.nCount);
+  freePeakList(&plNarrow);
+
+  // Waveforms shorter than the noise window or empty find nothing and do not fail
+  pcConfig.nNoiseWindow = 256;
+  check(findPeaks(afWave.data(), 0, &pcConfig, 0, 0, &plNarrow) && plNarrow.nCount == 0, "empty waveform", 0);
+  check(findPeaks(afWave.data(), 1, &pcConfig, 0, 0, &plNarrow), "one sample waveform", 1);
+  check(findPeaks(afWave.data(), 50, &pcConfig, 0, 0, &plNarrow), "waveform shorter than the window", 50);
+  freePeakList(&plNarrow);
+}
+
+static void testBlock(const PEAK_LIST *pplLists, int32_t nLists)
+{
+  uint32_t nPeaks = 0;
+  PEAK_ARRAYS paArrays;
+
+  for (int32_t l = 0; l < nLists; l++)
+    nPeaks += pplLists[l].nCount;
+
+  std::vector<uint8_t> abBlock(getPeakBlockLength(nPeaks));
+
+  writePeakBlock(pplLists, nLists, abBlock.data());
+  check(getPeakArrays(abBlock.data(), abBlock.size(), &paArrays) && paArrays.nPeaks == nPeaks, "block read back", nPeaks);
+
+  for (int32_t l = 0, p = 0; l < nLists && paArrays.nPeaks == nPeaks; l++)
+  {
+    for (int32_t k = 0; k < pplLists[l].nCount; k++, p++)
+    {
+      const PEAK *ppkPeak = &pplLists[l].ppkPeaks[k];
+
+      check(paArrays.plfPosition[p] == ppkPeak->lfPosition && paArrays.pfHeight[p] == ppkPeak->fHeight && paArrays.pfArea[p] == ppkPeak->fArea &&
+        paArrays.pnSegment[p] == ppkPeak->nSegment && paArrays.pnPlane[p] == ppkPeak->nPlane, "block fields", p);
+    }
+  }
+
+  check(!getPeakArrays(abBlock.data(), abBlock.size() - 1, &paArrays), "short block refused", (double)abBlock.size() - 1);
+  check(!getPeakArrays(abBlock.data(), sizeof(uint32_t), &paArrays), "header only refused", sizeof(uint32_t));
+}
+
+int main()
+{
+  PEAK_LIST aplFound[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+
+  testGaussians(&aplFound[0]);
+  testFixedLevel(&aplFound[1]);
+  testBlock(aplFound, 2);
+
+  freePeakList(&aplFound[0]);
+  freePeakList(&aplFound[1]);
+
+  printf(nFailures ? "%d failures\n" : "All peaks found where they were put\n", nFailures);
+
+  return nFailures ? 1 : 0;
+}
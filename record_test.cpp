@@ -0,0 +1,318 @@
+/*
+ * Writes recordings through Recorder block by block the way
+ * PicoScope::recordSegments lays them out, then reads them back through
+ * RecordReader: a finished file with its directory, a file whose header
+ * was never rewritten so the blocks are walked, and files cut in the
+ * middle of their last block. Both raw and packed planes are checked.
+ *
+ *   npm run test:record
+ */
+
+#include <stdio.h>
+#include <vector>
+
+#include "recorder.h"
+#include "recordreader.h"
+
+#define TEST_PATH                   "record-test.bin"
+#define TEST_CUT_PATH               "record-test-cut.bin"
+#define TEST_SAMPLES                300
+#define TEST_PLANES                 2
+
+static const int32_t anBlockSegments[] = {5, 3, 7, 1};
+static const int32_t nBlocks = sizeof(anBlockSegments) / sizeof(anBlockSegments[0]);
+static const int32_t nTotalSegments = 16;
+
+static int32_t nFailures = 0;
+
+static void check(bool bPassed, const char *pszWhat, const char *pszFile)
+{
+  if (bPassed)
+    return;
+
+  printf("FAIL %s, %s\n", pszWhat, pszFile);
+  nFailures++;
+}
+
+/* Baseline with a peak that moves with the segment, different for every plane */
+
+static int16_t getSample(uint64_t nSegment, int32_t nPlane, int32_t nSample)
+{
+  int32_t nValue = (int32_t)(nSample * 7 + nSegment * 13 + nPlane * 101) % 5 - 2;
+
+  if (nSample > (int32_t)(nSegment * 17 % 250) && nSample < (int32_t)(nSegment * 17 % 250) + 10)
+    nValue += 3000 + nPlane * 500;
+
+  return (int16_t)nValue;
+}
+
+static double getTriggerTime(uint64_t nSegment)
+{
+  return nSegment * 1e-3 + 0.5e-9;
+}
+
+/*
+ * Write every block, keep the header of an unfinished file when bFinish is
+ * false. Returns the file offset of the last block.
+ */
+
+static uint64_t writeRecording(const char *pszPath, bool bCompress, bool bFinish)
+{
+  static const uint8_t abPadding[8] = { 0 };
+  RECORD_FILE_HEADER rfHeader;
+  std::vector<RECORD_DIRECTORY_ENTRY> ardDirectory;
+  Recorder *pRecorder = new Recorder();
+  uint64_t nOffset, nLastBlock = 0;
+  uint64_t nTicket = 0;
+
+  memset(&rfHeader, 0, sizeof(RECORD_FILE_HEADER));
+  memcpy(rfHeader.acMagic, RECORD_FILE_MAGIC, sizeof(RECORD_FILE_MAGIC));
+  rfHeader.nVersion = RECORD_FILE_VERSION;
+  rfHeader.nHeaderSize = sizeof(RECORD_FILE_HEADER);
+  rfHeader.nScopeDataSize = sizeof(SCOPE_DATA);
+  rfHeader.nDataOffset = (sizeof(RECORD_FILE_HEADER) + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+  rfHeader.nCodec = bCompress ? RECORD_CODEC_DELTA : RECORD_CODEC_NONE;
+  rfHeader.nSamples = TEST_SAMPLES;
+  rfHeader.nSegments = 8;
+  rfHeader.nPlanes = TEST_PLANES;
+
+  check(pRecorder->open(pszPath, &rfHeader, sizeof(RECORD_FILE_HEADER)) == 0, "open for writing", pszPath);
+  nOffset = rfHeader.nDataOffset;
+
+  // The writer reads the chunks in place until waitFor, every block keeps its own storage
+  std::vector<std::vector<int16_t> > aanPlanes(nBlocks);
+  std::vector<std::vector<uint8_t> > aabPacked(nBlocks * TEST_PLANES);
+  std::vector<std::vector<RECORD_SEGMENT_ENTRY> > aarsEntries(nBlocks);
+  std::vector<RECORD_BLOCK_HEADER> arbHeader(nBlocks);
+
+  for (int32_t b = 0; b < nBlocks; b++)
+  {
+    RECORD_CHUNK arcChunk[TEST_PLANES + 3];
+    int32_t nCount = anBlockSegments[b];
+    size_t nPlaneBytes = (size_t)nCount * TEST_SAMPLES * sizeof(int16_t);
+    uint64_t nSamplesStart = nOffset + sizeof(RECORD_BLOCK_HEADER) + nCount * sizeof(RECORD_SEGMENT_ENTRY);
+    uint64_t nLength = nCount * sizeof(RECORD_SEGMENT_ENTRY);
+    int32_t nChunks = 2;
+    size_t nPadding;
+
+    aanPlanes[b].resize((size_t)TEST_PLANES * nCount * TEST_SAMPLES);
+    aarsEntries[b].resize(nCount);
+
+    for (int32_t c = 0; c < TEST_PLANES; c++)
+    {
+      int16_t *pnPlane = aanPlanes[b].data() + (size_t)c * nCount * TEST_SAMPLES;
+
+      for (int32_t g = 0; g < nCount; g++)
+      {
+        for (int32_t i = 0; i < TEST_SAMPLES; i++)
+          pnPlane[(size_t)g * TEST_SAMPLES + i] = getSample(rfHeader.nRecordSegments + g, c, i);
+      }
+
+      if (bCompress)
+      {
+        std::vector<uint8_t> &abPacked = aabPacked[b * TEST_PLANES + c];
+        size_t nPacked;
+
+        abPacked.resize(getCodecBound(sizeof(int16_t), TEST_SAMPLES, nCount) + sizeof(uint64_t), 0);
+        nPacked = encodeRuns(pnPlane, sizeof(int16_t), 1, TEST_SAMPLES, nCount, abPacked.data(), 1);
+
+        arcChunk[nChunks].pData = abPacked.data();
+        arcChunk[nChunks++].nLength = (nPacked + 7) / 8 * 8;
+        nLength += (nPacked + 7) / 8 * 8;
+      }
+      else
+      {
+        arcChunk[nChunks].pData = pnPlane;
+        arcChunk[nChunks++].nLength = nPlaneBytes;
+        nLength += nPlaneBytes;
+      }
+    }
+
+    for (int32_t g = 0; g < nCount; g++)
+    {
+      aarsEntries[b][g].nOffset = bCompress ? 0 : nSamplesStart + g * (size_t)TEST_SAMPLES * sizeof(int16_t);
+      aarsEntries[b][g].lfTriggerTime = getTriggerTime(rfHeader.nRecordSegments + g);
+      aarsEntries[b][g].nOverflow = (int16_t)(g & 1);
+    }
+
+    nPadding = (size_t)((8 - (sizeof(RECORD_BLOCK_HEADER) + nLength) % 8) % 8);
+
+    arbHeader[b].nMagic = RECORD_BLOCK_MAGIC;
+    arbHeader[b].nSequence = (uint32_t)b;
+    arbHeader[b].nFirstSegment = 0;
+    arbHeader[b].nSegmentCount = nCount;
+    arbHeader[b].nTimestamp = 0;
+    arbHeader[b].nLength = nLength + nPadding;
+    arbHeader[b].nRecordSegment = rfHeader.nRecordSegments;
+
+    arcChunk[0].pData = &arbHeader[b];
+    arcChunk[0].nLength = sizeof(RECORD_BLOCK_HEADER);
+    arcChunk[1].pData = aarsEntries[b].data();
+    arcChunk[1].nLength = nCount * sizeof(RECORD_SEGMENT_ENTRY);
+
+    if (nPadding)
+    {
+      arcChunk[nChunks].pData = abPadding;
+      arcChunk[nChunks++].nLength = nPadding;
+    }
+
+    nTicket = pRecorder->write(arcChunk, nChunks);
+    check(nTicket != 0, "block queued", pszPath);
+
+    RECORD_DIRECTORY_ENTRY rdEntry = {nOffset, rfHeader.nRecordSegments};
+
+    ardDirectory.push_back(rdEntry);
+    nLastBlock = nOffset;
+    nOffset += sizeof(RECORD_BLOCK_HEADER) + arbHeader[b].nLength;
+    rfHeader.nRecordSegments += nCount;
+  }
+
+  pRecorder->waitFor(nTicket);
+  check(pRecorder->getBlockCount() == (uint64_t)nBlocks && pRecorder->getDataLength() == nOffset - rfHeader.nDataOffset, "writer counters", pszPath);
+
+  if (bFinish)
+  {
+    RECORD_CHUNK rcDirectory = {ardDirectory.data(), ardDirectory.size() * sizeof(RECORD_DIRECTORY_ENTRY)};
+
+    rfHeader.nBlocks = nBlocks;
+    rfHeader.nDataBytes = nOffset - rfHeader.nDataOffset;
+    check(pRecorder->write(&rcDirectory, 1) != 0, "directory queued", pszPath);
+    rfHeader.nDirectoryOffset = nOffset;
+    rfHeader.nDirectoryEntries = nBlocks;
+
+    check(pRecorder->close(&rfHeader, sizeof(RECORD_FILE_HEADER)) == 0, "close", pszPath);
+  }
+  else
+  {
+    // As after a crash: the header still says nothing about the blocks
+    check(pRecorder->close(NULL, 0) == 0, "close", pszPath);
+  }
+
+  delete pRecorder;
+
+  return nLastBlock;
+}
+
+/* Copy the first nLength bytes of a file, a recording cut short */
+
+static void cutFile(const char *pszSource, const char *pszDestination, uint64_t nLength)
+{
+  FILE *pSource = fopen(pszSource, "rb");
+  FILE *pDestination = fopen(pszDestination, "wb");
+  std::vector<uint8_t> abData((size_t)nLength);
+
+  check(pSource && pDestination && fread(abData.data(), 1, abData.size(), pSource) == abData.size() &&
+    fwrite(abData.data(), 1, abData.size(), pDestination) == abData.size(), "cut file", pszDestination);
+
+  if (pSource)
+    fclose(pSource);
+  if (pDestination)
+    fclose(pDestination);
+}
+
+/* Every segment of the file against what was written, then a range across blocks */
+
+static void checkRecording(const char *pszPath, int32_t nExpectedBlocks)
+{
+  RecordReader *pReader = new RecordReader();
+  RECORD_VIEW arvView[nBlocks];
+  uint64_t nSegments = 0;
+  int32_t nViews;
+
+  for (int32_t b = 0; b < nExpectedBlocks; b++)
+    nSegments += anBlockSegments[b];
+
+  check(pReader->open(pszPath) == 0, "open for reading", pszPath);
+  if (pReader->getHeader() == NULL)
+  {
+    pReader->destroy();
+    return;
+  }
+
+  check(pReader->getSegmentCount() == nSegments, "segment count", pszPath);
+
+  nViews = pReader->getViews(0, nSegments, arvView, nBlocks);
+  check(nViews == nExpectedBlocks, "one view per block", pszPath);
+
+  for (int32_t v = 0; v < nViews; v++)
+  {
+    const RECORD_VIEW *prvView = &arvView[v];
+    std::vector<int16_t> anDecoded((size_t)TEST_PLANES * prvView->nSegmentCount * TEST_SAMPLES);
+    int16_t *apnPlane[TEST_PLANES];
+    bool bMatch = true;
+
+    for (int32_t c = 0; c < TEST_PLANES; c++)
+      apnPlane[c] = anDecoded.data() + (size_t)c * prvView->nSegmentCount * TEST_SAMPLES;
+
+    if (pReader->getHeader()->nCodec == RECORD_CODEC_DELTA)
+    {
+      check(pReader->decodeView(prvView, apnPlane, 2), "decode view", pszPath);
+    }
+    else
+    {
+      for (int32_t c = 0; c < TEST_PLANES; c++)
+        apnPlane[c] = (int16_t *)prvView->apnPlane[c];
+    }
+
+    for (int32_t g = 0; g < prvView->nSegmentCount; g++)
+    {
+      uint64_t nSegment = prvView->nFirstSegment + g;
+
+      bMatch = bMatch && prvView->prsEntries[g].lfTriggerTime == getTriggerTime(nSegment);
+
+      for (int32_t c = 0; c < TEST_PLANES; c++)
+      {
+        for (int32_t i = 0; i < TEST_SAMPLES; i++)
+          bMatch = bMatch && apnPlane[c][(size_t)g * TEST_SAMPLES + i] == getSample(nSegment, c, i);
+      }
+    }
+
+    check(bMatch, "samples and trigger times", pszPath);
+  }
+
+  // Segments 4 to 8 touch the end of the first block, all of the second and the start of the third
+  if (nExpectedBlocks >= 3)
+  {
+    nViews = pReader->getViews(4, 5, arvView, nBlocks);
+    check(nViews == 3 && arvView[0].nBlockSegment == 4 && arvView[0].nSegmentCount == 1 && arvView[1].nSegmentCount == 3 &&
+      arvView[2].nFirstSegment == 8 && arvView[2].nBlockSegment == 0 && arvView[2].nSegmentCount == 1, "range across blocks", pszPath);
+  }
+
+  check(pReader->getViews(nSegments, 1, arvView, nBlocks) == -1, "range past the end refused", pszPath);
+
+  pReader->destroy();
+}
+
+int main()
+{
+  for (int32_t nPacked = 0; nPacked < 2; nPacked++)
+  {
+    bool bCompress = nPacked == 1;
+    uint64_t nLastBlock;
+
+    // Finished file, found through its directory
+    nLastBlock = writeRecording(TEST_PATH, bCompress, true);
+    checkRecording(TEST_PATH, nBlocks);
+
+    // Directory and half the last block gone, the others are walked
+    cutFile(TEST_PATH, TEST_CUT_PATH, nLastBlock + sizeof(RECORD_BLOCK_HEADER) + 20);
+    checkRecording(TEST_CUT_PATH, nBlocks - 1);
+
+    // Never finished, every block walked
+    nLastBlock = writeRecording(TEST_PATH, bCompress, false);
+    checkRecording(TEST_PATH, nBlocks);
+
+    // Never finished and cut inside the last block header
+    cutFile(TEST_PATH, TEST_CUT_PATH, nLastBlock + sizeof(RECORD_BLOCK_HEADER) / 2);
+    checkRecording(TEST_CUT_PATH, nBlocks - 1);
+
+    printf("%s planes: checked\n", bCompress ? "packed" : "raw");
+  }
+
+  remove(TEST_PATH);
+  remove(TEST_CUT_PATH);
+
+  printf(nFailures ? "%d failures\n" : "All recordings read back as written\n", nFailures);
+
+  return nFailures ? 1 : 0;
+}
@@ -0,0 +1,449 @@
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+#endif
+
+#include "recorder.h"
+
+Recorder::Recorder()
+{
+#ifdef _WIN32
+  hFile = INVALID_HANDLE_VALUE;
+  hMapping = NULL;
+#else
+  nFile = -1;
+#endif
+  pbWindow = NULL;
+  nWindowStart = 0;
+  nFileLength = 0;
+  nDataStart = 0;
+  nWriteOffset = 0;
+  uv_mutex_init(&mutex);
+  uv_cond_init(&cond);
+  pQueueHead = NULL;
+  pQueueTail = NULL;
+  nNextTicket = 1;
+  nDoneTicket = 0;
+  nDataLength = 0;
+  nBlocks = 0;
+  nError = 0;
+  isOpened = false;
+  isStopping = false;
+}
+
+Recorder::~Recorder()
+{
+  close(NULL, 0);
+
+  uv_cond_destroy(&cond);
+  uv_mutex_destroy(&mutex);
+}
+
+int Recorder::open(const char *pszPath, const void *pHeader, size_t nHeaderLength)
+{
+  int nResult;
+
+  if (isOpened)
+    return EBUSY;
+
+#ifdef _WIN32
+  hFile = CreateFileA(pszPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return (int)GetLastError();
+#else
+  nFile = ::open(pszPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (nFile < 0)
+    return errno;
+#endif
+
+  nFileLength = 0;
+  nDataStart = (nHeaderLength + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+  nWriteOffset = nDataStart;
+  nNextTicket = 1;
+  nDoneTicket = 0;
+  nDataLength = 0;
+  nBlocks = 0;
+  nError = 0;
+  isStopping = false;
+
+  nResult = grow(nDataStart);
+  if (nResult == 0)
+    nResult = writeHeader(pHeader, nHeaderLength);
+  if (nResult == 0)
+    nResult = uv_thread_create(&thread, threadMain, this);
+
+  if (nResult != 0)
+  {
+    closeFile();
+    return nResult;
+  }
+
+  isOpened = true;
+
+  return 0;
+}
+
+int Recorder::close(const void *pHeader, size_t nHeaderLength)
+{
+  int nResult;
+
+  if (!isOpened)
+    return 0;
+
+  uv_mutex_lock(&mutex);
+  isStopping = true;
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
+
+  uv_thread_join(&thread);
+  isOpened = false;
+
+  unmapWindow();
+
+  // Preallocation past the last block is not part of the recording
+  nResult = nError;
+  if (nResult == 0)
+    nResult = truncateFile(nWriteOffset);
+  if (nResult == 0 && pHeader)
+    nResult = writeHeader(pHeader, nHeaderLength);
+
+  closeFile();
+
+  return nResult;
+}
+
+uint64_t Recorder::write(const RECORD_CHUNK *pChunks, int32_t nChunks)
+{
+  RECORD_ITEM *pItem;
+  size_t nInline = 0;
+  uint64_t nTicket;
+
+  if (!isOpened || nChunks < 1 || nChunks > RECORD_MAX_CHUNKS)
+    return 0;
+
+  pItem = (RECORD_ITEM *)calloc(1, sizeof(RECORD_ITEM));
+  if (pItem == NULL)
+    return 0;
+
+  pItem->nChunks = nChunks;
+
+  for (int32_t i = 0; i < nChunks; i++)
+  {
+    pItem->arcChunk[i] = pChunks[i];
+
+    // Block headers and the like usually live on the caller's stack
+    if (pChunks[i].nLength <= RECORD_INLINE_BYTES - nInline)
+    {
+      memcpy(pItem->abInline + nInline, pChunks[i].pData, pChunks[i].nLength);
+      pItem->arcChunk[i].pData = pItem->abInline + nInline;
+      nInline += pChunks[i].nLength;
+    }
+  }
+
+  uv_mutex_lock(&mutex);
+
+  nTicket = nNextTicket++;
+  pItem->nTicket = nTicket;
+
+  for (int32_t i = 0; i < nChunks; i++)
+    nDataLength += pChunks[i].nLength;
+  nBlocks++;
+
+  if (pQueueTail)
+    pQueueTail->pNext = pItem;
+  else
+    pQueueHead = pItem;
+  pQueueTail = pItem;
+
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
+
+  return nTicket;
+}
+
+void Recorder::waitFor(uint64_t nTicket)
+{
+  if (!isOpened)
+    return;
+
+  uv_mutex_lock(&mutex);
+  while (nDoneTicket < nTicket)
+    uv_cond_wait(&cond, &mutex);
+  uv_mutex_unlock(&mutex);
+}
+
+bool Recorder::isOpen()
+{
+  return isOpened;
+}
+
+uint64_t Recorder::getDataLength()
+{
+  uint64_t nLength;
+
+  uv_mutex_lock(&mutex);
+  nLength = nDataLength;
+  uv_mutex_unlock(&mutex);
+
+  return nLength;
+}
+
+uint64_t Recorder::getBlockCount()
+{
+  uint64_t nCount;
+
+  uv_mutex_lock(&mutex);
+  nCount = nBlocks;
+  uv_mutex_unlock(&mutex);
+
+  return nCount;
+}
+
+int Recorder::getError()
+{
+  int nResult;
+
+  uv_mutex_lock(&mutex);
+  nResult = nError;
+  uv_mutex_unlock(&mutex);
+
+  return nResult;
+}
+
+void Recorder::threadMain(void *pParameter)
+{
+  ((Recorder *)pParameter)->run();
+}
+
+void Recorder::run()
+{
+  uv_mutex_lock(&mutex);
+
+  for (;;)
+  {
+    RECORD_ITEM *pItem = pQueueHead;
+    int nResult = 0;
+
+    if (pItem == NULL)
+    {
+      if (isStopping)
+        break;
+
+      uv_cond_wait(&cond, &mutex);
+      continue;
+    }
+
+    pQueueHead = pItem->pNext;
+    if (pQueueHead == NULL)
+      pQueueTail = NULL;
+
+    // Copy without the lock, the caller keeps queueing meanwhile
+    if (nError == 0)
+    {
+      uv_mutex_unlock(&mutex);
+
+      for (int32_t i = 0; i < pItem->nChunks && nResult == 0; i++)
+        nResult = store(pItem->arcChunk[i].pData, pItem->arcChunk[i].nLength);
+
+      uv_mutex_lock(&mutex);
+    }
+
+    // After an error later blocks are dropped, but waiters are still released
+    if (nResult != 0 && nError == 0)
+      nError = nResult;
+
+    nDoneTicket = pItem->nTicket;
+    uv_cond_broadcast(&cond);
+
+    free(pItem);
+  }
+
+  uv_mutex_unlock(&mutex);
+}
+
+int Recorder::store(const void *pData, size_t nLength)
+{
+  const uint8_t *pbData = (const uint8_t *)pData;
+  int nResult;
+
+  nResult = grow(nWriteOffset + nLength);
+  if (nResult != 0)
+    return nResult;
+
+  while (nLength > 0)
+  {
+    size_t nStep;
+
+    nResult = mapWindow(nWriteOffset);
+    if (nResult != 0)
+      return nResult;
+
+    nStep = (size_t)(nWindowStart + RECORD_MAP_WINDOW - nWriteOffset);
+    if (nStep > nLength)
+      nStep = nLength;
+
+    memcpy(pbWindow + (nWriteOffset - nWindowStart), pbData, nStep);
+
+    pbData += nStep;
+    nLength -= nStep;
+    nWriteOffset += nStep;
+  }
+
+  return 0;
+}
+
+int Recorder::grow(uint64_t nEnd)
+{
+  uint64_t nLength;
+
+  if (nEnd <= nFileLength)
+    return 0;
+
+  // Whole windows only, so a mapping never reaches past the end of the file
+  nLength = (nEnd + RECORD_GROW_BYTES - 1) / RECORD_GROW_BYTES * RECORD_GROW_BYTES;
+
+#ifdef _WIN32
+  LARGE_INTEGER liLength;
+
+  // The mapping object is sized at creation, a new one covers the new length
+  unmapWindow();
+  if (hMapping)
+  {
+    CloseHandle(hMapping);
+    hMapping = NULL;
+  }
+
+  liLength.QuadPart = (LONGLONG)nLength;
+  if (!SetFilePointerEx(hFile, liLength, NULL, FILE_BEGIN) || !SetEndOfFile(hFile))
+    return (int)GetLastError();
+
+  hMapping = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+  if (hMapping == NULL)
+    return (int)GetLastError();
+#else
+  int nResult;
+
+  // Reserve the blocks up front, the file system can lay them out in one run
+  nResult = posix_fallocate(nFile, (off_t)nFileLength, (off_t)(nLength - nFileLength));
+  if (nResult == EINVAL || nResult == EOPNOTSUPP)
+    nResult = ftruncate(nFile, (off_t)nLength) == 0 ? 0 : errno;
+  if (nResult != 0)
+    return nResult;
+#endif
+
+  nFileLength = nLength;
+
+  return 0;
+}
+
+int Recorder::mapWindow(uint64_t nOffset)
+{
+  uint64_t nStart = nOffset / RECORD_MAP_WINDOW * RECORD_MAP_WINDOW;
+
+  if (pbWindow && nWindowStart == nStart)
+    return 0;
+
+  unmapWindow();
+
+#ifdef _WIN32
+  pbWindow = (uint8_t *)MapViewOfFile(hMapping, FILE_MAP_WRITE, (DWORD)(nStart >> 32), (DWORD)nStart, RECORD_MAP_WINDOW);
+  if (pbWindow == NULL)
+    return (int)GetLastError();
+#else
+  void *pWindow = mmap(NULL, RECORD_MAP_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, nFile, (off_t)nStart);
+
+  if (pWindow == MAP_FAILED)
+    return errno;
+
+  pbWindow = (uint8_t *)pWindow;
+#endif
+
+  nWindowStart = nStart;
+
+  return 0;
+}
+
+void Recorder::unmapWindow()
+{
+  if (pbWindow == NULL)
+    return;
+
+  // Dirty pages are written back by the OS, nothing waits for them here
+#ifdef _WIN32
+  UnmapViewOfFile(pbWindow);
+#else
+  munmap(pbWindow, RECORD_MAP_WINDOW);
+#endif
+
+  pbWindow = NULL;
+}
+
+int Recorder::writeHeader(const void *pHeader, size_t nHeaderLength)
+{
+#ifdef _WIN32
+  OVERLAPPED ovOffset;
+  DWORD nWritten = 0;
+
+  memset(&ovOffset, 0, sizeof(OVERLAPPED));
+  if (!WriteFile(hFile, pHeader, (DWORD)nHeaderLength, &nWritten, &ovOffset) || nWritten != nHeaderLength)
+    return (int)GetLastError();
+#else
+  if (pwrite(nFile, pHeader, nHeaderLength, 0) != (ssize_t)nHeaderLength)
+    return errno ? errno : EIO;
+#endif
+
+  return 0;
+}
+
+int Recorder::truncateFile(uint64_t nLength)
+{
+#ifdef _WIN32
+  LARGE_INTEGER liLength;
+
+  if (hMapping)
+  {
+    CloseHandle(hMapping);
+    hMapping = NULL;
+  }
+
+  liLength.QuadPart = (LONGLONG)nLength;
+  if (!SetFilePointerEx(hFile, liLength, NULL, FILE_BEGIN) || !SetEndOfFile(hFile))
+    return (int)GetLastError();
+#else
+  if (ftruncate(nFile, (off_t)nLength) != 0)
+    return errno;
+#endif
+
+  nFileLength = nLength;
+
+  return 0;
+}
+
+void Recorder::closeFile()
+{
+  unmapWindow();
+
+#ifdef _WIN32
+  if (hMapping)
+  {
+    CloseHandle(hMapping);
+    hMapping = NULL;
+  }
+
+  if (hFile != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (nFile >= 0)
+  {
+    ::close(nFile);
+    nFile = -1;
+  }
+#endif
+}
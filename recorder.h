@@ -0,0 +1,132 @@
+#ifndef _PS6000_RECORDER_H_
+#define _PS6000_RECORDER_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <uv.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#endif
+
+#define RECORD_ALIGNMENT            4096                    // Data starts on a page after the header
+#define RECORD_MAP_WINDOW           (64 * 1024 * 1024)      // Mapped at a time by the writer
+#define RECORD_GROW_BYTES           (256 * 1024 * 1024)     // File is preallocated in these steps
+#define RECORD_MAX_CHUNKS           12                      // Per write
+#define RECORD_INLINE_BYTES         128                     // Small chunks are copied on write
+
+typedef struct tRecordChunk
+{
+  const void *pData;
+  size_t nLength;
+} RECORD_CHUNK;
+
+typedef struct tRecordItem
+{
+  uint64_t nTicket;
+  int32_t nChunks;
+  RECORD_CHUNK arcChunk[RECORD_MAX_CHUNKS];
+  uint8_t abInline[RECORD_INLINE_BYTES];
+  struct tRecordItem *pNext;
+} RECORD_ITEM;
+
+/*
+ * Appends blocks to a preallocated file through a moving memory mapping on
+ * its own thread. Large chunks are not copied on write, the writer reads them
+ * where they are, so the caller keeps them untouched until waitFor returns
+ * for the ticket they were written with.
+ */
+class Recorder
+{
+  public:
+    /**
+     * @desc Constructor
+     */
+    Recorder();
+
+    /**
+     * @desc Destructor. Closes without rewriting the header.
+     */
+    ~Recorder();
+
+    /**
+     * @desc Create the file, write the header and start the writer thread
+     * @param[in] pHeader: Written at offset 0, data follows at the next RECORD_ALIGNMENT
+     * @return 0 on success, OS error code otherwise
+     */
+    int open(const char *pszPath, const void *pHeader, size_t nHeaderLength);
+
+    /**
+     * @desc Drain the queue, cut the preallocation off and close the file
+     * @param[in] pHeader: Replaces the header written by open, NULL keeps it
+     * @return 0 on success, first OS error code seen otherwise
+     */
+    int close(const void *pHeader, size_t nHeaderLength);
+
+    /**
+     * @desc Queue one block, its chunks are stored back to back
+     * @return Ticket for waitFor, 0 if nothing was queued
+     */
+    uint64_t write(const RECORD_CHUNK *pChunks, int32_t nChunks);
+
+    /**
+     * @desc Block until the write with this ticket and all before it are in the file
+     */
+    void waitFor(uint64_t nTicket);
+
+    bool isOpen();
+
+    /**
+     * @desc Bytes queued after the header so far
+     */
+    uint64_t getDataLength();
+
+    /**
+     * @desc Blocks queued so far
+     */
+    uint64_t getBlockCount();
+
+    /**
+     * @desc First OS error code the writer ran into, 0 if none
+     */
+    int getError();
+
+  private:
+    static void threadMain(void *pParameter);
+    void run();
+    int store(const void *pData, size_t nLength);
+    int grow(uint64_t nEnd);
+    int mapWindow(uint64_t nOffset);
+    void unmapWindow();
+    int writeHeader(const void *pHeader, size_t nHeaderLength);
+    int truncateFile(uint64_t nLength);
+    void closeFile();
+
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#else
+    int nFile;
+#endif
+    uint8_t *pbWindow;          // Mapping of [nWindowStart, nWindowStart + RECORD_MAP_WINDOW)
+    uint64_t nWindowStart;
+    uint64_t nFileLength;       // Preallocated
+    uint64_t nDataStart;
+    uint64_t nWriteOffset;      // Writer thread only
+
+    uv_thread_t thread;
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    RECORD_ITEM *pQueueHead;
+    RECORD_ITEM *pQueueTail;
+    uint64_t nNextTicket;
+    uint64_t nDoneTicket;
+    uint64_t nDataLength;
+    uint64_t nBlocks;
+    int nError;
+    bool isOpened;
+    bool isStopping;
+};
+
+#endif
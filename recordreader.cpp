@@ -0,0 +1,379 @@
+#include <errno.h>
+#include <stddef.h>
+
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+#include "recordreader.h"
+
+RecordReader::RecordReader()
+{
+#ifdef _WIN32
+  hFile = INVALID_HANDLE_VALUE;
+  hMapping = NULL;
+#endif
+  pbFile = NULL;
+  nFileLength = 0;
+  prfHeader = NULL;
+  prdDirectory = NULL;
+  prdWalked = NULL;
+  nBlocks = 0;
+  nSegments = 0;
+  uv_mutex_init(&mutex);
+  nReferences = 1;
+}
+
+RecordReader::~RecordReader()
+{
+  unmapFile();
+  SAFE_FREE(prdWalked);
+  uv_mutex_destroy(&mutex);
+}
+
+int RecordReader::open(const char *pszPath)
+{
+  const RECORD_FILE_HEADER *prfFile;
+  int nResult;
+
+  if (pbFile)
+    return EBUSY;
+
+  nResult = mapFile(pszPath);
+  if (nResult != 0)
+    return nResult;
+
+  // Fields before sdScopeData are the same whatever build wrote the file
+  prfFile = (const RECORD_FILE_HEADER *)pbFile;
+  if (nFileLength < sizeof(RECORD_FILE_HEADER) || memcmp(prfFile->acMagic, RECORD_FILE_MAGIC, sizeof(RECORD_FILE_MAGIC)) != 0 ||
+    prfFile->nVersion != RECORD_FILE_VERSION || prfFile->nHeaderSize < offsetof(RECORD_FILE_HEADER, sdScopeData) ||
+    prfFile->nDataOffset > nFileLength || prfFile->nSamples < 1 || prfFile->nPlanes < 1 || prfFile->nPlanes > DATA_MAX_PLANES ||
+    (prfFile->nCodec != RECORD_CODEC_NONE && prfFile->nCodec != RECORD_CODEC_DELTA))
+  {
+    unmapFile();
+    return EINVAL;
+  }
+
+  prfHeader = prfFile;
+
+  // Directory of a finished file, otherwise find the blocks one by one
+  if (prfHeader->nDirectoryOffset != 0 && prfHeader->nDirectoryOffset <= nFileLength &&
+    prfHeader->nDirectoryEntries <= (nFileLength - prfHeader->nDirectoryOffset) / sizeof(RECORD_DIRECTORY_ENTRY))
+  {
+    prdDirectory = (const RECORD_DIRECTORY_ENTRY *)(pbFile + prfHeader->nDirectoryOffset);
+    nBlocks = prfHeader->nDirectoryEntries;
+    nSegments = prfHeader->nRecordSegments;
+  }
+  else if (!walkBlocks())
+  {
+    unmapFile();
+    return ENOMEM;
+  }
+
+  return 0;
+}
+
+const RECORD_FILE_HEADER *RecordReader::getHeader()
+{
+  return prfHeader;
+}
+
+uint64_t RecordReader::getSegmentCount()
+{
+  return nSegments;
+}
+
+int32_t RecordReader::getViews(uint64_t nFirstSegment, uint64_t nCount, RECORD_VIEW *prvViews, int32_t nMaxViews)
+{
+  size_t nSegmentBytes;
+  uint64_t nViewSegments;
+  uint64_t nLow, nHigh;
+  int32_t nViews = 0;
+
+  if (prfHeader == NULL || nFirstSegment > nSegments || nCount > nSegments - nFirstSegment)
+    return -1;
+
+  nSegmentBytes = (size_t)prfHeader->nSamples * sizeof(int16_t);
+
+  // Each plane of a view has to fit one Buffer
+  nViewSegments = MAXIMUM_BUFFER_LENGTH / nSegmentBytes;
+  if (nViewSegments < 1)
+    nViewSegments = 1;
+
+  // Last block starting at or before the first segment
+  nLow = 0;
+  nHigh = nBlocks;
+  while (nHigh - nLow > 1)
+  {
+    uint64_t nMiddle = nLow + (nHigh - nLow) / 2;
+
+    if (prdDirectory[nMiddle].nRecordSegment <= nFirstSegment)
+      nLow = nMiddle;
+    else
+      nHigh = nMiddle;
+  }
+
+  for (uint64_t nBlock = nLow; nCount > 0 && nViews < nMaxViews && nBlock < nBlocks; )
+  {
+    const uint8_t *apbPacked[DATA_MAX_PLANES];
+    size_t anPacked[DATA_MAX_PLANES];
+    const RECORD_BLOCK_HEADER *prbBlock = getBlock(nBlock, apbPacked, anPacked);
+    const RECORD_SEGMENT_ENTRY *prsEntries;
+    const uint8_t *pbSamples;
+    uint64_t nSkip, nTake;
+
+    if (prbBlock == NULL)
+      return -1;
+
+    nSkip = nFirstSegment - prdDirectory[nBlock].nRecordSegment;
+    if (nSkip >= (uint64_t)prbBlock->nSegmentCount)
+    {
+      nBlock++;
+      continue;
+    }
+
+    nTake = prbBlock->nSegmentCount - nSkip;
+    if (nTake > nCount)
+      nTake = nCount;
+    if (nTake > nViewSegments)
+      nTake = nViewSegments;
+
+    prsEntries = (const RECORD_SEGMENT_ENTRY *)(prbBlock + 1);
+    pbSamples = (const uint8_t *)(prsEntries + prbBlock->nSegmentCount);
+
+    prvViews[nViews].nFirstSegment = nFirstSegment;
+    prvViews[nViews].nSegmentCount = (int32_t)nTake;
+    prvViews[nViews].nBlockSegment = (int32_t)nSkip;
+    prvViews[nViews].prsEntries = prsEntries + nSkip;
+    for (int32_t c = 0; c < prfHeader->nPlanes; c++)
+    {
+      if (prfHeader->nCodec == RECORD_CODEC_NONE)
+        prvViews[nViews].apnPlane[c] = (const int16_t *)(pbSamples + ((size_t)c * prbBlock->nSegmentCount + nSkip) * nSegmentBytes);
+      else
+        prvViews[nViews].apnPlane[c] = NULL;
+
+      prvViews[nViews].apbPacked[c] = prfHeader->nCodec == RECORD_CODEC_NONE ? NULL : apbPacked[c];
+      prvViews[nViews].anPackedLength[c] = prfHeader->nCodec == RECORD_CODEC_NONE ? 0 : anPacked[c];
+    }
+    nViews++;
+
+    nFirstSegment += nTake;
+    nCount -= nTake;
+  }
+
+  return nViews;
+}
+
+bool RecordReader::decodeView(const RECORD_VIEW *prvView, int16_t *const *ppnPlanes, int32_t nThreads)
+{
+  for (int32_t c = 0; c < prfHeader->nPlanes; c++)
+  {
+    if (prvView->apbPacked[c] == NULL ||
+      !decodeRuns(prvView->apbPacked[c], prvView->anPackedLength[c], prvView->nBlockSegment, prvView->nSegmentCount, ppnPlanes[c], nThreads))
+      return false;
+  }
+
+  return true;
+}
+
+void RecordReader::retain()
+{
+  uv_mutex_lock(&mutex);
+  nReferences++;
+  uv_mutex_unlock(&mutex);
+}
+
+void RecordReader::release()
+{
+  bool bDelete;
+
+  uv_mutex_lock(&mutex);
+  bDelete = --nReferences == 0;
+  uv_mutex_unlock(&mutex);
+
+  if (bDelete)
+    delete this;
+}
+
+void RecordReader::destroy()
+{
+  release();
+}
+
+int RecordReader::mapFile(const char *pszPath)
+{
+#ifdef _WIN32
+  LARGE_INTEGER liLength;
+
+  hFile = CreateFileA(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return (int)GetLastError();
+
+  if (!GetFileSizeEx(hFile, &liLength) || liLength.QuadPart == 0)
+  {
+    unmapFile();
+    return EINVAL;
+  }
+
+  nFileLength = (uint64_t)liLength.QuadPart;
+
+  // Copy on write, a view written to from JS never reaches the file
+  hMapping = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if (hMapping)
+    pbFile = (uint8_t *)MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+
+  if (pbFile == NULL)
+  {
+    int nResult = (int)GetLastError();
+
+    unmapFile();
+    return nResult;
+  }
+#else
+  struct stat stFile;
+  void *pFile;
+  int nFile;
+
+  nFile = ::open(pszPath, O_RDONLY);
+  if (nFile < 0)
+    return errno;
+
+  if (fstat(nFile, &stFile) != 0 || stFile.st_size == 0)
+  {
+    ::close(nFile);
+    return EINVAL;
+  }
+
+  nFileLength = (uint64_t)stFile.st_size;
+
+  // Copy on write, a view written to from JS never reaches the file
+  pFile = mmap(NULL, (size_t)nFileLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, nFile, 0);
+  ::close(nFile);
+
+  if (pFile == MAP_FAILED)
+    return errno;
+
+  pbFile = (uint8_t *)pFile;
+#endif
+
+  return 0;
+}
+
+void RecordReader::unmapFile()
+{
+#ifdef _WIN32
+  if (pbFile)
+    UnmapViewOfFile(pbFile);
+
+  if (hMapping)
+  {
+    CloseHandle(hMapping);
+    hMapping = NULL;
+  }
+
+  if (hFile != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (pbFile)
+    munmap(pbFile, (size_t)nFileLength);
+#endif
+
+  pbFile = NULL;
+  nFileLength = 0;
+  prfHeader = NULL;
+  prdDirectory = NULL;
+  nBlocks = 0;
+  nSegments = 0;
+}
+
+bool RecordReader::walkBlocks()
+{
+  uint64_t nOffset = prfHeader->nDataOffset;
+  uint64_t nSize = 0;
+
+  // Stops at the first block that was not written completely
+  while (nOffset <= nFileLength && nFileLength - nOffset >= sizeof(RECORD_BLOCK_HEADER))
+  {
+    const RECORD_BLOCK_HEADER *prbBlock = (const RECORD_BLOCK_HEADER *)(pbFile + nOffset);
+
+    if (prbBlock->nMagic != RECORD_BLOCK_MAGIC || prbBlock->nSegmentCount < 1 ||
+      prbBlock->nLength > nFileLength - nOffset - sizeof(RECORD_BLOCK_HEADER))
+      break;
+
+    if (nBlocks >= nSize)
+    {
+      RECORD_DIRECTORY_ENTRY *prdEntries;
+
+      nSize = nSize ? nSize * 2 : 1024;
+      prdEntries = (RECORD_DIRECTORY_ENTRY *)realloc(prdWalked, nSize * sizeof(RECORD_DIRECTORY_ENTRY));
+      if (prdEntries == NULL)
+        return false;
+
+      prdWalked = prdEntries;
+    }
+
+    prdWalked[nBlocks].nOffset = nOffset;
+    prdWalked[nBlocks].nRecordSegment = nSegments;
+    nBlocks++;
+    nSegments += prbBlock->nSegmentCount;
+
+    nOffset += sizeof(RECORD_BLOCK_HEADER) + prbBlock->nLength;
+  }
+
+  prdDirectory = prdWalked;
+
+  return true;
+}
+
+const RECORD_BLOCK_HEADER *RecordReader::getBlock(uint64_t nIndex, const uint8_t **ppbPacked, size_t *pnPacked)
+{
+  const RECORD_BLOCK_HEADER *prbBlock;
+  uint64_t nOffset = prdDirectory[nIndex].nOffset;
+  uint64_t nNeeded;
+
+  if (nOffset > nFileLength || nFileLength - nOffset < sizeof(RECORD_BLOCK_HEADER) || nOffset % 8 != 0)
+    return NULL;
+
+  prbBlock = (const RECORD_BLOCK_HEADER *)(pbFile + nOffset);
+  if (prbBlock->nMagic != RECORD_BLOCK_MAGIC || prbBlock->nSegmentCount < 1 ||
+    prbBlock->nLength > nFileLength - nOffset - sizeof(RECORD_BLOCK_HEADER))
+    return NULL;
+
+  nNeeded = (uint64_t)prbBlock->nSegmentCount * sizeof(RECORD_SEGMENT_ENTRY);
+
+  // Index and samples of every segment inside the block
+  if (prfHeader->nCodec == RECORD_CODEC_NONE)
+  {
+    nNeeded += (uint64_t)prbBlock->nSegmentCount * prfHeader->nPlanes * prfHeader->nSamples * sizeof(int16_t);
+
+    return nNeeded > prbBlock->nLength ? NULL : prbBlock;
+  }
+
+  // Packed planes follow each other, each stream one run per segment
+  for (int32_t c = 0; c < prfHeader->nPlanes; c++)
+  {
+    const uint8_t *pbStream = (const uint8_t *)(prbBlock + 1) + nNeeded;
+    const CODEC_HEADER *pchStream = (const CODEC_HEADER *)pbStream;
+    size_t nAvailable;
+
+    if (nNeeded > prbBlock->nLength)
+      return NULL;
+
+    nAvailable = (size_t)(prbBlock->nLength - nNeeded);
+    if (getDecodedLength(pbStream, nAvailable) == 0 || pchStream->nSampleSize != sizeof(int16_t) || pchStream->nStride != 1 ||
+      pchStream->nRuns != (uint32_t)prbBlock->nSegmentCount || pchStream->nRunValues != (uint64_t)prfHeader->nSamples)
+      return NULL;
+
+    ppbPacked[c] = pbStream;
+    pnPacked[c] = (size_t)pchStream->nLength;
+    nNeeded += (pchStream->nLength + 7) / 8 * 8;
+  }
+
+  return prbBlock;
+}
@@ -0,0 +1,100 @@
+#ifndef _PS6000_RECORD_READER_H_
+#define _PS6000_RECORD_READER_H_
+
+#include <errno.h>
+
+#include "main.h"
+
+// Segments of one block, pointing straight into the mapped file
+typedef struct tRecordView
+{
+  uint64_t nFirstSegment;           // In the whole file
+  int32_t nSegmentCount;
+  int32_t nBlockSegment;            // First segment of the view within its block
+  const RECORD_SEGMENT_ENTRY *prsEntries;
+  const int16_t *apnPlane[DATA_MAX_PLANES];   // nSegmentCount * nSamples each, NULL when packed
+  const uint8_t *apbPacked[DATA_MAX_PLANES];  // Codec stream of the whole block per plane
+  size_t anPackedLength[DATA_MAX_PLANES];
+} RECORD_VIEW;
+
+/*
+ * Random access to a file written by PicoScope::startRecording. The whole
+ * file is mapped copy-on-write, views handed out stay valid until the last
+ * reference is gone, however long after destroy() that is.
+ */
+class RecordReader
+{
+  public:
+    /**
+     * @desc Constructor
+     */
+    RecordReader();
+
+    /**
+     * @desc Map the file and check its header. Unfinished files have their
+     *       blocks walked to rebuild the directory.
+     * @return 0 on success, OS error code, EINVAL if it is not a recording
+     */
+    int open(const char *pszPath);
+
+    const RECORD_FILE_HEADER *getHeader();
+
+    /**
+     * @desc Segments in the file, over all blocks
+     */
+    uint64_t getSegmentCount();
+
+    /**
+     * @desc Views of segments [nFirstSegment, nFirstSegment + nCount), one per
+     *       block touched, each plane at most MAXIMUM_BUFFER_LENGTH bytes
+     * @return Views filled, fewer than needed when nMaxViews is reached, -1 for
+     *         a range outside the file or a damaged block
+     */
+    int32_t getViews(uint64_t nFirstSegment, uint64_t nCount, RECORD_VIEW *prvViews, int32_t nMaxViews);
+
+    /**
+     * @desc Unpack the planes of a view of a packed file
+     * @param[in] ppnPlanes: nPlanes buffers of nSegmentCount * nSamples
+     * @return false if the block is damaged
+     */
+    bool decodeView(const RECORD_VIEW *prvView, int16_t *const *ppnPlanes, int32_t nThreads);
+
+    /**
+     * @desc Keep the mapping for one more user of a view
+     */
+    void retain();
+
+    /**
+     * @desc Drop one reference taken by retain(). Safe to call from any thread.
+     */
+    void release();
+
+    /**
+     * @desc Drop the owner's reference. The mapping goes with the last view.
+     */
+    void destroy();
+
+  private:
+    ~RecordReader();
+    int mapFile(const char *pszPath);
+    void unmapFile();
+    bool walkBlocks();
+    const RECORD_BLOCK_HEADER *getBlock(uint64_t nIndex, const uint8_t **ppbPacked, size_t *pnPacked);
+
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#endif
+    uint8_t *pbFile;
+    uint64_t nFileLength;
+    const RECORD_FILE_HEADER *prfHeader;
+    const RECORD_DIRECTORY_ENTRY *prdDirectory;
+    RECORD_DIRECTORY_ENTRY *prdWalked;        // Rebuilt for an unfinished file
+    uint64_t nBlocks;
+    uint64_t nSegments;
+
+    uv_mutex_t mutex;
+    int32_t nReferences;
+};
+
+#endif
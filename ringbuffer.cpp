@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "ringbuffer.h"
+#include "largebuffer.h"
+
+RingBuffer::RingBuffer()
+{
+  pnBuffer = NULL;
+  nMask = 0;
+  nHead.store(0);
+  nTail.store(0);
+}
+
+RingBuffer::~RingBuffer()
+{
+  release();
+}
+
+bool RingBuffer::allocate(size_t nCapacity)
+{
+  size_t nSize = 1;
+
+  while (nSize < nCapacity)
+    nSize <<= 1;
+
+  release();
+
+  pnBuffer = (int16_t *)allocateLargeBuffer(nSize * sizeof(int16_t));
+  if (pnBuffer == NULL)
+    return false;
+
+  nMask = nSize - 1;
+
+  return true;
+}
+
+void RingBuffer::release()
+{
+  if (pnBuffer)
+  {
+    freeLargeBuffer(pnBuffer, (nMask + 1) * sizeof(int16_t));
+    pnBuffer = NULL;
+  }
+
+  nMask = 0;
+  reset();
+}
+
+void RingBuffer::reset()
+{
+  nHead.store(0);
+  nTail.store(0);
+}
+
+size_t RingBuffer::write(const int16_t *pnSrc, size_t nCount)
+{
+  if (pnBuffer == NULL)
+    return 0;
+
+  size_t nWrite = nHead.load(std::memory_order_relaxed);
+  size_t nRead = nTail.load(std::memory_order_acquire);
+  size_t nSpace = (nMask + 1) - (nWrite - nRead);
+
+  if (nCount > nSpace)
+    nCount = nSpace;
+
+  size_t nOffset = nWrite & nMask;
+  size_t nFirst = nMask + 1 - nOffset;
+
+  if (nFirst > nCount)
+    nFirst = nCount;
+
+  memcpy(pnBuffer + nOffset, pnSrc, nFirst * sizeof(int16_t));
+  memcpy(pnBuffer, pnSrc + nFirst, (nCount - nFirst) * sizeof(int16_t));
+
+  // Publish samples after they are written
+  nHead.store(nWrite + nCount, std::memory_order_release);
+
+  return nCount;
+}
+
+size_t RingBuffer::peek(const int16_t **ppnFirst, size_t *pnFirst, const int16_t **ppnSecond, size_t *pnSecond)
+{
+  size_t nRead = nTail.load(std::memory_order_relaxed);
+  size_t nWrite = nHead.load(std::memory_order_acquire);
+  size_t nCount = nWrite - nRead;
+  size_t nOffset = nRead & nMask;
+
+  *pnFirst = nMask + 1 - nOffset;
+  if (*pnFirst > nCount)
+    *pnFirst = nCount;
+
+  *ppnFirst = pnBuffer + nOffset;
+  *ppnSecond = pnBuffer;
+  *pnSecond = nCount - *pnFirst;
+
+  return nCount;
+}
+
+void RingBuffer::consume(size_t nCount)
+{
+  // Hand the space back after the consumer is done reading it
+  nTail.store(nTail.load(std::memory_order_relaxed) + nCount, std::memory_order_release);
+}
+
+size_t RingBuffer::available()
+{
+  return nHead.load(std::memory_order_acquire) - nTail.load(std::memory_order_acquire);
+}
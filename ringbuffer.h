@@ -0,0 +1,79 @@
+#ifndef _PS6000_RING_BUFFER_H_
+#define _PS6000_RING_BUFFER_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define RING_CACHE_LINE             64
+
+/*
+ * Single producer / single consumer ring of int16 samples. The producer only
+ * moves nHead and the consumer only moves nTail, so neither side takes a lock.
+ */
+class RingBuffer
+{
+  public:
+    /**
+     * @desc Constructor
+     */
+    RingBuffer();
+
+    /**
+     * @desc Destructor
+     */
+    ~RingBuffer();
+
+    /**
+     * @desc Allocate storage. Not thread safe, call while nobody produces or consumes.
+     * @param[in] nCapacity: Samples, rounded up to a power of two
+     * @return true on success
+     */
+    bool allocate(size_t nCapacity);
+
+    /**
+     * @desc Drop storage and contents
+     */
+    void release();
+
+    /**
+     * @desc Drop contents. Not thread safe, call while nobody produces or consumes.
+     */
+    void reset();
+
+    /**
+     * @desc Producer: append samples
+     * @return Number of samples written, less than nCount when the ring is full
+     */
+    size_t write(const int16_t *pnSrc, size_t nCount);
+
+    /**
+     * @desc Consumer: get readable samples in place as up to two contiguous spans
+     * @return Total samples readable (nFirst + nSecond)
+     */
+    size_t peek(const int16_t **ppnFirst, size_t *pnFirst, const int16_t **ppnSecond, size_t *pnSecond);
+
+    /**
+     * @desc Consumer: mark nCount samples returned by peek() as read
+     */
+    void consume(size_t nCount);
+
+    /**
+     * @desc Samples ready to read
+     */
+    size_t available();
+
+  private:
+    int16_t *pnBuffer;
+    size_t nMask;
+
+    // Keep indices on separate cache lines, each is written by one side only
+    char acPad0[RING_CACHE_LINE];
+    std::atomic<size_t> nHead;
+    char acPad1[RING_CACHE_LINE];
+    std::atomic<size_t> nTail;
+    char acPad2[RING_CACHE_LINE];
+};
+
+#endif
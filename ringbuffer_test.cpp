@@ -0,0 +1,169 @@
+/*
+ * Checks RingBuffer on its own: samples come out in order across the wrap,
+ * split into the two spans peek() returns, a full ring takes only what fits
+ * so the streaming callback can count the rest as dropped, and a producer
+ * and a consumer on two threads never lose or reorder a sample.
+ *
+ *   npm run test:ring
+ */
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "ringbuffer.h"
+
+#define RING_CAPACITY               1024
+#define STREAM_SAMPLES              2000000
+#define STREAM_CHUNK                333
+
+static int32_t nFailures = 0;
+
+static void check(bool bPassed, const char *pszWhat)
+{
+  if (bPassed)
+    return;
+
+  printf("FAIL %s\n", pszWhat);
+  nFailures++;
+}
+
+/* Fill with a running counter so any lost or repeated sample shows */
+
+static void fillCounter(int16_t *pnDst, size_t nCount, size_t nFirst)
+{
+  for (size_t i = 0; i < nCount; i++)
+    pnDst[i] = (int16_t)(nFirst + i);
+}
+
+/* Read everything available, check it continues the counter and consume it */
+
+static size_t drain(RingBuffer *pRing, size_t nExpected, bool *pbInOrder)
+{
+  const int16_t *pnFirst, *pnSecond;
+  size_t nFirst, nSecond;
+  size_t nCount = pRing->peek(&pnFirst, &nFirst, &pnSecond, &nSecond);
+
+  for (size_t i = 0; i < nFirst; i++)
+    *pbInOrder &= pnFirst[i] == (int16_t)(nExpected + i);
+
+  for (size_t i = 0; i < nSecond; i++)
+    *pbInOrder &= pnSecond[i] == (int16_t)(nExpected + nFirst + i);
+
+  pRing->consume(nCount);
+
+  return nCount;
+}
+
+static void testWraparound()
+{
+  RingBuffer rbRing;
+  std::vector<int16_t> anSrc(RING_CAPACITY);
+  const int16_t *pnFirst, *pnSecond;
+  size_t nFirst, nSecond;
+  bool bInOrder = true;
+
+  check(rbRing.allocate(RING_CAPACITY - 1), "allocate");
+
+  // Move both indices close to the end of the storage
+  fillCounter(anSrc.data(), RING_CAPACITY - 10, 0);
+  check(rbRing.write(anSrc.data(), RING_CAPACITY - 10) == RING_CAPACITY - 10, "capacity rounds up to a power of two");
+  check(drain(&rbRing, 0, &bInOrder) == RING_CAPACITY - 10, "drain before wrap");
+
+  // 30 samples from offset 1014 wrap after 10
+  fillCounter(anSrc.data(), 30, RING_CAPACITY - 10);
+  check(rbRing.write(anSrc.data(), 30) == 30, "write across the wrap");
+  check(rbRing.peek(&pnFirst, &nFirst, &pnSecond, &nSecond) == 30 && nFirst == 10 && nSecond == 20, "peek splits at the wrap");
+  check(drain(&rbRing, RING_CAPACITY - 10, &bInOrder) == 30 && bInOrder, "samples in order across the wrap");
+  check(rbRing.available() == 0, "empty after drain");
+
+  rbRing.reset();
+  check(rbRing.peek(&pnFirst, &nFirst, &pnSecond, &nSecond) == 0 && pnFirst == pnSecond, "reset starts at the front");
+}
+
+static void testDrops()
+{
+  RingBuffer rbRing;
+  std::vector<int16_t> anSrc(RING_CAPACITY);
+  uint64_t nOffered = 0, nWritten = 0, nDropped = 0, nRead = 0;
+  bool bInOrder = true;
+
+  check(rbRing.allocate(RING_CAPACITY), "allocate");
+
+  // Producer outruns the consumer three to one, the excess is counted the
+  // way onStreamingReady counts it
+  for (int32_t i = 0; i < 64; i++)
+  {
+    size_t nCount = 300 + i;
+    size_t nTaken;
+
+    fillCounter(anSrc.data(), nCount, (size_t)nWritten);
+    nTaken = rbRing.write(anSrc.data(), nCount);
+    check(nTaken <= nCount && rbRing.available() <= RING_CAPACITY, "write never overfills");
+
+    nOffered += nCount;
+    nWritten += nTaken;
+    if (nTaken < nCount)
+      nDropped += nCount - nTaken;
+
+    if (i % 3 == 2)
+      nRead += drain(&rbRing, (size_t)nRead, &bInOrder);
+  }
+
+  nRead += drain(&rbRing, (size_t)nRead, &bInOrder);
+
+  check(nDropped > 0, "full ring drops samples");
+  check(nWritten + nDropped == nOffered, "every sample written or dropped");
+  check(nRead == nWritten && bInOrder, "kept samples read back in order");
+
+  // A full ring takes nothing until the consumer frees space
+  fillCounter(anSrc.data(), RING_CAPACITY, 0);
+  check(rbRing.write(anSrc.data(), RING_CAPACITY) == RING_CAPACITY, "fill to capacity");
+  check(rbRing.write(anSrc.data(), 1) == 0, "full ring takes nothing");
+}
+
+static void testThreads()
+{
+  RingBuffer rbRing;
+  bool bInOrder = true;
+  size_t nRead = 0;
+
+  check(rbRing.allocate(RING_CAPACITY), "allocate");
+
+  std::thread thProducer([&rbRing]()
+  {
+    int16_t anChunk[STREAM_CHUNK];
+    size_t nSent = 0;
+
+    while (nSent < STREAM_SAMPLES)
+    {
+      size_t nCount = STREAM_SAMPLES - nSent < STREAM_CHUNK ? STREAM_SAMPLES - nSent : STREAM_CHUNK;
+      size_t nDone = 0;
+
+      fillCounter(anChunk, nCount, nSent);
+
+      while (nDone < nCount)
+        nDone += rbRing.write(anChunk + nDone, nCount - nDone);
+
+      nSent += nCount;
+    }
+  });
+
+  while (nRead < STREAM_SAMPLES)
+    nRead += drain(&rbRing, nRead, &bInOrder);
+
+  thProducer.join();
+
+  check(nRead == STREAM_SAMPLES && bInOrder, "threaded stream in order");
+}
+
+int main()
+{
+  testWraparound();
+  testDrops();
+  testThreads();
+
+  printf(nFailures ? "%d failures\n" : "All ring buffer checks passed\n", nFailures);
+
+  return nFailures ? 1 : 0;
+}
@@ -1,13 +1,14 @@
 'use strict'
 
-const picoscope = require('./build/Release/node-ps6000')
+const native = require('./build/Release/node-ps6000')
+const picoscope = new native.Device()
 const fs = require('fs')
 
 let option = {
-  "verticalScale": picoscope.PS6000_RANGE.PS6000_2V,
+  "verticalScale": native.PS6000_RANGE.PS6000_2V,
   "verticalOffset": 0.0,
-  "verticalCoupling": picoscope.PS6000_COUPLING.PS6000_DC_50R,
-  "verticalBandwidth": picoscope.PS6000_BANDWIDTH_LIMITER.PS6000_BW_FULL,
+  "verticalCoupling": native.PS6000_COUPLING.PS6000_DC_50R,
+  "verticalBandwidth": native.PS6000_BANDWIDTH_LIMITER.PS6000_BW_FULL,
   "horizontalSamplerate": 0.5,
   "horizontalSamples": 1000,
   "horizontalSegments": 20,
@@ -16,23 +17,31 @@ let option = {
 
 picoscope.open((result) => {
   new Promise(function (resolve, reject) {
-    console.log('open: res: ' + picoscope.PICO_STATUS.toString(result))
+    console.log('open: res: ' + native.PICO_STATUS.toString(result))
 
-    if (result === picoscope.PICO_STATUS.PICO_OK) {
-      result = picoscope.setOption(option)
-
-      if (result === picoscope.PICO_STATUS.PICO_OK) {
-        return resolve()
-      }
+    if (result === native.PICO_STATUS.PICO_OK) {
+      return resolve()
     }
 
     return reject()
+  }).then(function () {
+    return new Promise(function (resolve, reject) {
+      picoscope.setOption(option, (result) => {
+        console.log('setOption: res: ' + native.PICO_STATUS.toString(result))
+
+        if (result === native.PICO_STATUS.PICO_OK) {
+          return resolve()
+        }
+
+        reject()
+      })
+    })
   }).then(function () {
     return new Promise(function (resolve, reject) {
       picoscope.setDigitizer(false, (result) => {
-        console.log('setDigitizer: res: ' + picoscope.PICO_STATUS.toString(result))
+        console.log('setDigitizer: res: ' + native.PICO_STATUS.toString(result))
 
-        if (result === picoscope.PICO_STATUS.PICO_OK) {
+        if (result === native.PICO_STATUS.PICO_OK) {
           return resolve()
         }
 
@@ -42,11 +51,21 @@ picoscope.open((result) => {
   }).then(function () {
     return new Promise(function (resolve, reject) {
       picoscope.doAcquisition(false, (result) => {
-        console.log('doAcquisition: res: ' + picoscope.PICO_STATUS.toString(result))
-      }, (result) => {
-        console.log('doAcquisition: finished: ' + picoscope.PICO_STATUS.toString(result))
+        console.log('doAcquisition: res: ' + native.PICO_STATUS.toString(result))
+
+        if (result === native.PICO_STATUS.PICO_OK) {
+          return resolve()
+        }
+
+        reject()
+      })
+    })
+  }).then(function () {
+    return new Promise(function (resolve, reject) {
+      picoscope.waitAcquisition((result) => {
+        console.log('waitAcquisition: res: ' + native.PICO_STATUS.toString(result))
 
-        if (result === picoscope.PICO_STATUS.PICO_OK) {
+        if (result === native.PICO_STATUS.PICO_OK) {
           return resolve()
         }
 
@@ -56,9 +75,9 @@ picoscope.open((result) => {
   }).then(function () {
     return new Promise(function (resolve, reject) {
       picoscope.fetchData(false, (result, data) => {
-        console.log('fetchData: res: ' + picoscope.PICO_STATUS.toString(result))
+        console.log('fetchData: res: ' + native.PICO_STATUS.toString(result))
 
-        if (result === picoscope.PICO_STATUS.PICO_OK) {
+        if (result === native.PICO_STATUS.PICO_OK) {
           console.log(data)
           return resolve(data)
         }
@@ -80,7 +99,7 @@ picoscope.open((result) => {
   }).then(function () {
     return new Promise(function (resolve, reject) {
       picoscope.close((result) => {
-        console.log('close: res: ' + picoscope.PICO_STATUS.toString(result))
+        console.log('close: res: ' + native.PICO_STATUS.toString(result))
         resolve()
       })
     })
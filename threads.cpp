@@ -0,0 +1,169 @@
+#include <uv.h>
+
+#include "threads.h"
+
+typedef struct tJobBatch
+{
+  int32_t nPending;                 // Jobs handed to the pool and not finished yet
+  uv_cond_t cond;                   // Signalled when nPending drops to 0
+} JOB_BATCH;
+
+typedef struct tJobTask
+{
+  JOB_FUNCTION pfnJob;
+  void *pJob;
+  JOB_BATCH *pBatch;
+  struct tJobTask *pNext;
+} JOB_TASK;
+
+// Workers live as long as the process, they are started as runJobs needs them
+static uv_once_t onceJobPool = UV_ONCE_INIT;
+static uv_mutex_t mutexJobPool;
+static uv_cond_t condJobPool;
+static uv_thread_t athreadWorker[JOB_MAX_THREADS - 1];
+static int32_t nWorkers = 0;
+static JOB_TASK *pQueueHead = NULL;
+static JOB_TASK *pQueueTail = NULL;
+
+static void initJobPool()
+{
+  uv_mutex_init(&mutexJobPool);
+  uv_cond_init(&condJobPool);
+}
+
+/* First queued task, of pBatch only unless it is NULL. Called locked. */
+
+static JOB_TASK *takeTask(JOB_BATCH *pBatch)
+{
+  JOB_TASK **ppLink = &pQueueHead;
+  JOB_TASK *pPrevious = NULL;
+  JOB_TASK *pTask;
+
+  while (*ppLink && pBatch && (*ppLink)->pBatch != pBatch)
+  {
+    pPrevious = *ppLink;
+    ppLink = &pPrevious->pNext;
+  }
+
+  pTask = *ppLink;
+  if (pTask)
+  {
+    *ppLink = pTask->pNext;
+    if (pQueueTail == pTask)
+      pQueueTail = pPrevious;
+  }
+
+  return pTask;
+}
+
+static void workerMain(void *pParameter)
+{
+  (void)pParameter;
+
+  uv_mutex_lock(&mutexJobPool);
+
+  for (;;)
+  {
+    JOB_TASK *pTask = takeTask(NULL);
+    JOB_BATCH *pBatch;
+
+    if (pTask == NULL)
+    {
+      uv_cond_wait(&condJobPool, &mutexJobPool);
+      continue;
+    }
+
+    // The task lives on the caller's stack, it is not touched once counted
+    pBatch = pTask->pBatch;
+
+    uv_mutex_unlock(&mutexJobPool);
+    pTask->pfnJob(pTask->pJob);
+    uv_mutex_lock(&mutexJobPool);
+
+    if (--pBatch->nPending == 0)
+      uv_cond_signal(&pBatch->cond);
+  }
+}
+
+int32_t splitJobs(uint64_t nItems, uint64_t nMinSlice, int32_t nThreads, uint64_t *pnSlice)
+{
+  if (nThreads < 1)
+    nThreads = 1;
+  if (nThreads > JOB_MAX_THREADS)
+    nThreads = JOB_MAX_THREADS;
+  if (nMinSlice < 1)
+    nMinSlice = 1;
+  if ((uint64_t)nThreads > nItems / nMinSlice)
+    nThreads = nItems / nMinSlice > 0 ? (int32_t)(nItems / nMinSlice) : 1;
+
+  *pnSlice = (nItems + nThreads - 1) / nThreads;
+  if (*pnSlice == 0)
+    return 1;
+
+  // Rounding the slice up can leave the last threads without items
+  return (int32_t)((nItems + *pnSlice - 1) / *pnSlice);
+}
+
+void runJobs(void *pJobs, size_t nJobSize, int32_t nJobs, JOB_FUNCTION pfnJob)
+{
+  JOB_TASK ajtTask[JOB_MAX_THREADS];
+  JOB_BATCH jbBatch;
+  JOB_TASK *pTask;
+
+  if (nJobs <= 1)
+  {
+    pfnJob(pJobs);
+    return;
+  }
+
+  uv_once(&onceJobPool, initJobPool);
+  uv_cond_init(&jbBatch.cond);
+  jbBatch.nPending = nJobs - 1;
+
+  uv_mutex_lock(&mutexJobPool);
+
+  // One worker per job besides the first at most, jobs of a worker that
+  // could not start are left to the calling thread
+  while (nWorkers < nJobs - 1 && uv_thread_create(&athreadWorker[nWorkers], workerMain, NULL) == 0)
+    nWorkers++;
+
+  for (int32_t t = 1; t < nJobs; t++)
+  {
+    ajtTask[t].pfnJob = pfnJob;
+    ajtTask[t].pJob = (uint8_t *)pJobs + t * nJobSize;
+    ajtTask[t].pBatch = &jbBatch;
+    ajtTask[t].pNext = NULL;
+
+    if (pQueueTail)
+      pQueueTail->pNext = &ajtTask[t];
+    else
+      pQueueHead = &ajtTask[t];
+    pQueueTail = &ajtTask[t];
+  }
+
+  uv_cond_broadcast(&condJobPool);
+  uv_mutex_unlock(&mutexJobPool);
+
+  // First slice here
+  pfnJob(pJobs);
+
+  // Then any slice no worker picked up yet, workers busy with other callers
+  // or nested calls cannot hold this one up
+  uv_mutex_lock(&mutexJobPool);
+
+  while ((pTask = takeTask(&jbBatch)) != NULL)
+  {
+    uv_mutex_unlock(&mutexJobPool);
+    pTask->pfnJob(pTask->pJob);
+    uv_mutex_lock(&mutexJobPool);
+
+    jbBatch.nPending--;
+  }
+
+  while (jbBatch.nPending > 0)
+    uv_cond_wait(&jbBatch.cond, &mutexJobPool);
+
+  uv_mutex_unlock(&mutexJobPool);
+
+  uv_cond_destroy(&jbBatch.cond);
+}
@@ -0,0 +1,30 @@
+#ifndef _PS6000_THREADS_H_
+#define _PS6000_THREADS_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define JOB_MAX_THREADS             16
+
+typedef void (*JOB_FUNCTION)(void *pJob);
+
+/**
+ * @desc Cut nItems into contiguous slices, one per thread. The thread count is
+ *       clamped to 1..JOB_MAX_THREADS, then to the slices of at least nMinSlice
+ *       items there are, never below 1.
+ * @param[out] pnSlice: Items per slice, the last one may be shorter
+ * @return Slices, every one of them holds at least one item unless nItems is 0
+ */
+int32_t splitJobs(uint64_t nItems, uint64_t nMinSlice, int32_t nThreads, uint64_t *pnSlice);
+
+/**
+ * @desc Run pfnJob on nJobs jobs of nJobSize bytes each and wait for all of them.
+ *       The first job runs on the calling thread, the others on worker threads
+ *       that are started on first use and kept for the life of the process.
+ *       Jobs no worker has picked up by the time the first one is done run on
+ *       the calling thread as well. Safe to call from several threads at once.
+ * @param[in] nJobs: 1 to JOB_MAX_THREADS, as returned by splitJobs
+ */
+void runJobs(void *pJobs, size_t nJobSize, int32_t nJobs, JOB_FUNCTION pfnJob);
+
+#endif
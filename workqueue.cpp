@@ -0,0 +1,204 @@
+#include "workqueue.h"
+
+WorkQueue::WorkQueue()
+{
+  uv_mutex_init(&mutex);
+  uv_cond_init(&cond);
+  pDone = NULL;
+  pTodoHead = NULL;
+  pTodoTail = NULL;
+  pDoneHead = NULL;
+  pDoneTail = NULL;
+  nPending = 0;
+  isStarted = false;
+  isStopping = false;
+}
+
+WorkQueue::~WorkQueue()
+{
+  stop();
+
+  uv_cond_destroy(&cond);
+  uv_mutex_destroy(&mutex);
+}
+
+int WorkQueue::start()
+{
+  int nResult;
+
+  if (isStarted)
+    return 0;
+
+  pDone = new uv_async_t();
+
+  nResult = uv_async_init(uv_default_loop(), pDone, onDone);
+  if (nResult != 0)
+  {
+    delete pDone;
+    pDone = NULL;
+
+    return nResult;
+  }
+
+  // Only keep the loop alive while requests are pending
+  pDone->data = this;
+  uv_unref((uv_handle_t *)pDone);
+
+  isStopping = false;
+
+  nResult = uv_thread_create(&thread, threadMain, this);
+  if (nResult != 0)
+  {
+    uv_close((uv_handle_t *)pDone, onClose);
+    pDone = NULL;
+
+    return nResult;
+  }
+
+  isStarted = true;
+
+  return 0;
+}
+
+void WorkQueue::stop()
+{
+  WORK_ITEM *pItem;
+
+  if (!isStarted)
+    return;
+
+  uv_mutex_lock(&mutex);
+  isStopping = true;
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
+
+  uv_thread_join(&thread);
+
+  // Nothing should be left, but do not leak the bookkeeping if it is
+  pItem = pDoneHead;
+  while (pItem)
+  {
+    WORK_ITEM *pNext = pItem->pNext;
+
+    free(pItem);
+    pItem = pNext;
+  }
+
+  pDoneHead = NULL;
+  pDoneTail = NULL;
+  nPending = 0;
+
+  uv_close((uv_handle_t *)pDone, onClose);
+  pDone = NULL;
+  isStarted = false;
+}
+
+int WorkQueue::queue(uv_work_t *pRequest, uv_work_cb work, uv_after_work_cb after)
+{
+  WORK_ITEM *pItem;
+
+  if (!isStarted)
+    return UV_EINVAL;
+
+  pItem = (WORK_ITEM *)calloc(1, sizeof(WORK_ITEM));
+  if (pItem == NULL)
+    return UV_ENOMEM;
+
+  pItem->pRequest = pRequest;
+  pItem->work = work;
+  pItem->after = after;
+
+  if (nPending++ == 0)
+    uv_ref((uv_handle_t *)pDone);
+
+  uv_mutex_lock(&mutex);
+
+  if (pTodoTail)
+    pTodoTail->pNext = pItem;
+  else
+    pTodoHead = pItem;
+  pTodoTail = pItem;
+
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+int32_t WorkQueue::getPendingCount()
+{
+  return nPending;
+}
+
+void WorkQueue::threadMain(void *pParameter)
+{
+  WorkQueue *pQueue = (WorkQueue *)pParameter;
+
+  uv_mutex_lock(&pQueue->mutex);
+
+  for (;;)
+  {
+    WORK_ITEM *pItem = pQueue->pTodoHead;
+
+    if (pItem == NULL)
+    {
+      if (pQueue->isStopping)
+        break;
+
+      uv_cond_wait(&pQueue->cond, &pQueue->mutex);
+      continue;
+    }
+
+    pQueue->pTodoHead = pItem->pNext;
+    if (pQueue->pTodoHead == NULL)
+      pQueue->pTodoTail = NULL;
+    pItem->pNext = NULL;
+
+    // Run without the lock so new requests can be queued meanwhile
+    uv_mutex_unlock(&pQueue->mutex);
+    pItem->work(pItem->pRequest);
+    uv_mutex_lock(&pQueue->mutex);
+
+    if (pQueue->pDoneTail)
+      pQueue->pDoneTail->pNext = pItem;
+    else
+      pQueue->pDoneHead = pItem;
+    pQueue->pDoneTail = pItem;
+
+    uv_async_send(pQueue->pDone);
+  }
+
+  uv_mutex_unlock(&pQueue->mutex);
+}
+
+void WorkQueue::onDone(uv_async_t *handle)
+{
+  WorkQueue *pQueue = (WorkQueue *)handle->data;
+  WORK_ITEM *pItem;
+
+  // Take everything finished so far
+  uv_mutex_lock(&pQueue->mutex);
+  pItem = pQueue->pDoneHead;
+  pQueue->pDoneHead = NULL;
+  pQueue->pDoneTail = NULL;
+  uv_mutex_unlock(&pQueue->mutex);
+
+  while (pItem)
+  {
+    WORK_ITEM *pNext = pItem->pNext;
+
+    if (--pQueue->nPending == 0)
+      uv_unref((uv_handle_t *)pQueue->pDone);
+
+    // May free the request, and may queue more
+    pItem->after(pItem->pRequest, 0);
+
+    free(pItem);
+    pItem = pNext;
+  }
+}
+
+void WorkQueue::onClose(uv_handle_t *handle)
+{
+  delete (uv_async_t *)handle;
+}
@@ -0,0 +1,82 @@
+#ifndef _PS6000_WORK_QUEUE_H_
+#define _PS6000_WORK_QUEUE_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <uv.h>
+
+typedef struct tWorkItem
+{
+  uv_work_t *pRequest;
+  uv_work_cb work;
+  uv_after_work_cb after;
+  struct tWorkItem *pNext;
+} WORK_ITEM;
+
+/*
+ * One native thread running queued requests in order, with the same work /
+ * after callbacks as uv_queue_work. Results are handed back to the main loop
+ * through a uv_async_t, so nothing waits on the shared libuv threadpool.
+ */
+class WorkQueue
+{
+  public:
+    /**
+     * @desc Constructor
+     */
+    WorkQueue();
+
+    /**
+     * @desc Destructor. Call stop() first.
+     */
+    ~WorkQueue();
+
+    /**
+     * @desc Create the thread and the completion handle on the default loop.
+     *       Main thread only.
+     * @return 0 on success, libuv error code otherwise
+     */
+    int start();
+
+    /**
+     * @desc Join the thread and close the handle. Requests not delivered yet
+     *       never see their after callback, so only stop when nothing is
+     *       pending. Main thread only.
+     */
+    void stop();
+
+    /**
+     * @desc Queue a request. work runs on the queue thread, after runs on the
+     *       main loop with status 0. Main thread only.
+     * @return 0 on success, UV_ENOMEM or UV_EINVAL (not started)
+     */
+    int queue(uv_work_t *pRequest, uv_work_cb work, uv_after_work_cb after);
+
+    /**
+     * @desc Number of requests queued and not delivered yet
+     */
+    int32_t getPendingCount();
+
+  private:
+    static void threadMain(void *pParameter);
+    static void onDone(uv_async_t *handle);
+    static void onClose(uv_handle_t *handle);
+
+    uv_thread_t thread;
+    uv_mutex_t mutex;
+    uv_cond_t cond;
+    uv_async_t *pDone;
+
+    // Waiting to run, and finished waiting for delivery (both FIFO)
+    WORK_ITEM *pTodoHead;
+    WORK_ITEM *pTodoTail;
+    WORK_ITEM *pDoneHead;
+    WORK_ITEM *pDoneTail;
+
+    int32_t nPending;
+    bool isStarted;
+    bool isStopping;
+};
+
+#endif